@@ -1168,6 +1168,28 @@ namespace
     _check_buffer(buffer, size, { 0x41, 0xFF, 0xE3 });
     }
 
+  void asmcode_interned_texts()
+    {
+    asmcode code;
+    std::string label("L_label");
+    code.add(asmcode::JMP, label);
+    code.add(asmcode::LABEL, "L_label");
+    code.add(asmcode::COMMENT, "a comment");
+    code.add(asmcode::RET);
+    const auto& instructions = code.get_instructions_list().front();
+    TEST_EQ(instructions[0].text, instructions[1].text);
+    TEST_EQ(std::string("L_label"), code.get_text(instructions[1].text));
+    TEST_EQ(std::string("a comment"), code.get_text(instructions[2].text));
+    TEST_EQ(uint32_t(0), instructions[3].text);
+    TEST_EQ(uint32_t(3), code.number_of_texts());
+    uint32_t id;
+    TEST_ASSERT(code.find_text(id, "L_label"));
+    TEST_EQ(instructions[0].text, id);
+    TEST_ASSERT(!code.find_text(id, "L_other"));
+    code.clear();
+    TEST_EQ(uint32_t(1), code.number_of_texts());
+    }
+
   void asmcode_or_r15mem()
     {
     asmcode code; uint8_t buffer[255];
@@ -1283,6 +1305,7 @@ void run_all_asm_code_tests()
   asmcode_idiv();
   asmcode_cqo();
   asmcode_jmp();
+  asmcode_interned_texts();
   asmcode_or_r15mem();
   test_test();
   test_ucomisd();
@@ -5,10 +5,15 @@
 #include "AssemblerTests.h"
 #include <stdint.h>
 #include "asm/assembler.h"
+#include "asm/code_heap.h"
+#include "asm/jit_symbols.h"
 #ifdef _WIN32
 #include <windows.h>
 #endif
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <vector>
 
 #include "test_assert.h"
 
@@ -381,6 +386,193 @@ namespace
 
     }
 
+
+  void assembler_imm64_offsets()
+    {
+    asmcode code;
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::LABELADDRESS, "L_label");
+    code.add(asmcode::MOV, asmcode::R11, asmcode::NUMBER, 0x123456789abc);
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 5);
+    code.add(asmcode::RET);
+    code.add(asmcode::LABEL, "L_label");
+    code.add(asmcode::RET);
+
+    first_pass_data d;
+    uint64_t size;
+    uint8_t* f = (uint8_t*)assemble(size, d, code);
+
+    TEST_ASSERT(f != NULL);
+    TEST_EQ(d.imm64_offsets.size(), size_t(2));
+    if (f && d.imm64_offsets.size() == 2)
+      {
+      TEST_EQ(d.imm64_offsets[0], uint64_t(2));
+      TEST_EQ(d.imm64_offsets[1], uint64_t(12));
+      uint64_t label_address = *((uint64_t*)(f + d.imm64_offsets[0]));
+      uint64_t offset;
+      TEST_ASSERT(find_label_address(offset, d, code, "L_label"));
+      TEST_EQ(label_address, (uint64_t)f + offset);
+      uint64_t number = *((uint64_t*)(f + d.imm64_offsets[1]));
+      TEST_EQ(number, uint64_t(0x123456789abc));
+      }
+    if (f)
+      free_assembled_function((void*)f, size);
+    }
+
+  void assembler_code_heap()
+    {
+    typedef uint64_t(*fun_ptr)(uint64_t, ...);
+    code_heap_statistics before = get_code_heap_statistics();
+    std::vector<std::pair<fun_ptr, uint64_t>> functions;
+    for (uint64_t i = 0; i < 1000; ++i)
+      {
+      asmcode code;
+      code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, i);
+      code.add(asmcode::RET);
+      uint64_t size;
+      fun_ptr f = (fun_ptr)assemble(size, code);
+      functions.emplace_back(f, size);
+      }
+    code_heap_statistics after = get_code_heap_statistics();
+    TEST_ASSERT(after.regions <= before.regions + 1); // small functions share a region instead of getting a page each
+    TEST_EQ(before.used + 1000 * 16, after.used);
+    bool all_correct = true;
+    for (uint64_t i = 0; i < functions.size(); ++i)
+      all_correct &= functions[i].first(0) == i;
+    TEST_ASSERT(all_correct);
+#ifdef __linux__
+    TEST_ASSERT(code_heap_writable_address((void*)functions[0].first) != (void*)functions[0].first);
+#endif
+
+    // freed blocks are merged and reused
+    for (uint64_t i = 0; i < functions.size(); i += 2)
+      free_assembled_function((void*)functions[i].first, functions[i].second);
+    TEST_EQ(before.free_blocks + 500, get_code_heap_statistics().free_blocks);
+    for (uint64_t i = 1; i < functions.size(); i += 2)
+      free_assembled_function((void*)functions[i].first, functions[i].second);
+    code_heap_statistics freed = get_code_heap_statistics();
+    TEST_EQ(before.used, freed.used);
+    TEST_EQ(before.free_blocks, freed.free_blocks);
+
+    asmcode code;
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 1234);
+    code.add(asmcode::RET);
+    uint64_t size;
+    fun_ptr f = (fun_ptr)assemble(size, code);
+    TEST_EQ(uint64_t(1234), f(0));
+    free_assembled_function((void*)f, size);
+    }
+
+  void assembler_jump_relaxation()
+    {
+    asmcode code;
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 0);
+    code.add(asmcode::JMP, "L_close");
+    code.add(asmcode::LABEL, "L_close");
+    code.add(asmcode::JMPS, "L_far");
+    code.add(asmcode::LABEL, "L_back");
+    for (int i = 0; i < 100; ++i)
+      code.add(asmcode::INC, asmcode::RAX);
+    code.add(asmcode::RET);
+    code.add(asmcode::LABEL, "L_far");
+    code.add(asmcode::CMP, asmcode::RAX, asmcode::NUMBER, 0);
+    code.add(asmcode::JES, "L_back");
+    code.add(asmcode::RET);
+
+    typedef uint64_t(*fun_ptr)();
+    first_pass_data d;
+    uint64_t size;
+    fun_ptr f = (fun_ptr)assemble(size, d, code);
+    TEST_ASSERT(f != NULL);
+
+    const auto& instructions = code.get_instructions_list().front();
+    TEST_EQ(asmcode::JMPS, instructions[1].oper); // the label is close, so the short form is used
+    TEST_EQ(asmcode::JMP, instructions[3].oper); // the label is too far for a short jump
+    TEST_EQ(asmcode::JE, instructions[108].oper);
+    uint64_t close_address, back_address;
+    TEST_ASSERT(find_label_address(close_address, d, code, "L_close"));
+    TEST_ASSERT(find_label_address(back_address, d, code, "L_back"));
+    TEST_EQ(close_address, back_address - 5);
+    if (f)
+      {
+      TEST_EQ(uint64_t(100), f());
+      free_assembled_function((void*)f, size);
+      }
+    }
+
+  void assembler_jit_symbols()
+    {
+    asmcode code;
+    code.add(asmcode::GLOBAL, "L_main");
+    code.add_symbol("L_main", "main_symbol");
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::LABELADDRESS, "L_fun");
+    code.add(asmcode::JMP, asmcode::RAX);
+    code.push();
+    code.add(asmcode::LABEL_ALIGNED, "L_fun");
+    code.add_symbol("L_fun", "fun_symbol");
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 3);
+    code.add(asmcode::RET);
+    code.pop();
+
+    set_perf_map_enabled(true);
+    set_gdb_jit_enabled(true);
+    const uint64_t entries = number_of_gdb_jit_entries();
+    typedef uint64_t(*fun_ptr)();
+    first_pass_data d;
+    uint64_t size;
+    fun_ptr f = (fun_ptr)assemble(size, d, code);
+    set_perf_map_enabled(false);
+    set_gdb_jit_enabled(false);
+    TEST_ASSERT(f != NULL);
+    TEST_EQ(entries + 1, number_of_gdb_jit_entries());
+
+    uint64_t fun_address;
+    TEST_ASSERT(find_label_address(fun_address, d, code, "L_fun"));
+    std::stringstream main_line, fun_line;
+    main_line << std::hex << (uint64_t)f << " " << d.block_offsets[1] << " main_symbol"; // up to the alignment of L_fun
+    fun_line << std::hex << (uint64_t)f + fun_address << " " << d.size - fun_address << " fun_symbol";
+    bool main_found = false;
+    bool fun_found = false;
+    std::ifstream perf_map(get_perf_map_filename());
+    std::string line;
+    while (std::getline(perf_map, line))
+      {
+      main_found |= line == main_line.str();
+      fun_found |= line == fun_line.str();
+      }
+    TEST_ASSERT(main_found);
+    TEST_ASSERT(fun_found);
+
+    std::string name;
+    uint64_t code_address;
+    TEST_ASSERT(find_jit_symbol(name, code_address, (uint64_t)f + fun_address + 1));
+    TEST_EQ(std::string("fun_symbol"), name);
+    TEST_EQ((uint64_t)f, code_address);
+    TEST_ASSERT(find_jit_symbol(name, code_address, (uint64_t)f));
+    TEST_EQ(std::string("main_symbol"), name);
+    TEST_EQ(size_t(2), get_jit_symbols((void*)f).size());
+
+    if (f)
+      {
+      TEST_EQ(uint64_t(3), f());
+      free_assembled_function((void*)f, size);
+      }
+    TEST_EQ(entries, number_of_gdb_jit_entries());
+    TEST_ASSERT(!find_jit_symbol(name, code_address, (uint64_t)f));
+
+    // without perf, gdb or the symbol table no symbols are made
+    TEST_ASSERT(!jit_symbols_wanted());
+    f = (fun_ptr)assemble(size, d, code);
+    TEST_ASSERT(get_jit_symbols((void*)f).empty());
+    TEST_ASSERT(!find_jit_symbol(name, code_address, (uint64_t)f));
+    free_assembled_function((void*)f, size);
+    set_jit_symbol_table_enabled(true);
+    f = (fun_ptr)assemble(size, d, code);
+    set_jit_symbol_table_enabled(false);
+    TEST_EQ(size_t(2), get_jit_symbols((void*)f).size());
+    TEST_EQ(entries, number_of_gdb_jit_entries());
+    free_assembled_function((void*)f, size);
+    }
+
   }
 
 ASM_END
@@ -402,4 +594,10 @@ void run_all_assembler_tests()
   assembler_call_external();
   assembler_move_label_to_rax_and_call_rax();
   assembler_move_label_to_rax_and_call_rax_aligned();
+  assembler_imm64_offsets();
+  assembler_code_heap();
+  assembler_jump_relaxation();
+#ifdef __linux__
+  assembler_jit_symbols();
+#endif
   }
\ No newline at end of file
@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////////
+// Includes
+/////////////////////////////////////////////////////////////////////////////////
+
+#include "PeepholeTests.h"
+#include <stdint.h>
+#include <string>
+#include "asm/asmcode.h"
+#include "asm/peephole.h"
+#include "asm/vm.h"
+#include "test_assert.h"
+
+ASM_BEGIN
+
+namespace
+  {
+  uint64_t get_hits(const std::string& rule)
+    {
+    for (const auto& s : get_peephole_statistics())
+      if (s.name == rule)
+        return s.hits;
+    return (uint64_t)-1;
+    }
+
+  const std::vector<asmcode::instruction>& get_block(const asmcode& code)
+    {
+    return code.get_instructions_list().front();
+    }
+
+  uint64_t run(asmcode& code)
+    {
+    uint64_t size;
+    uint8_t* f = (uint8_t*)vm_bytecode(size, code);
+    registers reg;
+    run_bytecode(f, size, reg);
+    free_bytecode(f, size);
+    return reg.rax;
+    }
+
+  void peephole_jump_to_next_label()
+    {
+    reset_peephole_statistics();
+    asmcode code;
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 1);
+    code.add(asmcode::CMP, asmcode::RAX, asmcode::NUMBER, 1);
+    code.add(asmcode::JES, "L_next");
+    code.add(asmcode::JMP, "L_next");
+    code.add(asmcode::COMMENT, "the comment does not block the rule");
+    code.add(asmcode::LABEL, "L_other");
+    code.add(asmcode::LABEL, "L_next");
+    code.add(asmcode::JMP, "L_end");
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 2);
+    code.add(asmcode::LABEL, "L_end");
+    code.add(asmcode::RET);
+    peephole_optimize(code);
+    const auto& block = get_block(code);
+    TEST_EQ(size_t(9), block.size());
+    TEST_EQ(asmcode::COMMENT, block[2].oper);
+    TEST_EQ(asmcode::JMP, block[5].oper);
+    TEST_EQ(uint64_t(2), get_hits("jump-to-next-label"));
+    TEST_EQ(uint64_t(1), run(code));
+    }
+
+  void peephole_push_pop()
+    {
+    reset_peephole_statistics();
+    asmcode code;
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 7);
+    code.add(asmcode::PUSH, asmcode::RAX);
+    code.add(asmcode::POP, asmcode::RAX);
+    code.add(asmcode::PUSH, asmcode::RAX);
+    code.add(asmcode::POP, asmcode::RCX);
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::RCX);
+    code.add(asmcode::ADD, asmcode::RAX, asmcode::RCX);
+    code.add(asmcode::RET);
+    peephole_optimize(code);
+    const auto& block = get_block(code);
+    TEST_EQ(size_t(4), block.size());
+    TEST_EQ(asmcode::MOV, block[1].oper);
+    TEST_EQ(asmcode::RCX, block[1].operand1);
+    TEST_EQ(asmcode::RAX, block[1].operand2);
+    TEST_EQ(uint64_t(2), get_hits("push-pop"));
+    TEST_EQ(uint64_t(1), get_hits("move-back"));
+    TEST_EQ(uint64_t(14), run(code));
+    }
+
+  void peephole_moves()
+    {
+    reset_peephole_statistics();
+    asmcode code;
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 3);
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::RAX);
+    code.add(asmcode::MOV, asmcode::RCX, asmcode::RAX);
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::RCX);
+    code.add(asmcode::MOV, asmcode::RDX, asmcode::NUMBER, 100);
+    code.add(asmcode::MOV, asmcode::RDX, asmcode::RCX);
+    code.add(asmcode::MOV, asmcode::R11, asmcode::NUMBER, 5);
+    code.add(asmcode::MOV, asmcode::R11, asmcode::MEM_R11, 8); // reads r11, so the first move is needed
+    code.add(asmcode::ADD, asmcode::RAX, asmcode::RDX);
+    code.add(asmcode::RET);
+    peephole_optimize(code);
+    const auto& block = get_block(code);
+    TEST_EQ(size_t(7), block.size());
+    TEST_EQ(uint64_t(1), get_hits("move-to-self"));
+    TEST_EQ(uint64_t(1), get_hits("move-back"));
+    TEST_EQ(uint64_t(1), get_hits("overwritten-move"));
+    TEST_EQ(asmcode::RDX, block[2].operand1);
+    TEST_EQ(asmcode::RCX, block[2].operand2);
+    TEST_EQ(asmcode::R11, block[3].operand1);
+    TEST_EQ(asmcode::NUMBER, block[3].operand2);
+    }
+
+  void peephole_repeated_compare()
+    {
+    reset_peephole_statistics();
+    asmcode code;
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 5);
+    code.add(asmcode::CMP, asmcode::RAX, asmcode::NUMBER, 3);
+    code.add(asmcode::JLS, "L_less");
+    code.add(asmcode::CMP, asmcode::RAX, asmcode::NUMBER, 3);
+    code.add(asmcode::JES, "L_equal");
+    code.add(asmcode::CMP, asmcode::RAX, asmcode::NUMBER, 4);
+    code.add(asmcode::JES, "L_equal");
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 1);
+    code.add(asmcode::RET);
+    code.add(asmcode::LABEL, "L_less");
+    code.add(asmcode::LABEL, "L_equal");
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 0);
+    code.add(asmcode::RET);
+    peephole_optimize(code);
+    TEST_EQ(size_t(12), get_block(code).size());
+    TEST_EQ(uint64_t(1), get_hits("repeated-compare"));
+    TEST_EQ(uint64_t(1), run(code));
+    }
+
+  void peephole_labels_are_barriers()
+    {
+    reset_peephole_statistics();
+    asmcode code;
+    code.add(asmcode::PUSH, asmcode::RAX);
+    code.add(asmcode::LABEL, "L_label");
+    code.add(asmcode::POP, asmcode::RAX);
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 1);
+    code.add(asmcode::LABEL, "L_label_2");
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 2);
+    code.add(asmcode::RET);
+    peephole_optimize(code);
+    TEST_EQ(size_t(7), get_block(code).size());
+    for (const auto& s : get_peephole_statistics())
+      TEST_EQ(uint64_t(0), s.hits);
+    }
+  }
+
+ASM_END
+
+void run_all_peephole_tests()
+  {
+  using namespace ASM;
+  peephole_jump_to_next_label();
+  peephole_push_pop();
+  peephole_moves();
+  peephole_repeated_compare();
+  peephole_labels_are_barriers();
+  }
@@ -5,6 +5,7 @@
 #include "VMTests.h"
 #include <stdint.h>
 #include <iostream>
+#include <vector>
 #include "asm/asmcode.h"
 #include "asm/vm.h"
 #include "test_assert.h"
@@ -642,6 +643,98 @@ namespace
     free_bytecode(f, size);
     }
 
+  void test_vm_threaded_dispatch()
+    {
+    // sums 1..100 with a loop that calls a local function
+    asmcode code;
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 0);
+    code.add(asmcode::MOV, asmcode::RCX, asmcode::NUMBER, 100);
+    code.add(asmcode::LABEL, "L_loop");
+    code.add(asmcode::CALL, "L_add");
+    code.add(asmcode::DEC, asmcode::RCX);
+    code.add(asmcode::CMP, asmcode::RCX, asmcode::NUMBER, 0);
+    code.add(asmcode::JNE, "L_loop");
+    code.add(asmcode::RET);
+    code.add(asmcode::LABEL, "L_add");
+    code.add(asmcode::ADD, asmcode::RAX, asmcode::RCX);
+    code.add(asmcode::RET);
+    uint64_t size;
+    uint8_t* f = (uint8_t*)vm_bytecode(size, code);
+    registers reg;
+    run_bytecode(f, size, reg);
+    TEST_EQ(5050, reg.rax);
+    TEST_EQ(0, reg.rcx);
+
+    // a copy of the bytecode is not registered, so each instruction is decoded when it is executed, as the vm did
+    // before the bytecode was decoded in advance
+    std::vector<uint8_t> copy(f, f + size);
+    registers reg_copy;
+    run_bytecode(copy.data(), size, reg_copy);
+    TEST_EQ(reg.rax, reg_copy.rax);
+    TEST_EQ(reg.rcx, reg_copy.rcx);
+
+    // calls and returns between two blocks of bytecode
+    asmcode callee;
+    callee.add(asmcode::ADD, asmcode::RAX, asmcode::RCX);
+    callee.add(asmcode::RET);
+    uint64_t callee_size;
+    uint8_t* g = (uint8_t*)vm_bytecode(callee_size, callee);
+    asmcode caller;
+    caller.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 0);
+    caller.add(asmcode::MOV, asmcode::RCX, asmcode::NUMBER, 100);
+    caller.add(asmcode::LABEL, "L_loop");
+    caller.add(asmcode::CALL, asmcode::RDX);
+    caller.add(asmcode::DEC, asmcode::RCX);
+    caller.add(asmcode::CMP, asmcode::RCX, asmcode::NUMBER, 0);
+    caller.add(asmcode::JNE, "L_loop");
+    caller.add(asmcode::RET);
+    uint64_t caller_size;
+    uint8_t* h = (uint8_t*)vm_bytecode(caller_size, caller);
+    registers reg_blocks;
+    reg_blocks.rdx = (uint64_t)g;
+    run_bytecode(h, caller_size, reg_blocks);
+    TEST_EQ(5050, reg_blocks.rax);
+
+    free_bytecode(h, caller_size);
+    free_bytecode(g, callee_size);
+    free_bytecode(f, size);
+    }
+
+  void test_vm_jump_relaxation()
+    {
+    asmcode code;
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 0);
+    code.add(asmcode::JMP, "L_close");
+    code.add(asmcode::LABEL, "L_close");
+    code.add(asmcode::JMPS, "L_far");
+    code.add(asmcode::LABEL, "L_back");
+    for (int i = 0; i < 100; ++i)
+      code.add(asmcode::INC, asmcode::RAX);
+    code.add(asmcode::RET);
+    code.add(asmcode::LABEL, "L_far");
+    code.add(asmcode::CMP, asmcode::RAX, asmcode::NUMBER, 0);
+    code.add(asmcode::JES, "L_back");
+    code.add(asmcode::RET);
+
+    uint64_t size;
+    uint8_t* f = (uint8_t*)vm_bytecode(size, code);
+    const auto& instructions = code.get_instructions_list().front();
+    TEST_EQ(asmcode::JMPS, instructions[1].oper);
+    TEST_EQ(asmcode::JMP, instructions[3].oper);
+    TEST_EQ(asmcode::JE, instructions[108].oper);
+    registers reg;
+    try
+      {
+      run_bytecode(f, size, reg);
+      }
+    catch (std::logic_error e)
+      {
+      std::cout << e.what() << "\n";
+      }
+    TEST_EQ(100, reg.rax);
+    free_bytecode(f, size);
+    }
+
   } // namespace
 
 ASM_END
@@ -673,4 +766,6 @@ void run_all_vm_tests()
   test_vm_movq();
   test_vm_addsd();
   test_vm_fldpi();
+  test_vm_jump_relaxation();
+  test_vm_threaded_dispatch();
   }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "AssemblerTests.h"
 #include "AsmCodeTests.h"
+#include "PeepholeTests.h"
 #include "VMTests.h"
 
 #include <ctime>
@@ -16,6 +17,7 @@ int main(int /*argc*/, const char* /*argv*/[])
   run_all_assembler_tests();
 #endif
   run_all_vm_tests();
+  run_all_peephole_tests();
   auto toc = std::clock();
 
   if (!testing_fails) 
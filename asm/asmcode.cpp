@@ -50,6 +50,7 @@ asmcode::asmcode()
   {
   instructions_list.emplace_back();
   instructions_list_stack.push_back(instructions_list.begin());
+  intern(std::string());
   }
 
 asmcode::~asmcode()
@@ -73,6 +74,37 @@ void asmcode::clear()
   instructions_list.clear();
   instructions_list.emplace_back();
   instructions_list_stack.push_back(instructions_list.begin());
+  texts.clear();
+  text_ids.clear();
+  symbols.clear();
+  intern(std::string());
+  }
+
+void asmcode::add_symbol(const std::string& label, const std::string& name)
+  {
+  const uint32_t label_id = intern(label).id;
+  const uint32_t name_id = intern(name).id;
+  symbols.emplace_back(label_id, name_id);
+  }
+
+asmcode::text_id asmcode::intern(const std::string& text)
+  {
+  auto it = text_ids.find(text);
+  if (it != text_ids.end())
+    return text_id{ it->second };
+  const uint32_t id = (uint32_t)texts.size();
+  texts.push_back(text);
+  text_ids.emplace(text, id);
+  return text_id{ id };
+  }
+
+bool asmcode::find_text(uint32_t& id, const std::string& text) const
+  {
+  auto it = text_ids.find(text);
+  if (it == text_ids.end())
+    return false;
+  id = it->second;
+  return true;
   }
 
 const std::list<std::vector<asmcode::instruction>>& asmcode::get_instructions_list() const
@@ -91,81 +123,81 @@ void asmcode::stream(std::ostream& out) const
     {
     for (const auto& ins : *rit)
       {
-      ins.stream(out);
+      ins.stream(out, *this);
       }
     }
   }
 
-asmcode::instruction::instruction() : oper(NOP), operand1(EMPTY), operand2(EMPTY), operand1_mem(0), operand2_mem(0)
+asmcode::instruction::instruction() : oper(NOP), operand1(EMPTY), operand2(EMPTY), text(0), operand1_mem(0), operand2_mem(0)
   {
   }
 
-asmcode::instruction::instruction(const std::string& txt) : oper(COMMENT), operand1(EMPTY), operand2(EMPTY), operand1_mem(0), operand2_mem(0), text(txt)
+asmcode::instruction::instruction(text_id txt) : oper(COMMENT), operand1(EMPTY), operand2(EMPTY), text(txt.id), operand1_mem(0), operand2_mem(0)
   {
   }
 
-asmcode::instruction::instruction(operation op) : oper(op), operand1(EMPTY), operand2(EMPTY), operand1_mem(0), operand2_mem(0)
+asmcode::instruction::instruction(operation op) : oper(op), operand1(EMPTY), operand2(EMPTY), text(0), operand1_mem(0), operand2_mem(0)
   {
   }
 
-asmcode::instruction::instruction(operation op, operand op1) : oper(op), operand1(op1), operand2(EMPTY), operand1_mem(0), operand2_mem(0)
+asmcode::instruction::instruction(operation op, operand op1) : oper(op), operand1(op1), operand2(EMPTY), text(0), operand1_mem(0), operand2_mem(0)
   {
 
   }
 
-asmcode::instruction::instruction(operation op, operand op1, operand op2) : oper(op), operand1(op1), operand2(op2), operand1_mem(0), operand2_mem(0)
+asmcode::instruction::instruction(operation op, operand op1, operand op2) : oper(op), operand1(op1), operand2(op2), text(0), operand1_mem(0), operand2_mem(0)
   {
 
   }
 
-asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem) : oper(op), operand1(op1), operand2(EMPTY), operand1_mem(op1_mem), operand2_mem(0)
+asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem) : oper(op), operand1(op1), operand2(EMPTY), text(0), operand1_mem(op1_mem), operand2_mem(0)
   {
 
   }
 
-asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem, operand op2) : oper(op), operand1(op1), operand2(op2), operand1_mem(op1_mem), operand2_mem(0)
+asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem, operand op2) : oper(op), operand1(op1), operand2(op2), text(0), operand1_mem(op1_mem), operand2_mem(0)
   {
 
   }
 
-asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem, operand op2, uint64_t op2_mem) : oper(op), operand1(op1), operand2(op2), operand1_mem(op1_mem), operand2_mem(op2_mem)
+asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem, operand op2, uint64_t op2_mem) : oper(op), operand1(op1), operand2(op2), text(0), operand1_mem(op1_mem), operand2_mem(op2_mem)
   {
   }
 
-asmcode::instruction::instruction(operation op, operand op1, operand op2, uint64_t op2_mem) : oper(op), operand1(op1), operand2(op2), operand1_mem(0), operand2_mem(op2_mem)
+asmcode::instruction::instruction(operation op, operand op1, operand op2, uint64_t op2_mem) : oper(op), operand1(op1), operand2(op2), text(0), operand1_mem(0), operand2_mem(op2_mem)
   {
   }
 
-asmcode::instruction::instruction(operation op, const std::string& txt) : oper(op), operand1(EMPTY), operand2(EMPTY), operand1_mem(0), operand2_mem(0), text(txt)
+asmcode::instruction::instruction(operation op, text_id txt) : oper(op), operand1(EMPTY), operand2(EMPTY), text(txt.id), operand1_mem(0), operand2_mem(0)
   {
   }
 
-asmcode::instruction::instruction(operation op, operand op1, const std::string& txt) : oper(op), operand1(op1), operand2(EMPTY), operand1_mem(0), operand2_mem(0), text(txt)
+asmcode::instruction::instruction(operation op, operand op1, text_id txt) : oper(op), operand1(op1), operand2(EMPTY), text(txt.id), operand1_mem(0), operand2_mem(0)
   {
 
   }
 
-asmcode::instruction::instruction(operation op, operand op1, operand op2, const std::string& txt) : oper(op), operand1(op1), operand2(op2), operand1_mem(0), operand2_mem(0), text(txt)
+asmcode::instruction::instruction(operation op, operand op1, operand op2, text_id txt) : oper(op), operand1(op1), operand2(op2), text(txt.id), operand1_mem(0), operand2_mem(0)
   {
 
   }
 
-asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem, const std::string& txt) : oper(op), operand1(op1), operand2(EMPTY), operand1_mem(op1_mem), operand2_mem(0), text(txt)
+asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem, text_id txt) : oper(op), operand1(op1), operand2(EMPTY), text(txt.id), operand1_mem(op1_mem), operand2_mem(0)
   {
 
   }
 
-asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem, operand op2, const std::string& txt) : oper(op), operand1(op1), operand2(op2), operand1_mem(op1_mem), operand2_mem(0), text(txt)
+asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem, operand op2, text_id txt) : oper(op), operand1(op1), operand2(op2), text(txt.id), operand1_mem(op1_mem), operand2_mem(0)
   {
 
   }
 
-asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem, operand op2, uint64_t op2_mem, const std::string& txt) : oper(op), operand1(op1), operand2(op2), operand1_mem(op1_mem), operand2_mem(op2_mem), text(txt)
+asmcode::instruction::instruction(operation op, operand op1, uint64_t op1_mem, operand op2, uint64_t op2_mem, text_id txt) : oper(op), operand1(op1), operand2(op2), text(txt.id), operand1_mem(op1_mem), operand2_mem(op2_mem)
   {
 
   }
 
-asmcode::instruction::instruction(operation op, operand op1, operand op2, uint64_t op2_mem, const std::string& txt) : oper(op), operand1(op1), operand2(op2), operand1_mem(0), operand2_mem(op2_mem), text(txt)
+asmcode::instruction::instruction(operation op, operand op1, operand op2, uint64_t op2_mem, text_id txt) : oper(op), operand1(op1), operand2(op2), text(txt.id), operand1_mem(0), operand2_mem(op2_mem)
   {
 
   }
@@ -354,35 +386,36 @@ namespace
     }
   }
 
-void asmcode::instruction::stream(std::ostream& out) const
+void asmcode::instruction::stream(std::ostream& out, const asmcode& code) const
   {
+  const std::string& name = code.get_text(text);
   switch (oper)
     {
     case COMMENT:
     {
-    out << "; " << text << std::endl;
+    out << "; " << name << std::endl;
     break;
     }
     case GLOBAL:
     {
-    out << "global " << text << std::endl;
+    out << "global " << name << std::endl;
     out << "SECTION .text" << std::endl;
-    out << text << ":" << std::endl;
+    out << name << ":" << std::endl;
     break;
     }
     case LABEL:
     {
-    out << text << ":" << std::endl;
+    out << name << ":" << std::endl;
     break;
     }
     case LABEL_ALIGNED:
     {
-    out << text << ":" << std::endl;
+    out << name << ":" << std::endl;
     break;
     }
     case EXTERN:
     {
-    out << "extern " << text << std::endl;
+    out << "extern " << name << std::endl;
     break;
     }
     case CALLEXTERNAL:
@@ -391,10 +424,10 @@ void asmcode::instruction::stream(std::ostream& out) const
     out << "\tcall";
     if (operand1 != asmcode::EMPTY)
       {
-      out << " " << _operand2string(operand1, operand1_mem, text);
+      out << " " << _operand2string(operand1, operand1_mem, name);
       }
     else
-      out << " " << text;
+      out << " " << name;
     out << std::endl;
     break;
     }
@@ -403,96 +436,96 @@ void asmcode::instruction::stream(std::ostream& out) const
     out << "\tjmp";
     if (operand1 != asmcode::EMPTY)
       {
-      out << " " << _operand2string(operand1, operand1_mem, text);
+      out << " " << _operand2string(operand1, operand1_mem, name);
       }
     else
-      out << " " << text;
+      out << " " << name;
     out << std::endl;
     break;
     }
     case JE:
     {
-    out << "\tje " << text << std::endl;
+    out << "\tje " << name << std::endl;
     break;
     }
     case JNE:
     {
-    out << "\tjne " << text << std::endl;
+    out << "\tjne " << name << std::endl;
     break;
     }
     case JL:
     {
-    out << "\tjl " << text << std::endl;
+    out << "\tjl " << name << std::endl;
     break;
     }
     case JLE:
     {
-    out << "\tjle " << text << std::endl;
+    out << "\tjle " << name << std::endl;
     break;
     }
     case JA:
     {
-    out << "\tja " << text << std::endl;
+    out << "\tja " << name << std::endl;
     break;
     }
     case JB:
     {
-    out << "\tjb " << text << std::endl;
+    out << "\tjb " << name << std::endl;
     break;
     }
     case JG:
     {
-    out << "\tjg " << text << std::endl;
+    out << "\tjg " << name << std::endl;
     break;
     }
     case JGE:
     {
-    out << "\tjge " << text << std::endl;
+    out << "\tjge " << name << std::endl;
     break;
     }
     case JMPS:
     {
-    out << "\tjmp short " << text << std::endl;
+    out << "\tjmp short " << name << std::endl;
     break;
     }
     case JES:
     {
-    out << "\tje short " << text << std::endl;
+    out << "\tje short " << name << std::endl;
     break;
     }
     case JNES:
     {
-    out << "\tjne short " << text << std::endl;
+    out << "\tjne short " << name << std::endl;
     break;
     }
     case JLS:
     {
-    out << "\tjl short " << text << std::endl;
+    out << "\tjl short " << name << std::endl;
     break;
     }
     case JLES:
     {
-    out << "\tjle short " << text << std::endl;
+    out << "\tjle short " << name << std::endl;
     break;
     }
     case JAS:
     {
-    out << "\tja short " << text << std::endl;
+    out << "\tja short " << name << std::endl;
     break;
     }
     case JBS:
     {
-    out << "\tjb short " << text << std::endl;
+    out << "\tjb short " << name << std::endl;
     break;
     }
     case JGS:
     {
-    out << "\tjg short " << text << std::endl;
+    out << "\tjg short " << name << std::endl;
     break;
     }
     case JGES:
     {
-    out << "\tjge short " << text << std::endl;
+    out << "\tjge short " << name << std::endl;
     break;
     }
     default:
@@ -500,11 +533,11 @@ void asmcode::instruction::stream(std::ostream& out) const
     out << "\t" << _operation2string(oper);
     if (operand1 != asmcode::EMPTY)
       {
-      out << " " << _operand2string(operand1, operand1_mem, text);
+      out << " " << _operand2string(operand1, operand1_mem, name);
       }
     if (operand2 != asmcode::EMPTY)
       {
-      out << ", " << _operand2string(operand2, operand2_mem, text);
+      out << ", " << _operand2string(operand2, operand2_mem, name);
       }
     out << std::endl;
     break;
@@ -5,6 +5,8 @@
 #include <string>
 #include <stdint.h>
 #include <ostream>
+#include <type_traits>
+#include <unordered_map>
 #include "namespace.h"
 #include "asm_api.h"
 
@@ -68,6 +70,7 @@ class asmcode
       JG,
       JGE,
       JNE,
+      // For a jump to a label the assembler picks the short or the near form itself (see jump_relaxation.h)
       JMPS, // JMP short
       JAS, // JA short
       JBS, // JB short
@@ -198,15 +201,25 @@ class asmcode
       XMM15 
       };   
 
+    /*
+    Labels, names of externals and comments are interned per asmcode object: an instruction refers to its text by an id
+    that get_text turns back into the string. Id 0 is the empty string. This keeps instructions small and trivially copyable,
+    and lets the assembler resolve labels by indexing instead of by string lookups.
+    */
+    struct text_id
+      {
+      uint32_t id;
+      };
+
     struct instruction
       {
       operation oper;
       operand operand1, operand2;
+      uint32_t text;
       uint64_t operand1_mem, operand2_mem;
-      std::string text;
 
       ASSEMBLER_API instruction();
-      ASSEMBLER_API instruction(const std::string& text);
+      ASSEMBLER_API instruction(text_id txt);
       ASSEMBLER_API instruction(operation op);
       ASSEMBLER_API instruction(operation op, operand op1);
       ASSEMBLER_API instruction(operation op, operand op1, operand op2);
@@ -214,25 +227,31 @@ class asmcode
       ASSEMBLER_API instruction(operation op, operand op1, uint64_t op1_mem, operand op2);
       ASSEMBLER_API instruction(operation op, operand op1, uint64_t op1_mem, operand op2, uint64_t op2_mem);
       ASSEMBLER_API instruction(operation op, operand op1, operand op2, uint64_t op2_mem);      
-      ASSEMBLER_API instruction(operation op, const std::string& text);
-      ASSEMBLER_API instruction(operation op, operand op1, const std::string& text);
-      ASSEMBLER_API instruction(operation op, operand op1, operand op2, const std::string& text);
-      ASSEMBLER_API instruction(operation op, operand op1, uint64_t op1_mem, const std::string& text);
-      ASSEMBLER_API instruction(operation op, operand op1, uint64_t op1_mem, operand op2, const std::string& text);
-      ASSEMBLER_API instruction(operation op, operand op1, uint64_t op1_mem, operand op2, uint64_t op2_mem, const std::string& text);
-      ASSEMBLER_API instruction(operation op, operand op1, operand op2, uint64_t op2_mem, const std::string& text);
+      ASSEMBLER_API instruction(operation op, text_id txt);
+      ASSEMBLER_API instruction(operation op, operand op1, text_id txt);
+      ASSEMBLER_API instruction(operation op, operand op1, operand op2, text_id txt);
+      ASSEMBLER_API instruction(operation op, operand op1, uint64_t op1_mem, text_id txt);
+      ASSEMBLER_API instruction(operation op, operand op1, uint64_t op1_mem, operand op2, text_id txt);
+      ASSEMBLER_API instruction(operation op, operand op1, uint64_t op1_mem, operand op2, uint64_t op2_mem, text_id txt);
+      ASSEMBLER_API instruction(operation op, operand op1, operand op2, uint64_t op2_mem, text_id txt);
 
-      ASSEMBLER_API void stream(std::ostream& out) const;
+      ASSEMBLER_API void stream(std::ostream& out, const asmcode& code) const;
       ASSEMBLER_API uint64_t fill_opcode(uint8_t* opcode_stream) const;
       };
 
+    static_assert(std::is_trivially_copyable<instruction>::value, "instructions are copied around a lot");
+
     ASSEMBLER_API asmcode();
     ASSEMBLER_API ~asmcode();
 
+    /*
+    Appends an instruction to the current instruction vector. The arguments are those of an instruction constructor, except
+    that the text is passed as a string, which is interned.
+    */
     template <class... T>
     void add(T&&... val)
       {
-      instruction ins(std::forward<T>(val)...);
+      instruction ins(make_argument(std::forward<T>(val))...);
       (*instructions_list_stack.back()).push_back(ins);
       }
 
@@ -246,12 +265,56 @@ class asmcode
 
     ASSEMBLER_API void clear();
 
+    ASSEMBLER_API text_id intern(const std::string& text);
+
+    const std::string& get_text(uint32_t id) const
+      {
+      return texts[id];
+      }
+
+    /*
+    Returns false if text was never interned in this object.
+    */
+    ASSEMBLER_API bool find_text(uint32_t& id, const std::string& text) const;
+
+    uint32_t number_of_texts() const
+      {
+      return (uint32_t)texts.size();
+      }
+
+    /*
+    Names the code that starts at label, for profilers and debuggers (see jit_symbols.h). The named code ends at the next
+    named label or at the end of the instruction vector that contains label.
+    */
+    ASSEMBLER_API void add_symbol(const std::string& label, const std::string& name);
+
+    /*
+    Returns the named labels as pairs of text ids (label, name).
+    */
+    const std::vector<std::pair<uint32_t, uint32_t>>& get_symbols() const
+      {
+      return symbols;
+      }
+
     ASSEMBLER_API static std::string operation_to_string(operation op);
     ASSEMBLER_API static std::string operand_to_string(operand op);
 
+  private:
+    template <class T>
+    decltype(auto) make_argument(T&& val)
+      {
+      if constexpr (std::is_convertible<T, std::string>::value)
+        return intern(val);
+      else
+        return std::forward<T>(val);
+      }
+
   private:
     std::list<std::vector<instruction>> instructions_list;
     std::vector<std::list<std::vector<instruction>>::iterator> instructions_list_stack;
+    std::vector<std::string> texts;
+    std::unordered_map<std::string, uint32_t> text_ids;
+    std::vector<std::pair<uint32_t, uint32_t>> symbols;
 
 
   };
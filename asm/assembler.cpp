@@ -1,58 +1,128 @@
 #include "assembler.h"
+#include "code_heap.h"
+#include "jit_symbols.h"
+#include "jump_relaxation.h"
 
+#include <algorithm>
 #include <stdint.h>
 #include <map>
 #include <string>
 
-#ifdef _WIN32
-#include <windows.h>
-#else
-#include <sys/mman.h>
-#endif
-
 ASM_BEGIN
 
 namespace
   {
 
+  bool is_64_bit_register(asmcode::operand op)
+    {
+    return (op >= asmcode::RAX && op <= asmcode::R15);
+    }
+
+  void add_instruction_size(first_pass_data& data, const asmcode::instruction& instr, uint64_t sz)
+    {
+    if (instr.oper == asmcode::MOV && sz == 10 && is_64_bit_register(instr.operand1) && (instr.operand2 == asmcode::NUMBER || instr.operand2 == asmcode::LABELADDRESS))
+      data.imm64_offsets.push_back(data.size + sz - 8); // the immediate is encoded in the last 8 bytes of the instruction
+    data.size += sz;
+    }
+
+  /*
+  Returns the size of a jump, with a dummy displacement if the jump goes to a label.
+  */
+  uint64_t jump_size(asmcode::instruction instr, uint8_t* buffer)
+    {
+    if (instr.operand1 == asmcode::EMPTY)
+      {
+      instr.operand1 = asmcode::NUMBER;
+      instr.operand1_mem = 0x11;
+      }
+    return instr.fill_opcode(buffer);
+    }
+
+  uint64_t instruction_size(asmcode::instruction instr, const first_pass_data& data, uint8_t* buffer)
+    {
+    switch (instr.oper)
+      {
+      case asmcode::CALLEXTERNAL:
+      case asmcode::CALL:
+      {
+      const uint64_t external_address = data.external_to_address[instr.text];
+      if (external_address != no_address)
+        {
+        asmcode::instruction load_address(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, external_address);
+        asmcode::instruction call(asmcode::CALL, asmcode::RAX);
+        return load_address.fill_opcode(buffer) + call.fill_opcode(buffer);
+        }
+      if (instr.operand1 == asmcode::EMPTY)
+        {
+        instr.operand1 = asmcode::NUMBER;
+        instr.operand1_mem = 0x11111111;
+        }
+      return instr.fill_opcode(buffer);
+      }
+      case asmcode::JMP:
+      case asmcode::JE:
+      case asmcode::JL:
+      case asmcode::JLE:
+      case asmcode::JG:
+      case asmcode::JA:
+      case asmcode::JB:
+      case asmcode::JGE:
+      case asmcode::JNE:
+      case asmcode::JMPS:
+      case asmcode::JES:
+      case asmcode::JLS:
+      case asmcode::JLES:
+      case asmcode::JGS:
+      case asmcode::JAS:
+      case asmcode::JBS:
+      case asmcode::JGES:
+      case asmcode::JNES:
+        return jump_size(instr, buffer);
+      case asmcode::EXTERN:
+        return 0;
+      default:
+        return instr.fill_opcode(buffer);
+      }
+    }
+
   void first_pass(first_pass_data& data, asmcode& code, const std::map<std::string, uint64_t>& externals)
     {
     uint8_t buffer[255];
+    init_first_pass_data(data, code, externals);
+    std::vector<uint64_t> sizes;
+    relax_jumps(sizes, code, [&](const asmcode::instruction& instr) { return instruction_size(instr, data, buffer); }, true);
+    size_t instruction_index = 0;
     data.size = 0;
-    data.label_to_address.clear();
+    data.imm64_offsets.clear();
+    data.block_offsets.clear();
     for (auto it = code.get_instructions_list().begin(); it != code.get_instructions_list().end(); ++it)
       {
+      data.block_offsets.push_back(data.size);
       std::vector<std::pair<size_t, int>> nops_to_add;
       for (size_t i = 0; i < it->size(); ++i)
         {
         auto instr = (*it)[i];
+        const uint64_t sz = sizes[instruction_index++];
         switch (instr.oper)
           {
           case asmcode::CALLEXTERNAL:
           case asmcode::CALL:
           {
-          auto it2 = externals.find(instr.text);
-          if (it2 != externals.end())
+          const uint64_t external_address = data.external_to_address[instr.text];
+          if (external_address != no_address)
             {
             instr.oper = asmcode::MOV;
             instr.operand1 = asmcode::RAX;
             instr.operand2 = asmcode::NUMBER;
-            instr.operand2_mem = it2->second;
-            data.size += instr.fill_opcode(buffer);
+            instr.operand2_mem = external_address;
+            add_instruction_size(data, instr, instr.fill_opcode(buffer));
             instr.oper = asmcode::CALL;
             instr.operand1 = asmcode::RAX;
             instr.operand2 = asmcode::EMPTY;
             data.size += instr.fill_opcode(buffer);
             }
           else
-            {
-            if (instr.operand1 == asmcode::EMPTY)
-              {
-              instr.operand1 = asmcode::NUMBER;
-              instr.operand1_mem = 0x11111111;
-              }
-            data.size += instr.fill_opcode(buffer);
-            }
+            data.size += sz;
           break;
           }
           case asmcode::JMP:
@@ -64,15 +134,6 @@ namespace
           case asmcode::JB:
           case asmcode::JGE:
           case asmcode::JNE:
-          {
-          if (instr.operand1 == asmcode::EMPTY)
-            {
-            instr.operand1 = asmcode::NUMBER;
-            instr.operand1_mem = 0x11111111;
-            }
-          data.size += instr.fill_opcode(buffer);
-          break;
-          }
           case asmcode::JMPS:
           case asmcode::JES:
           case asmcode::JLS:
@@ -82,12 +143,7 @@ namespace
           case asmcode::JBS:
           case asmcode::JGES:
           case asmcode::JNES:
-          {
-          instr.operand1 = asmcode::NUMBER;
-          instr.operand1_mem = 0x11;
-          data.size += instr.fill_opcode(buffer);
-          break;
-          }
+            data.size += sz; break;
           case asmcode::LABEL:
             data.label_to_address[instr.text] = data.size; break;
           case asmcode::LABEL_ALIGNED:
@@ -108,14 +164,12 @@ namespace
             data.label_to_address[instr.text] = data.size; break;
           case asmcode::EXTERN:
           {
-          auto it2 = externals.find(instr.text);
-          if (it2 == externals.end())
+          if (data.external_to_address[instr.text] == no_address)
             throw std::logic_error("error: external is not defined");
-          data.external_to_address[instr.text] = it2->second;
           break;
           }
           default:
-            data.size += instr.fill_opcode(buffer); break;
+            add_instruction_size(data, instr, sz); break;
           }
         }
       size_t nops_offset = 0;
@@ -129,9 +183,12 @@ namespace
     }
 
 
-  uint8_t* second_pass(uint8_t* func, const first_pass_data& data, const asmcode& code)
+  /*
+  Writes the code at func. address_start is the address from which the code will run, which differs from func
+  if the code is written through another view of the same memory.
+  */
+  uint8_t* second_pass(uint8_t* func, uint64_t address_start, const first_pass_data& data, const asmcode& code)
     {
-    uint64_t address_start = (uint64_t)(reinterpret_cast<uint64_t*>(func));
     uint8_t* start = func;
     for (auto it = code.get_instructions_list().begin(); it != code.get_instructions_list().end(); ++it)
       {
@@ -139,17 +196,17 @@ namespace
         {       
         if (instr.operand1 == asmcode::LABELADDRESS)
           {
-          auto it2 = data.label_to_address.find(instr.text);
-          if (it2 == data.label_to_address.end())
+          const uint64_t address = data.label_to_address[instr.text];
+          if (address == no_address)
             throw std::logic_error("error: label is not defined");
-          instr.operand1_mem = address_start + it2->second;
+          instr.operand1_mem = address_start + address;
           }
         if (instr.operand2 == asmcode::LABELADDRESS)
           {
-          auto it2 = data.label_to_address.find(instr.text);
-          if (it2 == data.label_to_address.end())
+          const uint64_t address = data.label_to_address[instr.text];
+          if (address == no_address)
             throw std::logic_error("error: label is not defined");
-          instr.operand2_mem = address_start + it2->second;
+          instr.operand2_mem = address_start + address;
           }      
         switch (instr.oper)
           {
@@ -158,17 +215,17 @@ namespace
           {
           if (instr.operand1 != asmcode::EMPTY)
             break;
-          auto it_label = data.label_to_address.find(instr.text);
-          auto it_external = data.external_to_address.find(instr.text);
-          if (it_external != data.external_to_address.end())
+          const uint64_t label_address = data.label_to_address[instr.text];
+          const uint64_t external_address = data.external_to_address[instr.text];
+          if (external_address != no_address)
             {
-            asmcode::instruction extra_instr(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, it_external->second);
+            asmcode::instruction extra_instr(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, external_address);
             func += extra_instr.fill_opcode(func);
             instr.operand1 = asmcode::RAX;
             }
-          else if (it_label != data.label_to_address.end())
+          else if (label_address != no_address)
             {
-            int64_t address = (int64_t)it_label->second;
+            int64_t address = (int64_t)label_address;
             int64_t current = (int64_t)(func - start);
             instr.operand1 = asmcode::NUMBER;
             instr.operand1_mem = (int64_t(address - current - 5));
@@ -188,10 +245,9 @@ namespace
           {
           if (instr.operand1 != asmcode::EMPTY)
             break;
-          auto it2 = data.label_to_address.find(instr.text);
-          if (it2 == data.label_to_address.end())
+          if (data.label_to_address[instr.text] == no_address)
             throw std::logic_error("second_pass error: label does not exist");
-          int64_t address = (int64_t)it2->second;
+          int64_t address = (int64_t)data.label_to_address[instr.text];
           int64_t current = (int64_t)(func - start);
           instr.operand1 = asmcode::NUMBER;
           instr.operand1_mem = (int64_t(address - current - 6));
@@ -201,10 +257,9 @@ namespace
           {
           if (instr.operand1 != asmcode::EMPTY)
             break;
-          auto it2 = data.label_to_address.find(instr.text);
-          if (it2 == data.label_to_address.end())
+          if (data.label_to_address[instr.text] == no_address)
             throw std::logic_error("second_pass error: label does not exist");
-          int64_t address = (int64_t)it2->second;
+          int64_t address = (int64_t)data.label_to_address[instr.text];
           int64_t current = (int64_t)(func - start);
           instr.operand1 = asmcode::NUMBER;
           instr.operand1_mem = (int64_t(address - current - 5));
@@ -222,10 +277,9 @@ namespace
           {
           if (instr.operand1 != asmcode::EMPTY)
             break;
-          auto it2 = data.label_to_address.find(instr.text);
-          if (it2 == data.label_to_address.end())
+          if (data.label_to_address[instr.text] == no_address)
             throw std::logic_error("second_pass error: label does not exist");
-          int64_t address = (int64_t)it2->second;
+          int64_t address = (int64_t)data.label_to_address[instr.text];
           int64_t current = (int64_t)(func - start);
           instr.operand1 = asmcode::NUMBER;
           instr.operand1_mem = (int64_t(address - current - 2));
@@ -244,6 +298,85 @@ namespace
       }
     return func;
     }
+
+  /*
+  Turns the named labels of code into symbols. A symbol ends at the next symbol or at the end of its instruction vector.
+  Instruction vectors without any named label get the name skiwi_code.
+  */
+  std::vector<jit_symbol> make_jit_symbols(const first_pass_data& data, const asmcode& code)
+    {
+    std::vector<std::pair<uint64_t, uint32_t>> starts;
+    for (const auto& sym : code.get_symbols())
+      {
+      if (sym.first < data.label_to_address.size() && data.label_to_address[sym.first] != no_address)
+        starts.emplace_back(data.label_to_address[sym.first], sym.second);
+      }
+    std::stable_sort(starts.begin(), starts.end(), [](const std::pair<uint64_t, uint32_t>& left, const std::pair<uint64_t, uint32_t>& right)
+      {
+      return left.first < right.first;
+      });
+    std::vector<jit_symbol> symbols;
+    auto block_end = [&](uint64_t offset)
+      {
+      auto it = std::upper_bound(data.block_offsets.begin(), data.block_offsets.end(), offset);
+      return it == data.block_offsets.end() ? data.size : *it;
+      };
+    for (size_t i = 0; i < starts.size(); ++i)
+      {
+      if (i > 0 && starts[i].first == starts[i - 1].first)
+        continue;
+      uint64_t end = block_end(starts[i].first);
+      if (i + 1 < starts.size() && starts[i + 1].first < end)
+        end = starts[i + 1].first;
+      if (end > starts[i].first)
+        symbols.push_back(jit_symbol{ code.get_text(starts[i].second), starts[i].first, end - starts[i].first });
+      }
+    for (size_t b = 0; b < data.block_offsets.size(); ++b)
+      {
+      const uint64_t begin = data.block_offsets[b];
+      const uint64_t end = b + 1 < data.block_offsets.size() ? data.block_offsets[b + 1] : data.size;
+      auto it = std::lower_bound(starts.begin(), starts.end(), begin, [](const std::pair<uint64_t, uint32_t>& left, uint64_t offset)
+        {
+        return left.first < offset;
+        });
+      if (end > begin && (it == starts.end() || it->first >= end))
+        symbols.push_back(jit_symbol{ "skiwi_code", begin, end - begin });
+      }
+    return symbols;
+    }
+  }
+
+void init_first_pass_data(first_pass_data& d, const asmcode& code, const std::map<std::string, uint64_t>& externals)
+  {
+  d.label_to_address.assign(code.number_of_texts(), no_address);
+  d.external_to_address.assign(code.number_of_texts(), no_address);
+  if (externals.size() < code.number_of_texts())
+    {
+    for (const auto& external : externals)
+      {
+      uint32_t id;
+      if (code.find_text(id, external.first))
+        d.external_to_address[id] = external.second;
+      }
+    }
+  else
+    {
+    for (uint32_t id = 1; id < code.number_of_texts(); ++id)
+      {
+      auto it = externals.find(code.get_text(id));
+      if (it != externals.end())
+        d.external_to_address[id] = it->second;
+      }
+    }
+  }
+
+bool find_label_address(uint64_t& address, const first_pass_data& d, const asmcode& code, const std::string& label)
+  {
+  uint32_t id;
+  if (!code.find_text(id, label) || id >= d.label_to_address.size() || d.label_to_address[id] == no_address)
+    return false;
+  address = d.label_to_address[id];
+  return true;
   }
 
 void* assemble(uint64_t& size, first_pass_data& d, asmcode& code, const std::map<std::string, uint64_t>& externals)
@@ -252,34 +385,24 @@ void* assemble(uint64_t& size, first_pass_data& d, asmcode& code, const std::map
   d.label_to_address.clear();
   first_pass(d, code, externals);
 
-  void *compiled_func;
-#ifdef _WIN32
-  compiled_func = VirtualAlloc(0, d.size + d.data_size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-#else
-  compiled_func = mmap(NULL, d.size + d.data_size, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-#endif
+  void* compiled_func = allocate_executable_memory(d.size + d.data_size);
+  uint8_t* writable_func = (uint8_t*)code_heap_writable_address(compiled_func);
 
-  if (!compiled_func)
-    throw std::runtime_error("Could not allocate virtual memory");
+  uint8_t* func_end = second_pass(writable_func, (uint64_t)compiled_func, d, code);
 
-  uint8_t* func_end = second_pass((uint8_t*)compiled_func, d, code);
-
-  uint64_t size_used = func_end - (uint8_t*)compiled_func;
+  uint64_t size_used = func_end - writable_func;
 
   if (size_used != d.size)
     {
+    free_assembled_function(compiled_func, d.size + d.data_size);
     throw std::logic_error("error: error in size computation.");
     }
 
   size = d.size + d.data_size;
 
-#ifdef _WIN32
-  unsigned long i;
-  auto success = VirtualProtect((void *)(compiled_func), d.size + d.data_size, 0x40, (unsigned long *)&i);
+  if (jit_symbols_wanted())
+    register_jit_symbols(compiled_func, d.size, make_jit_symbols(d, code));
 
-  if (!success)
-    return NULL;
-#endif
   return compiled_func;
   }
 
@@ -301,14 +424,15 @@ void* assemble(uint64_t& size, asmcode& code)
   return assemble(size, code, externals);
   }
 
+void* allocate_executable_memory(uint64_t size)
+  {
+  return code_heap_allocate(size);
+  }
+
 void free_assembled_function(void* f, uint64_t size)
   {
-#ifdef _WIN32
-  (void*)size;
-  VirtualFree(f, 0, MEM_RELEASE);
-#else
-  munmap(f, size);
-#endif
+  unregister_jit_symbols(f);
+  code_heap_free(f, size);
   }
 
 ASM_END
@@ -5,24 +5,45 @@
 #include "asmcode.h"
 #include <map>
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 ASM_BEGIN
 
+const uint64_t no_address = (uint64_t)-1;
+
 struct first_pass_data
   {
   first_pass_data() : size(0), data_size(0) {}
 
   uint64_t size, data_size;
-  std::map<std::string, uint64_t> label_to_address;
-  std::map<std::string, uint64_t> external_to_address;
+  std::vector<uint64_t> label_to_address; // indexed by the text id of the label, no_address if the text is not a label
+  std::vector<uint64_t> external_to_address; // indexed by the text id of the external, no_address if the text is not an external
+  std::vector<uint64_t> imm64_offsets; // byte offsets of all 64-bit immediate operands, needed for relocating the code
+  std::vector<uint64_t> block_offsets; // byte offset of the start of each instruction vector
   };
 
+/*
+Sizes label_to_address and external_to_address for the texts of code, and fills in the address of each external that code uses.
+Called by the first pass of assemble and vm_bytecode.
+*/
+ASSEMBLER_API void init_first_pass_data(first_pass_data& d, const asmcode& code, const std::map<std::string, uint64_t>& externals);
+
+/*
+Returns false if label is not a label of code. Otherwise address is set to the offset of label from the start of the code.
+*/
+ASSEMBLER_API bool find_label_address(uint64_t& address, const first_pass_data& d, const asmcode& code, const std::string& label);
+
 ASSEMBLER_API void* assemble(uint64_t& size, first_pass_data& d, asmcode& code, const std::map<std::string, uint64_t>& externals);
 ASSEMBLER_API void* assemble(uint64_t& size, first_pass_data& d, asmcode& code);
 ASSEMBLER_API void* assemble(uint64_t& size, asmcode& code, const std::map<std::string, uint64_t>& externals);
 ASSEMBLER_API void* assemble(uint64_t& size, asmcode& code);
 
+/*
+Returns the executable address of size bytes in the code heap. Write to it through code_heap_writable_address (see code_heap.h).
+*/
+ASSEMBLER_API void* allocate_executable_memory(uint64_t size);
+
 ASSEMBLER_API void free_assembled_function(void* f, uint64_t size);
 
 ASM_END
@@ -0,0 +1,284 @@
+#include "code_heap.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+ASM_BEGIN
+
+namespace
+  {
+  const uint64_t block_alignment = 16;
+  const uint64_t default_region_size = 4 * 1024 * 1024;
+
+  struct region
+    {
+    uint8_t* executable; // the view through which the code runs
+    uint8_t* writable; // the view through which the code is written, equal to executable if there is only one view
+    uint64_t size;
+    uint64_t top; // offset of the first byte that was never handed out, or that was freed again
+    uint64_t used;
+    bool dual_mapped; // true if writable and executable are two views of the same memory file
+    std::map<uint64_t, uint64_t> free_blocks; // offset to size, all below top
+    };
+
+  uint64_t get_page_size()
+    {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (uint64_t)info.dwPageSize;
+#else
+    return (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+  uint64_t round_up(uint64_t value, uint64_t multiple)
+    {
+    return (value + multiple - 1) / multiple * multiple;
+    }
+
+  bool map_region(region& r, uint64_t size)
+    {
+    r.size = size;
+    r.top = 0;
+    r.used = 0;
+    r.dual_mapped = false;
+#ifdef _WIN32
+    r.executable = (uint8_t*)VirtualAlloc(0, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    r.writable = r.executable;
+    return r.executable != nullptr;
+#else
+#ifdef __linux__
+    int fd = memfd_create("skiwi-code", MFD_CLOEXEC);
+    if (fd >= 0)
+      {
+      void* writable = MAP_FAILED;
+      void* executable = MAP_FAILED;
+      if (ftruncate(fd, (off_t)size) == 0)
+        {
+        writable = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        executable = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        }
+      close(fd); // the mappings keep the memory file alive, so the region does not hold on to a file descriptor
+      if (writable != MAP_FAILED && executable != MAP_FAILED)
+        {
+        r.writable = (uint8_t*)writable;
+        r.executable = (uint8_t*)executable;
+        r.dual_mapped = true;
+        return true;
+        }
+      if (writable != MAP_FAILED)
+        munmap(writable, size);
+      if (executable != MAP_FAILED)
+        munmap(executable, size); // e.g. a noexec /dev/shm, fall back to a single view
+      }
+#endif
+    void* memory = mmap(NULL, size, PROT_EXEC | PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+      return false;
+    r.executable = (uint8_t*)memory;
+    r.writable = r.executable;
+    return true;
+#endif
+    }
+
+  void unmap_region(region& r)
+    {
+#ifdef _WIN32
+    VirtualFree(r.executable, 0, MEM_RELEASE);
+#else
+    if (r.writable != r.executable)
+      munmap(r.writable, r.size);
+    munmap(r.executable, r.size);
+#endif
+    }
+
+  /*
+  Gives the pages that lie completely inside [offset, offset + size) back to the os. They read as zeros afterwards.
+  */
+  void release_pages(region& r, uint64_t offset, uint64_t size)
+    {
+#ifdef _WIN32
+    (void)r;
+    (void)offset;
+    (void)size;
+#else
+    const uint64_t page_size = get_page_size();
+    const uint64_t first = round_up(offset, page_size);
+    const uint64_t last = (offset + size) / page_size * page_size;
+    if (first >= last)
+      return;
+#ifdef __linux__
+    if (r.dual_mapped)
+      {
+      madvise(r.writable + first, last - first, MADV_REMOVE); // punches a hole in the memory file, so both views read zeros
+      return;
+      }
+#endif
+    madvise(r.executable + first, last - first, MADV_DONTNEED);
+#endif
+    }
+
+  class code_heap
+    {
+    public:
+      void* allocate(uint64_t size)
+        {
+        size = round_up((std::max)(size, (uint64_t)1), block_alignment);
+        std::lock_guard<std::mutex> lock(mut);
+        for (auto rit = regions.rbegin(); rit != regions.rend(); ++rit)
+          {
+          region& r = *rit;
+          for (auto it = r.free_blocks.begin(); it != r.free_blocks.end(); ++it)
+            {
+            if (it->second < size)
+              continue;
+            const uint64_t offset = it->first;
+            const uint64_t remaining = it->second - size;
+            r.free_blocks.erase(it);
+            if (remaining)
+              r.free_blocks[offset + size] = remaining;
+            r.used += size;
+            return r.executable + offset;
+            }
+          if (r.size - r.top >= size)
+            {
+            const uint64_t offset = r.top;
+            r.top += size;
+            r.used += size;
+            return r.executable + offset;
+            }
+          }
+        region r;
+        if (!map_region(r, (std::max)(default_region_size, round_up(size, get_page_size()))))
+          throw std::runtime_error("Could not allocate virtual memory");
+        r.top = size;
+        r.used = size;
+        regions.push_back(r);
+        return r.executable;
+        }
+
+      void free(void* executable_address, uint64_t size)
+        {
+        size = round_up((std::max)(size, (uint64_t)1), block_alignment);
+        std::lock_guard<std::mutex> lock(mut);
+        auto rit = find_region(executable_address);
+        if (rit == regions.end())
+          throw std::logic_error("code_heap: the address was not allocated by the code heap");
+        region& r = *rit;
+        r.used -= size;
+        if (r.used == 0 && regions.size() > 1)
+          {
+          unmap_region(r);
+          regions.erase(rit);
+          return;
+          }
+        uint64_t offset = (uint8_t*)executable_address - r.executable;
+        auto next = r.free_blocks.lower_bound(offset);
+        if (next != r.free_blocks.begin())
+          {
+          auto previous = std::prev(next);
+          if (previous->first + previous->second == offset)
+            {
+            offset = previous->first;
+            size += previous->second;
+            r.free_blocks.erase(previous);
+            }
+          }
+        if (next != r.free_blocks.end() && offset + size == next->first)
+          {
+          size += next->second;
+          r.free_blocks.erase(next);
+          }
+        if (offset + size == r.top)
+          {
+          release_pages(r, offset, r.top - offset);
+          r.top = offset;
+          }
+        else
+          {
+          release_pages(r, offset, size);
+          r.free_blocks[offset] = size;
+          }
+        }
+
+      void* writable_address(void* executable_address)
+        {
+        std::lock_guard<std::mutex> lock(mut);
+        auto rit = find_region(executable_address);
+        if (rit == regions.end())
+          throw std::logic_error("code_heap: the address was not allocated by the code heap");
+        return rit->writable + ((uint8_t*)executable_address - rit->executable);
+        }
+
+      code_heap_statistics statistics()
+        {
+        std::lock_guard<std::mutex> lock(mut);
+        code_heap_statistics stats;
+        stats.regions = regions.size();
+        stats.reserved = 0;
+        stats.used = 0;
+        stats.free_blocks = 0;
+        for (const auto& r : regions)
+          {
+          stats.reserved += r.size;
+          stats.used += r.used;
+          stats.free_blocks += r.free_blocks.size();
+          }
+        return stats;
+        }
+
+    private:
+      std::vector<region>::iterator find_region(void* executable_address)
+        {
+        uint8_t* address = (uint8_t*)executable_address;
+        return std::find_if(regions.begin(), regions.end(), [&](const region& r)
+          {
+          return address >= r.executable && address < r.executable + r.size;
+          });
+        }
+
+    private:
+      std::mutex mut;
+      std::vector<region> regions;
+    };
+
+  code_heap& get_code_heap()
+    {
+    static code_heap* heap = new code_heap(); // never destroyed, code may be freed by destructors of other static objects
+    return *heap;
+    }
+  }
+
+void* code_heap_allocate(uint64_t size)
+  {
+  return get_code_heap().allocate(size);
+  }
+
+void code_heap_free(void* executable_address, uint64_t size)
+  {
+  get_code_heap().free(executable_address, size);
+  }
+
+void* code_heap_writable_address(void* executable_address)
+  {
+  return get_code_heap().writable_address(executable_address);
+  }
+
+code_heap_statistics get_code_heap_statistics()
+  {
+  return get_code_heap().statistics();
+  }
+
+ASM_END
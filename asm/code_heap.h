@@ -0,0 +1,42 @@
+#pragma once
+
+#include "namespace.h"
+#include "asm_api.h"
+#include <stdint.h>
+
+ASM_BEGIN
+
+/*
+The code heap hands out executable memory for assembled functions. Functions are carved out of large regions, so that
+a small function does not cost a system call and a page of its own. Freed blocks are merged with their free neighbours,
+the pages that are completely free are given back to the os, and a region is released when nothing in it is in use.
+Code cannot be moved once it is assembled (closures hold its addresses), so the heap is never compacted by moving code.
+
+On linux each region is mapped twice from the same memory file: code is written through a view that is readable and
+writable, and executed through a view that is readable and executable (W^X). Elsewhere a region is one view with
+all three permissions, and code_heap_writable_address returns its argument.
+*/
+
+struct code_heap_statistics
+  {
+  uint64_t regions; // number of regions
+  uint64_t reserved; // bytes reserved by all regions
+  uint64_t used; // bytes in use by functions
+  uint64_t free_blocks; // number of free blocks in between the functions
+  };
+
+/*
+Returns the executable address of a block of at least size bytes. Use code_heap_writable_address to fill it.
+*/
+ASSEMBLER_API void* code_heap_allocate(uint64_t size);
+
+ASSEMBLER_API void code_heap_free(void* executable_address, uint64_t size);
+
+/*
+Returns the address through which the block at executable_address can be written.
+*/
+ASSEMBLER_API void* code_heap_writable_address(void* executable_address);
+
+ASSEMBLER_API code_heap_statistics get_code_heap_statistics();
+
+ASM_END
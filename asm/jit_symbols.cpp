@@ -0,0 +1,391 @@
+#include "jit_symbols.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <elf.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+/*
+The gdb jit interface. gdb puts a breakpoint in __jit_debug_register_code and reads __jit_debug_descriptor when it is hit,
+so the names, the layout and the calling protocol are fixed by gdb.
+*/
+extern "C"
+  {
+  typedef enum
+    {
+    JIT_NOACTION = 0,
+    JIT_REGISTER_FN,
+    JIT_UNREGISTER_FN
+    } jit_actions_t;
+
+  struct jit_code_entry
+    {
+    struct jit_code_entry* next_entry;
+    struct jit_code_entry* prev_entry;
+    const char* symfile_addr;
+    uint64_t symfile_size;
+    };
+
+  struct jit_descriptor
+    {
+    uint32_t version;
+    uint32_t action_flag;
+    struct jit_code_entry* relevant_entry;
+    struct jit_code_entry* first_entry;
+    };
+
+  void __attribute__((noinline)) __jit_debug_register_code()
+    {
+    __asm__ __volatile__("");
+    }
+
+  struct jit_descriptor __jit_debug_descriptor = { 1, 0, 0, 0 };
+  }
+#endif
+
+ASM_BEGIN
+
+namespace
+  {
+  std::atomic<bool> perf_map_enabled(false);
+  std::atomic<bool> gdb_jit_enabled(false);
+  std::atomic<bool> symbol_table_enabled(false);
+
+  struct code_symbols
+    {
+    uint64_t size;
+    std::vector<jit_symbol> symbols; // sorted by offset
+    };
+
+#ifdef __linux__
+  struct gdb_jit_object
+    {
+    jit_code_entry entry;
+    std::vector<uint8_t> elf;
+    };
+#endif
+
+  struct jit_state
+    {
+    std::mutex mut; // guards the symbol table, the perf map file and the gdb descriptor
+    std::map<uint64_t, code_symbols> symbol_table; // start address of the code to its symbols
+#ifdef __linux__
+    FILE* perf_map = nullptr;
+    std::map<const void*, gdb_jit_object*> gdb_jit_objects;
+#endif
+    };
+
+  jit_state& get_jit_state()
+    {
+    static jit_state* state = new jit_state(); // never destroyed, code may be freed by destructors of other static objects
+    return *state;
+    }
+
+#ifdef __linux__
+  void write_perf_map(jit_state& js, const void* address, const std::vector<jit_symbol>& symbols)
+    {
+    if (!js.perf_map)
+      {
+      js.perf_map = fopen(get_perf_map_filename().c_str(), "a");
+      if (!js.perf_map)
+        return;
+      }
+    for (const auto& sym : symbols)
+      fprintf(js.perf_map, "%llx %llx %s\n", (unsigned long long)((uint64_t)address + sym.offset), (unsigned long long)sym.size, sym.name.c_str());
+    fflush(js.perf_map);
+    }
+
+  template <class T>
+  uint64_t append(std::vector<uint8_t>& elf, const T& value)
+    {
+    const uint64_t offset = elf.size();
+    elf.resize(offset + sizeof(T));
+    memcpy(elf.data() + offset, &value, sizeof(T));
+    return offset;
+    }
+
+  uint64_t append_string(std::vector<uint8_t>& elf, const std::string& s)
+    {
+    const uint64_t offset = elf.size();
+    elf.insert(elf.end(), s.begin(), s.end());
+    elf.push_back(0);
+    return offset;
+    }
+
+  void align(std::vector<uint8_t>& elf, uint64_t alignment)
+    {
+    while (elf.size() % alignment)
+      elf.push_back(0);
+    }
+
+  /*
+  Builds a relocatable elf object with a .text section that has no contents, but is placed at address, and a symbol table
+  with a function symbol per jit_symbol.
+  */
+  std::vector<uint8_t> make_elf_object(const void* address, uint64_t size, const std::vector<jit_symbol>& symbols)
+    {
+    enum { section_null, section_text, section_symtab, section_strtab, section_shstrtab, number_of_sections };
+    std::vector<uint8_t> elf;
+    Elf64_Ehdr header;
+    memset(&header, 0, sizeof(Elf64_Ehdr));
+    append(elf, header);
+
+    const uint64_t shstrtab_offset = elf.size();
+    append_string(elf, "");
+    const uint64_t text_name = append_string(elf, ".text") - shstrtab_offset;
+    const uint64_t symtab_name = append_string(elf, ".symtab") - shstrtab_offset;
+    const uint64_t strtab_name = append_string(elf, ".strtab") - shstrtab_offset;
+    const uint64_t shstrtab_name = append_string(elf, ".shstrtab") - shstrtab_offset;
+    const uint64_t shstrtab_size = elf.size() - shstrtab_offset;
+
+    const uint64_t strtab_offset = elf.size();
+    append_string(elf, "");
+    std::vector<uint64_t> symbol_names;
+    for (const auto& sym : symbols)
+      symbol_names.push_back(append_string(elf, sym.name) - strtab_offset);
+    const uint64_t strtab_size = elf.size() - strtab_offset;
+
+    align(elf, 8);
+    const uint64_t symtab_offset = elf.size();
+    Elf64_Sym sym;
+    memset(&sym, 0, sizeof(Elf64_Sym));
+    append(elf, sym);
+    for (size_t i = 0; i < symbols.size(); ++i)
+      {
+      sym.st_name = (Elf64_Word)symbol_names[i];
+      sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+      sym.st_other = STV_DEFAULT;
+      sym.st_shndx = section_text;
+      sym.st_value = symbols[i].offset;
+      sym.st_size = symbols[i].size;
+      append(elf, sym);
+      }
+    const uint64_t symtab_size = elf.size() - symtab_offset;
+
+    align(elf, 8);
+    const uint64_t section_headers_offset = elf.size();
+    Elf64_Shdr section[number_of_sections];
+    memset(section, 0, sizeof(section));
+    section[section_text].sh_name = (Elf64_Word)text_name;
+    section[section_text].sh_type = SHT_NOBITS;
+    section[section_text].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    section[section_text].sh_addr = (Elf64_Addr)address;
+    section[section_text].sh_size = size;
+    section[section_text].sh_addralign = 16;
+    section[section_symtab].sh_name = (Elf64_Word)symtab_name;
+    section[section_symtab].sh_type = SHT_SYMTAB;
+    section[section_symtab].sh_offset = symtab_offset;
+    section[section_symtab].sh_size = symtab_size;
+    section[section_symtab].sh_link = section_strtab;
+    section[section_symtab].sh_info = 1; // index of the first global symbol
+    section[section_symtab].sh_addralign = 8;
+    section[section_symtab].sh_entsize = sizeof(Elf64_Sym);
+    section[section_strtab].sh_name = (Elf64_Word)strtab_name;
+    section[section_strtab].sh_type = SHT_STRTAB;
+    section[section_strtab].sh_offset = strtab_offset;
+    section[section_strtab].sh_size = strtab_size;
+    section[section_strtab].sh_addralign = 1;
+    section[section_shstrtab].sh_name = (Elf64_Word)shstrtab_name;
+    section[section_shstrtab].sh_type = SHT_STRTAB;
+    section[section_shstrtab].sh_offset = shstrtab_offset;
+    section[section_shstrtab].sh_size = shstrtab_size;
+    section[section_shstrtab].sh_addralign = 1;
+    for (int i = 0; i < number_of_sections; ++i)
+      append(elf, section[i]);
+
+    header.e_ident[EI_MAG0] = ELFMAG0;
+    header.e_ident[EI_MAG1] = ELFMAG1;
+    header.e_ident[EI_MAG2] = ELFMAG2;
+    header.e_ident[EI_MAG3] = ELFMAG3;
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_REL;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_shoff = section_headers_offset;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = number_of_sections;
+    header.e_shstrndx = section_shstrtab;
+    memcpy(elf.data(), &header, sizeof(Elf64_Ehdr));
+    return elf;
+    }
+
+  void register_with_gdb(jit_state& js, const void* address, uint64_t size, const std::vector<jit_symbol>& symbols)
+    {
+    gdb_jit_object* obj = new gdb_jit_object();
+    obj->elf = make_elf_object(address, size, symbols);
+    obj->entry.symfile_addr = (const char*)obj->elf.data();
+    obj->entry.symfile_size = obj->elf.size();
+    obj->entry.prev_entry = nullptr;
+    obj->entry.next_entry = __jit_debug_descriptor.first_entry;
+    if (obj->entry.next_entry)
+      obj->entry.next_entry->prev_entry = &obj->entry;
+    __jit_debug_descriptor.first_entry = &obj->entry;
+    __jit_debug_descriptor.relevant_entry = &obj->entry;
+    __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+    __jit_debug_register_code();
+    js.gdb_jit_objects[address] = obj;
+    }
+
+  void unregister_with_gdb(gdb_jit_object* obj)
+    {
+    if (obj->entry.prev_entry)
+      obj->entry.prev_entry->next_entry = obj->entry.next_entry;
+    else
+      __jit_debug_descriptor.first_entry = obj->entry.next_entry;
+    if (obj->entry.next_entry)
+      obj->entry.next_entry->prev_entry = obj->entry.prev_entry;
+    __jit_debug_descriptor.relevant_entry = &obj->entry;
+    __jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+    __jit_debug_register_code();
+    delete obj;
+    }
+#endif
+  }
+
+void set_perf_map_enabled(bool enabled)
+  {
+  perf_map_enabled = enabled;
+  }
+
+bool is_perf_map_enabled()
+  {
+  return perf_map_enabled;
+  }
+
+void set_gdb_jit_enabled(bool enabled)
+  {
+  gdb_jit_enabled = enabled;
+  }
+
+bool is_gdb_jit_enabled()
+  {
+  return gdb_jit_enabled;
+  }
+
+void set_jit_symbol_table_enabled(bool enabled)
+  {
+  symbol_table_enabled = enabled;
+  }
+
+bool is_jit_symbol_table_enabled()
+  {
+  return symbol_table_enabled;
+  }
+
+bool jit_symbols_wanted()
+  {
+  return symbol_table_enabled || perf_map_enabled || gdb_jit_enabled;
+  }
+
+std::string get_perf_map_filename()
+  {
+#ifdef __linux__
+  return "/tmp/perf-" + std::to_string((long long)getpid()) + ".map";
+#else
+  return std::string();
+#endif
+  }
+
+void register_jit_symbols(const void* address, uint64_t size, const std::vector<jit_symbol>& symbols)
+  {
+  if (symbols.empty() || !jit_symbols_wanted())
+    return;
+  jit_state& js = get_jit_state();
+  std::lock_guard<std::mutex> lock(js.mut);
+  code_symbols& cs = js.symbol_table[(uint64_t)address];
+  cs.size = size;
+  cs.symbols = symbols;
+  std::sort(cs.symbols.begin(), cs.symbols.end(), [](const jit_symbol& left, const jit_symbol& right)
+    {
+    return left.offset < right.offset;
+    });
+#ifdef __linux__
+  if (perf_map_enabled)
+    write_perf_map(js, address, symbols);
+  if (gdb_jit_enabled)
+    {
+    auto it = js.gdb_jit_objects.find(address);
+    if (it != js.gdb_jit_objects.end())
+      {
+      unregister_with_gdb(it->second);
+      js.gdb_jit_objects.erase(it);
+      }
+    register_with_gdb(js, address, size, symbols);
+    }
+#endif
+  }
+
+void unregister_jit_symbols(const void* address)
+  {
+  jit_state& js = get_jit_state();
+  std::lock_guard<std::mutex> lock(js.mut);
+  js.symbol_table.erase((uint64_t)address);
+#ifdef __linux__
+  auto it = js.gdb_jit_objects.find(address);
+  if (it == js.gdb_jit_objects.end())
+    return;
+  unregister_with_gdb(it->second);
+  js.gdb_jit_objects.erase(it);
+#endif
+  }
+
+bool find_jit_symbol(std::string& name, uint64_t& code_address, uint64_t address)
+  {
+  jit_state& js = get_jit_state();
+  std::lock_guard<std::mutex> lock(js.mut);
+  auto it = js.symbol_table.upper_bound(address);
+  if (it == js.symbol_table.begin())
+    return false;
+  --it;
+  const uint64_t offset = address - it->first;
+  if (offset >= it->second.size)
+    return false;
+  const auto& symbols = it->second.symbols;
+  auto sym = std::upper_bound(symbols.begin(), symbols.end(), offset, [](uint64_t off, const jit_symbol& s)
+    {
+    return off < s.offset;
+    });
+  if (sym == symbols.begin())
+    return false;
+  --sym;
+  if (offset >= sym->offset + sym->size)
+    return false;
+  name = sym->name;
+  code_address = it->first;
+  return true;
+  }
+
+std::vector<jit_symbol> get_jit_symbols(const void* address)
+  {
+  jit_state& js = get_jit_state();
+  std::lock_guard<std::mutex> lock(js.mut);
+  auto it = js.symbol_table.find((uint64_t)address);
+  if (it == js.symbol_table.end())
+    return std::vector<jit_symbol>();
+  return it->second.symbols;
+  }
+
+uint64_t number_of_gdb_jit_entries()
+  {
+#ifdef __linux__
+  jit_state& js = get_jit_state();
+  std::lock_guard<std::mutex> lock(js.mut);
+  return js.gdb_jit_objects.size();
+#else
+  return 0;
+#endif
+  }
+
+ASM_END
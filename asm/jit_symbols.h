@@ -0,0 +1,78 @@
+#pragma once
+
+#include "namespace.h"
+#include "asm_api.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+ASM_BEGIN
+
+/*
+Makes assembled code visible to profilers and debuggers, so that time spent in generated code is attributed to a name
+instead of an anonymous address.
+
+The symbols of all assembled code are kept in a table, so that addresses can be named in this process, e.g. by a profiler.
+The perf map appends a line "address size name" per symbol to /tmp/perf-<pid>.map, which perf reads when it reports.
+The gdb jit interface hands gdb a small in-memory elf object per assembled function that only contains a symbol table
+(see "JIT Compilation Interface" in the gdb manual). Both are off by default, and are only available on linux.
+The symbol table is only filled while one of its users is enabled: the perf map, gdb, or the symbol table itself, which a
+profiler enables while it needs names. Otherwise assemble does not make symbols at all.
+*/
+
+struct jit_symbol
+  {
+  std::string name;
+  uint64_t offset; // from the start of the code
+  uint64_t size;
+  };
+
+ASSEMBLER_API void set_perf_map_enabled(bool enabled);
+ASSEMBLER_API bool is_perf_map_enabled();
+
+ASSEMBLER_API void set_gdb_jit_enabled(bool enabled);
+ASSEMBLER_API bool is_gdb_jit_enabled();
+
+ASSEMBLER_API void set_jit_symbol_table_enabled(bool enabled);
+ASSEMBLER_API bool is_jit_symbol_table_enabled();
+
+/*
+Returns true if the symbol table, the perf map or gdb is enabled, i.e. if register_jit_symbols does anything.
+*/
+ASSEMBLER_API bool jit_symbols_wanted();
+
+/*
+Returns the name of the perf map of this process.
+*/
+ASSEMBLER_API std::string get_perf_map_filename();
+
+/*
+Adds the symbols of the code at address to the symbol table of this process (see find_jit_symbol), and publishes them to
+the perf map and to gdb, depending on which of them are enabled. Does nothing if jit_symbols_wanted() is false. Called
+by assemble.
+*/
+ASSEMBLER_API void register_jit_symbols(const void* address, uint64_t size, const std::vector<jit_symbol>& symbols);
+
+/*
+Removes the code at address from the symbol table and from gdb. The perf map is append only, perf uses the last entry
+that covers an address. Called by free_assembled_function.
+*/
+ASSEMBLER_API void unregister_jit_symbols(const void* address);
+
+/*
+Returns false if address does not lie in registered code. Otherwise name is set to the name of the symbol that covers
+address, and code_address to the start of the assembled function that contains address.
+*/
+ASSEMBLER_API bool find_jit_symbol(std::string& name, uint64_t& code_address, uint64_t address);
+
+/*
+Returns the symbols that were registered for the code at address.
+*/
+ASSEMBLER_API std::vector<jit_symbol> get_jit_symbols(const void* address);
+
+/*
+Returns the number of objects that are currently registered with gdb.
+*/
+ASSEMBLER_API uint64_t number_of_gdb_jit_entries();
+
+ASM_END
@@ -0,0 +1,136 @@
+#include "jump_relaxation.h"
+
+#include <vector>
+
+ASM_BEGIN
+
+namespace
+  {
+  struct jump_forms
+    {
+    asmcode::operation short_form;
+    asmcode::operation near_form;
+    };
+
+  const jump_forms all_jump_forms[] =
+    {
+    { asmcode::JMPS, asmcode::JMP },
+    { asmcode::JES, asmcode::JE },
+    { asmcode::JLS, asmcode::JL },
+    { asmcode::JLES, asmcode::JLE },
+    { asmcode::JGS, asmcode::JG },
+    { asmcode::JAS, asmcode::JA },
+    { asmcode::JBS, asmcode::JB },
+    { asmcode::JGES, asmcode::JGE },
+    { asmcode::JNES, asmcode::JNE }
+    };
+
+  const jump_forms* find_jump_forms(const asmcode::instruction& instr)
+    {
+    if (instr.operand1 != asmcode::EMPTY)
+      return nullptr;
+    for (const auto& forms : all_jump_forms)
+      {
+      if (instr.oper == forms.short_form || instr.oper == forms.near_form)
+        return &forms;
+      }
+    return nullptr;
+    }
+
+  struct jump
+    {
+    asmcode::instruction* instr;
+    const jump_forms* forms;
+    size_t index; // position in the layout
+    size_t target; // position of the label in the layout
+    uint64_t short_size, near_size;
+    bool is_near;
+    };
+
+  bool is_aligned_label(asmcode::operation op)
+    {
+    return op == asmcode::LABEL_ALIGNED || op == asmcode::GLOBAL;
+    }
+  }
+
+void relax_jumps(std::vector<uint64_t>& sizes, asmcode& code, const std::function<uint64_t(const asmcode::instruction&)>& instruction_size, bool displacement_from_next_instruction)
+  {
+  std::vector<asmcode::operation> layout; // the operation of each instruction, in the order of the code
+  sizes.clear();
+  const size_t no_index = (size_t)-1;
+  std::vector<size_t> label_index(code.number_of_texts(), no_index); // text id to position of the label in the layout
+  std::vector<jump> jumps;
+  for (auto& block : code.get_instructions_list())
+    {
+    for (auto& instr : block)
+      {
+      const size_t index = layout.size();
+      layout.push_back(instr.oper);
+      if (instr.oper == asmcode::LABEL || is_aligned_label(instr.oper))
+        {
+        label_index[instr.text] = index;
+        sizes.push_back(0);
+        continue;
+        }
+      const jump_forms* forms = find_jump_forms(instr);
+      if (forms)
+        {
+        jump j;
+        j.instr = &instr;
+        j.forms = forms;
+        j.index = index;
+        instr.oper = forms->short_form;
+        j.short_size = instruction_size(instr);
+        instr.oper = forms->near_form;
+        j.near_size = instruction_size(instr);
+        j.is_near = false;
+        jumps.push_back(j);
+        sizes.push_back(j.short_size);
+        }
+      else
+        sizes.push_back(instruction_size(instr));
+      }
+    }
+  if (jumps.empty())
+    return;
+  for (auto& j : jumps)
+    {
+    j.target = label_index[j.instr->text];
+    if (j.target == no_index)
+      j.is_near = true; // the second pass reports the missing label
+    }
+
+  std::vector<uint64_t> addresses(layout.size());
+  bool changed = true;
+  while (changed)
+    {
+    uint64_t address = 0;
+    for (size_t i = 0; i < layout.size(); ++i)
+      {
+      if (is_aligned_label(layout[i]) && (address & 7))
+        address += 8 - (address & 7);
+      addresses[i] = address;
+      address += sizes[i];
+      }
+    changed = false;
+    for (auto& j : jumps)
+      {
+      if (j.is_near)
+        continue;
+      int64_t displacement = (int64_t)addresses[j.target] - (int64_t)addresses[j.index];
+      if (displacement_from_next_instruction)
+        displacement -= (int64_t)j.short_size;
+      if (displacement > 127 || displacement < -128)
+        {
+        j.is_near = true;
+        sizes[j.index] = j.near_size;
+        changed = true;
+        }
+      }
+    }
+
+  for (auto& j : jumps)
+    j.instr->oper = j.is_near ? j.forms->near_form : j.forms->short_form;
+  }
+
+ASM_END
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "namespace.h"
+#include "asm_api.h"
+#include "asmcode.h"
+#include <functional>
+#include <vector>
+#include <stdint.h>
+
+ASM_BEGIN
+
+/*
+Chooses the encoding of each jump to a label in code: the short form (JMPS, JES, ...) with an 8-bit displacement
+if the label is close enough, the near form (JMP, JE, ...) with a 32-bit displacement otherwise. Which of the two forms
+a code generator used does not matter, both are treated as a jump to the label.
+
+All jumps start short. The code is laid out, each short jump whose label is out of reach becomes near, and this is repeated
+until no jump changes anymore. A jump never goes back from near to short, so this ends after at most as many rounds
+as there are jumps, and in practice after a few.
+
+instruction_size returns the number of bytes of an instruction that is not a label, as the first pass of the backend
+would count it. If displacement_from_next_instruction is true, the displacement of a jump is measured from the
+end of the jump (x64), otherwise from its start (vm bytecode). On return, sizes holds the size of each instruction in the
+order of the code, with the final encoding of the jumps and 0 for labels, so that the first pass need not compute them again.
+*/
+ASSEMBLER_API void relax_jumps(std::vector<uint64_t>& sizes, asmcode& code, const std::function<uint64_t(const asmcode::instruction&)>& instruction_size, bool displacement_from_next_instruction);
+
+ASM_END
@@ -0,0 +1,323 @@
+#include "peephole.h"
+
+#include <algorithm>
+#include <atomic>
+
+ASM_BEGIN
+
+namespace
+  {
+  typedef asmcode::instruction instruction;
+
+  /*
+  A view on one instruction vector in which instructions can be removed without moving the others.
+  */
+  struct window
+    {
+    std::vector<instruction>& block;
+    std::vector<bool> removed;
+
+    window(std::vector<instruction>& b) : block(b), removed(b.size(), false) {}
+
+    /*
+    Returns the index of the first instruction after i that is not a comment and not removed, or block.size().
+    */
+    size_t next(size_t i) const
+      {
+      ++i;
+      while (i < block.size() && (removed[i] || block[i].oper == asmcode::COMMENT))
+        ++i;
+      return i;
+      }
+
+    bool valid(size_t i) const
+      {
+      return i < block.size();
+      }
+
+    void remove(size_t i)
+      {
+      removed[i] = true;
+      }
+    };
+
+  bool is_register(asmcode::operand op)
+    {
+    return op >= asmcode::RAX && op <= asmcode::R15;
+    }
+
+  bool is_memory(asmcode::operand op)
+    {
+    return op >= asmcode::MEM_RAX && op <= asmcode::MEM_R15;
+    }
+
+  asmcode::operand memory_base(asmcode::operand op)
+    {
+    switch (op)
+      {
+      case asmcode::MEM_RAX: return asmcode::RAX;
+      case asmcode::MEM_RBX: return asmcode::RBX;
+      case asmcode::MEM_RCX: return asmcode::RCX;
+      case asmcode::MEM_RDX: return asmcode::RDX;
+      case asmcode::MEM_RDI: return asmcode::RDI;
+      case asmcode::MEM_RSI: return asmcode::RSI;
+      case asmcode::MEM_RSP: return asmcode::RSP;
+      case asmcode::MEM_RBP: return asmcode::RBP;
+      case asmcode::MEM_R8: return asmcode::R8;
+      case asmcode::MEM_R9: return asmcode::R9;
+      case asmcode::MEM_R10: return asmcode::R10;
+      case asmcode::MEM_R11: return asmcode::R11;
+      case asmcode::MEM_R12: return asmcode::R12;
+      case asmcode::MEM_R13: return asmcode::R13;
+      case asmcode::MEM_R14: return asmcode::R14;
+      case asmcode::MEM_R15: return asmcode::R15;
+      default: return asmcode::EMPTY;
+      }
+    }
+
+  bool same_operand(asmcode::operand op1, uint64_t mem1, asmcode::operand op2, uint64_t mem2)
+    {
+    return op1 == op2 && (!is_memory(op1) || mem1 == mem2);
+    }
+
+  bool is_label(const instruction& ins)
+    {
+    return ins.oper == asmcode::LABEL || ins.oper == asmcode::LABEL_ALIGNED || ins.oper == asmcode::GLOBAL;
+    }
+
+  bool is_conditional_jump(asmcode::operation op)
+    {
+    switch (op)
+      {
+      case asmcode::JA:
+      case asmcode::JB:
+      case asmcode::JE:
+      case asmcode::JL:
+      case asmcode::JLE:
+      case asmcode::JG:
+      case asmcode::JGE:
+      case asmcode::JNE:
+      case asmcode::JAS:
+      case asmcode::JBS:
+      case asmcode::JES:
+      case asmcode::JLS:
+      case asmcode::JLES:
+      case asmcode::JGS:
+      case asmcode::JGES:
+      case asmcode::JNES:
+        return true;
+      default:
+        return false;
+      }
+    }
+
+  bool is_jump_to_label(const instruction& ins)
+    {
+    return (ins.oper == asmcode::JMP || ins.oper == asmcode::JMPS || is_conditional_jump(ins.oper)) && ins.operand1 == asmcode::EMPTY && ins.text != 0;
+    }
+
+  /*
+  JMP L; L: => L:
+  Also when other labels come in between.
+  */
+  bool jump_to_next_label(window& w, size_t i)
+    {
+    const instruction& jmp = w.block[i];
+    if (!is_jump_to_label(jmp))
+      return false;
+    for (size_t j = w.next(i); w.valid(j) && is_label(w.block[j]); j = w.next(j))
+      {
+      if (w.block[j].text == jmp.text)
+        {
+        w.remove(i);
+        return true;
+        }
+      }
+    return false;
+    }
+
+  /*
+  PUSH r; POP r => nothing
+  PUSH r1; POP r2 => MOV r2, r1
+  */
+  bool push_pop(window& w, size_t i)
+    {
+    const instruction& push = w.block[i];
+    if (push.oper != asmcode::PUSH || !is_register(push.operand1) || push.operand1 == asmcode::RSP)
+      return false;
+    size_t j = w.next(i);
+    if (!w.valid(j))
+      return false;
+    instruction& pop = w.block[j];
+    if (pop.oper != asmcode::POP || !is_register(pop.operand1) || pop.operand1 == asmcode::RSP)
+      return false;
+    w.remove(i);
+    if (pop.operand1 == push.operand1)
+      w.remove(j);
+    else
+      pop = instruction(asmcode::MOV, pop.operand1, push.operand1);
+    return true;
+    }
+
+  /*
+  MOV r, r => nothing
+  */
+  bool move_to_self(window& w, size_t i)
+    {
+    const instruction& mov = w.block[i];
+    if (mov.oper != asmcode::MOV || !is_register(mov.operand1) || mov.operand1 != mov.operand2)
+      return false;
+    w.remove(i);
+    return true;
+    }
+
+  /*
+  MOV x, y; MOV y, x => MOV x, y
+  */
+  bool move_back(window& w, size_t i)
+    {
+    const instruction& first = w.block[i];
+    if (first.oper != asmcode::MOV)
+      return false;
+    if (!(is_register(first.operand1) && is_memory(first.operand2)) && !(is_memory(first.operand1) && is_register(first.operand2)) && !(is_register(first.operand1) && is_register(first.operand2)))
+      return false;
+    if (memory_base(first.operand1) == first.operand2 || memory_base(first.operand2) == first.operand1)
+      return false;
+    size_t j = w.next(i);
+    if (!w.valid(j))
+      return false;
+    const instruction& second = w.block[j];
+    if (second.oper != asmcode::MOV)
+      return false;
+    if (!same_operand(first.operand1, first.operand1_mem, second.operand2, second.operand2_mem) || !same_operand(first.operand2, first.operand2_mem, second.operand1, second.operand1_mem))
+      return false;
+    w.remove(j);
+    return true;
+    }
+
+  /*
+  MOV r, x; MOV r, y => MOV r, y
+  if y does not depend on r.
+  */
+  bool overwritten_move(window& w, size_t i)
+    {
+    const instruction& first = w.block[i];
+    if (first.oper != asmcode::MOV || !is_register(first.operand1) || first.operand1 == asmcode::RSP)
+      return false;
+    size_t j = w.next(i);
+    if (!w.valid(j))
+      return false;
+    const instruction& second = w.block[j];
+    if (second.oper != asmcode::MOV || second.operand1 != first.operand1)
+      return false;
+    if (second.operand2 == first.operand1 || memory_base(second.operand2) == first.operand1)
+      return false;
+    w.remove(i);
+    return true;
+    }
+
+  /*
+  CMP x, y; Jcc L1; CMP x, y => CMP x, y; Jcc L1
+  The conditional jumps in between do not change the flags, so the second comparison gives the same result.
+  */
+  bool repeated_compare(window& w, size_t i)
+    {
+    const instruction& first = w.block[i];
+    if (first.oper != asmcode::CMP && first.oper != asmcode::TEST)
+      return false;
+    size_t j = w.next(i);
+    if (!w.valid(j) || !is_jump_to_label(w.block[j]) || !is_conditional_jump(w.block[j].oper))
+      return false;
+    while (w.valid(j) && is_jump_to_label(w.block[j]) && is_conditional_jump(w.block[j].oper))
+      j = w.next(j);
+    if (!w.valid(j))
+      return false;
+    const instruction& second = w.block[j];
+    if (second.oper != first.oper || second.operand1 != first.operand1 || second.operand2 != first.operand2 || second.operand1_mem != first.operand1_mem || second.operand2_mem != first.operand2_mem || second.text != first.text)
+      return false;
+    w.remove(j);
+    return true;
+    }
+
+  struct peephole_rule
+    {
+    const char* name;
+    bool(*apply)(window& w, size_t i);
+    };
+
+  const peephole_rule rules[] =
+    {
+    { "jump-to-next-label", &jump_to_next_label },
+    { "push-pop", &push_pop },
+    { "move-to-self", &move_to_self },
+    { "move-back", &move_back },
+    { "overwritten-move", &overwritten_move },
+    { "repeated-compare", &repeated_compare }
+    };
+
+  const size_t number_of_rules = sizeof(rules) / sizeof(peephole_rule);
+
+  std::atomic<uint64_t> rule_hits[number_of_rules];
+
+  void optimize_block(std::vector<instruction>& block)
+    {
+    window w(block);
+    uint64_t hits[number_of_rules] = {};
+    bool changed = true;
+    while (changed)
+      {
+      changed = false;
+      for (size_t i = 0; i < block.size(); ++i)
+        {
+        if (w.removed[i] || block[i].oper == asmcode::COMMENT)
+          continue;
+        for (size_t r = 0; r < number_of_rules; ++r)
+          {
+          if (rules[r].apply(w, i))
+            {
+            ++hits[r];
+            changed = true;
+            if (w.removed[i])
+              break;
+            }
+          }
+        }
+      }
+    size_t kept = 0;
+    for (size_t i = 0; i < block.size(); ++i)
+      {
+      if (!w.removed[i])
+        {
+        if (kept != i)
+          block[kept] = std::move(block[i]);
+        ++kept;
+        }
+      }
+    block.resize(kept);
+    for (size_t r = 0; r < number_of_rules; ++r)
+      if (hits[r])
+        rule_hits[r] += hits[r];
+    }
+  }
+
+void peephole_optimize(asmcode& code)
+  {
+  for (auto& block : code.get_instructions_list())
+    optimize_block(block);
+  }
+
+std::vector<peephole_rule_statistics> get_peephole_statistics()
+  {
+  std::vector<peephole_rule_statistics> stats;
+  for (size_t r = 0; r < number_of_rules; ++r)
+    stats.push_back(peephole_rule_statistics{ rules[r].name, rule_hits[r].load() });
+  return stats;
+  }
+
+void reset_peephole_statistics()
+  {
+  for (size_t r = 0; r < number_of_rules; ++r)
+    rule_hits[r] = 0;
+  }
+
+ASM_END
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "namespace.h"
+#include "asm_api.h"
+#include "asmcode.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+ASM_BEGIN
+
+/*
+The peephole optimizer rewrites short windows of instructions in each instruction vector of an asmcode object into
+cheaper equivalents, e.g. a push of a register followed by a pop becomes a move, and a jump to the label that
+immediately follows it is removed. The rules only look at neighbouring instructions (comments are skipped), so they never
+match across a label, and they never change the flags or the value of a register or memory location that
+the remaining code can observe. The rules are applied until none of them matches anymore.
+
+Running the optimizer before assemble or vm_bytecode is optional: the code is correct either way.
+*/
+ASSEMBLER_API void peephole_optimize(asmcode& code);
+
+struct peephole_rule_statistics
+  {
+  std::string name;
+  uint64_t hits; // number of times the rule was applied since the last reset
+  };
+
+/*
+Returns the hit counter of each rule in the rule table. The counters are shared by all threads.
+*/
+ASSEMBLER_API std::vector<peephole_rule_statistics> get_peephole_statistics();
+
+ASSEMBLER_API void reset_peephole_statistics();
+
+ASM_END
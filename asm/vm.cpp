@@ -1,10 +1,14 @@
 #include "vm.h"
+#include "jump_relaxation.h"
 
 #include <iostream>
 #include <sstream>
 #include <cassert>
 #include <cmath>
 #include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
 
 ASM_BEGIN
 
@@ -449,28 +453,92 @@ namespace
     }
 
 
+  /*
+  Returns the size of a jump, with a dummy displacement if the jump goes to a label.
+  */
+  uint64_t jump_size(asmcode::instruction instr, uint8_t* buffer)
+    {
+    if (instr.operand1 == asmcode::EMPTY)
+      {
+      instr.operand1 = asmcode::NUMBER;
+      instr.operand1_mem = 0x11;
+      }
+    return fill_vm_bytecode(instr, buffer);
+    }
+
+  uint64_t instruction_size(asmcode::instruction instr, const first_pass_data& data, uint8_t* buffer)
+    {
+    switch (instr.oper)
+      {
+      case asmcode::CALLEXTERNAL:
+      case asmcode::CALL:
+      {
+      const uint64_t external_address = data.external_to_address[instr.text];
+      if (external_address != no_address)
+        {
+        asmcode::instruction load_address(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, external_address);
+        asmcode::instruction call(instr.oper, asmcode::RAX);
+        return fill_vm_bytecode(load_address, buffer) + fill_vm_bytecode(call, buffer);
+        }
+      if (instr.operand1 == asmcode::EMPTY)
+        {
+        instr.operand1 = asmcode::NUMBER;
+        instr.operand1_mem = 0x11111111;
+        }
+      return fill_vm_bytecode(instr, buffer);
+      }
+      case asmcode::JMP:
+      case asmcode::JE:
+      case asmcode::JL:
+      case asmcode::JLE:
+      case asmcode::JG:
+      case asmcode::JA:
+      case asmcode::JB:
+      case asmcode::JGE:
+      case asmcode::JNE:
+      case asmcode::JMPS:
+      case asmcode::JES:
+      case asmcode::JLS:
+      case asmcode::JLES:
+      case asmcode::JGS:
+      case asmcode::JAS:
+      case asmcode::JBS:
+      case asmcode::JGES:
+      case asmcode::JNES:
+        return jump_size(instr, buffer);
+      case asmcode::EXTERN:
+        return 0;
+      default:
+        return fill_vm_bytecode(instr, buffer);
+      }
+    }
+
   void first_pass(first_pass_data& data, asmcode& code, const std::map<std::string, uint64_t>& externals)
     {
     uint8_t buffer[255];
+    init_first_pass_data(data, code, externals);
+    std::vector<uint64_t> sizes;
+    relax_jumps(sizes, code, [&](const asmcode::instruction& instr) { return instruction_size(instr, data, buffer); }, false);
+    size_t instruction_index = 0;
     data.size = 0;
-    data.label_to_address.clear();
     for (auto it = code.get_instructions_list().begin(); it != code.get_instructions_list().end(); ++it)
       {
       std::vector<std::pair<size_t, int>> nops_to_add;
       for (size_t i = 0; i < it->size(); ++i)
         {
         auto instr = (*it)[i];
+        const uint64_t sz = sizes[instruction_index++];
         switch (instr.oper)
           {
           case asmcode::CALLEXTERNAL:
           {
-          auto it2 = externals.find(instr.text);
-          if (it2 != externals.end())
+          const uint64_t external_address = data.external_to_address[instr.text];
+          if (external_address != no_address)
             {
             instr.oper = asmcode::MOV;
             instr.operand1 = asmcode::RAX;
             instr.operand2 = asmcode::NUMBER;
-            instr.operand2_mem = it2->second;
+            instr.operand2_mem = external_address;
             data.size += fill_vm_bytecode(instr, buffer);
             instr.oper = asmcode::CALLEXTERNAL;
             instr.operand1 = asmcode::RAX;
@@ -487,13 +555,13 @@ namespace
           }
           case asmcode::CALL:
           {
-          auto it2 = externals.find(instr.text);
-          if (it2 != externals.end())
+          const uint64_t external_address = data.external_to_address[instr.text];
+          if (external_address != no_address)
             {
             instr.oper = asmcode::MOV;
             instr.operand1 = asmcode::RAX;
             instr.operand2 = asmcode::NUMBER;
-            instr.operand2_mem = it2->second;
+            instr.operand2_mem = external_address;
             data.size += fill_vm_bytecode(instr, buffer);
             instr.oper = asmcode::CALL;
             instr.operand1 = asmcode::RAX;
@@ -501,14 +569,7 @@ namespace
             data.size += fill_vm_bytecode(instr, buffer);
             }
           else
-            {
-            if (instr.operand1 == asmcode::EMPTY)
-              {
-              instr.operand1 = asmcode::NUMBER;
-              instr.operand1_mem = 0x11111111;
-              }
-            data.size += fill_vm_bytecode(instr, buffer);
-            }
+            data.size += sz;
           break;
           }
           case asmcode::JMP:
@@ -520,15 +581,6 @@ namespace
           case asmcode::JB:
           case asmcode::JGE:
           case asmcode::JNE:
-          {
-          if (instr.operand1 == asmcode::EMPTY)
-            {
-            instr.operand1 = asmcode::NUMBER;
-            instr.operand1_mem = 0x11111111;
-            }
-          data.size += fill_vm_bytecode(instr, buffer);
-          break;
-          }
           case asmcode::JMPS:
           case asmcode::JES:
           case asmcode::JLS:
@@ -538,12 +590,7 @@ namespace
           case asmcode::JBS:
           case asmcode::JGES:
           case asmcode::JNES:
-          {
-          instr.operand1 = asmcode::NUMBER;
-          instr.operand1_mem = 0x11;
-          data.size += fill_vm_bytecode(instr, buffer);
-          break;
-          }
+            data.size += sz; break;
           case asmcode::LABEL:
             data.label_to_address[instr.text] = data.size; break;
           case asmcode::LABEL_ALIGNED:
@@ -564,14 +611,12 @@ namespace
             data.label_to_address[instr.text] = data.size; break;
           case asmcode::EXTERN:
           {
-          auto it2 = externals.find(instr.text);
-          if (it2 == externals.end())
+          if (data.external_to_address[instr.text] == no_address)
             throw std::logic_error("error: external is not defined");
-          data.external_to_address[instr.text] = it2->second;
           break;
           }
           default:
-            data.size += fill_vm_bytecode(instr, buffer); break;
+            data.size += sz; break;
           }
         }
       size_t nops_offset = 0;
@@ -595,17 +640,17 @@ namespace
         {
         if (instr.operand1 == asmcode::LABELADDRESS)
           {
-          auto it2 = data.label_to_address.find(instr.text);
-          if (it2 == data.label_to_address.end())
+          const uint64_t address = data.label_to_address[instr.text];
+          if (address == no_address)
             throw std::logic_error("error: label is not defined");
-          instr.operand1_mem = address_start + it2->second;
+          instr.operand1_mem = address_start + address;
           }
         if (instr.operand2 == asmcode::LABELADDRESS)
           {
-          auto it2 = data.label_to_address.find(instr.text);
-          if (it2 == data.label_to_address.end())
+          const uint64_t address = data.label_to_address[instr.text];
+          if (address == no_address)
             throw std::logic_error("error: label is not defined");
-          instr.operand2_mem = address_start + it2->second;
+          instr.operand2_mem = address_start + address;
           }
         switch (instr.oper)
           {
@@ -613,17 +658,17 @@ namespace
           {
           if (instr.operand1 != asmcode::EMPTY)
             break;
-          auto it_label = data.label_to_address.find(instr.text);
-          auto it_external = data.external_to_address.find(instr.text);
-          if (it_external != data.external_to_address.end())
+          const uint64_t label_address = data.label_to_address[instr.text];
+          const uint64_t external_address = data.external_to_address[instr.text];
+          if (external_address != no_address)
             {
-            asmcode::instruction extra_instr(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, it_external->second);
+            asmcode::instruction extra_instr(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, external_address);
             func += fill_vm_bytecode(extra_instr, func);
             instr.operand1 = asmcode::RAX;
             }
-          else if (it_label != data.label_to_address.end())
+          else if (label_address != no_address)
             {
-            int64_t address = (int64_t)it_label->second;
+            int64_t address = (int64_t)label_address;
             int64_t current = (int64_t)(func - start);
             instr.operand1 = asmcode::NUMBER;
             instr.operand1_mem = (int64_t(address - current));
@@ -643,10 +688,9 @@ namespace
           {
           if (instr.operand1 != asmcode::EMPTY)
             break;
-          auto it2 = data.label_to_address.find(instr.text);
-          if (it2 == data.label_to_address.end())
+          if (data.label_to_address[instr.text] == no_address)
             throw std::logic_error("second_pass error: label does not exist");
-          int64_t address = (int64_t)it2->second;
+          int64_t address = (int64_t)data.label_to_address[instr.text];
           int64_t current = (int64_t)(func - start);
           instr.operand1 = asmcode::NUMBER;
           instr.operand1_mem = (int64_t(address - current));
@@ -656,10 +700,9 @@ namespace
           {
           if (instr.operand1 != asmcode::EMPTY)
             break;
-          auto it2 = data.label_to_address.find(instr.text);
-          if (it2 == data.label_to_address.end())
+          if (data.label_to_address[instr.text] == no_address)
             throw std::logic_error("second_pass error: label does not exist");
-          int64_t address = (int64_t)it2->second;
+          int64_t address = (int64_t)data.label_to_address[instr.text];
           int64_t current = (int64_t)(func - start);
           instr.operand1 = asmcode::NUMBER;
           instr.operand1_mem = (int64_t(address - current));
@@ -677,10 +720,9 @@ namespace
           {
           if (instr.operand1 != asmcode::EMPTY)
             break;
-          auto it2 = data.label_to_address.find(instr.text);
-          if (it2 == data.label_to_address.end())
+          if (data.label_to_address[instr.text] == no_address)
             throw std::logic_error("second_pass error: label does not exist");
-          int64_t address = (int64_t)it2->second;
+          int64_t address = (int64_t)data.label_to_address[instr.text];
           int64_t current = (int64_t)(func - start);
           instr.operand1 = asmcode::NUMBER;
           instr.operand1_mem = (int64_t(address - current));
@@ -701,6 +743,115 @@ namespace
     }
   }
 
+namespace
+  {
+
+  /*
+  An instruction of the bytecode in decoded form, so that run_bytecode does not need to call disassemble_bytecode
+  each time the instruction is executed.
+  handler is the address of the code in run_bytecode that executes op (only used with threaded dispatch).
+  */
+  struct decoded_instruction
+    {
+    const void* handler;
+    const uint8_t* address;
+    uint64_t operand1_mem;
+    uint64_t operand2_mem;
+    uint8_t op;
+    uint8_t operand1;
+    uint8_t operand2;
+    uint8_t size;
+    };
+
+  const uint32_t no_instruction = 0xffffffff;
+
+  /*
+  The decoded version of a block of bytecode generated by vm_bytecode.
+  offset_to_index maps an offset in the bytecode to the index of the instruction that starts at that offset,
+  so that jumps and calls can be resolved without decoding.
+  Blocks are decoded lazily, the first time run_bytecode enters them.
+  */
+  struct decoded_bytecode
+    {
+    const uint8_t* begin;
+    uint64_t size;
+    bool decoded;
+    std::vector<decoded_instruction> instructions;
+    std::vector<uint32_t> offset_to_index;
+    };
+
+  std::mutex decoded_bytecode_mutex;
+  std::map<const uint8_t*, std::unique_ptr<decoded_bytecode>> decoded_bytecode_registry;
+
+  void register_bytecode(const uint8_t* bytecode, uint64_t size)
+    {
+    std::unique_ptr<decoded_bytecode> block(new decoded_bytecode());
+    block->begin = bytecode;
+    block->size = size;
+    block->decoded = false;
+    std::lock_guard<std::mutex> lock(decoded_bytecode_mutex);
+    decoded_bytecode_registry[bytecode] = std::move(block);
+    }
+
+  void unregister_bytecode(const uint8_t* bytecode)
+    {
+    std::lock_guard<std::mutex> lock(decoded_bytecode_mutex);
+    decoded_bytecode_registry.erase(bytecode);
+    }
+
+  void decode_instruction(decoded_instruction& instr, const uint8_t* bytecode, const void* const* handlers)
+    {
+    asmcode::operation op;
+    asmcode::operand operand1;
+    asmcode::operand operand2;
+    instr.size = (uint8_t)disassemble_bytecode(op, operand1, operand2, instr.operand1_mem, instr.operand2_mem, bytecode);
+    instr.op = (uint8_t)op;
+    instr.operand1 = (uint8_t)operand1;
+    instr.operand2 = (uint8_t)operand2;
+    instr.address = bytecode;
+    instr.handler = handlers ? handlers[instr.op] : nullptr;
+    }
+
+  void decode_bytecode(decoded_bytecode& block, const void* const* handlers)
+    {
+    block.instructions.clear();
+    block.offset_to_index.assign(block.size, no_instruction);
+    uint64_t offset = 0;
+    while (offset < block.size)
+      {
+      if (block.begin[offset] > (uint8_t)asmcode::XORPD) // not a valid instruction, stop decoding here
+        break;
+      decoded_instruction instr;
+      decode_instruction(instr, block.begin + offset, handlers);
+      if (offset + instr.size > block.size)
+        break;
+      block.offset_to_index[offset] = (uint32_t)block.instructions.size();
+      block.instructions.push_back(instr);
+      offset += instr.size;
+      }
+    block.decoded = true;
+    }
+
+  /*
+  Returns the decoded block that contains address, or nullptr if address is not part of bytecode generated by vm_bytecode.
+  */
+  const decoded_bytecode* find_decoded_bytecode(const uint8_t* address, const void* const* handlers)
+    {
+    std::lock_guard<std::mutex> lock(decoded_bytecode_mutex);
+    auto it = decoded_bytecode_registry.upper_bound(address);
+    if (it == decoded_bytecode_registry.begin())
+      return nullptr;
+    --it;
+    decoded_bytecode* block = it->second.get();
+    if (address >= block->begin + block->size)
+      return nullptr;
+    if (!block->decoded)
+      decode_bytecode(*block, handlers);
+    return block;
+    }
+
+  }
+
 void* vm_bytecode(uint64_t& size, first_pass_data& d, asmcode& code, const std::map<std::string, uint64_t>& externals)
   {
   d.external_to_address.clear();
@@ -723,6 +874,8 @@ void* vm_bytecode(uint64_t& size, first_pass_data& d, asmcode& code, const std::
 
   size = d.size + d.data_size;
 
+  register_bytecode(compiled_func, d.size);
+
   return (void*)compiled_func;
   }
 
@@ -747,6 +900,7 @@ void* vm_bytecode(uint64_t& size, asmcode& code)
 void free_bytecode(void* f, uint64_t size)
   {
   (void*)size;
+  unregister_bytecode((const uint8_t*)f);
   delete[] (uint8_t*)f;
   }
 
@@ -1489,7 +1643,8 @@ namespace
     i.operand2 = operand2;
     i.operand1_mem = operand1_mem;
     i.operand2_mem = operand2_mem;
-    i.stream(std::cout);
+    asmcode no_texts;
+    i.stream(std::cout, no_texts);
     }
 
   std::vector<asmcode::operand> get_windows_calling_registers()
@@ -2521,7 +2676,107 @@ namespace
       }
     }
 
+
+  const uint32_t nr_of_recent_blocks = 8;
+
+  /*
+  Keeps track of the decoded block that run_bytecode is currently executing, and of the blocks it executed last.
+  Calls and returns between blocks mostly go back and forth between a few blocks, so they are found in recent_blocks
+  without taking the lock of the registry.
+  */
+  struct bytecode_cursor
+    {
+    bytecode_cursor(const void* const* h) : block(nullptr), end(nullptr), handlers(h), next_recent_block(0)
+      {
+      for (uint32_t i = 0; i < nr_of_recent_blocks; ++i)
+        recent_blocks[i] = nullptr;
+      }
+
+    const decoded_bytecode* block;
+    const decoded_instruction* end;
+    const void* const* handlers;
+    decoded_instruction scratch;
+    const decoded_bytecode* recent_blocks[nr_of_recent_blocks];
+    uint32_t next_recent_block;
+    };
+
+  bool block_contains(const decoded_bytecode* block, const uint8_t* address)
+    {
+    return block && address >= block->begin && address < block->begin + block->size;
+    }
+
+  const decoded_bytecode* find_block(bytecode_cursor& cursor, const uint8_t* address)
+    {
+    for (uint32_t i = 0; i < nr_of_recent_blocks; ++i)
+      {
+      if (block_contains(cursor.recent_blocks[i], address))
+        return cursor.recent_blocks[i];
+      }
+    const decoded_bytecode* block = find_decoded_bytecode(address, cursor.handlers);
+    if (block)
+      {
+      cursor.recent_blocks[cursor.next_recent_block] = block;
+      cursor.next_recent_block = (cursor.next_recent_block + 1) % nr_of_recent_blocks;
+      }
+    return block;
+    }
+
+  /*
+  Returns the decoded instruction at address. Addresses in the current block are resolved via its offset_to_index table,
+  other addresses via the recently executed blocks or the registry of decoded bytecode. Bytecode that was not generated
+  by vm_bytecode is decoded one instruction at a time.
+  */
+  const decoded_instruction* find_instruction(bytecode_cursor& cursor, const uint8_t* address)
+    {
+    if (!block_contains(cursor.block, address))
+      cursor.block = find_block(cursor, address);
+    if (cursor.block)
+      {
+      uint32_t index = cursor.block->offset_to_index[address - cursor.block->begin];
+      if (index != no_instruction)
+        {
+        cursor.end = cursor.block->instructions.data() + cursor.block->instructions.size();
+        return cursor.block->instructions.data() + index;
+        }
+      }
+    decode_instruction(cursor.scratch, address, cursor.handlers);
+    cursor.end = &cursor.scratch + 1;
+    return &cursor.scratch;
+    }
+
   } // namespace
+
+/*
+The instructions of run_bytecode are fetched from the decoded form of the bytecode (see decoded_bytecode).
+With gcc and clang each instruction handler jumps directly to the handler of the next instruction (threaded dispatch),
+other compilers dispatch via the switch statement.
+*/
+#if defined(__GNUC__)
+#define SKIWI_VM_THREADED_DISPATCH
+#endif
+
+#define VM_FETCH() \
+  op = (asmcode::operation)ip->op; \
+  operand1 = (asmcode::operand)ip->operand1; \
+  operand2 = (asmcode::operand)ip->operand2; \
+  operand1_mem = ip->operand1_mem; \
+  operand2_mem = ip->operand2_mem; \
+  sz = ip->size; \
+  bytecode_ptr = ip->address
+
+#define VM_ADVANCE() \
+  ip = (sz != 0 && ip + 1 != cursor.end) ? ip + 1 : find_instruction(cursor, bytecode_ptr + sz)
+
+#ifdef SKIWI_VM_THREADED_DISPATCH
+#define VM_CASE(oper) case asmcode::oper: vm_label_##oper:
+#define VM_DEFAULT default: vm_label_default:
+#define VM_NEXT { VM_ADVANCE(); VM_FETCH(); goto *ip->handler; }
+#else
+#define VM_CASE(oper) case asmcode::oper:
+#define VM_DEFAULT default:
+#define VM_NEXT break
+#endif
+
 void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const std::vector<external_function>& externals)
   {
   (void*)size;
@@ -2529,37 +2784,143 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
   regs.rsp -= 8;
   *((uint64_t*)regs.rsp) = 0xffffffffffffffff; // this address means the function call representing this bytecode
 
-  const uint8_t* bytecode_ptr = bytecode;
+#ifdef SKIWI_VM_THREADED_DISPATCH
+  static const void* const dispatch_table[] = {
+    &&vm_label_ADD,
+    &&vm_label_ADDSD,
+    &&vm_label_AND,
+    &&vm_label_CALL,
+    &&vm_label_CALLEXTERNAL,
+    &&vm_label_CMP,
+    &&vm_label_CMPEQPD,
+    &&vm_label_CMPLTPD,
+    &&vm_label_CMPLEPD,
+    &&vm_label_default,
+    &&vm_label_CQO,
+    &&vm_label_CVTSI2SD,
+    &&vm_label_CVTTSD2SI,
+    &&vm_label_DEC,
+    &&vm_label_DIV,
+    &&vm_label_DIVSD,
+    &&vm_label_default,
+    &&vm_label_F2XM1,
+    &&vm_label_FADD,
+    &&vm_label_FADDP,
+    &&vm_label_FILD,
+    &&vm_label_FISTPQ,
+    &&vm_label_FLD,
+    &&vm_label_FLD1,
+    &&vm_label_FLDLN2,
+    &&vm_label_FLDPI,
+    &&vm_label_FMUL,
+    &&vm_label_FSIN,
+    &&vm_label_FCOS,
+    &&vm_label_FPATAN,
+    &&vm_label_FPTAN,
+    &&vm_label_FRNDINT,
+    &&vm_label_FSCALE,
+    &&vm_label_FSQRT,
+    &&vm_label_FSTP,
+    &&vm_label_FSUB,
+    &&vm_label_FSUBP,
+    &&vm_label_FSUBRP,
+    &&vm_label_FXCH,
+    &&vm_label_FYL2X,
+    &&vm_label_default,
+    &&vm_label_IDIV,
+    &&vm_label_IMUL,
+    &&vm_label_INC,
+    &&vm_label_JMP,
+    &&vm_label_JA,
+    &&vm_label_JB,
+    &&vm_label_JE,
+    &&vm_label_JL,
+    &&vm_label_JLE,
+    &&vm_label_JG,
+    &&vm_label_JGE,
+    &&vm_label_JNE,
+    &&vm_label_JMPS,
+    &&vm_label_JAS,
+    &&vm_label_JBS,
+    &&vm_label_JES,
+    &&vm_label_JLS,
+    &&vm_label_JLES,
+    &&vm_label_JGS,
+    &&vm_label_JGES,
+    &&vm_label_JNES,
+    &&vm_label_default,
+    &&vm_label_default,
+    &&vm_label_MOV,
+    &&vm_label_MOVQ,
+    &&vm_label_MOVMSKPD,
+    &&vm_label_MOVSD,
+    &&vm_label_MOVZX,
+    &&vm_label_MUL,
+    &&vm_label_MULSD,
+    &&vm_label_NEG,
+    &&vm_label_NOP,
+    &&vm_label_OR,
+    &&vm_label_POP,
+    &&vm_label_PUSH,
+    &&vm_label_RET,
+    &&vm_label_SAL,
+    &&vm_label_SAR,
+    &&vm_label_SETE,
+    &&vm_label_SETNE,
+    &&vm_label_SETL,
+    &&vm_label_SETG,
+    &&vm_label_SETLE,
+    &&vm_label_SETGE,
+    &&vm_label_SHL,
+    &&vm_label_SHR,
+    &&vm_label_SQRTPD,
+    &&vm_label_SUB,
+    &&vm_label_SUBSD,
+    &&vm_label_TEST,
+    &&vm_label_UCOMISD,
+    &&vm_label_XOR,
+    &&vm_label_XORPD
+    };
+  static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) == (size_t)asmcode::XORPD + 1, "dispatch_table should contain all operations");
+  bytecode_cursor cursor(dispatch_table);
+#else
+  bytecode_cursor cursor(nullptr);
+#endif
+
+  const decoded_instruction* ip = find_instruction(cursor, bytecode);
+
+  asmcode::operation op;
+  asmcode::operand operand1;
+  asmcode::operand operand2;
+  uint64_t operand1_mem;
+  uint64_t operand2_mem;
+  uint64_t sz;
+  const uint8_t* bytecode_ptr;
 
   for (;;)
     {
-    asmcode::operation op;
-    asmcode::operand operand1;
-    asmcode::operand operand2;
-    uint64_t operand1_mem;
-    uint64_t operand2_mem;
-    uint64_t sz = disassemble_bytecode(op, operand1, operand2, operand1_mem, operand2_mem, bytecode_ptr);
+    VM_FETCH();
 
     //print(op, operand1, operand2, operand1_mem, operand2_mem);
 
     switch (op)
       {
-      case asmcode::ADD:
+      VM_CASE(ADD)
       {
       execute_operation<AddOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::ADDSD:
+      VM_CASE(ADDSD)
       {
       execute_double_operation<AddsdOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::AND:
+      VM_CASE(AND)
       {
       execute_operation<AndOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::CALLEXTERNAL:
+      VM_CASE(CALLEXTERNAL)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       uint64_t address = *oprnd1;
@@ -2567,9 +2928,9 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
       if (it == externals.end())
         throw std::logic_error("Call to unknown external function\n");
       call_external(*it, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::CALL:
+      VM_CASE(CALL)
       {
       if (operand1 == asmcode::NUMBER) // local call
         {
@@ -2588,65 +2949,65 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         sz = 0;
         //throw std::logic_error("external call not implemented");
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::CMP:
+      VM_CASE(CMP)
       {
       compare_operation(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::CQO:
+      VM_CASE(CQO)
       {
       if (regs.rax & 0x8000000000000000)
         regs.rdx = 0xffffffffffffffff;
       else
         regs.rdx = 0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::CMPEQPD:
+      VM_CASE(CMPEQPD)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       uint64_t* oprnd2 = get_address_64bit(operand2, operand2_mem, regs);
       double v1 = *reinterpret_cast<double*>(oprnd1);
       double v2 = *reinterpret_cast<double*>(oprnd2);
       *oprnd1 = (v1 == v2) ? 0xffffffffffffffff : 0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::CMPLTPD:
+      VM_CASE(CMPLTPD)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       uint64_t* oprnd2 = get_address_64bit(operand2, operand2_mem, regs);
       double v1 = *reinterpret_cast<double*>(oprnd1);
       double v2 = *reinterpret_cast<double*>(oprnd2);
       *oprnd1 = (v1 < v2) ? 0xffffffffffffffff : 0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::CMPLEPD:
+      VM_CASE(CMPLEPD)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       uint64_t* oprnd2 = get_address_64bit(operand2, operand2_mem, regs);
       double v1 = *reinterpret_cast<double*>(oprnd1);
       double v2 = *reinterpret_cast<double*>(oprnd2);
       *oprnd1 = (v1 <= v2) ? 0xffffffffffffffff : 0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::CVTSI2SD:
+      VM_CASE(CVTSI2SD)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       uint64_t* oprnd2 = get_address_64bit(operand2, operand2_mem, regs);
       double v = (double)((int64_t)*oprnd2);
       *reinterpret_cast<double*>(oprnd1) = v;
-      break;
+      VM_NEXT;
       }
-      case asmcode::CVTTSD2SI:
+      VM_CASE(CVTTSD2SI)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       uint64_t* oprnd2 = get_address_64bit(operand2, operand2_mem, regs);
       double v = *reinterpret_cast<double*>(oprnd2);
       *oprnd1 = (int64_t)v;
-      break;
+      VM_NEXT;
       }
-      case asmcode::DEC:
+      VM_CASE(DEC)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       if (oprnd1)
@@ -2669,9 +3030,9 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
             regs.eflags |= zero_flag;
           }
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::DIV:
+      VM_CASE(DIV)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       uint64_t divider = *oprnd1;
@@ -2679,20 +3040,20 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
       uint64_t remainder = regs.rax % divider;
       regs.rax = result;
       regs.rdx = remainder;
-      break;
+      VM_NEXT;
       }
-      case asmcode::DIVSD:
+      VM_CASE(DIVSD)
       {
       execute_double_operation<DivsdOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::F2XM1:
+      VM_CASE(F2XM1)
       {
       double v = std::pow(2.0, *regs.fpstackptr) - 1.0;
       *regs.fpstackptr = v;
-      break;
+      VM_NEXT;
       }
-      case asmcode::FADD: 
+      VM_CASE(FADD) 
       {
       if (operand2 == asmcode::EMPTY)
         {
@@ -2706,55 +3067,55 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         double* oprnd2 = (double*)get_address_64bit(operand2, operand2_mem, regs);
         *oprnd1 += *oprnd2;
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::FADDP:
+      VM_CASE(FADDP)
       {
       double tmp = *(regs.fpstackptr);
       regs.fpstackptr += 1;
       *regs.fpstackptr += tmp;
-      break;
+      VM_NEXT;
       }
-      case asmcode::FILD:
+      VM_CASE(FILD)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       regs.fpstackptr -= 1;
       *regs.fpstackptr = (double)((int64_t)(*oprnd1));
-      break;
+      VM_NEXT;
       }
-      case asmcode::FISTPQ:
+      VM_CASE(FISTPQ)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       *oprnd1 = (int64_t)(*regs.fpstackptr);
       regs.fpstackptr += 1;
-      break;
+      VM_NEXT;
       }
-      case asmcode::FLD:
+      VM_CASE(FLD)
       {      
       double* oprnd1 = (double*)get_address_64bit(operand1, operand1_mem, regs);      
       regs.fpstackptr -= 1;
       *regs.fpstackptr = *oprnd1;
-      break;
+      VM_NEXT;
       }
-      case asmcode::FLD1:
+      VM_CASE(FLD1)
       {
       regs.fpstackptr -= 1;
       *regs.fpstackptr = 1.0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::FLDLN2:
+      VM_CASE(FLDLN2)
       {
       regs.fpstackptr -= 1;
       *regs.fpstackptr = std::log(2.0);
-      break;
+      VM_NEXT;
       }
-      case asmcode::FLDPI:
+      VM_CASE(FLDPI)
       {
       regs.fpstackptr -= 1;
       *regs.fpstackptr = 3.141592653589793238462643383;
-      break;
+      VM_NEXT;
       }
-      case asmcode::FMUL:
+      VM_CASE(FMUL)
       {
       if (operand2 == asmcode::EMPTY)
         {
@@ -2768,57 +3129,57 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         double* oprnd2 = (double*)get_address_64bit(operand2, operand2_mem, regs);
         *oprnd1 *= *oprnd2;
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::FSIN:
+      VM_CASE(FSIN)
       {
       *regs.fpstackptr = std::sin(*regs.fpstackptr);
-      break;
+      VM_NEXT;
       }
-      case asmcode::FCOS:
+      VM_CASE(FCOS)
       {
       *regs.fpstackptr = std::cos(*regs.fpstackptr);
-      break;
+      VM_NEXT;
       }
-      case asmcode::FPATAN:
+      VM_CASE(FPATAN)
       {
       double y = *(regs.fpstackptr + 1);
       double x = *(regs.fpstackptr);
       regs.fpstackptr += 1;
       *regs.fpstackptr = std::atan2(y,x);
-      break;
+      VM_NEXT;
       }
-      case asmcode::FPTAN:
+      VM_CASE(FPTAN)
       {
       *regs.fpstackptr = std::tan(*regs.fpstackptr);
       regs.fpstackptr -= 1;
       *regs.fpstackptr = 1.0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::FRNDINT:
+      VM_CASE(FRNDINT)
       {
       *regs.fpstackptr = std::round(*regs.fpstackptr);
-      break;
+      VM_NEXT;
       }
-      case asmcode::FSCALE:
+      VM_CASE(FSCALE)
       {
       double s = std::trunc(*(regs.fpstackptr + 1));
       *regs.fpstackptr *= std::pow(2.0, s);
-      break;
+      VM_NEXT;
       }
-      case asmcode::FSQRT:
+      VM_CASE(FSQRT)
       {
       *regs.fpstackptr = std::sqrt(*regs.fpstackptr);
-      break;
+      VM_NEXT;
       }
-      case asmcode::FSTP:
+      VM_CASE(FSTP)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       *oprnd1 = *reinterpret_cast<uint64_t*>(regs.fpstackptr);
       regs.fpstackptr += 1;
-      break;
+      VM_NEXT;
       }
-      case asmcode::FSUB:
+      VM_CASE(FSUB)
       {
       if (operand2 == asmcode::EMPTY)
         {
@@ -2832,23 +3193,23 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         double* oprnd2 = (double*)get_address_64bit(operand2, operand2_mem, regs);
         *oprnd1 -= *oprnd2;
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::FSUBP:
+      VM_CASE(FSUBP)
       {
       double tmp = *(regs.fpstackptr);
       regs.fpstackptr += 1;
       *regs.fpstackptr -= tmp;
-      break;
+      VM_NEXT;
       }      
-      case asmcode::FSUBRP:
+      VM_CASE(FSUBRP)
       {
       double tmp = *(regs.fpstackptr);
       regs.fpstackptr += 1;
       *regs.fpstackptr = tmp - *regs.fpstackptr;
-      break;
+      VM_NEXT;
       }
-      case asmcode::FXCH:
+      VM_CASE(FXCH)
       {
       double* oprnd1 = (double*)get_address_64bit(operand1, operand1_mem, regs);
       if (oprnd1)
@@ -2863,16 +3224,16 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         *(regs.fpstackptr) = *(regs.fpstackptr + 1);
         *(regs.fpstackptr + 1) = tmp;
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::FYL2X:
+      VM_CASE(FYL2X)
       {
       double tmp = std::log2(*(regs.fpstackptr));
       regs.fpstackptr += 1;
       *regs.fpstackptr *= tmp;
-      break;
+      VM_NEXT;
       }
-      case asmcode::IDIV:
+      VM_CASE(IDIV)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       int64_t divider = (int64_t)*oprnd1;
@@ -2880,9 +3241,9 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
       int64_t remainder = (int64_t)regs.rax % divider;
       regs.rax = result;
       regs.rdx = remainder;
-      break;
+      VM_NEXT;
       }
-      case asmcode::IMUL:
+      VM_CASE(IMUL)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       if (oprnd1)
@@ -2899,9 +3260,9 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         regs.rax &= 0xffffffffffffff00;
         regs.rax |= rax;
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::INC:
+      VM_CASE(INC)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       if (oprnd1)
@@ -2924,10 +3285,10 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
             regs.eflags |= zero_flag;
           }
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::JA:
-      case asmcode::JAS:
+      VM_CASE(JA)
+      VM_CASE(JAS)
       {
       if (((regs.eflags & zero_flag) | (regs.eflags & carry_flag)) == 0)
         {
@@ -2942,10 +3303,10 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
           throw std::logic_error("ja(s) not implemented");
           }
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::JB:
-      case asmcode::JBS:
+      VM_CASE(JB)
+      VM_CASE(JBS)
       {
       if (regs.eflags & carry_flag)
         {
@@ -2960,10 +3321,10 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
           throw std::logic_error("jb(s) not implemented");
           }
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::JE:
-      case asmcode::JES:
+      VM_CASE(JE)
+      VM_CASE(JES)
       {
       if (regs.eflags & zero_flag)
         {
@@ -2978,10 +3339,10 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
           throw std::logic_error("je(s) not implemented");
           }
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::JG:
-      case asmcode::JGS:
+      VM_CASE(JG)
+      VM_CASE(JGS)
       {
       if ((((regs.eflags & sign_flag) ^ (regs.eflags & overflow_flag)) | (regs.eflags & zero_flag)) == 0)
         {
@@ -2996,10 +3357,10 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
           throw std::logic_error("jg(s) not implemented");
           }
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::JGE:
-      case asmcode::JGES:
+      VM_CASE(JGE)
+      VM_CASE(JGES)
       {
       if (((regs.eflags & sign_flag) ^ (regs.eflags & overflow_flag)) == 0)
         {
@@ -3014,10 +3375,10 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
           throw std::logic_error("jge(s) not implemented");
           }
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::JL:
-      case asmcode::JLS:
+      VM_CASE(JL)
+      VM_CASE(JLS)
       {
       if (((regs.eflags & sign_flag) ^ (regs.eflags & overflow_flag)))
         {
@@ -3032,10 +3393,10 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
           throw std::logic_error("jl(s) not implemented");
           }
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::JLE:
-      case asmcode::JLES:
+      VM_CASE(JLE)
+      VM_CASE(JLES)
       {
       if ((((regs.eflags & sign_flag) ^ (regs.eflags & overflow_flag)) | (regs.eflags & zero_flag)))
         {
@@ -3050,10 +3411,10 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
           throw std::logic_error("jle(s) not implemented");
           }
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::JNE:
-      case asmcode::JNES:
+      VM_CASE(JNE)
+      VM_CASE(JNES)
       {
       if ((regs.eflags & zero_flag) == 0)
         {
@@ -3068,9 +3429,9 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
           throw std::logic_error("jne(s) not implemented");
           }
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::JMPS:
+      VM_CASE(JMPS)
       {
       if (operand1 == asmcode::NUMBER)
         {
@@ -3082,9 +3443,9 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         {
         throw std::logic_error("jmps not implemented");
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::JMP:
+      VM_CASE(JMP)
       {
       if (operand1 == asmcode::NUMBER)
         {
@@ -3098,30 +3459,30 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         bytecode_ptr = (const uint8_t*)(*oprnd1);
         sz = 0;
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::MOVMSKPD:
+      VM_CASE(MOVMSKPD)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       uint64_t* oprnd2 = get_address_64bit(operand2, operand2_mem, regs);
       *oprnd1 = (*oprnd2) ? 1 : 0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::MOVSD:
-      case asmcode::MOVQ:
-      case asmcode::MOV:
+      VM_CASE(MOVSD)
+      VM_CASE(MOVQ)
+      VM_CASE(MOV)
       {
       execute_operation<MovOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::MOVZX:
+      VM_CASE(MOVZX)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       uint8_t* oprnd2 = get_address_8bit(operand2, operand2_mem, regs);
       *oprnd1 = *oprnd2;
-      break;
+      VM_NEXT;
       }
-      case asmcode::MUL:
+      VM_CASE(MUL)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       if (oprnd1)
@@ -3136,14 +3497,14 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         regs.rax &= 0xffffffffffffff00;
         regs.rax |= rax;
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::MULSD:
+      VM_CASE(MULSD)
       {
       execute_double_operation<MulsdOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::NEG:
+      VM_CASE(NEG)
       {
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       if (oprnd1)
@@ -3157,23 +3518,23 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         int8_t val = (int8_t)(*oprnd1_8);
         *oprnd1_8 = -val;
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::NOP: break;
-      case asmcode::OR:
+      VM_CASE(NOP) VM_NEXT;
+      VM_CASE(OR)
       {
       execute_operation<OrOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::POP:
+      VM_CASE(POP)
       {
       uint64_t address = *((uint64_t*)regs.rsp);
       regs.rsp += 8;
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
       *oprnd1 = address;
-      break;
+      VM_NEXT;
       }
-      case asmcode::PUSH:
+      VM_CASE(PUSH)
       {
       regs.rsp -= 8;
       uint64_t* oprnd1 = get_address_64bit(operand1, operand1_mem, regs);
@@ -3186,9 +3547,9 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         uint8_t* oprnd1_8 = get_address_8bit(operand1, operand1_mem, regs);
         *((uint64_t*)regs.rsp) = (int8_t)(*oprnd1_8);
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::RET:
+      VM_CASE(RET)
       {
       uint64_t address = *((uint64_t*)regs.rsp);
       regs.rsp += 8; // to check, might need to pop more
@@ -3196,98 +3557,98 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         return;
       bytecode_ptr = (const uint8_t*)address;
       sz = 0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::SAL:
+      VM_CASE(SAL)
       {
       execute_operation<ShlOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::SAR:
+      VM_CASE(SAR)
       {
       execute_operation<SarOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::SETE:
+      VM_CASE(SETE)
       {
       uint8_t* oprnd1 = get_address_8bit(operand1, operand1_mem, regs);
       if (regs.eflags & zero_flag)
         *oprnd1 = 1;
       else
         *oprnd1 = 0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::SETNE:
+      VM_CASE(SETNE)
       {
       uint8_t* oprnd1 = get_address_8bit(operand1, operand1_mem, regs);
       if (regs.eflags & zero_flag)
         *oprnd1 = 0;
       else
         *oprnd1 = 1;
-      break;
+      VM_NEXT;
       }
-      case asmcode::SETL:
+      VM_CASE(SETL)
       {
       uint8_t* oprnd1 = get_address_8bit(operand1, operand1_mem, regs);
       if (((regs.eflags & sign_flag) ^ (regs.eflags & overflow_flag)))
         *oprnd1 = 1;
       else
         *oprnd1 = 0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::SETLE:
+      VM_CASE(SETLE)
       {
       uint8_t* oprnd1 = get_address_8bit(operand1, operand1_mem, regs);
       if ((((regs.eflags & sign_flag) ^ (regs.eflags & overflow_flag)) | (regs.eflags & zero_flag)) == 0)
         *oprnd1 = 0;
       else
         *oprnd1 = 1;
-      break;
+      VM_NEXT;
       }
-      case asmcode::SETG:
+      VM_CASE(SETG)
       {
       uint8_t* oprnd1 = get_address_8bit(operand1, operand1_mem, regs);
       if ((((regs.eflags & sign_flag) ^ (regs.eflags & overflow_flag)) | (regs.eflags & zero_flag)) == 0)
         *oprnd1 = 1;
       else
         *oprnd1 = 0;
-      break;
+      VM_NEXT;
       }
-      case asmcode::SETGE:
+      VM_CASE(SETGE)
       {
       uint8_t* oprnd1 = get_address_8bit(operand1, operand1_mem, regs);
       if (((regs.eflags & sign_flag) ^ (regs.eflags & overflow_flag)))
         *oprnd1 = 0;
       else
         *oprnd1 = 1;
-      break;
+      VM_NEXT;
       }
-      case asmcode::SHL:
+      VM_CASE(SHL)
       {
       execute_operation<ShlOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::SHR:
+      VM_CASE(SHR)
       {
       execute_operation<ShrOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::SQRTPD:
+      VM_CASE(SQRTPD)
       {
       execute_double_operation<SqrtpdOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::SUB:
+      VM_CASE(SUB)
       {
       execute_operation<SubOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::SUBSD:
+      VM_CASE(SUBSD)
       {
       execute_double_operation<SubsdOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::TEST:
+      VM_CASE(TEST)
       {
       uint64_t tmp = execute_operation_const<AndOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
       if (tmp)
@@ -3303,9 +3664,9 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         regs.eflags |= zero_flag;
         regs.eflags &= ~sign_flag;
         }
-      break;
+      VM_NEXT;
       }
-      case asmcode::UCOMISD:
+      VM_CASE(UCOMISD)
       {
       double* oprnd1 = (double*)get_address_64bit(operand1, operand1_mem, regs);
       double* oprnd2 = (double*)get_address_64bit(operand2, operand2_mem, regs);
@@ -3326,27 +3687,33 @@ void run_bytecode(const uint8_t* bytecode, uint64_t size, registers& regs, const
         regs.eflags = zero_flag;
         }
 
-      break;
+      VM_NEXT;
       }
-      case asmcode::XOR:
+      VM_CASE(XOR)
       {
       execute_operation<XorOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      case asmcode::XORPD:
+      VM_CASE(XORPD)
       {
       execute_double_operation<XorpdOper>(operand1, operand2, operand1_mem, operand2_mem, regs);
-      break;
+      VM_NEXT;
       }
-      default:
+      VM_DEFAULT
       {
       std::stringstream str;
       str << asmcode::operation_to_string(op) << " is not implemented yet!";
       throw std::logic_error(str.str());
       }
       }
-    bytecode_ptr += sz;
+    VM_ADVANCE();
     }
   }
 
+#undef VM_FETCH
+#undef VM_ADVANCE
+#undef VM_CASE
+#undef VM_DEFAULT
+#undef VM_NEXT
+
 ASM_END
@@ -0,0 +1 @@
+define
\ No newline at end of file
@@ -0,0 +1 @@
+lambda
\ No newline at end of file
@@ -0,0 +1 @@
+setq
\ No newline at end of file
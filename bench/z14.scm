@@ -0,0 +1 @@
+(call/cc (lambda (x) x))
\ No newline at end of file
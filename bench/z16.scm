@@ -0,0 +1 @@
+(zero? n)
\ No newline at end of file
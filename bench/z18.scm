@@ -0,0 +1 @@
+((lambda () (cons 'lambda 'cons)))
\ No newline at end of file
@@ -0,0 +1 @@
+#t
\ No newline at end of file
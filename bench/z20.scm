@@ -0,0 +1 @@
+even?
\ No newline at end of file
@@ -0,0 +1 @@
+odd?
\ No newline at end of file
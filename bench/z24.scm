@@ -0,0 +1 @@
+-infinity
\ No newline at end of file
@@ -0,0 +1 @@
+define-syntax
\ No newline at end of file
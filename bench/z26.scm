@@ -0,0 +1 @@
+syntax-rules
\ No newline at end of file
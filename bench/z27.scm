@@ -0,0 +1 @@
+defmacro
\ No newline at end of file
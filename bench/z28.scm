@@ -0,0 +1 @@
+extend-syntax
\ No newline at end of file
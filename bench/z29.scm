@@ -0,0 +1 @@
+define-macro!
\ No newline at end of file
@@ -0,0 +1 @@
+42
\ No newline at end of file
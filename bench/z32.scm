@@ -0,0 +1,4 @@
+(define $\equiv$
+  (lambda (a$_1$ a$_2$)
+    ($\land$ ($\sqsubseteq$ a$_1$ a$_2$)
+	     ($\sqsupseteq$ a$_1$ a$_2$))))
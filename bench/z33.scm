@@ -0,0 +1 @@
+(load "config.scm")
@@ -0,0 +1 @@
+(set! SLaTeX.*texinputs* "...")
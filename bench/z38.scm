@@ -0,0 +1 @@
+(load "callsla.scm")
@@ -0,0 +1 @@
+(call-slatex <tex-file>)
@@ -0,0 +1 @@
+<tex-file>
\ No newline at end of file
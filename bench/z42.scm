@@ -0,0 +1 @@
+system
\ No newline at end of file
@@ -0,0 +1 @@
+SLaTeX.*texinputs*
\ No newline at end of file
@@ -0,0 +1 @@
+SLaTeX.process-main-tex-file
\ No newline at end of file
@@ -0,0 +1 @@
+y
\ No newline at end of file
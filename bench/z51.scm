@@ -0,0 +1 @@
+SLaTeX.
\ No newline at end of file
@@ -0,0 +1 @@
+call-slatex
\ No newline at end of file
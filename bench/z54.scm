@@ -0,0 +1 @@
+delete-file
\ No newline at end of file
@@ -0,0 +1 @@
+file-exists?
\ No newline at end of file
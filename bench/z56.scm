@@ -0,0 +1 @@
+force-output
\ No newline at end of file
@@ -0,0 +1,2 @@
+(lambda (x y) (cons x (cons y
+'())))
\ No newline at end of file
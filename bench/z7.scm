@@ -0,0 +1 @@
+(set! x 42)
\ No newline at end of file
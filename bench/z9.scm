@@ -0,0 +1 @@
+set!
\ No newline at end of file
@@ -0,0 +1 @@
+(call/cc I)
\ No newline at end of file
@@ -10,16 +10,19 @@
 #include "test_assert.h"
 
 #include <asm/assembler.h>
+#include <asm/jit_symbols.h>
 
 #include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <cassert>
 #include <map>
+#include <sstream>
 #include <stdint.h>
 #ifdef _WIN32
 #include <io.h>
 #else
+#include <signal.h>
 #include <unistd.h>
 #endif
 #include <fcntl.h>
@@ -28,6 +31,7 @@
 #include <libskiwi/cinput_data.h>
 #include <libskiwi/compiler_options.h>
 #include <libskiwi/compile_data.h>
+#include <libskiwi/compile_transaction.h>
 #include <libskiwi/compiler.h>
 #include <libskiwi/context.h>
 #include <libskiwi/define_conversion.h>
@@ -38,6 +42,7 @@
 #include <libskiwi/parse.h>
 #include <libskiwi/preprocess.h>
 #include <libskiwi/primitives_lib.h>
+#include <libskiwi/profiler.h>
 #include <libskiwi/repl_data.h>
 #include <libskiwi/runtime.h>
 #include <libskiwi/simplify_to_core.h>
@@ -114,7 +119,7 @@ namespace
         fun_ptr f = (fun_ptr)assemble(size, d, code);
         f(&ctxt);
         compiled_functions.emplace_back(f, size);
-        assign_primitive_addresses(pm, d, (uint64_t)f);
+        assign_primitive_addresses(pm, d, code, (uint64_t)f);
         }
       catch (std::logic_error e)
         {
@@ -228,13 +233,13 @@ namespace
       md = create_macro_data();
       }
 
-    void make_new_context(uint64_t heap_size, uint64_t global_stack, uint16_t local_stack, uint64_t scheme_stack)
+    void make_new_context(uint64_t heap_size, uint64_t global_stack, uint16_t local_stack, uint64_t scheme_stack, uint64_t nursery_size = 0)
       {
       for (auto& f : compiled_functions)
         free_assembled_function((void*)f.first, f.second);
       compiled_functions.clear();
       destroy_context(ctxt);
-      ctxt = create_context(heap_size, global_stack, local_stack, scheme_stack);
+      ctxt = create_context(heap_size, global_stack, local_stack, scheme_stack, nursery_size);
       env = std::make_shared<environment<environment_entry>>(nullptr);
       rd = repl_data();
       asmcode code;
@@ -247,7 +252,7 @@ namespace
         fun_ptr f = (fun_ptr)assemble(size, d, code);
         f(&ctxt);
         compiled_functions.emplace_back(f, size);
-        assign_primitive_addresses(pm, d, (uint64_t)f);
+        assign_primitive_addresses(pm, d, code, (uint64_t)f);
         }
       catch (std::logic_error e)
         {
@@ -2398,8 +2403,7 @@ namespace
       TEST_EQ("34", run("(fib 8)"));
       TEST_EQ("55", run("(fib 9)"));
       TEST_EQ("89", run("(fib 10)"));
-      //TEST_EQ("165580141", run("(fib 40)"));
-      TEST_EQ("runtime error: closure: heap overflow", run("(fib 40)"));
+      TEST_EQ("165580141", run("(fib 40)")); // the primitives library was compiled with garbage collection, so closure makes room
       }
     };
 
@@ -2762,6 +2766,114 @@ namespace
       }
     };
 
+  struct gc_large_lazy_heap : public compile_fixture {
+    void test()
+      {
+      make_new_context(1024 * 1024 * 256, 1024, 1024, 1024);
+      TEST_EQ("100", run("(letrec([f (lambda(i)  (when (<= i 10000) (let([x (list 0 0 0 0 0 0 0 0 0 0)]) (f(add1 i)))))]) (f 0) 100)"));
+      TEST_EQ("(1 2 3)", run("(list 1 2 3)"));
+
+      context huge = create_context(1024 * 1024, 1024, 1024, 1024, 0, true);
+      TEST_EQ(unalloc_tag, huge.globals[0]);
+      TEST_EQ(unalloc_tag, huge.globals[1023]);
+      TEST_EQ(unalloc_tag, huge.locals[1023]);
+      TEST_EQ(0, huge.to_space[0]);
+      huge.from_space[0] = 7;
+      TEST_EQ(7, huge.from_space[0]);
+      destroy_context(huge);
+      }
+    };
+
+  struct gc_heap_resize : public compile_fixture {
+    void test()
+      {
+      make_new_context(1024 * 2, 1024, 1024, 1024);
+      set_heap_resize_policy(ctxt, 1024 * 64, 50, 10);
+      run("(define build (lambda (n acc) (if (= n 0) acc (build (- n 1) (cons n acc)))))");
+      run("(define sum-list (lambda (l acc) (if (null? l) acc (sum-list (cdr l) (+ acc (car l))))))");
+      run("(define lst (build 2000 ()))");
+      TEST_EQ("2001000", run("(sum-list lst 0)"));
+      TEST_ASSERT(ctxt.total_heap_size > 1024 * 2);
+      TEST_ASSERT(ctxt.heap_block != nullptr);
+
+      run("(set! lst ())");
+      TEST_EQ("100", run("(letrec([f (lambda(i)  (when (<= i 10000) (let([x (list 0 0 0 0 0 0 0 0 0 0)]) (f(add1 i)))))]) (f 0) 100)"));
+      TEST_EQ(1024 * 2, ctxt.total_heap_size);
+      TEST_ASSERT(ctxt.heap_block == nullptr);
+      TEST_EQ("1275", run("(sum-list (build 50 ()) 0)"));
+
+      // allocations that are larger than the heap make it grow
+      TEST_EQ("3000", run("(vector-length (make-vector 3000 0))"));
+      TEST_ASSERT(ctxt.total_heap_size > 3000);
+      run("(define keep (list 1 2 3))");
+      TEST_EQ("(1 2 3)", run("(vector-ref (make-vector 5000 keep) 4999)"));
+      TEST_EQ("#\\a", run("(string-ref (make-string 30000 #\\a) 29999)"));
+      TEST_EQ("runtime error: make-vector: heap overflow", run("(make-vector 100000 0)"));
+      TEST_EQ("1275", run("(sum-list (build 50 ()) 0)"));
+      }
+    };
+
+  struct gc_generational : public compile_fixture {
+    void test()
+      {
+      ops.generational_gc = true;
+      make_new_context(1024 * 8, 1024, 1024, 1024, 1024);
+      TEST_EQ("100", run("(letrec([f (lambda(i)  (when (<= i 10000) (let([x (list 0 0 0 0 0 0 0 0 0 0)]) (f(add1 i)))))]) (f 0) 100)"));
+
+      run("(define churn (lambda (n) (when (> n 0) (list 1 2 3 4 5 6 7 8) (churn (- n 1)))))");
+      run("(define v (make-vector 10 0))");
+      run("(define p (cons 0 0))");
+      run("(churn 2000)");
+      // v and p are in the old generation now, and get pointers to young objects
+      run("(vector-set! v 3 (list 1 2 3))");
+      run("(set-car! p (vector 4 5 6))");
+      run("(set-cdr! p (cons 7 8))");
+      run("(vector-fill! v (cons 9 9))");
+      run("(vector-set! v 3 (list 1 2 3))");
+      run("(churn 2000)");
+      TEST_EQ("#((9 . 9) (9 . 9) (9 . 9) (1 2 3) (9 . 9) (9 . 9) (9 . 9) (9 . 9) (9 . 9) (9 . 9))", run("v"));
+      TEST_EQ("(#(4 5 6) 7 . 8)", run("p"));
+
+      // more old-to-young pointers than the remembered set can hold
+      run("(define big (make-vector 200 0))");
+      run("(churn 2000)");
+      run("(define fill (lambda (i) (when (< i 200) (vector-set! big i (cons i i)) (fill (add1 i)))))");
+      run("(fill 0)");
+      run("(fill 0)");
+      run("(churn 2000)");
+      run("(define sum (lambda (i acc) (if (= i 200) acc (sum (add1 i) (+ acc (car (vector-ref big i)))))))");
+      TEST_EQ("19900", run("(sum 0 0)"));
+
+      // a long-lived list that fills most of the old generation, so that major collections shrink the nursery
+      run("(define sum-list (lambda (l acc) (if (null? l) acc (sum-list (cdr l) (+ acc (car l))))))");
+      run("(define make-list-n (lambda (n) (if (= n 0) () (cons n (make-list-n (- n 1))))))");
+      run("(define lst (make-list-n 400))");
+      run("(churn 2000)");
+      TEST_EQ("80200", run("(sum-list lst 0)"));
+      TEST_EQ("19900", run("(sum 0 0)"));
+      TEST_ASSERT(ctxt.old_alloc <= ctxt.old_space_end);
+
+      // objects that do not fit the nursery are allocated in the old generation
+      make_new_context(1024 * 64, 1024, 1024, 1024, 1024);
+      run("(define churn (lambda (n) (when (> n 0) (list 1 2 3 4 5 6 7 8) (churn (- n 1)))))");
+      run("(define keep (list 1 2 3))");
+      TEST_EQ("3000", run("(vector-length (make-vector 3000 0))"));
+      run("(define v (make-vector 5000 keep))");
+      run("(churn 2000)");
+      TEST_EQ("(1 2 3)", run("(vector-ref v 4999)"));
+      run("(vector-set! v 4000 (cons 4 5))");
+      run("(churn 2000)");
+      TEST_EQ("(4 . 5)", run("(vector-ref v 4000)"));
+      run("(define s (make-string 20000 #\\a))");
+      TEST_EQ("40000", run("(string-length (string-append1 s s))"));
+      TEST_EQ("#\\a", run("(string-ref (substring (string-append1 s s) 100 30000) 29899)"));
+      run("(churn 2000)");
+      TEST_EQ("(1 2 3)", run("(vector-ref v 0)"));
+      TEST_EQ("runtime error: make-vector: heap overflow", run("(make-vector 100000 0)"));
+      TEST_ASSERT(ctxt.old_alloc <= ctxt.old_space_end);
+      }
+    };
+
   struct fib_perf_test : public compile_fixture {
     void test()
       {
@@ -2785,6 +2897,190 @@ namespace
       //expand_and_format("(define FIB (lambda (n) (cond [(fx<? n 2) 1]  [else (fx+ (FIB (fx- n 2)) (FIB(fx- n 1)))]))) ");
       }
     };
+  struct compile_transaction_rollback : public compile_fixture {
+    bool fails_and_rolls_back(const std::string& script, bool changes_quotes_and_names)
+      {
+      compile_transaction transaction(env, rd);
+      const auto quotes = rd.quote_to_index;
+      const auto names = rd.procedure_names;
+      try
+        {
+        get_asmcode(script);
+        }
+      catch (std::exception&)
+        {
+        if (changes_quotes_and_names)
+          {
+          TEST_ASSERT(rd.quote_to_index.size() > quotes.size());
+          TEST_ASSERT(rd.procedure_names.size() > names.size());
+          }
+        transaction.rollback();
+        return true;
+        }
+      return false;
+      }
+
+    void test()
+      {
+      ops.procedure_counters = true; // only compiled here, so the context needs no counters
+      get_asmcode("(define kept '(x y))");
+      const auto quotes = rd.quote_to_index;
+      const auto names = rd.procedure_names;
+      const uint64_t global_index = rd.global_index;
+      const uint64_t alpha_conversion_index = rd.alpha_conversion_index;
+
+      // fails in alpha conversion
+      TEST_ASSERT(fails_and_rolls_back("(begin (define rolled-back '(a b c)) (set! no-such-var 1))", false));
+      TEST_ASSERT(quotes == rd.quote_to_index);
+      TEST_ASSERT(names == rd.procedure_names);
+      TEST_EQ(global_index, rd.global_index);
+      TEST_EQ(alpha_conversion_index, rd.alpha_conversion_index);
+
+      // fails in code generation, after the quotes were collected and the lambda was named
+      TEST_ASSERT(fails_and_rolls_back("(begin (define rolled-back '(a b c)) (define (f x) x) (foreign-call no-such-function))", true));
+      TEST_ASSERT(quotes == rd.quote_to_index);
+      TEST_ASSERT(names == rd.procedure_names);
+      TEST_EQ(global_index, rd.global_index);
+      TEST_EQ(alpha_conversion_index, rd.alpha_conversion_index);
+      alpha_conversion_data acd;
+      TEST_ASSERT(!rd.alpha_conversion_env->find(acd, "rolled-back"));
+      TEST_ASSERT(rd.alpha_conversion_env->find(acd, "kept"));
+      }
+    };
+
+  struct clone_context_test : public compile_fixture {
+    std::string run_in(context& c, const std::string& script)
+      {
+      asmcode code = get_asmcode(script);
+      first_pass_data d;
+      uint64_t size;
+      fun_ptr f = (fun_ptr)assemble(size, d, code);
+      std::stringstream str;
+      uint64_t res = f(&c);
+      scheme_runtime(res, str, env, rd, nullptr);
+      compiled_functions.emplace_back(f, size);
+      return str.str();
+      }
+
+#ifdef __linux__
+    // the line of /proc/self/maps that holds address
+    std::string mapping_of(const void* address)
+      {
+      std::ifstream maps("/proc/self/maps");
+      std::string line;
+      while (std::getline(maps, line))
+        {
+        std::stringstream ss(line);
+        uint64_t begin = 0, end = 0;
+        char dash;
+        ss >> std::hex >> begin >> dash >> end;
+        if (begin <= (uint64_t)address && (uint64_t)address < end)
+          return line;
+        }
+      return std::string();
+      }
+#endif
+
+    void test()
+      {
+      run("(define x 42)");
+      run("(define lst (list 1 2 3))");
+      run("(define f (lambda (y) (+ x y)))");
+      context c1 = clone_context(ctxt);
+      TEST_EQ("43", run_in(c1, "(f 1)"));
+      TEST_EQ("(1 2 3)", run_in(c1, "lst"));
+      run("(set! x 100)");
+      TEST_EQ("101", run("(f 1)"));
+      TEST_EQ("43", run_in(c1, "(f 1)"));
+      context c2 = clone_context(ctxt);
+#ifdef __linux__
+      int fd = ctxt.snapshot_fd;
+      TEST_ASSERT(fd >= 0);
+      // the clone maps the snapshot, the memory of ctxt is left as it was
+      TEST_ASSERT(mapping_of(c2.globals).find("skiwi-context") != std::string::npos);
+      TEST_ASSERT(mapping_of(ctxt.globals).find("skiwi-context") == std::string::npos);
+#endif
+      context c3 = clone_context(ctxt);
+#ifdef __linux__
+      TEST_EQ(fd, ctxt.snapshot_fd);
+      // scratch memory is not compared, the globals are
+      ctxt.locals[ctxt.number_of_locals] = 12345;
+      ctxt.stack_end[-1] = 12345;
+      context c4 = clone_context(ctxt);
+      TEST_EQ(fd, ctxt.snapshot_fd);
+      destroy_context(c4);
+      run("(define y 1)");
+      context c5 = clone_context(ctxt);
+      TEST_ASSERT(fd != ctxt.snapshot_fd);
+      TEST_EQ("1", run_in(c5, "y"));
+      destroy_context(c5);
+#endif
+      TEST_EQ("101", run_in(c2, "(f 1)"));
+      run_in(c2, "(set! x 7)");
+      TEST_EQ("8", run_in(c2, "(f 1)"));
+      TEST_EQ("101", run_in(c3, "(f 1)"));
+      TEST_EQ("101", run("(f 1)"));
+      TEST_EQ("100", run_in(c3, "(letrec([g (lambda(i)  (when (<= i 100000) (let([x (list 0 0 0 0 0 0 0 0 0 0)]) (g(add1 i)))))]) (g 0) 100)"));
+      TEST_EQ("(1 2 3)", run_in(c3, "lst"));
+      destroy_context(c1);
+      destroy_context(c2);
+      destroy_context(c3);
+      TEST_EQ("101", run("(f 1)"));
+      }
+    };
+
+  struct clone_context_perf_test : public compile_fixture {
+    void test()
+      {
+      make_new_context(2 * 1024 * 1024, 64 * 1024, 256, 4096);
+      run("(define x 42)");
+      const int nr_of_clones = 50;
+
+      auto tic = std::clock();
+      for (int i = 0; i < nr_of_clones; ++i)
+        {
+        // the clone as it was made before: a new context and a copy of all of its memory
+        context c = create_context(ctxt.heap_min_size, ctxt.globals_end - ctxt.globals, (uint32_t)ctxt.number_of_locals, ctxt.stack_end - ctxt.stack_top);
+        for (uint64_t j = 0; j < ctxt.memory_size; ++j)
+          c.memory_allocated[j] = ctxt.memory_allocated[j];
+        destroy_context(c);
+        }
+      auto toc = std::clock();
+      std::cout << "clone context by copy: " << (toc - tic) * 1000 / CLOCKS_PER_SEC << "ms for " << nr_of_clones << " clones\n";
+
+      tic = std::clock();
+      for (int i = 0; i < nr_of_clones; ++i)
+        {
+        context c = clone_context(ctxt);
+        destroy_context(c);
+        }
+      toc = std::clock();
+      std::cout << "clone context: " << (toc - tic) * 1000 / CLOCKS_PER_SEC << "ms for " << nr_of_clones << " clones\n";
+      }
+    };
+
+  struct lambda_symbol_names_test : public compile_fixture {
+    bool has_symbol(const asmcode& code, const std::string& name)
+      {
+      for (const auto& sym : code.get_symbols())
+        if (code.get_text(sym.second) == name)
+          return true;
+      return false;
+      }
+
+    void test()
+      {
+      const bool symbol_table_was_enabled = ASM::is_jit_symbol_table_enabled();
+      ASM::set_jit_symbol_table_enabled(false);
+      TEST_ASSERT(!ASM::jit_symbols_wanted());
+      TEST_ASSERT(!has_symbol(get_asmcode("(define (f x) (+ x 1))"), "f")); // nobody uses the names, so they are not made
+      ASM::set_jit_symbol_table_enabled(true);
+      asmcode code = get_asmcode("(define (g x) (+ x 1))");
+      ASM::set_jit_symbol_table_enabled(symbol_table_was_enabled);
+      TEST_ASSERT(has_symbol(code, "g"));
+      }
+    };
+
   struct primitive_of_2_args_inlined : public compile_fixture {
     void test()
       {
@@ -5321,6 +5617,552 @@ to /* and */ in c/c++
     skiwi_quit();
     }
 
+  void startup_cache_test()
+    {
+    using namespace skiwi;
+    std::string cache_file("startup_cache_test.cache");
+    std::remove(cache_file.c_str());
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = nullptr;
+    params.use_startup_cache = true;
+    params.startup_cache_file = cache_file;
+    // the first run compiles the startup libraries and writes the cache
+    scheme_with_skiwi(nullptr, nullptr, params);
+    TEST_EQ("(5 7 9)", skiwi_raw_to_string(skiwi_run_raw("(map + '(1 2 3) '(4 5 6))")));
+    skiwi_quit();
+    std::ifstream f(cache_file);
+    TEST_ASSERT(f.is_open());
+    f.close();
+    // the second run loads the startup libraries from the cache
+    std::stringstream trace;
+    params.trace = &trace;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    TEST_ASSERT(trace.str().find("loaded startup libraries") != std::string::npos);
+    TEST_EQ("(5 7 9)", skiwi_raw_to_string(skiwi_run_raw("(map + '(1 2 3) '(4 5 6))")));
+    TEST_EQ("foo", skiwi_raw_to_string(skiwi_run_raw("(string->symbol \"foo\")")));
+    TEST_EQ("#t", skiwi_raw_to_string(skiwi_run_raw("(eq? 'bar (string->symbol \"bar\"))")));
+    TEST_EQ("6", skiwi_raw_to_string(skiwi_run_raw("(apply + '(1 2 3))")));
+    TEST_EQ("3", skiwi_raw_to_string(skiwi_run_raw("(force (delay (+ 1 2)))")));
+    TEST_EQ("composite", skiwi_raw_to_string(skiwi_run_raw("(case (* 2 3) ((2 3 5 7) 'prime) ((1 4 6 8 9) 'composite))")));
+    TEST_EQ("(1 2 3)", skiwi_raw_to_string(skiwi_run_raw("(do ((vec (make-vector 3)) (i 0 (+ i 1))) ((= i 3) (vector->list vec)) (vector-set! vec i (+ i 1)))")));
+    TEST_EQ("120", skiwi_raw_to_string(skiwi_run_raw("(define (fac n) (if (< n 2) 1 (* n (fac (- n 1))))) (fac 5)")));
+    TEST_EQ("(0 1 2 3 4)", skiwi_raw_to_string(skiwi_run_raw("(import 'srfi-1) (iota 5)")));
+    std::string packages_file = std::string(getenv("SKIWI_MODULE_PATH")) + std::string("packages.scm");
+    skiwi_quit();
+
+    // packages.scm is loaded by modules.scm, so changing it makes the cache stale
+    std::string packages;
+      {
+      std::ifstream in(packages_file);
+      std::stringstream ss;
+      ss << in.rdbuf();
+      packages = ss.str();
+      }
+      {
+      std::ofstream out(packages_file);
+      out << packages << "\n; changed\n";
+      }
+    trace.str("");
+    scheme_with_skiwi(nullptr, nullptr, params);
+    TEST_ASSERT(trace.str().find("loaded startup libraries") == std::string::npos);
+    TEST_EQ("(5 7 9)", skiwi_raw_to_string(skiwi_run_raw("(map + '(1 2 3) '(4 5 6))")));
+    skiwi_quit();
+      {
+      std::ofstream out(packages_file);
+      out << packages;
+      }
+    std::remove(cache_file.c_str());
+
+    // the generational collector does not use the cache at all
+    std::stringstream errors;
+    params.stderror = &errors;
+    params.generational_gc = true;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    TEST_EQ("(5 7 9)", skiwi_raw_to_string(skiwi_run_raw("(map + '(1 2 3) '(4 5 6))")));
+    skiwi_quit();
+    TEST_EQ(std::string(), errors.str());
+    std::ifstream generational_cache(cache_file);
+    TEST_ASSERT(!generational_cache.is_open());
+    }
+
+  void parallel_test()
+    {
+    using namespace skiwi;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = nullptr;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_run("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    skiwi_run("(define offset 1000)");
+    auto fib = skiwi_compile("(c-input \"(int i)\") (+ offset (fib i))");
+    TEST_ASSERT(fib != nullptr);
+    skiwi_parallel_init(4);
+    TEST_EQ(4, skiwi_parallel_threads());
+    auto results = skiwi_parallel_map<int64_t>(fib, 20, [](scm_type v) { return v.get_fixnum(); });
+    TEST_EQ(20, results.size());
+    TEST_EQ(1000, results[0]);
+    TEST_EQ(1055, results[10]);
+    TEST_EQ(5181, results[19]);
+
+    // the workers see the globals of the main context as they are at the start of each batch
+    skiwi_run("(set! offset 0)");
+    auto lists = skiwi_compile("(c-input \"(int i)\") (let loop ([k 0] [acc '()]) (if (= k 20000) (+ offset (length acc) i) (loop (+ k 1) (cons (list i k) acc))))");
+    auto lengths = skiwi_parallel_map<int64_t>(lists, 16, [](scm_type v) { return v.get_fixnum(); });
+    for (int64_t i = 0; i < 16; ++i)
+      TEST_EQ(20000 + i, lengths[i]);
+
+    auto names = skiwi_parallel_map<std::string>(skiwi_compile("(c-input \"(int i)\") (number->string (* i i))"), 5, [](scm_type v) { return v.get_string(); });
+    TEST_EQ("16", names[4]);
+
+    bool thrown = false;
+    try
+      {
+      skiwi_parallel_for(10, [](uint64_t index, void*) { if (index == 7) throw std::runtime_error("task 7"); });
+      }
+    catch (std::runtime_error& e)
+      {
+      thrown = true;
+      TEST_EQ(std::string("task 7"), std::string(e.what()));
+      }
+    TEST_ASSERT(thrown);
+    TEST_EQ("1055", skiwi_raw_to_string(skiwi_run_raw("(+ 1000 (fib 10))")));
+
+    // the tasks write to private copies of the current ports and of the symbol table
+    skiwi_run("(define sp (make-port #f \"output-string\" -2 (make-string 256) 0 256))");
+    skiwi_run("(current-output-port sp)");
+    auto symbols = skiwi_compile("(c-input \"(int i)\") (let ([name (string-append \"task-\" (number->string i))]) (write-string name) (eq? (string->symbol name) (string->symbol name)))");
+    auto interned = skiwi_parallel_map<bool>(symbols, 64, [](scm_type v) { return v.is_bool_true(); });
+    TEST_EQ(64, interned.size());
+    for (bool b : interned)
+      TEST_ASSERT(b);
+    TEST_EQ("0", skiwi_raw_to_string(skiwi_run_raw("(%slot-ref sp 4)")));
+    TEST_EQ("#t", skiwi_raw_to_string(skiwi_run_raw("(eq? (string->symbol \"task-3\") 'task-3)")));
+    skiwi_parallel_exit();
+    TEST_EQ(0, skiwi_parallel_threads());
+    skiwi_quit();
+    }
+
+  void call_test()
+    {
+    using namespace skiwi;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = nullptr;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    scm_type add3 = skiwi_run_raw("(lambda (a b c) (+ a b c))");
+    TEST_ASSERT(add3.is_closure());
+    TEST_EQ(6, skiwi_call(add3, make_fixnum(1), make_fixnum(2), make_fixnum(3)).get_fixnum());
+    TEST_EQ(15, skiwi_call(add3, make_fixnum(4), make_fixnum(5), make_fixnum(6)).get_fixnum());
+    TEST_EQ(7.5, skiwi_apply(add3, { make_fixnum(1), make_flonum(2.5), make_fixnum(4) }).get_flonum());
+
+    skiwi_run("(define (make-adder n) (lambda (x) (+ x n)))");
+    scm_type add10 = skiwi_run_raw("(make-adder 10)");
+    int64_t sum = 0;
+    for (int64_t i = 0; i < 1000; ++i)
+      sum += skiwi_call(add10, make_fixnum(i)).get_fixnum();
+    TEST_EQ(509500, sum);
+
+    scm_type exclaim = skiwi_run_raw("(lambda (s) (string-append s \"!\"))");
+    TEST_EQ(std::string("skiwi!"), skiwi_call(exclaim, make_string("skiwi")).get_string());
+    scm_type answer = skiwi_run_raw("(lambda () 42)");
+    TEST_EQ(42, skiwi_call(answer).get_fixnum());
+
+    // the argument globals don't keep the arguments alive after the call
+    TEST_EQ("#f", skiwi_raw_to_string(skiwi_run_raw("%skiwi-call-argument-0")));
+
+    bool thrown = false;
+    try
+      {
+      skiwi_call(make_fixnum(3), make_fixnum(1));
+      }
+    catch (std::runtime_error&)
+      {
+      thrown = true;
+      }
+    TEST_ASSERT(thrown);
+
+    // the closure can run in the context of a parallel task too
+    scm_type square = skiwi_run_raw("(lambda (x) (* x x))");
+    skiwi_call(square, make_fixnum(0)); // compiles the stub on the main thread
+    std::vector<int64_t> squares(8);
+    skiwi_parallel_for(8, [&](uint64_t index, void* ctxt)
+      {
+      squares[index] = skiwi_apply(square, { make_fixnum((int64_t)index) }, ctxt).get_fixnum();
+      });
+    TEST_EQ(49, squares[7]);
+
+    thrown = false;
+    try
+      {
+      skiwi_apply(answer, std::vector<scm_type>(17, make_fixnum(0)));
+      }
+    catch (std::runtime_error&)
+      {
+      thrown = true;
+      }
+    TEST_ASSERT(thrown);
+    skiwi_quit();
+    }
+
+  uint64_t call_with_two(uint64_t f, uint64_t x)
+    {
+    return skiwi_call(scm_type(f), scm_type(x), make_fixnum(2)).value();
+    }
+
+  void* call_from_primitive_register(void*)
+    {
+    register_external_primitive("call-with-two", (void*)&call_with_two, skiwi_scm, skiwi_scm, skiwi_scm);
+    return nullptr;
+    }
+
+  void call_from_primitive_test()
+    {
+    using namespace skiwi;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = nullptr;
+    params.heap_size = 1024 * 1024;
+    scheme_with_skiwi(&call_from_primitive_register, nullptr, params);
+    // the first call with two arguments happens inside running scheme code, which continues afterwards
+    TEST_EQ("43", skiwi_raw_to_string(skiwi_run_raw("(let ([p (cons 40 0)]) (+ 1 (call-with-two (lambda (p n) (+ (car p) n)) p)))")));
+    TEST_EQ("45", skiwi_raw_to_string(skiwi_run_raw("(+ (call-with-two (lambda (p n) (+ (car p) n)) (cons 40 0)) (call-with-two (lambda (p n) (car p)) (list 3)))")));
+    TEST_EQ("#f", skiwi_raw_to_string(skiwi_run_raw("%skiwi-call-closure")));
+    skiwi_quit();
+    }
+
+  void compile_cache_test()
+    {
+    using namespace skiwi;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = nullptr;
+    params.use_compile_cache = true;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_run("(define counter 0)");
+    auto f = skiwi_compile("(begin (set! counter (+ counter 1)) counter)");
+    TEST_ASSERT(f != nullptr);
+    TEST_ASSERT(f == skiwi_compile("(begin (set! counter (+ counter 1)) counter)"));
+    TEST_EQ("1", skiwi_raw_to_string(skiwi_run_raw("(begin (set! counter (+ counter 1)) counter)")));
+    TEST_EQ("2", skiwi_raw_to_string(skiwi_run_raw("(begin (set! counter (+ counter 1)) counter)")));
+    TEST_EQ("3", skiwi_raw_to_string(skiwi_run_raw(f, skiwi_get_context())));
+
+    // a forward declaration reserves the global that the later definition fills in
+    auto g = skiwi_compile("(defined-later)");
+    skiwi_run("(define (defined-later) 7)");
+    TEST_ASSERT(g == skiwi_compile("(defined-later)"));
+    TEST_EQ("7", skiwi_raw_to_string(skiwi_run_raw(g, skiwi_get_context())));
+
+    // redefining a global reuses its position, so the cached code stays valid
+    skiwi_run("(define counter 100)");
+    TEST_ASSERT(f == skiwi_compile("(begin (set! counter (+ counter 1)) counter)"));
+    TEST_EQ("101", skiwi_raw_to_string(skiwi_run_raw("(begin (set! counter (+ counter 1)) counter)")));
+
+    // defining a macro invalidates the cache
+    auto h = skiwi_compile("(twice 4)");
+    skiwi_run("(define-macro (twice x) `(* 2 ,x))");
+    TEST_ASSERT(h != skiwi_compile("(twice 4)"));
+    TEST_EQ("8", skiwi_raw_to_string(skiwi_run_raw("(twice 4)")));
+
+    // only free variables are dependencies, so defining a global with the name of a local keeps the entry
+    auto k = skiwi_compile("(let ([local-x 1]) (+ local-x counter))");
+    skiwi_run("(define local-x 5)");
+    TEST_ASSERT(k == skiwi_compile("(let ([local-x 1]) (+ local-x counter))"));
+    TEST_EQ("102", skiwi_raw_to_string(skiwi_run_raw("(let ([local-x 1]) (+ local-x counter))")));
+    skiwi_quit();
+
+    // the least recently used entry is evicted, and its code is released
+    params.compile_cache_size = 2;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_reclaim_code();
+    TEST_EQ("3", skiwi_raw_to_string(skiwi_run_raw("(+ 1 2)")));
+    TEST_EQ("4", skiwi_raw_to_string(skiwi_run_raw("(+ 1 3)")));
+    TEST_EQ("3", skiwi_raw_to_string(skiwi_run_raw("(+ 1 2)")));
+    TEST_EQ(0, skiwi_reclaim_code());
+    TEST_EQ("5", skiwi_raw_to_string(skiwi_run_raw("(+ 1 4)"))); // evicts (+ 1 3)
+    TEST_ASSERT(skiwi_reclaim_code() > 0);
+    auto kept = skiwi_compile("(+ 1 2)");
+    TEST_EQ("3", skiwi_raw_to_string(skiwi_run_raw(kept, skiwi_get_context())));
+    skiwi_compile("(+ 1 5)"); // evicts (+ 1 4)
+    TEST_ASSERT(skiwi_reclaim_code() > 0);
+    skiwi_compile("(+ 1 6)"); // evicts (+ 1 2), but skiwi_compile handed out its code
+    TEST_EQ(0, skiwi_reclaim_code());
+    TEST_EQ("3", skiwi_raw_to_string(skiwi_run_raw(kept, skiwi_get_context())));
+    skiwi_quit();
+    }
+
+  void compile_error_rollback_test()
+    {
+    using namespace skiwi;
+    std::stringstream errors;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &errors;
+    params.stdoutput = nullptr;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_run("(define kept 1)");
+
+    // the compilation fails in alpha conversion, after the define was seen, so the global and the quote of this input are undone
+    skiwi_run("(begin (define rolled-back '(a b c)) (set! no-such-var 1))");
+    TEST_ASSERT(errors.str().find("set! error") != std::string::npos);
+    TEST_ASSERT(skiwi_raw_to_string(skiwi_run_raw("rolled-back")).find("unknown variable") != std::string::npos);
+
+    TEST_EQ("1", skiwi_raw_to_string(skiwi_run_raw("kept")));
+    TEST_EQ("(a b c)", skiwi_raw_to_string(skiwi_run_raw("'(a b c)")));
+    skiwi_run("(define rolled-back 3)");
+    TEST_EQ("4", skiwi_raw_to_string(skiwi_run_raw("(+ kept rolled-back)")));
+    skiwi_quit();
+    }
+
+  void reclaim_code_test()
+    {
+    using namespace skiwi;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = nullptr;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_run_raw("(reclaim-garbage)");
+    skiwi_reclaim_code();
+    uint64_t code_size = skiwi_code_size();
+
+    // expressions that create no closures are released right after running
+    for (int i = 0; i < 200; ++i)
+      skiwi_run_raw("(+ 1 2)");
+    TEST_EQ("3", skiwi_raw_to_string(skiwi_run_raw("(+ 1 2)")));
+    TEST_EQ(code_size, skiwi_code_size());
+
+    // closures that escape keep their code
+    skiwi_run("(define keep (let ([n 1]) (lambda (x) (+ x n))))");
+    for (int i = 0; i < 200; ++i)
+      skiwi_run_raw("(let loop ([i 0] [acc '()]) (if (< i 10) (loop (+ i 1) (cons (lambda () i) acc)) (length acc)))");
+    TEST_ASSERT(skiwi_code_size() > code_size);
+    skiwi_run_raw("(reclaim-garbage)");
+    TEST_ASSERT(skiwi_reclaim_code() > 0);
+    TEST_EQ("5", skiwi_raw_to_string(skiwi_run_raw("(keep 4)")));
+    uint64_t code_size_with_keep = skiwi_code_size();
+
+    // the code of eval stays bounded
+    skiwi_run_raw("(let loop ([i 0]) (if (< i 300) (begin (eval '(let ([f (lambda (x) (* x x))]) (f 3))) (loop (+ i 1))) i))");
+    skiwi_run_raw("(reclaim-garbage)");
+    skiwi_reclaim_code();
+    TEST_ASSERT(skiwi_code_size() < code_size_with_keep + 4 * 4096);
+    TEST_EQ("5", skiwi_raw_to_string(skiwi_run_raw("(keep 4)")));
+
+    // a continuation keeps the code of the expression that it returns to
+    skiwi_run("(define k #f)");
+    TEST_EQ("2", skiwi_raw_to_string(skiwi_run_raw("(+ 1 (%call/cc (lambda (c) (set! k c) 1)))")));
+    skiwi_run_raw("(reclaim-garbage)");
+    skiwi_reclaim_code();
+    TEST_EQ("11", skiwi_raw_to_string(skiwi_run_raw("(k 10)")));
+    skiwi_quit();
+    }
+
+  void profile_test()
+    {
+    using namespace skiwi;
+    if (!profiler_is_supported())
+      return;
+    std::stringstream str;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = &str;
+    TEST_ASSERT(params.profiling); // by default, code compiled before the profiler started is named too
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_run("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    str.str("");
+    skiwi_profile_start(100);
+    TEST_EQ("832040", skiwi_raw_to_string(skiwi_run_raw("(fib 30)")));
+    skiwi_profile_stop();
+    const std::string report = str.str();
+    TEST_ASSERT(report.find("samples, one every 100 microseconds") != std::string::npos);
+    TEST_ASSERT(report.find("%  fib\n") != std::string::npos);
+    TEST_ASSERT(report.find("skiwi_parameters::profiling") == std::string::npos);
+    TEST_ASSERT(!profiler_is_running());
+#ifndef _WIN32
+    struct sigaction action;
+    sigaction(SIGPROF, nullptr, &action);
+    TEST_ASSERT(action.sa_handler == SIG_DFL); // the disposition from before skiwi_profile_start
+#endif
+    skiwi_quit();
+
+    // without profiling only the code that is compiled while the profiler runs is named
+    params.profiling = false;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    TEST_ASSERT(!ASM::is_jit_symbol_table_enabled());
+    str.str("");
+    skiwi_profile_start(100);
+    skiwi_run("(define (fib2 n) (if (< n 2) n (+ (fib2 (- n 1)) (fib2 (- n 2)))))");
+    TEST_EQ("832040", skiwi_raw_to_string(skiwi_run_raw("(fib2 30)")));
+    skiwi_profile_stop();
+    TEST_ASSERT(str.str().find("%  fib2\n") != std::string::npos);
+    TEST_ASSERT(str.str().find("see skiwi_parameters::profiling") != std::string::npos);
+    TEST_ASSERT(!ASM::is_jit_symbol_table_enabled());
+    skiwi_quit();
+    }
+
+  void procedure_counters_test(bool generational_gc)
+    {
+    using namespace skiwi;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = &std::cout;
+    params.procedure_counters = true;
+    params.generational_gc = generational_gc;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_run("(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    skiwi_run("(define (loop n) (if (= n 0) 0 (begin (make-vector 100 0) (loop (- n 1)))))");
+    skiwi_reset_procedure_counters();
+    TEST_EQ("6765", skiwi_raw_to_string(skiwi_run_raw("(fib 20)")));
+    TEST_EQ("0", skiwi_raw_to_string(skiwi_run_raw("(loop 100000)"))); // allocates more than the heap, so the garbage collector runs
+    std::vector<skiwi_procedure_counter> counters = skiwi_procedure_counters();
+    TEST_ASSERT(counters.size() >= 2);
+    TEST_EQ(std::string("loop"), counters[0].name);
+    TEST_EQ(100001, counters[0].calls);
+    TEST_EQ(100000 * 101 * 8, counters[0].allocated_bytes); // a vector of 100 elements and its header
+    TEST_EQ(std::string("fib"), counters[1].name);
+    TEST_EQ(21891, counters[1].calls);
+    skiwi_reset_procedure_counters();
+    TEST_ASSERT(skiwi_procedure_counters().empty());
+    skiwi_quit();
+    }
+
+  void gc_stats_test(bool generational_gc)
+    {
+    using namespace skiwi;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = &std::cout;
+    params.generational_gc = generational_gc;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_reset_gc_stats();
+    skiwi_gc_stats stats = skiwi_get_gc_stats();
+    TEST_EQ(0, stats.collections);
+    TEST_EQ(0, stats.bytes_reclaimed);
+    skiwi_run("(define (loop n) (if (= n 0) 0 (begin (make-vector 100 0) (loop (- n 1)))))");
+    TEST_EQ("0", skiwi_raw_to_string(skiwi_run_raw("(loop 100000)"))); // allocates more than the heap, so the garbage collector runs
+    stats = skiwi_get_gc_stats();
+    TEST_ASSERT(stats.collections > 0);
+    TEST_ASSERT(stats.full_collections <= stats.collections);
+    if (!generational_gc)
+      TEST_EQ(stats.collections, stats.full_collections);
+    TEST_ASSERT(stats.bytes_reclaimed > 0);
+    TEST_ASSERT(stats.max_pause_nanoseconds <= stats.total_pause_nanoseconds);
+    TEST_ASSERT(stats.last_pause_nanoseconds <= stats.max_pause_nanoseconds);
+    TEST_ASSERT(stats.peak_allocated_bytes >= stats.bytes_reclaimed / stats.collections); // no collection reclaims more than was in use
+    TEST_ASSERT(stats.peak_live_bytes > 0);
+    TEST_ASSERT(stats.peak_live_bytes < stats.peak_allocated_bytes); // the loop only keeps one small vector alive
+    TEST_EQ("#t", skiwi_raw_to_string(skiwi_run_raw("(= (vector-length (gc-stats)) 7)")));
+    TEST_EQ(std::to_string(stats.collections), skiwi_raw_to_string(skiwi_run_raw("(vector-ref (gc-stats) 0)")));
+    TEST_EQ(std::to_string(stats.bytes_reclaimed), skiwi_raw_to_string(skiwi_run_raw("(vector-ref (gc-stats) 3)")));
+    skiwi_quit();
+    }
+
+  /*
+  The dynamic benchmark fails when a collection misses a value that the running code keeps on the scheme stack, as the
+  continuation of apply.
+  */
+  void gc_generational_dynamic_benchmark_test()
+    {
+    using namespace skiwi;
+    const std::string folder(SKIWI_BENCH_FOLDER);
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = nullptr;
+    params.heap_size = 64 * 1024 * 1024;
+    params.local_stack = 1024;
+    params.generational_gc = true;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_run("(load \"" + folder + "run-benchmark.scm\")");
+    skiwi_run("(load \"" + folder + "dynamic.src.scm\")");
+    std::string script = "(begin (i!) (let ([ast (dynamic-parse-file \"" + folder + "dynamic.src.scm\")]) (normalize-global-constraints!) (reset-counters!) (tag-ast*-show ast) (counters-show)))";
+    TEST_EQ("((218 . 455) (6 . 1892) (2204 . 446))", skiwi_raw_to_string(skiwi_run_raw(script)));
+    TEST_EQ("((218 . 455) (6 . 1892) (2204 . 446))", skiwi_raw_to_string(skiwi_run_raw(script)));
+    skiwi_quit();
+    }
+
+  void heap_profile_test(bool generational_gc)
+    {
+    using namespace skiwi;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = &std::cout;
+    params.generational_gc = generational_gc;
+    params.heap_profiling = true;
+    params.heap_profile_interval = 1; // every byte is sampled, so the numbers are exact
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_run("(define (keep-vectors n acc) (if (= n 0) acc (keep-vectors (- n 1) (cons (make-vector 10 0) acc))))");
+    skiwi_run("(define (garbage n) (if (= n 0) 0 (begin (make-vector 100 0) (garbage (- n 1)))))");
+    skiwi_reset_heap_profile();
+    skiwi_run("(define kept (keep-vectors 1000 '()))");
+    TEST_EQ("0", skiwi_raw_to_string(skiwi_run_raw("(garbage 100000)"))); // allocates more than the heap, so the garbage collector runs
+    skiwi_run("(reclaim-garbage)");
+    std::vector<skiwi_heap_profile_entry> profile = skiwi_heap_profile();
+    auto find = [&](const std::string& procedure, const std::string& type)
+      {
+      for (const auto& e : profile)
+        if (e.procedure == procedure && e.type == type)
+          return e;
+      return skiwi_heap_profile_entry{ procedure, type, 0, 0, 0 };
+      };
+    TEST_ASSERT(!profile.empty());
+    TEST_EQ("garbage", profile.front().procedure);
+    TEST_EQ(100000 * 808, find("garbage", "vector").total_bytes);
+    TEST_EQ(0, find("garbage", "vector").live_bytes);
+    TEST_EQ(1000 * 88, find("keep-vectors", "vector").total_bytes);
+    TEST_EQ(1000 * 88, find("keep-vectors", "vector").live_bytes);
+    TEST_EQ(1000 * 24, find("keep-vectors", "pair").total_bytes);
+    TEST_EQ(1000 * 24, find("keep-vectors", "pair").live_bytes);
+    skiwi_reset_heap_profile();
+    TEST_ASSERT(skiwi_heap_profile().empty());
+    skiwi_quit();
+    }
+
+  void compile_stats_test()
+    {
+    using namespace skiwi;
+    skiwi_parameters params;
+    params.trace = nullptr;
+    params.stderror = &std::cout;
+    params.stdoutput = &std::cout;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    skiwi_reset_compile_stats();
+    TEST_ASSERT(skiwi_compile_stats().empty());
+    skiwi_run("(define (square x) (* x x))");
+    TEST_EQ("9", skiwi_raw_to_string(skiwi_run_raw("(square 3)")));
+    std::vector<skiwi_compile_pass_stats> stats = skiwi_compile_stats();
+    auto find = [&](const std::string& pass)
+      {
+      for (const auto& p : stats)
+        if (p.pass == pass)
+          return p;
+      return skiwi_compile_pass_stats{ pass, 0, 0, 0, 0 };
+      };
+    TEST_EQ(2, find("parse").runs);
+    TEST_EQ(2, find("macro expansion").runs);
+    TEST_EQ(2, find("alpha conversion").runs);
+    TEST_EQ(2, find("cps conversion").runs);
+    TEST_EQ(2, find("closure conversion").runs);
+    TEST_EQ(2, find("linear scan").runs);
+    TEST_EQ(2, find("code generation").runs);
+    TEST_EQ(2, find("assemble").runs);
+    TEST_ASSERT(find("code generation").allocations > 0);
+    TEST_ASSERT(find("code generation").allocated_bytes >= find("code generation").allocations);
+    skiwi_reset_compile_stats();
+    TEST_ASSERT(skiwi_compile_stats().empty());
+    skiwi_quit();
+    }
+
   struct eval_test : public compile_fixture_skiwi
     {
     void test()
@@ -6093,6 +6935,9 @@ void run_all_compile_tests()
   gctest().test();
   gc_fib().test();
   gc_overflow().test();
+  gc_large_lazy_heap().test();
+  gc_heap_resize().test();
+  gc_generational().test();
   primitive_of_2_args_inlined().test();
   lambda_variable_arity_not_using_rest_arg().test();
   lambda_variable_arity_while_using_rest_arg().test();
@@ -6118,6 +6963,10 @@ void run_all_compile_tests()
   apply().test();
   fib_iterative_perf_test().test();
   fib_perf_test().test();
+  compile_transaction_rollback().test();
+  clone_context_test().test();
+  clone_context_perf_test().test();
+  lambda_symbol_names_test().test();
   make_port_test().test();
   make_port2_test().test();
   r5rs_test().test();
@@ -6164,6 +7013,22 @@ void run_all_compile_tests()
   getenvtest().test();
   filetest().test();
   load_test();
+  startup_cache_test();
+  parallel_test();
+  call_test();
+  call_from_primitive_test();
+  compile_cache_test();
+  compile_error_rollback_test();
+  reclaim_code_test();
+  profile_test();
+  procedure_counters_test(false);
+  procedure_counters_test(true);
+  gc_stats_test(false);
+  gc_stats_test(true);
+  gc_generational_dynamic_benchmark_test();
+  heap_profile_test(false);
+  heap_profile_test(true);
+  compile_stats_test();
   debug_test();
   hex_test().test();
   binary_test().test();
@@ -90,7 +90,7 @@ namespace
 #endif
         run_bytecode(f, size, reg);
         compiled_bytecode.emplace_back(f, size);
-        assign_primitive_addresses(pm, d, (uint64_t)f);
+        assign_primitive_addresses(pm, d, code, (uint64_t)f);
         }
       catch (std::logic_error e)
         {
@@ -371,7 +371,7 @@ namespace
 #endif
         run_bytecode(f, size, reg);
         compiled_bytecode.emplace_back(f, size);
-        assign_primitive_addresses(pm, d, (uint64_t)f);
+        assign_primitive_addresses(pm, d, code, (uint64_t)f);
         }
       catch (std::logic_error e)
         {
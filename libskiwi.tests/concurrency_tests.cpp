@@ -0,0 +1,138 @@
+#include "concurrency_tests.h"
+#include "test_assert.h"
+
+#include <libskiwi/concurrency.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+SKIWI_BEGIN
+
+namespace
+  {
+
+  void thread_pool_tests()
+    {
+    thread_pool pool(4);
+    TEST_EQ(4, pool.size());
+    std::vector<std::atomic<int>> visits(1000);
+    std::atomic<uint64_t> sum(0);
+    pool.run(visits.size(), [&](uint64_t begin, uint64_t end)
+      {
+      for (uint64_t i = begin; i < end; ++i)
+        {
+        if (i < 10) // the first items are expensive, so the other participants have to steal from the first one
+          std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        ++visits[i];
+        sum += i;
+        }
+      });
+    bool all_visited_once = true;
+    for (const auto& v : visits)
+      all_visited_once &= (v == 1);
+    TEST_ASSERT(all_visited_once);
+    TEST_EQ(999 * 1000 / 2, sum.load());
+
+    std::atomic<uint64_t> nested_items(0);
+    pool.run(8, [&](uint64_t begin, uint64_t end)
+      {
+      for (uint64_t i = begin; i < end; ++i)
+        pool.run(10, [&](uint64_t b, uint64_t e) { nested_items += e - b; });
+      });
+    TEST_EQ(80, nested_items.load());
+
+    bool thrown = false;
+    try
+      {
+      pool.run(100, [&](uint64_t begin, uint64_t end)
+        {
+        if (begin <= 50 && 50 < end)
+          throw std::runtime_error("task 50 failed");
+        });
+      }
+    catch (std::runtime_error& e)
+      {
+      thrown = true;
+      TEST_EQ(std::string("task 50 failed"), std::string(e.what()));
+      }
+    TEST_ASSERT(thrown);
+    }
+
+  void thread_pool_participant_tests()
+    {
+    thread_pool pool(4);
+    std::vector<std::atomic<uint64_t>> participant_of(1000);
+    std::vector<std::thread::id> thread_of_participant(pool.size());
+    std::atomic<bool> same_thread(true);
+    std::mutex mut;
+    pool.run_indexed(participant_of.size(), [&](uint64_t begin, uint64_t end, uint32_t participant)
+      {
+        {
+        std::lock_guard<std::mutex> lock(mut);
+        if (thread_of_participant[participant] == std::thread::id())
+          thread_of_participant[participant] = std::this_thread::get_id();
+        else if (thread_of_participant[participant] != std::this_thread::get_id())
+          same_thread = false;
+        }
+      for (uint64_t i = begin; i < end; ++i)
+        participant_of[i] = participant;
+      });
+    bool in_range = true;
+    for (const auto& p : participant_of)
+      in_range &= (p < pool.size());
+    TEST_ASSERT(in_range);
+    TEST_ASSERT(same_thread.load()); // a participant index always belongs to the same thread
+    TEST_ASSERT(thread_of_participant[0] == std::this_thread::get_id() || thread_of_participant[0] == std::thread::id());
+
+    thread_pool single(1);
+    uint32_t only_participant = 1;
+    single.run_indexed(10, [&](uint64_t, uint64_t, uint32_t participant) { only_participant = participant; });
+    TEST_EQ(0, only_participant);
+    }
+
+  void parallel_for_tests()
+    {
+    compiler_options ops;
+    std::vector<int> squares(100);
+    parallel_for(size_t(0), squares.size(), [&](size_t i) { squares[i] = (int)(i * i); }, ops);
+    TEST_EQ(99 * 99, squares.back());
+
+    // the error of the first item that fails is reported, whichever thread finds it first
+    ops.parallel = true;
+    set_thread_pool_size(4);
+    for (int run = 0; run < 20; ++run)
+      {
+      std::string message;
+      try
+        {
+        parallel_for(size_t(0), size_t(100), [&](size_t i)
+          {
+          if (i == 30 || i == 70 || i == 99)
+            throw std::runtime_error("form " + std::to_string(i));
+          }, ops);
+        }
+      catch (std::runtime_error& e)
+        {
+        message = e.what();
+        }
+      TEST_EQ(std::string("form 30"), message);
+      }
+    set_thread_pool_size(0);
+    }
+
+  }
+
+SKIWI_END
+
+void run_all_concurrency_tests()
+  {
+  using namespace SKIWI;
+  thread_pool_tests();
+  thread_pool_participant_tests();
+  parallel_for_tests();
+  }
@@ -14,12 +14,14 @@
 #include <libskiwi/alpha_conversion.h>
 #include <libskiwi/assignable_var_conversion.h>
 #include <libskiwi/closure_conversion.h>
+#include <libskiwi/concurrency.h>
 #include <libskiwi/constant_propagation.h>
 #include <libskiwi/constant_folding.h>
 #include <libskiwi/cps_conversion.h>
 #include <libskiwi/define_conversion.h>
 #include <libskiwi/free_var_analysis.h>
 #include <libskiwi/global_define_env.h>
+#include <libskiwi/inline_primitives_conversion.h>
 #include <libskiwi/dump.h>
 #include <libskiwi/linear_scan_index.h>
 #include <libskiwi/linear_scan.h>
@@ -31,6 +33,7 @@
 #include <libskiwi/parse.h>
 #include <libskiwi/reader.h>
 #include <libskiwi/tokenize.h>
+#include <libskiwi/visitor.h>
 
 SKIWI_BEGIN
 
@@ -811,6 +814,196 @@ namespace
     TEST_EQ("( cons ( quote a ) ( cons ( cons ( quote quasiquote ) ( cons ( cons ( quote b ) ( cons ( cons ( quote unquote ) ( cons ( quote (+ 1 2) ) ( quote () ) ) ) ( cons ( cons ( quote unquote ) ( cons ( cons ( quote foo ) ( cons ( + 1 3 ) ( quote (d) ) ) ) ( quote () ) ) ) ( quote (e) ) ) ) ) ( quote () ) ) ) ( quote (f) ) ) ) ", to_string(prog));
     }
 
+  struct free_variables_collector : public base_visitor<free_variables_collector>
+    {
+    std::stringstream str;
+
+    virtual bool _previsit(Lambda& lam)
+      {
+      for (const auto& v : lam.free_variables)
+        str << v << " ";
+      str << "| ";
+      return true;
+      }
+    };
+
+  struct scan_index_collector : public base_visitor<scan_index_collector>
+    {
+    std::stringstream str;
+
+    template <class T>
+    bool record(const T& t)
+      {
+      str << t.pre_scan_index << ":" << t.scan_index << " ";
+      return true;
+      }
+
+    virtual bool _previsit(Fixnum& f) { return record(f); }
+    virtual bool _previsit(True& t) { return record(t); }
+    virtual bool _previsit(False& f) { return record(f); }
+    virtual bool _previsit(Variable& v) { return record(v); }
+    virtual bool _previsit(Begin& b) { return record(b); }
+    virtual bool _previsit(FunCall& f) { return record(f); }
+    virtual bool _previsit(If& i) { return record(i); }
+    virtual bool _previsit(Lambda& l) { return record(l); }
+    virtual bool _previsit(Let& l) { return record(l); }
+    virtual bool _previsit(PrimitiveCall& p) { return record(p); }
+    virtual bool _previsit(Set& s) { return record(s); }
+    };
+
+  struct local_names_collector : public base_visitor<local_names_collector>
+    {
+    std::vector<std::string> names;
+
+    virtual bool _previsit(Lambda& lam)
+      {
+      names.insert(names.end(), lam.variables.begin(), lam.variables.end());
+      return true;
+      }
+
+    virtual bool _previsit(Let& l)
+      {
+      for (const auto& binding : l.bindings)
+        names.push_back(binding.first);
+      return true;
+      }
+    };
+
+  template <class T>
+  std::string collect(Program& prog)
+    {
+    T collector;
+    visitor<Program, T>::visit(prog, &collector);
+    return collector.str.str();
+    }
+
+  void per_form_passes_tests()
+    {
+    compiler_options ops;
+    ops.parallel = true;
+    set_thread_pool_size(4); // take the parallel path, also on a machine with a single hardware thread
+    TEST_EQ(4, get_thread_pool().size());
+    const std::string script = "(define (f x) (g x 1)) (define (g a b) (let ([c (+ a b)]) (if (and (< c 3) #t) (car (cons c a)) (f (- c 1))))) (define h (lambda (x) (* 2 3 x))) (f 2)";
+    auto make_prog = [&]()
+      {
+      auto tokens = tokenize(script);
+      std::reverse(tokens.begin(), tokens.end());
+      auto prog = make_program(tokens);
+      define_conversion(prog);
+      single_begin_conversion(prog);
+      return prog;
+      };
+    auto serial = make_prog();
+    auto per_form = make_prog();
+    simplify_to_core_forms(serial);
+    simplify_to_core_forms(per_form, ops);
+    TEST_EQ(to_string(serial), to_string(per_form));
+
+    uint64_t serial_index = 0, per_form_index = 0;
+    std::shared_ptr<environment<alpha_conversion_data>> serial_env, per_form_env;
+    alpha_conversion(serial, serial_index, serial_env, true);
+    alpha_conversion(per_form, per_form_index, per_form_env, true, ops);
+    TEST_EQ(serial_index, per_form_index);
+    // the local names are numbered per form, the global names after all forms
+    TEST_EQ(std::string("( begin ( set! f_6 ( lambda ( x_0 ) ( begin ( g_5 x_0 1 ) ) ) ) ( set! g_5 ( lambda ( a_1 b_2 ) ( begin ( let ( [ c_3 ( + a_1 b_2 ) ] ) ( begin ( if ( if ( < c_3 3 ) #t #f ) ( car ( cons c_3 a_1 ) ) ( f_6 ( - c_3 1 ) ) ) ) ) ) ) ) ( set! h_7 ( lambda ( x_4 ) ( begin ( * 2 3 x_4 ) ) ) ) ( f_6 2 ) ) "), to_string(per_form));
+    auto per_form_converted = make_prog();
+    simplify_to_core_forms(per_form_converted, ops);
+    uint64_t index = 0;
+    std::shared_ptr<environment<alpha_conversion_data>> env;
+    alpha_conversion(per_form_converted, index, env, true, ops);
+    TEST_EQ(to_string(per_form), to_string(per_form_converted));
+
+    serial = per_form_converted;
+    inline_primitives(serial, serial_index, true, false);
+    inline_primitives(per_form, per_form_index, true, false, ops);
+    // every form reserves a block of names that is large enough for its primitive calls
+    TEST_ASSERT(serial_index <= per_form_index);
+    TEST_EQ(to_string(serial), to_string(per_form));
+
+    constant_propagation(serial);
+    constant_propagation(per_form, ops);
+    constant_folding(serial);
+    constant_folding(per_form, ops);
+    TEST_EQ(to_string(serial), to_string(per_form));
+
+    tail_call_analysis(serial);
+    tail_call_analysis(per_form, ops);
+    TEST_EQ(only_tail_calls(serial), only_tail_calls(per_form));
+
+    environment_map serial_globals = std::make_shared<environment<environment_entry>>(nullptr);
+    environment_map per_form_globals = std::make_shared<environment<environment_entry>>(nullptr);
+    free_variable_analysis(serial, serial_globals);
+    free_variable_analysis(per_form, per_form_globals, ops);
+    TEST_EQ(collect<free_variables_collector>(serial), collect<free_variables_collector>(per_form));
+    TEST_ASSERT(collect<free_variables_collector>(per_form).find("g_5") != std::string::npos); // f refers to g
+
+    compute_linear_scan_index(serial);
+    compute_linear_scan_index(per_form, ops);
+    TEST_EQ(collect<scan_index_collector>(serial), collect<scan_index_collector>(per_form));
+
+    // many forms over several threads, with a local that shadows a primitive: every local gets a name of its own
+    std::stringstream many_forms;
+    for (int i = 0; i < 100; ++i)
+      many_forms << "(define (f" << i << " x car) (let ([y (car x)]) (lambda (z) (+ x y z)))) ";
+    auto tokens = tokenize(many_forms.str());
+    std::reverse(tokens.begin(), tokens.end());
+    Program many = make_program(tokens);
+    define_conversion(many);
+    single_begin_conversion(many);
+    simplify_to_core_forms(many, ops);
+    uint64_t many_index = 0;
+    std::shared_ptr<environment<alpha_conversion_data>> many_env;
+    alpha_conversion(many, many_index, many_env, true, ops);
+    local_names_collector names;
+    visitor<Program, local_names_collector>::visit(many, &names);
+    TEST_EQ(400, names.names.size()); // x, car, y and z of every form
+    std::sort(names.names.begin(), names.names.end());
+    TEST_ASSERT(std::adjacent_find(names.names.begin(), names.names.end()) == names.names.end());
+    TEST_ASSERT(to_string(many).find("( car_") != std::string::npos); // (car x) calls the local car
+    set_thread_pool_size(0);
+    }
+
+  void environment_transaction_tests()
+    {
+    auto global = std::make_shared<environment<int>>(nullptr);
+    global->push("a", 1);
+    global->push("b", 2);
+    auto local = std::make_shared<environment<int>>(global);
+    uint64_t savepoint = global->begin_transaction();
+    global->push("c", 3);
+    local->replace("a", 10); // changes the entry in global
+    local->push_outer("d", 4);
+    local->remove("b");
+    uint64_t inner_savepoint = global->begin_transaction();
+    global->push("a", 100);
+    global->rollback(inner_savepoint);
+    int value = 0;
+    TEST_ASSERT(global->find(value, "a"));
+    TEST_EQ(10, value);
+    global->rollback(savepoint);
+    TEST_ASSERT(global->find(value, "a"));
+    TEST_EQ(1, value);
+    TEST_ASSERT(global->find(value, "b"));
+    TEST_EQ(2, value);
+    TEST_ASSERT(!global->has("c"));
+    TEST_ASSERT(!global->has("d"));
+
+    savepoint = global->begin_transaction();
+    global->push("e", 5);
+    global->commit(savepoint);
+    TEST_ASSERT(global->has("e"));
+
+    auto top_level = std::make_shared<environment<int>>(global);
+    top_level->push("a", 20);
+    top_level->push("f", 6);
+    auto rolled_up = rollup_into_outer(top_level);
+    TEST_ASSERT(rolled_up == global);
+    TEST_ASSERT(rolled_up->find(value, "a"));
+    TEST_EQ(20, value);
+    TEST_ASSERT(rolled_up->has("e"));
+    TEST_ASSERT(rolled_up->has("f"));
+    }
+
   }
 
 SKIWI_END
@@ -834,4 +1027,6 @@ void run_all_conversion_tests()
   bug1();
   quasiquote_conversion_tests();
   constant_propagation_tests();
+  environment_transaction_tests();
+  per_form_passes_tests();
   }
@@ -0,0 +1,51 @@
+#include <libskiwi/libskiwi.h>
+
+#include <new>
+#include <stdlib.h>
+
+/*
+The tests replace the global allocation functions, so that the compile stats count the allocations of the passes
+(see skiwi_count_allocation).
+*/
+
+namespace
+  {
+  void* counted_allocation(std::size_t size)
+    {
+    skiwi::skiwi_count_allocation(size);
+    void* p = malloc(size ? size : 1);
+    if (!p)
+      throw std::bad_alloc();
+    return p;
+    }
+  }
+
+void* operator new(std::size_t size)
+  {
+  return counted_allocation(size);
+  }
+
+void* operator new[](std::size_t size)
+  {
+  return counted_allocation(size);
+  }
+
+void operator delete(void* p) noexcept
+  {
+  free(p);
+  }
+
+void operator delete[](void* p) noexcept
+  {
+  free(p);
+  }
+
+void operator delete(void* p, std::size_t) noexcept
+  {
+  operator delete(p);
+  }
+
+void operator delete[](void* p, std::size_t) noexcept
+  {
+  operator delete[](p);
+  }
@@ -2,6 +2,7 @@
 
 #include "compile_tests.h"
 #include "compile_vm_tests.h"
+#include "concurrency_tests.h"
 #include "conversion_tests.h"
 #include "format_tests.h"
 #include "parse_tests.h"
@@ -19,6 +20,7 @@ int main(int /*argc*/, const char* /*argv*/[])
   run_all_parse_tests();
   run_all_tokenize_tests();
   run_all_conversion_tests();
+  run_all_concurrency_tests();
   run_all_preprocess_tests();
   run_all_compile_tests();
   run_all_compile_vm_tests();
@@ -1,8 +1,13 @@
 #include "alpha_conversion.h"
 #include "compile_error.h"
 #include "visitor.h"
+#include "concurrency.h"
+#include "debug_find.h"
 #include "parse.h"
 
+#include <atomic>
+#include <cassert>
+#include <map>
 #include <vector>
 #include <cctype>
 
@@ -14,6 +19,97 @@ namespace
   {
   std::vector<Set*> g_unhandled_sets;
 
+  std::string make_name(const std::string& original, uint64_t i)
+    {
+    std::stringstream str;
+    str << original << "_" << i;
+    return str.str();
+    }
+
+  typedef std::shared_ptr<environment<alpha_conversion_data>> alpha_conversion_env;
+
+  /*
+  The conversions below depend on the variables that are known at top level, i.e. on the top-level forms that were
+  converted before.
+  */
+  void convert_variable(Variable& v, const alpha_conversion_env& env, uint64_t& index, bool modify_names)
+    {
+    alpha_conversion_data new_name;
+    if (!env->find(new_name, v.name)) // variables are already used in a context with the variable being defined later
+      {
+      //throw_error(v.line_nr, v.column_nr, v.filename, primitive_unknown, v.name);
+      new_name.name = modify_names ? make_name(v.name, index++) : v.name;
+      new_name.forward_declaration = true;
+      env->push_outer(v.name, new_name);
+      }
+    v.name = new_name.name;
+    }
+
+  void convert_set(Set& s, const alpha_conversion_env& env, uint64_t& index, bool modify_names, std::vector<Set*>& unhandled_sets)
+    {
+    alpha_conversion_data new_name;
+
+    if (s.originates_from_define || s.originates_from_quote)
+      {
+      if (!env->find(new_name, s.name))
+        {
+        new_name.name = modify_names ? make_name(s.name, index++) : s.name;
+        env->push(s.name, new_name);
+        }
+      else
+        {
+        if (new_name.forward_declaration) // this variable was forward declared, but now it is also defined, so set forward_declaration to false.
+          {
+          new_name.forward_declaration = false;
+          env->push(s.name, new_name);
+          }
+        else
+          s.originates_from_define = false; // was already defined before, therefore, treat this define as a set!
+        }
+      s.name = new_name.name;
+      }
+    else if (!env->find(new_name, s.name))
+      {
+      static std::map<std::string, expression_type> expr_map = generate_expression_map();
+      auto it = expr_map.find(s.name);
+      if (it != expr_map.end() && it->second == et_primitive_call)
+        { // we're setting a primitive call, convert it to a define
+        new_name.name = modify_names ? make_name(s.name, index++) : s.name;
+        env->push(s.name, new_name);
+        s.name = new_name.name;
+        s.originates_from_define = true;
+        }
+      else
+        unhandled_sets.push_back(&s);
+      }
+    else
+      s.name = new_name.name;
+    }
+
+  void convert_primitive_call(Expression& e, const alpha_conversion_data& new_name)
+    {
+    PrimitiveCall& p = std::get<PrimitiveCall>(e);
+    Variable v;
+    v.name = new_name.name;
+    if (p.as_object)
+      e = v;
+    else
+      {
+      // the arguments are moved, so that pointers to the argument expressions stay valid
+      FunCall f;
+      f.fun.push_back(v);
+      f.arguments = std::move(p.arguments);
+      e = std::move(f);
+      }
+    }
+
+  void convert_primitive_call(Expression& e, const alpha_conversion_env& env)
+    {
+    alpha_conversion_data new_name;
+    if (env->find(new_name, std::get<PrimitiveCall>(e).primitive_name)) // it is possible that a primitive name has been redefined. That case is treated here.
+      convert_primitive_call(e, new_name);
+    }
+
   struct alpha_conversion_state
     {
     enum struct e_ac_state
@@ -30,25 +126,47 @@ namespace
     alpha_conversion_state(Expression* ip_expr, e_ac_state s) : p_expr(ip_expr), state(s) {}
     };
 
+  /*
+  A change of the parallel conversion of a top-level form. The changes are only made once every form is known to fit
+  in its block of indices, so that the serial conversion can still start from the unchanged program otherwise.
+  */
+  struct deferred_change
+    {
+    std::string* name; // becomes new_name.name, or nullptr if primitive_call is converted with new_name
+    Expression* primitive_call;
+    alpha_conversion_data new_name;
+    };
+
+  void make_change(deferred_change& change)
+    {
+    if (change.name)
+      *change.name = std::move(change.new_name.name);
+    else
+      convert_primitive_call(*change.primitive_call, change.new_name);
+    }
+
   struct alpha_conversion_helper
     {
     std::vector<alpha_conversion_state> expressions;
     std::vector<uint64_t> index;
     std::vector<std::shared_ptr<environment<alpha_conversion_data>>> env;
     bool modify_names;
+    std::vector<Expression*>* top_level_references; // if not null, expressions that depend on the top-level variables are collected here instead of converted
+    std::vector<deferred_change>* deferred_changes; // if not null, the names are changed later, see deferred_change
 
-    alpha_conversion_helper(uint64_t i, const std::shared_ptr<environment<alpha_conversion_data>>& p_outer, bool mn)
+    alpha_conversion_helper(uint64_t i, const std::shared_ptr<environment<alpha_conversion_data>>& p_outer, bool mn) : top_level_references(nullptr), deferred_changes(nullptr)
       {
       modify_names = mn;
       index.push_back(i);
       env.push_back(std::make_shared<environment<alpha_conversion_data>>(p_outer));
       }
 
-    std::string make_name(const std::string& original, uint64_t i)
+    void rename(std::string& name, const std::string& new_name)
       {
-      std::stringstream str;
-      str << original << "_" << i;
-      return str.str();
+      if (deferred_changes)
+        deferred_changes->push_back(deferred_change{ &name, nullptr, alpha_conversion_data(new_name) });
+      else
+        name = new_name;
       }
 
     void treat_expressions()
@@ -71,14 +189,12 @@ namespace
             {
             Variable& v = std::get<Variable>(e);
             alpha_conversion_data new_name;
-            if (!env.back()->find(new_name, v.name)) // variables are already used in a context with the variable being defined later
-              {
-              //throw_error(v.line_nr, v.column_nr, v.filename, primitive_unknown, v.name);
-              new_name.name = modify_names ? make_name(v.name, index.back()++) : v.name;
-              new_name.forward_declaration = true;
-              env.back()->push_outer(v.name, new_name);
-              }
-            v.name = new_name.name;
+            if (!top_level_references)
+              convert_variable(v, env.back(), index.back(), modify_names);
+            else if (env.back()->find(new_name, v.name))
+              rename(v.name, new_name.name);
+            else
+              top_level_references->push_back(&e);
             }
           else if (std::holds_alternative<Nop>(e))
             {
@@ -129,7 +245,7 @@ namespace
               std::string& var_name = lam.variables[i];
               std::string new_name = modify_names ? make_name(var_name, index.back()++) : var_name;
               env.back()->push(var_name, new_name);
-              lam.variables[i] = new_name;
+              rename(lam.variables[i], new_name);
               }
             //visitor<Expression, alpha_conversion_visitor>::visit(lam.body.front(), &new_visitor);
             //index = new_visitor.index;            
@@ -173,7 +289,7 @@ namespace
               std::string original = binding.first;
               std::string adapted = modify_names ? make_name(original, index.back()++) : original;
               env.back()->push(original, adapted);
-              binding.first = adapted;
+              rename(binding.first, adapted);
               }
 
             expressions.push_back(&l.body.front());
@@ -182,59 +298,27 @@ namespace
             {
             Set& s = std::get<Set>(e);
             alpha_conversion_data new_name;
-
-            if (s.originates_from_define || s.originates_from_quote)
-              {
-              if (!env.back()->find(new_name, s.name))
-                {
-                new_name.name = modify_names ? make_name(s.name, index.back()++) : s.name;
-                env.back()->push(s.name, new_name);
-                }
-              else
-                {
-                if (new_name.forward_declaration) // this variable was forward declared, but now it is also defined, so set forward_declaration to false.
-                  {
-                  new_name.forward_declaration = false;
-                  env.back()->push(s.name, new_name);
-                  }
-                else
-                  s.originates_from_define = false; // was already defined before, therefore, treat this define as a set!
-                }
-              s.name = new_name.name;
-              }
-            else if (!env.back()->find(new_name, s.name))
-              {
-              static std::map<std::string, expression_type> expr_map = generate_expression_map();
-              auto it = expr_map.find(s.name);
-              if (it != expr_map.end() && it->second == et_primitive_call)
-                { // we're setting a primitive call, convert it to a define
-                new_name.name = modify_names ? make_name(s.name, index.back()++) : s.name;
-                env.back()->push(s.name, new_name);
-                s.name = new_name.name;
-                s.originates_from_define = true;
-                }
-              else
-                g_unhandled_sets.push_back(&s);
-              }
+            if (!top_level_references)
+              convert_set(s, env.back(), index.back(), modify_names, g_unhandled_sets);
+            else if (!s.originates_from_define && !s.originates_from_quote && env.back()->find(new_name, s.name))
+              rename(s.name, new_name.name);
             else
-              s.name = new_name.name;
+              top_level_references->push_back(&e);
             }
           else if (std::holds_alternative<PrimitiveCall>(e))
             {
-            PrimitiveCall& p = std::get<PrimitiveCall>(e);
             alpha_conversion_data new_name;
-            if (env.back()->find(new_name, p.primitive_name)) // it is possible that a primitive name has been redefined. That case is treated here.
+            if (!top_level_references)
+              convert_primitive_call(e, env.back());
+            else if (env.back()->find(new_name, std::get<PrimitiveCall>(e).primitive_name))
               {
-              FunCall f;
-              Variable v;
-              v.name = new_name.name;
-              f.fun.push_back(v);
-              f.arguments = p.arguments;
-              if (p.as_object)
-                e = v;
+              if (deferred_changes)
+                deferred_changes->push_back(deferred_change{ nullptr, &e, new_name });
               else
-                e = f;
+                convert_primitive_call(e, new_name);
               }
+            else
+              top_level_references->push_back(&e);
             }
           else
             throw std::runtime_error("Compiler error!: alpha conversion: not implemented");
@@ -407,8 +491,7 @@ void alpha_conversion(Program& prog, uint64_t& alpha_conversion_index, std::shar
   ach.treat_expressions();
 
   //env = acv.env;
-  env = ach.env.back();
-  env->rollup();
+  env = rollup_into_outer(ach.env.back());
 
   for (auto& unhandled_set : g_unhandled_sets)
     {
@@ -432,6 +515,125 @@ void alpha_conversion(Program& prog, uint64_t& alpha_conversion_index, std::shar
   prog.alpha_converted = true;
   }
 
+/*
+The top-level forms are converted in three steps:
+1. In parallel: every form counts its local variables (lambda variables and let bindings). The forms get consecutive blocks
+   of alpha conversion indices of that size, in program order.
+2. In parallel: every form renames its local variables with the indices of its block. The variables, set!s and primitive
+   calls that are not local are not converted yet, but collected in the order in which the serial conversion would
+   meet them. The new names are only written once every form turned out to fit in its block, otherwise the program is
+   converted serially.
+3. Serially, in program order: the collected expressions are converted against the top-level environment. This step
+   sees the top-level defines and forward declarations in the same order as the serial conversion, so the result
+   only differs in the numbering of the names.
+A set! of a primitive that is not defined turns into a define of a local variable when it occurs inside a lambda, and a
+define that is not a top-level form is treated as local too. Programs with such forms use the serial conversion.
+*/
+void alpha_conversion(Program& prog, uint64_t& alpha_conversion_index, std::shared_ptr<environment<alpha_conversion_data>>& env, bool modify_names, const compiler_options& ops)
+  {
+  if (!ops.parallel || prog.expressions.size() != 1 || !std::holds_alternative<Begin>(prog.expressions.front()))
+    {
+    alpha_conversion(prog, alpha_conversion_index, env, modify_names);
+    return;
+    }
+  Begin& beg = std::get<Begin>(prog.expressions.front());
+  const size_t sz = beg.arguments.size();
+  std::vector<uint64_t> first_index(sz + 1, 0);
+  std::atomic<bool> needs_serial_conversion(false);
+  parallel_for(size_t(0), sz, [&](size_t i)
+    {
+    static std::map<std::string, expression_type> expr_map = generate_expression_map();
+    uint64_t nr_of_local_variables = 0;
+    const Expression* form = &beg.arguments[i];
+    find(beg.arguments[i], [&](const Expression& e)
+      {
+      if (std::holds_alternative<Lambda>(e))
+        nr_of_local_variables += std::get<Lambda>(e).variables.size();
+      else if (std::holds_alternative<Let>(e))
+        nr_of_local_variables += std::get<Let>(e).bindings.size();
+      else if (std::holds_alternative<Set>(e))
+        {
+        const Set& s = std::get<Set>(e);
+        if (s.originates_from_define || s.originates_from_quote)
+          {
+          if (&e != form)
+            needs_serial_conversion = true;
+          }
+        else
+          {
+          auto it = expr_map.find(s.name);
+          if (it != expr_map.end() && it->second == et_primitive_call)
+            needs_serial_conversion = true;
+          }
+        }
+      return false;
+      });
+    first_index[i + 1] = nr_of_local_variables;
+    }, ops);
+  if (needs_serial_conversion)
+    {
+    alpha_conversion(prog, alpha_conversion_index, env, modify_names);
+    return;
+    }
+  first_index[0] = alpha_conversion_index;
+  for (size_t i = 0; i < sz; ++i)
+    first_index[i + 1] += first_index[i];
+
+  std::vector<std::vector<Expression*>> top_level_references(sz);
+  std::vector<std::vector<deferred_change>> deferred_changes(sz);
+  std::atomic<bool> block_overflow(false);
+  parallel_for(size_t(0), sz, [&](size_t i)
+    {
+    alpha_conversion_helper ach(first_index[i], nullptr, modify_names);
+    ach.top_level_references = &top_level_references[i];
+    ach.deferred_changes = &deferred_changes[i];
+    ach.expressions.push_back(&beg.arguments[i]);
+    ach.treat_expressions();
+    if (ach.index.back() > first_index[i + 1]) // the count of step 1 missed a name, the blocks of the forms overlap
+      block_overflow = true;
+    }, ops);
+  if (block_overflow)
+    {
+    alpha_conversion(prog, alpha_conversion_index, env, modify_names);
+    return;
+    }
+  parallel_for(size_t(0), sz, [&](size_t i)
+    {
+    for (auto& change : deferred_changes[i])
+      make_change(change);
+    }, ops);
+
+  alpha_conversion_env top_level_env = std::make_shared<environment<alpha_conversion_data>>(env);
+  uint64_t index = first_index[sz];
+  std::vector<Set*> unhandled_sets;
+  for (const auto& references : top_level_references)
+    {
+    for (Expression* p_expr : references)
+      {
+      Expression& e = *p_expr;
+      if (std::holds_alternative<Variable>(e))
+        convert_variable(std::get<Variable>(e), top_level_env, index, modify_names);
+      else if (std::holds_alternative<Set>(e))
+        convert_set(std::get<Set>(e), top_level_env, index, modify_names, unhandled_sets);
+      else
+        convert_primitive_call(e, top_level_env);
+      }
+    }
+
+  env = rollup_into_outer(top_level_env);
+
+  for (auto& unhandled_set : unhandled_sets)
+    {
+    alpha_conversion_data new_name;
+    if (!env->find(new_name, unhandled_set->name))
+      throw std::runtime_error("alpha conversion: set! error");
+    unhandled_set->name = new_name.name;
+    }
+
+  alpha_conversion_index = index;
+  prog.alpha_converted = true;
+  }
+
 std::string get_variable_name_before_alpha(const std::string& variable_name_after_alpha)
   {
   auto pos = variable_name_after_alpha.find_last_of('_');
@@ -12,6 +12,8 @@
 
 SKIWI_BEGIN
 
+struct compiler_options;
+
 struct alpha_conversion_data
   {
   SKIWI_SCHEME_API alpha_conversion_data() : forward_declaration(false) {}
@@ -30,6 +32,12 @@ The index is in and output via the variable alpha_conversion_index.
 */
 SKIWI_SCHEME_API void alpha_conversion(Program& prog, uint64_t& alpha_conversion_index, std::shared_ptr<environment<alpha_conversion_data>>& env, bool modify_names = true);
 
+/*
+Converts the top-level forms in parallel if ops.parallel is set. The names get other indices than with the serial
+conversion, but the indices do not depend on the number of threads.
+*/
+SKIWI_SCHEME_API void alpha_conversion(Program& prog, uint64_t& alpha_conversion_index, std::shared_ptr<environment<alpha_conversion_data>>& env, bool modify_names, const compiler_options& ops);
+
 std::string get_variable_name_before_alpha(const std::string& variable_name_after_alpha);
 
 SKIWI_END
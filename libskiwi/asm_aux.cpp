@@ -3,6 +3,7 @@
 #include "context.h"
 #include "context_defs.h"
 #include "globals.h"
+#include "heap_profiler.h"
 #include <sstream>
 
 SKIWI_BEGIN
@@ -289,6 +290,97 @@ void check_heap(asmcode& code, runtime_error re)
   code.add(asmcode::LABEL, heap_ok);
   }
 
+void check_heap_or_make_room(asmcode& code, runtime_error re)
+  {
+  // clobbers rax and r15
+  auto heap_ok = label_to_string(label++);
+  code.add(asmcode::SHL, asmcode::RAX, asmcode::NUMBER, 3);
+  code.add(asmcode::ADD, asmcode::RAX, ALLOC);
+  code.add(asmcode::MOV, asmcode::R15, FROM_SPACE_END);
+  code.add(asmcode::CMP, asmcode::RAX, asmcode::R15);
+  code.add(asmcode::JLS, heap_ok);
+  code.add(asmcode::SUB, asmcode::RAX, ALLOC);
+  code.add(asmcode::CALL, "L_make_room"); // keeps rax, but moves ALLOC
+  code.add(asmcode::ADD, asmcode::RAX, ALLOC);
+  code.add(asmcode::MOV, asmcode::R15, FROM_SPACE_END);
+  code.add(asmcode::CMP, asmcode::RAX, asmcode::R15);
+  code.add(asmcode::JLS, heap_ok);
+  code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, (uint64_t)re);
+  code.add(asmcode::SHL, asmcode::RAX, asmcode::NUMBER, 8);
+  code.add(asmcode::OR, asmcode::RAX, asmcode::NUMBER, error_tag);
+  code.add(asmcode::JMP, ERROR);
+  code.add(asmcode::LABEL, heap_ok);
+  }
+
+void write_barrier(asmcode& code, asmcode::operand slot, asmcode::operand value)
+  {
+  auto done = label_to_string(label++);
+  auto record = label_to_string(label++);
+  auto overflow = label_to_string(label++);
+  code.add(asmcode::MOV, asmcode::R11, value);
+  code.add(asmcode::AND, asmcode::R11, asmcode::NUMBER, block_mask);
+  code.add(asmcode::CMP, asmcode::R11, asmcode::NUMBER, block_tag);
+  code.add(asmcode::JNE, done);
+  code.add(asmcode::CMP, value, NURSERY);
+  code.add(asmcode::JL, done);
+  code.add(asmcode::CMP, value, NURSERY_END);
+  code.add(asmcode::JGE, done);
+  code.add(asmcode::CMP, slot, NURSERY);
+  code.add(asmcode::JL, record);
+  code.add(asmcode::CMP, slot, NURSERY_END);
+  code.add(asmcode::JL, done);
+  code.add(asmcode::LABEL, record);
+  code.add(asmcode::MOV, asmcode::R15, REMEMBERED_SET_TOP);
+  code.add(asmcode::CMP, asmcode::R15, REMEMBERED_SET_END);
+  code.add(asmcode::JGE, overflow);
+  code.add(asmcode::MOV, asmcode::MEM_R15, slot);
+  code.add(asmcode::ADD, asmcode::R15, asmcode::NUMBER, CELLS(1));
+  code.add(asmcode::MOV, REMEMBERED_SET_TOP, asmcode::R15);
+  code.add(asmcode::JMP, done);
+  code.add(asmcode::LABEL, overflow);
+  // the remembered set is full: the next collection will be a major collection, which does not need it
+  code.add(asmcode::MOV, REMEMBERED_SET_OVERFLOW, asmcode::NUMBER, 1);
+  code.add(asmcode::LABEL, done);
+  }
+
+void count_procedure_allocations(asmcode& code, asmcode::operand free_reg_1, asmcode::operand free_reg_2)
+  {
+  code.add(asmcode::MOV, free_reg_1, CURRENT_PROCEDURE);
+  code.add(asmcode::ADD, free_reg_1, PROCEDURE_COUNTERS);
+  code.add(asmcode::MOV, free_reg_2, ALLOC);
+  code.add(asmcode::SUB, free_reg_2, PROCEDURE_ALLOC_MARK);
+  code.add(asmcode::ADD, get_mem_operand(free_reg_1), CELLS(1), free_reg_2);
+  }
+
+void check_heap_sample(asmcode& code, asmcode::operand allocated_bytes)
+  {
+  auto no_sample = label_to_string(label++);
+  code.add(asmcode::SUB, HEAP_SAMPLE_COUNTDOWN, allocated_bytes);
+  code.add(asmcode::JG, no_sample);
+  code.add(asmcode::PUSH, asmcode::RAX);
+  code.add(asmcode::PUSH, asmcode::R11);
+  code.add(asmcode::PUSH, asmcode::R15);
+  save_before_foreign_call(code);
+  code.add(asmcode::MOV, ALLOC_SAVED, ALLOC);
+  align_stack(code);
+  code.add(asmcode::MOV, asmcode::R15, CONTEXT); // r15 should be saved by the callee but r10 not, so we save the context in r15
+#ifdef _WIN32
+  code.add(asmcode::MOV, asmcode::RCX, CONTEXT);
+  code.add(asmcode::SUB, asmcode::RSP, asmcode::NUMBER, 32);
+#else
+  code.add(asmcode::MOV, asmcode::RDI, CONTEXT);
+#endif
+  code.add(asmcode::MOV, asmcode::R11, asmcode::NUMBER, (uint64_t)&sample_heap_allocations);
+  code.add(asmcode::CALLEXTERNAL, asmcode::R11);
+  code.add(asmcode::MOV, CONTEXT, asmcode::R15); // now we restore the context
+  restore_stack(code);
+  restore_after_foreign_call(code);
+  code.add(asmcode::POP, asmcode::R15);
+  code.add(asmcode::POP, asmcode::R11);
+  code.add(asmcode::POP, asmcode::RAX);
+  code.add(asmcode::LABEL, no_sample);
+  }
+
 void save_before_foreign_call(asmcode& code)
   {
   /*
@@ -45,6 +45,34 @@ void jump_if_arg_does_not_point_to_promise(ASM::asmcode& code, ASM::asmcode::ope
 /*assumes RAX contains the extra heap size requested*/
 void check_heap(ASM::asmcode& code, runtime_error re);
 
+/*
+Like check_heap, but if the rax cells do not fit, L_make_room first collects garbage and grows the heap so that they fit,
+and the check is repeated. Only for the code of the primitives library, at points where every heap object that is still
+needed is a tagged pointer in one of the registers that the collector updates (rcx, rdx, rsi, rdi, r8, r9, r12, r14) or
+in the locals. Clobbers rax and r15, keeps r11.
+*/
+void check_heap_or_make_room(ASM::asmcode& code, runtime_error re);
+
+/*
+Write barrier for the generational garbage collector: value was just written to the address in slot.
+If value points into the nursery and slot does not, slot is added to the remembered set.
+Clobbers r11 and r15.
+*/
+void write_barrier(ASM::asmcode& code, ASM::asmcode::operand slot, ASM::asmcode::operand value);
+
+/*
+Adds the bytes that were allocated since PROCEDURE_ALLOC_MARK to the counters of the current procedure
+(see compiler_options::procedure_counters). The context should have procedure counters. Clobbers both free registers.
+*/
+void count_procedure_allocations(ASM::asmcode& code, ASM::asmcode::operand free_reg_1, ASM::asmcode::operand free_reg_2);
+
+/*
+Subtracts allocated_bytes from HEAP_SAMPLE_COUNTDOWN, and calls sample_heap_allocations when the countdown runs out
+(see compiler_options::heap_profiling). Call it right after count_procedure_allocations, with its second free register.
+All registers are kept.
+*/
+void check_heap_sample(ASM::asmcode& code, ASM::asmcode::operand allocated_bytes);
+
 
 void save_before_foreign_call(ASM::asmcode& code);
 void restore_after_foreign_call(ASM::asmcode& code);
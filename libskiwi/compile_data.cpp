@@ -24,6 +24,8 @@ compile_data create_compile_data(uint64_t heap_size, uint64_t globals_stack, uin
   cd.first_ra_map_time_point_to_elapse = (uint64_t)-1;
 
   cd.p_ctxt = p_ctxt;
+  cd.lambda_names = nullptr;
+  cd.procedure_index = 0;
   return cd;
   }
 
@@ -6,12 +6,14 @@
 #include "reg_alloc.h"
 #include "reg_alloc_map.h"
 #include "libskiwi_api.h"
+#include <map>
 #include <string>
 #include <memory>
 
 SKIWI_BEGIN
 
 struct context;
+struct Lambda;
 
 struct compile_data
   {
@@ -23,6 +25,9 @@ struct compile_data
   uint64_t heap_size;
   std::string halt_label;
   context* p_ctxt;
+  const std::map<const Lambda*, std::string>* lambda_names; // names of the lambdas that are the value of a define, used as symbol names of their code, nullptr if no symbol names are made
+  std::string symbol_name; // symbol name of the code that is being compiled
+  uint64_t procedure_index; // index in repl_data::procedure_names of the code that is being compiled, see compiler_options::procedure_counters
   };
 
 
@@ -0,0 +1,85 @@
+#include "compile_stats.h"
+
+#include <chrono>
+#include <mutex>
+
+SKIWI_BEGIN
+
+namespace
+  {
+  std::mutex stats_mutex;
+  std::vector<compile_pass_stats> stats;
+  thread_local compile_pass_timer* innermost_timer = nullptr;
+  thread_local uint64_t allocation_count = 0;
+  thread_local uint64_t allocated_byte_count = 0;
+
+  uint64_t now_in_nanoseconds()
+    {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+  }
+
+compile_pass_timer::compile_pass_timer(const char* pass_name) : name(pass_name), nanoseconds(0), allocations(0), allocated_bytes(0), outer(innermost_timer)
+  {
+  if (outer)
+    outer->pause();
+  innermost_timer = this;
+  resume();
+  }
+
+compile_pass_timer::~compile_pass_timer()
+  {
+  pause();
+    {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    auto it = stats.begin();
+    while (it != stats.end() && it->name != name)
+      ++it;
+    if (it == stats.end())
+      it = stats.insert(it, compile_pass_stats{ name, 0, 0, 0, 0 });
+    ++it->runs;
+    it->nanoseconds += nanoseconds;
+    it->allocations += allocations;
+    it->allocated_bytes += allocated_bytes;
+    }
+  innermost_timer = outer;
+  if (outer)
+    outer->resume();
+  }
+
+void compile_pass_timer::pause()
+  {
+  nanoseconds += now_in_nanoseconds() - resumed_at;
+  allocations += allocation_count - allocations_at_resume;
+  allocated_bytes += allocated_byte_count - allocated_bytes_at_resume;
+  }
+
+void compile_pass_timer::resume()
+  {
+  allocations_at_resume = allocation_count;
+  allocated_bytes_at_resume = allocated_byte_count;
+  resumed_at = now_in_nanoseconds();
+  }
+
+void count_compile_allocation(uint64_t size)
+  {
+  if (innermost_timer)
+    {
+    ++allocation_count;
+    allocated_byte_count += size;
+    }
+  }
+
+std::vector<compile_pass_stats> get_compile_stats()
+  {
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  return stats;
+  }
+
+void reset_compile_stats()
+  {
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  stats.clear();
+  }
+
+SKIWI_END
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "namespace.h"
+#include "libskiwi_api.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+SKIWI_BEGIN
+
+/*
+Compile-time statistics per pass of the compiler (macro expansion, alpha conversion, cps conversion, ..., code
+generation, assembly). A compile_pass_timer measures the pass that runs in its scope: the wall-clock time, and the
+number and size of the allocations that were reported with count_compile_allocation.
+
+Passes can run inside other passes, e.g. the macro expander compiles the macros it finds. The time and allocations of
+the inner pass are only counted for the inner pass, so that the numbers of all passes add up to the total.
+Allocations are counted per thread, so the allocations of the worker threads of a parallel pass are not counted.
+*/
+
+struct compile_pass_stats
+  {
+  std::string name;
+  uint64_t runs;
+  uint64_t nanoseconds;
+  uint64_t allocations;
+  uint64_t allocated_bytes;
+  };
+
+class compile_pass_timer
+  {
+  public:
+    SKIWI_SCHEME_API explicit compile_pass_timer(const char* pass_name);
+    SKIWI_SCHEME_API ~compile_pass_timer();
+
+    compile_pass_timer(const compile_pass_timer&) = delete;
+    compile_pass_timer& operator = (const compile_pass_timer&) = delete;
+
+  private:
+    const char* name;
+    uint64_t nanoseconds; // of this pass, up to the moment it was resumed last
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    uint64_t resumed_at;
+    uint64_t allocations_at_resume;
+    uint64_t allocated_bytes_at_resume;
+    compile_pass_timer* outer;
+
+    void pause();
+    void resume();
+  };
+
+/*
+Counts an allocation of size bytes for the pass that runs in the calling thread, if any. The library does not replace
+the global operator new, so allocations are only counted if the application does so and calls this function from it
+(see skiwi_count_allocation in libskiwi.h).
+*/
+SKIWI_SCHEME_API void count_compile_allocation(uint64_t size);
+
+/*
+Returns the statistics of all passes that ran since the last reset_compile_stats, in the order in which they first ran.
+*/
+SKIWI_SCHEME_API std::vector<compile_pass_stats> get_compile_stats();
+
+SKIWI_SCHEME_API void reset_compile_stats();
+
+SKIWI_END
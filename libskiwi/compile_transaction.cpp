@@ -0,0 +1,57 @@
+#include "compile_transaction.h"
+
+SKIWI_BEGIN
+
+compile_transaction::compile_transaction(environment_map& i_env, repl_data& i_rd) : env(i_env), rd(i_rd),
+  old_env(i_env), old_alpha_conversion_env(i_rd.alpha_conversion_env), env_savepoint(0), alpha_conversion_env_savepoint(0),
+  old_alpha_conversion_index(i_rd.alpha_conversion_index), old_global_index(i_rd.global_index),
+  old_nr_of_procedure_names(i_rd.procedure_names.size()), open(true)
+  {
+  if (old_env)
+    env_savepoint = old_env->begin_transaction();
+  if (old_alpha_conversion_env)
+    alpha_conversion_env_savepoint = old_alpha_conversion_env->begin_transaction();
+  }
+
+compile_transaction::~compile_transaction()
+  {
+  if (open)
+    commit();
+  }
+
+void compile_transaction::commit()
+  {
+  if (!open)
+    return;
+  if (old_env)
+    old_env->commit(env_savepoint);
+  if (old_alpha_conversion_env)
+    old_alpha_conversion_env->commit(alpha_conversion_env_savepoint);
+  open = false;
+  }
+
+void compile_transaction::rollback()
+  {
+  if (!open)
+    return;
+  if (old_env)
+    old_env->rollback(env_savepoint);
+  if (old_alpha_conversion_env)
+    old_alpha_conversion_env->rollback(alpha_conversion_env_savepoint);
+  env = old_env;
+  rd.alpha_conversion_env = old_alpha_conversion_env;
+  // the quotes of this compilation got an index from alpha_conversion_index, so they are exactly the new ones
+  for (auto it = rd.quote_to_index.begin(); it != rd.quote_to_index.end();)
+    {
+    if (it->second >= old_alpha_conversion_index)
+      it = rd.quote_to_index.erase(it);
+    else
+      ++it;
+    }
+  rd.alpha_conversion_index = old_alpha_conversion_index;
+  rd.global_index = old_global_index;
+  rd.procedure_names.resize(old_nr_of_procedure_names);
+  open = false;
+  }
+
+SKIWI_END
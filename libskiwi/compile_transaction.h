@@ -0,0 +1,44 @@
+#pragma once
+
+#include "namespace.h"
+#include "libskiwi_api.h"
+#include "compiler.h"
+#include "repl_data.h"
+
+#include <stdint.h>
+
+SKIWI_BEGIN
+
+/*
+Undoes the changes that a compilation makes to the global environment and to the repl data when the compilation fails.
+Instead of making a deep copy of both before every compilation, the environments record the entries that change (see
+environment::begin_transaction), and the parts of the repl data that only grow are cut back to their old size. So the
+cost of a compilation no longer grows with the number of globals.
+The transaction commits when it goes out of scope, unless rollback was called.
+*/
+class compile_transaction
+  {
+  public:
+    SKIWI_SCHEME_API compile_transaction(environment_map& env, repl_data& rd);
+    SKIWI_SCHEME_API ~compile_transaction();
+
+    compile_transaction(const compile_transaction&) = delete;
+    compile_transaction& operator = (const compile_transaction&) = delete;
+
+    SKIWI_SCHEME_API void commit();
+    SKIWI_SCHEME_API void rollback();
+
+  private:
+    environment_map& env;
+    repl_data& rd;
+    environment_map old_env;
+    std::shared_ptr<environment<alpha_conversion_data>> old_alpha_conversion_env;
+    uint64_t env_savepoint;
+    uint64_t alpha_conversion_env_savepoint;
+    uint64_t old_alpha_conversion_index;
+    uint64_t old_global_index;
+    uint64_t old_nr_of_procedure_names;
+    bool open;
+  };
+
+SKIWI_END
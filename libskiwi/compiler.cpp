@@ -1,5 +1,6 @@
 #include "compiler.h"
 #include "compile_error.h"
+#include "compile_stats.h"
 #include "context.h"
 #include "context_defs.h"
 #include "asm_aux.h"
@@ -10,6 +11,9 @@
 #include "types.h"
 #include "globals.h"
 #include "cinput_data.h"
+#include "visitor.h"
+#include <asm/jit_symbols.h>
+#include <asm/peephole.h>
 #include <map>
 #include <string>
 #include <sstream>
@@ -75,6 +79,7 @@ function_map generate_function_map()
   fm.insert(std::pair<std::string, fun_ptr>("%eval", &compile_eval));
   fm.insert(std::pair<std::string, fun_ptr>("file-exists?", &compile_file_exists));
   fm.insert(std::pair<std::string, fun_ptr>("fixnum?", &compile_is_fixnum));
+  fm.insert(std::pair<std::string, fun_ptr>("gc-stats", &compile_gc_stats));
   fm.insert(std::pair<std::string, fun_ptr>("fixnum->char", &compile_fixnum_to_char));
   fm.insert(std::pair<std::string, fun_ptr>("fixnum->flonum", &compile_fixnum_to_flonum));
   fm.insert(std::pair<std::string, fun_ptr>("fixnum-expt", &compile_fixnum_expt));
@@ -800,14 +805,140 @@ namespace
     code.add(asmcode::JMP, CONTINUE);
     }
 
+  /*
+  Returns the lambda of a closure, or nullptr if expr is not a closure.
+  */
+  const Lambda* get_closure_lambda(const Expression& expr)
+    {
+    if (std::holds_alternative<Lambda>(expr))
+      return &std::get<Lambda>(expr);
+    if (std::holds_alternative<PrimitiveCall>(expr))
+      {
+      const PrimitiveCall& p = std::get<PrimitiveCall>(expr);
+      if (p.primitive_name == "closure" && !p.arguments.empty() && std::holds_alternative<Lambda>(p.arguments.front()))
+        return &std::get<Lambda>(p.arguments.front());
+      }
+    return nullptr;
+    }
+
+  /*
+  Finds the lambda of each define. After cps conversion a define does not hold its lambda anymore: the closure is bound
+  to a continuation variable by a let, and the define sets the global to that variable.
+  */
+  struct lambda_names_visitor : public base_visitor<lambda_names_visitor>
+    {
+    std::map<std::string, const Lambda*> bound_lambdas;
+    std::map<const Lambda*, std::string> lambda_names;
+
+    virtual bool _previsit(Let& l)
+      {
+      for (const auto& binding : l.bindings)
+        {
+        const Lambda* lam = get_closure_lambda(binding.second);
+        if (lam)
+          bound_lambdas[binding.first] = lam;
+        }
+      return true;
+      }
+
+    virtual bool _previsit(Set& s)
+      {
+      if (!s.originates_from_define)
+        return true;
+      const Lambda* lam = get_closure_lambda(s.value.front());
+      if (!lam && std::holds_alternative<Variable>(s.value.front()))
+        {
+        auto it = bound_lambdas.find(std::get<Variable>(s.value.front()).name);
+        if (it != bound_lambdas.end())
+          lam = it->second;
+        }
+      if (lam)
+        lambda_names[lam] = get_variable_name_before_alpha(s.name);
+      return true;
+      }
+    };
+
+  /*
+  Entry code of a procedure when compiler_options::procedure_counters is set. What was allocated since the last entry is
+  counted for the procedure that was running, and procedure_index becomes the running procedure. Uses rax and r15, which
+  are free at the entry of a lambda. With compiler_options::heap_profiling, what was allocated is also sampled.
+  */
+  void compile_procedure_counters(asmcode& code, uint64_t procedure_index, bool is_call, const compiler_options& ops)
+    {
+    count_procedure_allocations(code, asmcode::RAX, asmcode::R15);
+    if (ops.heap_profiling)
+      check_heap_sample(code, asmcode::R15);
+    code.add(asmcode::MOV, PROCEDURE_ALLOC_MARK, ALLOC);
+    code.add(asmcode::MOV, CURRENT_PROCEDURE, asmcode::NUMBER, procedure_index * CELLS(2));
+    if (is_call)
+      {
+      code.add(asmcode::MOV, asmcode::RAX, PROCEDURE_COUNTERS);
+      code.add(asmcode::INC, asmcode::MEM_RAX, procedure_index * CELLS(2));
+      }
+    }
+
+  const std::string* find_lambda_name(const compile_data& cd, const Lambda& lam)
+    {
+    if (!cd.lambda_names)
+      return nullptr;
+    auto it = cd.lambda_names->find(&lam);
+    return it == cd.lambda_names->end() ? nullptr : &it->second;
+    }
+
+  /*
+  Lambdas that the compiler made (e.g. continuations) have no place in the source code.
+  */
+  bool is_compiler_made_lambda(const compile_data& cd, const Lambda& lam)
+    {
+    return lam.line_nr < 0 && !find_lambda_name(cd, lam);
+    }
+
+  /*
+  Lambdas that are the value of a define are named after the define, other lambdas after the place where they are written.
+  Lambdas that the compiler made are named after the code that contains them.
+  */
+  std::string lambda_symbol_name(const compile_data& cd, const Lambda& lam)
+    {
+    if (const std::string* name = find_lambda_name(cd, lam))
+      return *name;
+    if (lam.line_nr < 0)
+      return cd.symbol_name + "/continuation";
+    std::stringstream str;
+    str << "lambda@";
+    if (!lam.filename.empty())
+      str << lam.filename << ":";
+    str << lam.line_nr << ":" << lam.column_nr;
+    return str.str();
+    }
+
   void compile_lambda(registered_functions& fns, environment_map& env, repl_data& rd, compile_data& cd, asmcode& code, const Lambda& lam, const primitive_map& pm, const compiler_options& ops)
     {
     compile_data new_cd = create_compile_data(cd.heap_size, cd.globals_stack, cd.ra->number_of_locals(), cd.p_ctxt);
     new_cd.halt_label = cd.halt_label;
+    new_cd.lambda_names = cd.lambda_names;
+    if (cd.lambda_names)
+      new_cd.symbol_name = lambda_symbol_name(cd, lam);
+    new_cd.procedure_index = cd.procedure_index;
     new_cd.ra->make_all_available();
     code.push();
     auto lab = label_to_string(label++);
     code.add(asmcode::LABEL_ALIGNED, lab);
+    if (cd.lambda_names)
+      code.add_symbol(lab, new_cd.symbol_name);
+    if (ops.procedure_counters)
+      {
+      /*
+      Continuations count as the procedure that made them: they are not a call, and what they allocate is allocated by
+      that procedure.
+      */
+      const bool is_call = !is_compiler_made_lambda(cd, lam);
+      if (is_call)
+        {
+        new_cd.procedure_index = rd.procedure_names.size();
+        rd.procedure_names.push_back(new_cd.symbol_name);
+        }
+      compile_procedure_counters(code, new_cd.procedure_index, is_call, ops);
+      }
     environment_map new_env = std::make_shared<environment<environment_entry>>(env);
     for (size_t i = 0; i < lam.variables.size(); ++i)
       {
@@ -1907,104 +2038,142 @@ void compile(environment_map& env, repl_data& rd, macro_data& md, context& ctxt,
 
   preprocess(env, rd, md, ctxt, cinput, prog, pm, options);
 
-  label = 0;
+    {
+    compile_pass_timer timer("code generation");
+    label = 0;
 
-  compile_data data = create_compile_data(ctxt.total_heap_size, ctxt.globals_end - ctxt.globals, (uint32_t)ctxt.number_of_locals, &ctxt);
+    compile_data data = create_compile_data(ctxt.total_heap_size, ctxt.globals_end - ctxt.globals, (uint32_t)ctxt.number_of_locals, &ctxt);
 
-  data.ra->make_all_available();
-  data.ra_map.clear();
-  data.first_ra_map_time_point_to_elapse = (uint64_t)-1;
+    data.ra->make_all_available();
+    data.ra_map.clear();
+    data.first_ra_map_time_point_to_elapse = (uint64_t)-1;
+
+    // the names are only used for the symbols of the code and for the procedure counters, so they are not made otherwise
+    lambda_names_visitor lnv;
+    if (options.procedure_counters || ASM::jit_symbols_wanted())
+      {
+      visitor<Program, lambda_names_visitor>::visit(prog, &lnv);
+      data.lambda_names = &lnv.lambda_names;
+      }
+    data.symbol_name = "scheme_program";
+    if (options.procedure_counters && rd.procedure_names.empty())
+      rd.procedure_names.push_back("[top level]");
 
 
 
-  if (rd.global_index > data.globals_stack) // too many globals declared
-    throw_error(too_many_globals);
+    if (rd.global_index > data.globals_stack) // too many globals declared
+      throw_error(too_many_globals);
 
-  code.add(asmcode::GLOBAL, "scheme_entry");
+    code.add(asmcode::GLOBAL, "scheme_entry");
+    code.add_symbol("scheme_entry", "scheme_entry");
 
 #ifdef _WIN32
-  /*
-  windows parameters calling convention: rcx, rdx, r8, r9
-  First parameter (rcx) points to the context.
-  We store the pointer to the context in register r10.
-  */
-  code.add(asmcode::MOV, CONTEXT, asmcode::RCX);
+    /*
+    windows parameters calling convention: rcx, rdx, r8, r9
+    First parameter (rcx) points to the context.
+    We store the pointer to the context in register r10.
+    */
+    code.add(asmcode::MOV, CONTEXT, asmcode::RCX);
 
 #else
-  /*
-  Linux parameters calling convention: rdi, rsi, rdx, rcx, r8, r9
-  First parameter (rdi) points to the context.
-  We store the pointer to the context in register r10.
-  */
-  code.add(asmcode::MOV, CONTEXT, asmcode::RDI);
+    /*
+    Linux parameters calling convention: rdi, rsi, rdx, rcx, r8, r9
+    First parameter (rdi) points to the context.
+    We store the pointer to the context in register r10.
+    */
+    code.add(asmcode::MOV, CONTEXT, asmcode::RDI);
 #endif
 
-  /*
-  Save the current content of the registers in the context
-  */
-  store_registers(code);
+    /*
+    Save the current content of the registers in the context
+    */
+    store_registers(code);
+
+    code.add(asmcode::MOV, asmcode::R11, asmcode::LABELADDRESS, "L_error");
+    code.add(asmcode::MOV, ERROR, asmcode::R11); // store the error label in the context
+
+    code.add(asmcode::MOV, STACK_REGISTER, STACK); // get the stack location from the context and put it in the dedicated register
+    code.add(asmcode::MOV, STACK_SAVE, STACK_REGISTER);  // save the current stack position. At the end of this method we'll restore STACK to STACK_SAVE, as scheme
+                                                         // does not pop every stack position that was pushed due to continuation passing style.
 
-  code.add(asmcode::MOV, asmcode::R11, asmcode::LABELADDRESS, "L_error");
-  code.add(asmcode::MOV, ERROR, asmcode::R11); // store the error label in the context
+    code.add(asmcode::MOV, ALLOC, ALLOC_SAVED);
 
-  code.add(asmcode::MOV, STACK_REGISTER, STACK); // get the stack location from the context and put it in the dedicated register
-  code.add(asmcode::MOV, STACK_SAVE, STACK_REGISTER);  // save the current stack position. At the end of this method we'll restore STACK to STACK_SAVE, as scheme
-                                                       // does not pop every stack position that was pushed due to continuation passing style.
+    if (options.procedure_counters)
+      {
+      code.add(asmcode::MOV, CURRENT_PROCEDURE, asmcode::NUMBER, 0); // the top level code
+      code.add(asmcode::MOV, PROCEDURE_ALLOC_MARK, ALLOC);
+      }
 
-  code.add(asmcode::MOV, ALLOC, ALLOC_SAVED);
+    compile_cinput_parameters(cinput, env, code);
 
-  compile_cinput_parameters(cinput, env, code);
+    /*
+    Align stack with 16 byte boundary
+    */
+    code.add(asmcode::AND, asmcode::RSP, asmcode::NUMBER, 0xFFFFFFFFFFFFFFF0);
 
-  /*
-  Align stack with 16 byte boundary
-  */
-  code.add(asmcode::AND, asmcode::RSP, asmcode::NUMBER, 0xFFFFFFFFFFFFFFF0);
+    /*
+    Make registers point to unalloc_tag, so that gc cannot crash due to old register content
+    */
+    code.add(asmcode::MOV, asmcode::RCX, asmcode::NUMBER, unalloc_tag);
+    code.add(asmcode::MOV, asmcode::RDX, asmcode::NUMBER, unalloc_tag);
+    code.add(asmcode::MOV, asmcode::RSI, asmcode::NUMBER, unalloc_tag);
+    code.add(asmcode::MOV, asmcode::RDI, asmcode::NUMBER, unalloc_tag);
+    code.add(asmcode::MOV, asmcode::R8, asmcode::NUMBER, unalloc_tag);
+    code.add(asmcode::MOV, asmcode::R9, asmcode::NUMBER, unalloc_tag);
+    code.add(asmcode::MOV, asmcode::R12, asmcode::NUMBER, unalloc_tag);
+    code.add(asmcode::MOV, asmcode::R14, asmcode::NUMBER, unalloc_tag);
 
-  /*
-  Make registers point to unalloc_tag, so that gc cannot crash due to old register content
-  */
-  code.add(asmcode::MOV, asmcode::RCX, asmcode::NUMBER, unalloc_tag);
-  code.add(asmcode::MOV, asmcode::RDX, asmcode::NUMBER, unalloc_tag);
-  code.add(asmcode::MOV, asmcode::RSI, asmcode::NUMBER, unalloc_tag);
-  code.add(asmcode::MOV, asmcode::RDI, asmcode::NUMBER, unalloc_tag);
-  code.add(asmcode::MOV, asmcode::R8, asmcode::NUMBER, unalloc_tag);
-  code.add(asmcode::MOV, asmcode::R9, asmcode::NUMBER, unalloc_tag);
-  code.add(asmcode::MOV, asmcode::R12, asmcode::NUMBER, unalloc_tag);
-  code.add(asmcode::MOV, asmcode::R14, asmcode::NUMBER, unalloc_tag);
+    /*Call the main procedure*/
+    code.add(asmcode::JMP, "L_scheme_entry");
+
+    code.add(asmcode::LABEL, "L_error");
 
-  /*Call the main procedure*/
-  code.add(asmcode::JMP, "L_scheme_entry");
+    code.add(asmcode::LABEL, "L_finish");
 
-  code.add(asmcode::LABEL, "L_error");
+    if (options.procedure_counters)
+      {
+      count_procedure_allocations(code, asmcode::R11, asmcode::R15); // rax contains the result
+      if (options.heap_profiling)
+        check_heap_sample(code, asmcode::R15);
+      }
 
-  code.add(asmcode::LABEL, "L_finish");
+    code.add(asmcode::MOV, ALLOC_SAVED, ALLOC);
 
-  code.add(asmcode::MOV, ALLOC_SAVED, ALLOC);
+    code.add(asmcode::MOV, STACK_REGISTER, STACK_SAVE); // restore the scheme stack to its saved position
+    code.add(asmcode::MOV, STACK, STACK_REGISTER);
 
-  code.add(asmcode::MOV, STACK_REGISTER, STACK_SAVE); // restore the scheme stack to its saved position
-  code.add(asmcode::MOV, STACK, STACK_REGISTER);
+    /*Restore the registers to their original state*/
+    load_registers(code);
 
-  /*Restore the registers to their original state*/
-  load_registers(code);
+    /*Return to the caller*/
+    code.add(asmcode::RET);
 
-  /*Return to the caller*/
-  code.add(asmcode::RET);
+    /*Compile the main procedure*/
+    code.push();
+    code.add(asmcode::GLOBAL, "L_scheme_entry");
+    code.add_symbol("L_scheme_entry", "scheme_program");
+    compile_program(fns, env, rd, data, code, prog, pm, options);
+    if (options.do_cps_conversion)
+      {
+      code.add(asmcode::COMMENT, "error: invalid program termination");
+      code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, (uint64_t)re_invalid_program_termination);
+      code.add(asmcode::SHL, asmcode::RAX, asmcode::NUMBER, 8);
+      code.add(asmcode::OR, asmcode::RAX, asmcode::NUMBER, error_tag);
+      code.add(asmcode::JMP, "L_error");
+      }
+    else
+      code.add(asmcode::JMP, "L_finish");
+    code.pop();
 
-  /*Compile the main procedure*/
-  code.push();
-  code.add(asmcode::GLOBAL, "L_scheme_entry");
-  compile_program(fns, env, rd, data, code, prog, pm, options);
-  if (options.do_cps_conversion)
+    if (options.procedure_counters)
+      reserve_procedure_counters(ctxt, rd.procedure_names.size());
+    }
+
+  if (options.do_peephole_optimization)
     {
-    code.add(asmcode::COMMENT, "error: invalid program termination");
-    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, (uint64_t)re_invalid_program_termination);
-    code.add(asmcode::SHL, asmcode::RAX, asmcode::NUMBER, 8);
-    code.add(asmcode::OR, asmcode::RAX, asmcode::NUMBER, error_tag);
-    code.add(asmcode::JMP, "L_error");
+    compile_pass_timer timer("peephole optimization");
+    peephole_optimize(code);
     }
-  else
-    code.add(asmcode::JMP, "L_finish");
-  code.pop();
   }
 
 SKIWI_END
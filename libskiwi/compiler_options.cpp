@@ -27,17 +27,21 @@ compiler_options::compiler_options()
   safe_flonums = true;
   safe_promises = true;
   garbage_collection = true;
+  generational_gc = false;
   do_handle_include = true;
   do_lambda_to_let_conversion = true;
   do_constant_folding = true;
   do_constant_propagation = true;
   do_expand_macros = true;
+  do_peephole_optimization = true;
   do_remove_single_begins = true;
   standard_bindings = false;
 
   fast_expression_targetting = true;
   parallel = true;
   keep_variable_stack = true;
+  procedure_counters = false;
+  heap_profiling = false;
   }
 
 SKIWI_END
@@ -35,6 +35,7 @@ struct compiler_options
   bool do_constant_folding;
   bool do_constant_propagation;
   bool do_expand_macros;
+  bool do_peephole_optimization; // rewrites the generated instructions with the rules in asm/peephole.h
   bool standard_bindings; // if true, user guarantees that primitives are not redefined. This allows faster code when inlining.
   bool safe_primitives;  
   // cons and flonums create small entries on the heap. With good functioning garbage collection, testing for heap overflow should not be necessary
@@ -42,9 +43,12 @@ struct compiler_options
   bool safe_flonums;
   bool safe_promises;
   bool garbage_collection;
+  bool generational_gc; // if true, the garbage collector uses a nursery and a write barrier. The context should be created with a nursery.
   bool fast_expression_targetting;
   bool parallel;
   bool keep_variable_stack; // default true: adds last used globals to a debug stack for better error reporting
+  bool procedure_counters; // default false: counts the calls of each procedure and the bytes it allocates, see context::procedure_counters
+  bool heap_profiling; // default false: samples the allocations of each procedure, see heap_profiler.h. Needs procedure_counters.
   };
 
 SKIWI_END
@@ -0,0 +1,174 @@
+#include "concurrency.h"
+
+#include <algorithm>
+
+SKIWI_BEGIN
+
+namespace
+  {
+  thread_local bool inside_thread_pool = false;
+  }
+
+thread_pool::thread_pool(uint32_t nr_of_participants) : queues((std::max)((uint32_t)1, nr_of_participants)), stop(false), batch(0), busy(0), chunk_size(0), nr_of_items(0), current_task(nullptr)
+  {
+  for (uint32_t i = 1; i < (uint32_t)queues.size(); ++i)
+    workers.emplace_back([this, i]() { work(i); });
+  }
+
+thread_pool::~thread_pool()
+  {
+    {
+    std::lock_guard<std::mutex> lock(mut);
+    stop = true;
+    }
+  start.notify_all();
+  for (auto& t : workers)
+    t.join();
+  }
+
+void thread_pool::run(uint64_t nr_of_items_in_batch, const std::function<void(uint64_t, uint64_t)>& range_task)
+  {
+  run_indexed(nr_of_items_in_batch, [&](uint64_t begin, uint64_t end, uint32_t) { range_task(begin, end); });
+  }
+
+void thread_pool::run_indexed(uint64_t nr_of_items_in_batch, const std::function<void(uint64_t, uint64_t, uint32_t)>& range_task)
+  {
+  if (nr_of_items_in_batch == 0)
+    return;
+  std::unique_lock<std::mutex> batch_lock(batch_mutex, std::defer_lock);
+  if (workers.empty() || inside_thread_pool || !batch_lock.try_lock())
+    {
+    range_task(0, nr_of_items_in_batch, 0);
+    return;
+    }
+  const uint64_t nr_of_participants = queues.size();
+  // a few chunks per participant leave room for stealing, without paying a call per item
+  chunk_size = (std::max)((uint64_t)1, nr_of_items_in_batch / (nr_of_participants * 8));
+  nr_of_items = nr_of_items_in_batch;
+  const uint64_t nr_of_chunks = (nr_of_items + chunk_size - 1) / chunk_size;
+  for (uint64_t i = 0; i < nr_of_participants; ++i)
+    {
+    std::lock_guard<std::mutex> lock(queues[i].mut);
+    queues[i].begin = nr_of_chunks * i / nr_of_participants;
+    queues[i].end = nr_of_chunks * (i + 1) / nr_of_participants;
+    }
+    {
+    std::lock_guard<std::mutex> lock(mut);
+    current_task = &range_task;
+    error = nullptr;
+    busy = (uint32_t)workers.size();
+    ++batch;
+    }
+  start.notify_all();
+  inside_thread_pool = true;
+  participate(0);
+  inside_thread_pool = false;
+  std::unique_lock<std::mutex> lock(mut);
+  done.wait(lock, [this]() { return busy == 0; });
+  current_task = nullptr;
+  if (error)
+    std::rethrow_exception(error);
+  }
+
+void thread_pool::work(uint32_t index)
+  {
+  inside_thread_pool = true;
+  uint64_t last_batch = 0;
+  for (;;)
+    {
+      {
+      std::unique_lock<std::mutex> lock(mut);
+      start.wait(lock, [&]() { return stop || batch != last_batch; });
+      if (stop)
+        return;
+      last_batch = batch;
+      }
+    participate(index);
+    std::lock_guard<std::mutex> lock(mut);
+    if (--busy == 0)
+      done.notify_one();
+    }
+  }
+
+void thread_pool::participate(uint32_t index)
+  {
+  uint64_t chunk;
+  while (pop_own_chunk(index, chunk) || (steal(index) && pop_own_chunk(index, chunk)))
+    {
+    const uint64_t begin = chunk * chunk_size;
+    const uint64_t end = (std::min)(begin + chunk_size, nr_of_items);
+    try
+      {
+      (*current_task)(begin, end, index);
+      }
+    catch (...)
+      {
+      std::lock_guard<std::mutex> lock(mut);
+      if (!error)
+        error = std::current_exception();
+      }
+    }
+  }
+
+bool thread_pool::pop_own_chunk(uint32_t index, uint64_t& chunk)
+  {
+  chunk_queue& q = queues[index];
+  std::lock_guard<std::mutex> lock(q.mut);
+  if (q.begin == q.end)
+    return false;
+  chunk = q.begin++;
+  return true;
+  }
+
+/*
+Moves the back half of the chunks of the next participant that still has chunks into the queue of index. Only its owner
+refills a queue, so the queue of index is still empty when the stolen chunks arrive.
+*/
+bool thread_pool::steal(uint32_t index)
+  {
+  const uint32_t nr_of_participants = (uint32_t)queues.size();
+  for (uint32_t offset = 1; offset < nr_of_participants; ++offset)
+    {
+    chunk_queue& victim = queues[(index + offset) % nr_of_participants];
+    uint64_t begin, end;
+      {
+      std::lock_guard<std::mutex> lock(victim.mut);
+      if (victim.begin == victim.end)
+        continue;
+      end = victim.end;
+      begin = victim.end - (victim.end - victim.begin + 1) / 2;
+      victim.end = begin;
+      }
+    chunk_queue& q = queues[index];
+    std::lock_guard<std::mutex> lock(q.mut);
+    q.begin = begin;
+    q.end = end;
+    return true;
+    }
+  return false;
+  }
+
+namespace
+  {
+  std::unique_ptr<thread_pool>& process_thread_pool()
+    {
+    static std::unique_ptr<thread_pool> pool(new thread_pool(std::thread::hardware_concurrency()));
+    return pool;
+    }
+  }
+
+thread_pool& get_thread_pool()
+  {
+  return *process_thread_pool();
+  }
+
+void set_thread_pool_size(uint32_t nr_of_participants)
+  {
+  if (nr_of_participants == 0)
+    nr_of_participants = std::thread::hardware_concurrency();
+  auto& pool = process_thread_pool();
+  pool.reset();
+  pool.reset(new thread_pool(nr_of_participants));
+  }
+
+SKIWI_END
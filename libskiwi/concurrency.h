@@ -1,6 +1,7 @@
 #pragma once
 
 #include "compiler_options.h"
+#include "libskiwi_api.h"
 
 #include <functional>
 #include <thread>
@@ -8,6 +9,11 @@
 #include <exception>
 #include <cstring>
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <stdint.h>
 #ifdef _WIN32
 #include <windows.h>
 #undef min
@@ -436,33 +442,104 @@ class combinable
   };
 
 
-template <class _Type, class TFunctor>
-void parallel_for(_Type first, _Type last, TFunctor fun, const compiler_options& ops)
+/*
+A pool of worker threads for the compiler passes. The workers are started once and live as long as the pool, so a
+parallel_for does not pay for creating and joining threads.
+
+run calls range_task(begin, end) for consecutive chunks of [0, nr_of_items) on the workers and on the calling thread,
+and returns when all chunks are done. Every participant starts with its own contiguous share of the chunks and, when it
+runs out, steals half of the remaining chunks of another participant, so that a few expensive items do not keep the
+other threads waiting. The first exception thrown by range_task is rethrown in the calling thread.
+A run from inside a range_task, or while another thread runs a batch on the same pool, runs on the calling thread only.
+run_indexed also passes the index in [0, size()) of the participant that runs the chunk, 0 being the calling thread, so
+that a caller can keep state per participant (skiwi_parallel_for keeps a skiwi context per participant).
+*/
+class thread_pool
   {
-  if (ops.parallel)
-    {
-    const _Type n_threads = (_Type)std::thread::hardware_concurrency();
+  public:
+    SKIWI_SCHEME_API explicit thread_pool(uint32_t nr_of_participants); // including the thread that calls run
+    SKIWI_SCHEME_API ~thread_pool();
 
-    const _Type n = last - first;
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator = (const thread_pool&) = delete;
+
+    uint32_t size() const
+      {
+      return (uint32_t)queues.size();
+      }
 
-    const _Type n_max_tasks_per_thread = (n / n_threads) + (n % n_threads == 0 ? 0 : 1);
-    const _Type n_lacking_tasks = n_max_tasks_per_thread * n_threads - n;
+    SKIWI_SCHEME_API void run(uint64_t nr_of_items, const std::function<void(uint64_t, uint64_t)>& range_task);
+    SKIWI_SCHEME_API void run_indexed(uint64_t nr_of_items, const std::function<void(uint64_t, uint64_t, uint32_t)>& range_task);
 
-    auto inner_loop = [&](const _Type thread_index)
+  private:
+    struct alignas(64) chunk_queue
       {
-      const _Type n_lacking_tasks_so_far = n_threads > (thread_index + n_lacking_tasks) ? 0 : (thread_index + n_lacking_tasks) - n_threads;
-      const _Type inclusive_start_index = thread_index * n_max_tasks_per_thread - n_lacking_tasks_so_far;
-      const _Type exclusive_end_index = inclusive_start_index + n_max_tasks_per_thread - (thread_index + n_lacking_tasks >= n_threads ? 1 : 0);
+      std::mutex mut;
+      uint64_t begin = 0;
+      uint64_t end = 0;
+      };
+
+    void work(uint32_t index);
+    void participate(uint32_t index);
+    bool pop_own_chunk(uint32_t index, uint64_t& chunk);
+    bool steal(uint32_t index);
+
+    std::vector<chunk_queue> queues; // queue 0 belongs to the thread that calls run, queue i > 0 to workers[i-1]
+    std::vector<std::thread> workers;
+    std::mutex batch_mutex;
+    std::mutex mut;
+    std::condition_variable start, done;
+    bool stop;
+    uint64_t batch;
+    uint32_t busy;
+    uint64_t chunk_size;
+    uint64_t nr_of_items;
+    const std::function<void(uint64_t, uint64_t, uint32_t)>* current_task;
+    std::exception_ptr error;
+  };
+
+/*
+The process-wide pool with a participant per hardware thread, created the first time it is used.
+set_thread_pool_size replaces it by a pool of nr_of_participants (0 means one per hardware thread), e.g. so that tests can
+run the parallel passes on a machine with a single hardware thread. It should not be called while the pool is in use.
+*/
+SKIWI_SCHEME_API thread_pool& get_thread_pool();
+SKIWI_SCHEME_API void set_thread_pool_size(uint32_t nr_of_participants);
 
-      for (_Type k = inclusive_start_index; k < exclusive_end_index; ++k)
+/*
+Calls fun(i) for i in [first, last), on the thread pool if ops.parallel. If items throw, the exception of the item with the
+lowest index is rethrown, as in the serial loop, so that the reported error does not depend on the scheduling. Items after
+an item that threw are skipped when possible.
+*/
+template <class _Type, class TFunctor>
+void parallel_for(_Type first, _Type last, TFunctor fun, const compiler_options& ops)
+  {
+  if (ops.parallel && last - first > 1 && get_thread_pool().size() > 1)
+    {
+    std::mutex error_mutex;
+    std::atomic<uint64_t> error_index((uint64_t)-1);
+    std::exception_ptr error;
+    get_thread_pool().run((uint64_t)(last - first), [&](uint64_t begin, uint64_t end)
+      {
+      for (uint64_t k = begin; k < end && k < error_index.load(std::memory_order_relaxed); ++k)
         {
-        fun(k + first);
+        try
+          {
+          fun(first + (_Type)k);
+          }
+        catch (...)
+          {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (k < error_index)
+            {
+            error_index = k;
+            error = std::current_exception();
+            }
+          }
         }
-      };
-    std::vector<std::thread> threads;
-    for (_Type j = 0; j < n_threads; ++j) { threads.push_back(std::thread(inner_loop, j)); }
-    for (auto& t : threads) { t.join(); }
-
+      });
+    if (error)
+      std::rethrow_exception(error);
     }
   else
     {
@@ -10,6 +10,7 @@
 
 #include "compile_error.h"
 #include "visitor.h"
+#include "concurrency.h"
 
 SKIWI_BEGIN
 
@@ -2039,4 +2040,21 @@ void constant_folding(Program& prog)
   prog.constant_folded = true;
   }
 
+void constant_folding(Program& prog, const compiler_options& ops)
+  {
+  if (prog.expressions.size() != 1 || !std::holds_alternative<Begin>(prog.expressions.front()))
+    {
+    constant_folding(prog);
+    return;
+    }
+  Begin& beg = std::get<Begin>(prog.expressions.front());
+  parallel_for(size_t(0), beg.arguments.size(), [&](size_t i)
+    {
+    constant_folding_helper cfh;
+    cfh.expressions.push_back(&beg.arguments[i]);
+    cfh.treat_expressions();
+    }, ops);
+  prog.constant_folded = true;
+  }
+
 SKIWI_END
@@ -7,6 +7,9 @@
 
 SKIWI_BEGIN
 
+struct compiler_options;
+
 SKIWI_SCHEME_API void constant_folding(Program& prog);
+SKIWI_SCHEME_API void constant_folding(Program& prog, const compiler_options& ops);
 
 SKIWI_END
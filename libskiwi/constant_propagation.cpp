@@ -9,6 +9,7 @@
 
 #include "compile_error.h"
 #include "visitor.h"
+#include "concurrency.h"
 
 SKIWI_BEGIN
 
@@ -533,4 +534,30 @@ void constant_propagation(Program& prog)
   prog.constant_propagated = true;
   }
 
+/*
+After alpha conversion a let binding is only visible, and can only be mutated, inside its own top-level form, so the
+forms can be treated independently.
+*/
+void constant_propagation(Program& prog, const compiler_options& ops)
+  {
+  if (prog.expressions.size() != 1 || !std::holds_alternative<Begin>(prog.expressions.front()))
+    {
+    constant_propagation(prog);
+    return;
+    }
+  Begin& beg = std::get<Begin>(prog.expressions.front());
+  parallel_for(size_t(0), beg.arguments.size(), [&](size_t i)
+    {
+    is_unmutable_variable_helper iuvh;
+    iuvh.expressions.push_back(&beg.arguments[i]);
+    iuvh.treat_expressions();
+
+    constant_propagation_helper cph;
+    cph.p_is_unmutable = &iuvh.is_unmutable;
+    cph.expressions.push_back(&beg.arguments[i]);
+    cph.treat_expressions();
+    }, ops);
+  prog.constant_propagated = true;
+  }
+
 SKIWI_END
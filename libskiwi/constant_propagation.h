@@ -7,6 +7,9 @@
 
 SKIWI_BEGIN
 
+struct compiler_options;
+
 SKIWI_SCHEME_API void constant_propagation(Program& prog);
+SKIWI_SCHEME_API void constant_propagation(Program& prog, const compiler_options& ops);
 
 SKIWI_END
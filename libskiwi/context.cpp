@@ -1,82 +1,491 @@
 #include "context.h"
 #include "types.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 SKIWI_BEGIN
 
-context create_context(uint64_t heap_size, uint64_t globals_stack, uint32_t local_stack, uint64_t scheme_stack)
+namespace
   {
-  context c;
-  // The number of locals is not that large, but the buffer for the locals is large, as it equals the heapsize/4.
-  // The reason is that we want to be able to do something like (apply + long-list).
-  // The apply method will rewrite this as (+ a b c ... ) where a,b,c are the elements of long-list.
-  // Theoretically this could be a pretty long list that overflows the local buffer if we only provide for local_stack memory places.
-  // Therefore we provide a large local stack buffer.
-  uint64_t local_stack_buffer = heap_size / 4;
-  if (local_stack > local_stack_buffer)
-    local_stack_buffer = (uint32_t)local_stack;
-  uint64_t total_size = (uint64_t)5 + (uint64_t)256 + (uint64_t)3 + (uint64_t)8 + (uint64_t)local_stack_buffer + globals_stack + heap_size + scheme_stack;
-  c.memory_allocated = new uint64_t[total_size];
-  uint64_t* ptr = c.memory_allocated;
-  for (uint64_t i = 0; i < total_size; ++i, ++ptr)
-    *ptr = unalloc_tag;
-  c.dcvt = c.memory_allocated;
-  c.ocvt = c.dcvt + 1;
-  c.xcvt = c.ocvt + 1;
-  c.gcvt = c.xcvt + 1;
-  c.buffer = c.gcvt + 1;
-  c.rsp_save = c.buffer + 256;
-  c.temporary_flonum = c.rsp_save + 1;
-  c.gc_save = c.temporary_flonum + 2;
-  c.locals = c.gc_save + 8;
-  c.globals = c.locals + (uint64_t)local_stack_buffer;
-  c.globals_end = c.globals + globals_stack;
-  c.stack_top = c.globals + globals_stack;
-  c.stack = c.stack_top;
-  c.stack_end = c.stack + scheme_stack;
-  c.from_space = c.globals + globals_stack + scheme_stack;
-  c.to_space = c.from_space + (heap_size / 2);
-  c.total_heap_size = heap_size;
-  c.alloc = c.from_space;
-  c.from_space_reserve = (c.total_heap_size / 2) * 1 / 8;
-  c.from_space_end = c.from_space + (heap_size / 2);
-  c.to_space_end = c.to_space + (heap_size / 2);
-  c.limit = c.from_space_end - c.from_space_reserve;
-  c.number_of_locals = (uint64_t)local_stack;
-
-  c.temporary_flonum[0] = make_block_header(1, T_FLONUM);
-
-  for (int i = 0; i < SKIWI_VARIABLE_DEBUG_STACK_SIZE; ++i)
-    {
-    c.last_global_variable_used[i] = (uint64_t)-1;
-    }
-
-  *c.dcvt = (uint64_t)'%' | (((uint64_t)'l') << 8) | (((uint64_t)'l') << 16) | (((uint64_t)'d') << 24);
-  *c.ocvt = (uint64_t)'%' | (((uint64_t)'l') << 8) | (((uint64_t)'l') << 16) | (((uint64_t)'o') << 24);
-  *c.xcvt = (uint64_t)'%' | (((uint64_t)'l') << 8) | (((uint64_t)'l') << 16) | (((uint64_t)'x') << 24);
-  *c.gcvt = (uint64_t)'%' | (((uint64_t)'.') << 8) | (((uint64_t)'2') << 16) | (((uint64_t)'0') << 24) | (((uint64_t)'g') << 32);
-  return c;
+  uint64_t get_remembered_set_size(uint64_t nursery_size)
+    {
+    return nursery_size / 4;
+    }
+
+  /*
+  Reserves size cells of zero-initialised memory. Pages are only committed by the os when they are touched.
+  Returns nullptr if the memory could not be reserved.
+  */
+  uint64_t* allocate_memory(uint64_t size, bool huge_pages)
+    {
+#ifdef _WIN32
+    (void)huge_pages;
+    return (uint64_t*)VirtualAlloc(nullptr, size * sizeof(uint64_t), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* p = mmap(nullptr, size * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+      return nullptr;
+#ifdef MADV_HUGEPAGE
+    if (huge_pages)
+      madvise(p, size * sizeof(uint64_t), MADV_HUGEPAGE);
+#else
+    (void)huge_pages;
+#endif
+    return (uint64_t*)p;
+#endif
+    }
+
+  void free_memory(uint64_t* p, uint64_t size)
+    {
+    if (!p)
+      return;
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, size * sizeof(uint64_t));
+#endif
+    }
+
+  void set_semispaces(context& c, uint64_t* heap, uint64_t heap_size)
+    {
+    c.from_space = heap;
+    c.to_space = c.from_space + (heap_size / 2);
+    c.total_heap_size = heap_size;
+    c.alloc = c.from_space;
+    c.from_space_reserve = (c.total_heap_size / 2) * 1 / 8;
+    c.from_space_end = c.from_space + (heap_size / 2);
+    c.to_space_end = c.to_space + (heap_size / 2);
+    c.limit = c.from_space_end - c.from_space_reserve;
+    }
+  }
+
+namespace
+  {
+  context make_context(uint64_t heap_size, uint64_t globals_stack, uint32_t local_stack, uint64_t scheme_stack, uint64_t nursery_size, bool huge_pages, bool fill_sentinels)
+    {
+    if (nursery_size * 3 > heap_size)
+      throw std::runtime_error("The nursery cannot be larger than a third of the heap");
+    context c;
+    // The number of locals is not that large, but the buffer for the locals is large, as it equals the heapsize/4.
+    // The reason is that we want to be able to do something like (apply + long-list).
+    // The apply method will rewrite this as (+ a b c ... ) where a,b,c are the elements of long-list.
+    // Theoretically this could be a pretty long list that overflows the local buffer if we only provide for local_stack memory places.
+    // Therefore we provide a large local stack buffer.
+    uint64_t local_stack_buffer = heap_size / 4;
+    if (local_stack > local_stack_buffer)
+      local_stack_buffer = (uint32_t)local_stack;
+    uint64_t remembered_set_size = get_remembered_set_size(nursery_size);
+    uint64_t total_size = (uint64_t)5 + (uint64_t)256 + (uint64_t)3 + (uint64_t)8 + (uint64_t)local_stack_buffer + globals_stack + heap_size + scheme_stack + remembered_set_size;
+    c.memory_allocated = allocate_memory(total_size, huge_pages);
+    if (!c.memory_allocated)
+      throw std::bad_alloc();
+    c.memory_size = total_size;
+    c.huge_pages = huge_pages;
+    c.snapshot_fd = -1;
+    c.dcvt = c.memory_allocated;
+    c.ocvt = c.dcvt + 1;
+    c.xcvt = c.ocvt + 1;
+    c.gcvt = c.xcvt + 1;
+    c.buffer = c.gcvt + 1;
+    c.rsp_save = c.buffer + 256;
+    c.temporary_flonum = c.rsp_save + 1;
+    c.gc_save = c.temporary_flonum + 2;
+    c.locals = c.gc_save + 8;
+    c.globals = c.locals + (uint64_t)local_stack_buffer;
+    c.globals_end = c.globals + globals_stack;
+    c.stack_top = c.globals + globals_stack;
+    c.stack = c.stack_top;
+    c.stack_end = c.stack + scheme_stack;
+    set_semispaces(c, c.globals + globals_stack + scheme_stack, heap_size);
+    c.number_of_locals = (uint64_t)local_stack;
+
+    /*
+    The memory is zero, which is fixnum 0 for the garbage collector. Only the cells that are inspected before they are
+    written need unalloc_tag: the registers saved for gc, the locals and the globals (gc stops at the first unalloc_tag global).
+    The remainder of the locals buffer, the stack and the heap are left untouched, so they cost no memory until used.
+    */
+    if (fill_sentinels)
+      {
+      std::fill(c.memory_allocated, c.locals + local_stack, unalloc_tag);
+      std::fill(c.globals, c.globals_end, unalloc_tag);
+      }
+
+    c.nursery = nullptr;
+    c.nursery_end = nullptr;
+    c.old_space = nullptr;
+    c.old_space_end = nullptr;
+    c.old_to_space = nullptr;
+    c.old_to_space_end = nullptr;
+    c.old_alloc = nullptr;
+    c.remembered_set = nullptr;
+    c.remembered_set_top = nullptr;
+    c.remembered_set_end = nullptr;
+    c.remembered_set_overflow = 0;
+
+    c.heap_block = nullptr;
+    c.heap_block_pending = nullptr;
+    c.heap_min_size = heap_size;
+    c.heap_max_size = heap_size;
+    c.heap_grow_threshold = 50;
+    c.heap_shrink_threshold = 10;
+    c.heap_request = 0;
+
+    c.procedure_counters = nullptr;
+    c.procedure_counters_size = 0;
+    c.current_procedure = 0;
+    c.procedure_alloc_mark = nullptr;
+
+    c.heap_prof = nullptr;
+    c.heap_sample_countdown = INT64_MAX;
+
+    reset_gc_statistics(c);
+
+    if (nursery_size)
+      {
+      /*
+      The nursery sits in between the two semispaces of the old generation. During a major collection both the
+      nursery and the current old space are evacuated, and this layout keeps them in one contiguous range.
+      */
+      uint64_t semispace_size = (heap_size - nursery_size) / 2;
+      c.old_space = c.globals + globals_stack + scheme_stack;
+      c.old_space_end = c.old_space + semispace_size;
+      c.nursery = c.old_space_end;
+      c.nursery_end = c.nursery + nursery_size;
+      c.old_to_space = c.nursery_end;
+      c.old_to_space_end = c.old_to_space + semispace_size;
+      c.old_alloc = c.old_space;
+      c.remembered_set = c.memory_allocated + (total_size - remembered_set_size);
+      c.remembered_set_top = c.remembered_set;
+      c.remembered_set_end = c.remembered_set + remembered_set_size;
+
+      c.from_space = c.nursery;
+      c.from_space_end = c.nursery_end;
+      c.to_space = nullptr;
+      c.to_space_end = nullptr;
+      c.alloc = c.nursery;
+      c.from_space_reserve = nursery_size / 8;
+      c.limit = c.from_space_end - c.from_space_reserve;
+      }
+
+    c.temporary_flonum[0] = make_block_header(1, T_FLONUM);
+
+    for (int i = 0; i < SKIWI_VARIABLE_DEBUG_STACK_SIZE; ++i)
+      {
+      c.last_global_variable_used[i] = (uint64_t)-1;
+      }
+
+    *c.dcvt = (uint64_t)'%' | (((uint64_t)'l') << 8) | (((uint64_t)'l') << 16) | (((uint64_t)'d') << 24);
+    *c.ocvt = (uint64_t)'%' | (((uint64_t)'l') << 8) | (((uint64_t)'l') << 16) | (((uint64_t)'o') << 24);
+    *c.xcvt = (uint64_t)'%' | (((uint64_t)'l') << 8) | (((uint64_t)'l') << 16) | (((uint64_t)'x') << 24);
+    *c.gcvt = (uint64_t)'%' | (((uint64_t)'.') << 8) | (((uint64_t)'2') << 16) | (((uint64_t)'0') << 24) | (((uint64_t)'g') << 32);
+    return c;
+    }
+
+#ifdef __linux__
+  uint64_t get_page_size()
+    {
+    static const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+    return page_size;
+    }
+
+  /*
+  The snapshot covers the whole pages of memory_allocated in front of the heap: the locals, the globals and the stack.
+  The heap is not part of it, as a clone starts with an empty heap of its own.
+  */
+  uint64_t get_snapshot_size(const context& ctxt)
+    {
+    uint64_t size = (uint64_t)(ctxt.stack_end - ctxt.memory_allocated) * sizeof(uint64_t);
+    return size - size % get_page_size();
+    }
+
+  /*
+  Returns true if the cells [first, last) of ctxt equal the same cells in its snapshot. Holes in the memfd read as zeros.
+  */
+  bool snapshot_range_is_current(const context& ctxt, const uint64_t* first, const uint64_t* last)
+    {
+    uint64_t buffer[4096];
+    for (const uint64_t* p = first; p < last; p += 4096)
+      {
+      const uint64_t n = (std::min)((uint64_t)4096, (uint64_t)(last - p));
+      const off_t offset = (off_t)((p - ctxt.memory_allocated) * sizeof(uint64_t));
+      if (pread(ctxt.snapshot_fd, buffer, n * sizeof(uint64_t), offset) != (ssize_t)(n * sizeof(uint64_t)) || memcmp(buffer, p, n * sizeof(uint64_t)) != 0)
+        return false;
+      }
+    return true;
+    }
+
+  /*
+  Returns true if ctxt has a snapshot that still holds the cells of ctxt that are in use, so that a new snapshot would not
+  give a different clone. These are the cells in front of the locals, the locals and the globals up to the first
+  unalloc_tag (the globals are handed out in order, see the garbage collector). The remainder of the locals buffer and the
+  stack are scratch memory, that a clone writes before it reads, so they are not compared and the cost does not grow with
+  the size of the context.
+  */
+  bool snapshot_is_current(const context& ctxt)
+    {
+    if (ctxt.snapshot_fd < 0)
+      return false;
+    const uint64_t* globals_in_use = std::find(ctxt.globals, ctxt.globals_end, (uint64_t)unalloc_tag);
+    if (globals_in_use != ctxt.globals_end)
+      ++globals_in_use; // the snapshot should end its globals at the same cell
+    return snapshot_range_is_current(ctxt, ctxt.memory_allocated, ctxt.locals + ctxt.number_of_locals) &&
+      snapshot_range_is_current(ctxt, ctxt.globals, globals_in_use);
+    }
+
+  /*
+  Writes the snapshot pages of ctxt to a new memfd, that the clones map privately, so that they share the pages until they
+  write to them. The memory of ctxt is only read, it is not remapped. Pages that are all zero are not written, they stay
+  holes in the memfd.
+  */
+  bool make_snapshot(const context& ctxt)
+    {
+    const uint64_t page_size = get_page_size();
+    const uint64_t size = get_snapshot_size(ctxt);
+    if (size == 0)
+      return false;
+    int fd = memfd_create("skiwi-context", MFD_CLOEXEC);
+    if (fd < 0)
+      return false;
+    bool ok = ftruncate(fd, (off_t)size) == 0;
+    const char* memory = (const char*)ctxt.memory_allocated;
+    for (uint64_t offset = 0; ok && offset < size; offset += page_size)
+      {
+      const uint64_t* page = (const uint64_t*)(memory + offset);
+      if (std::all_of(page, page + page_size / sizeof(uint64_t), [](uint64_t v) { return v == 0; }))
+        continue;
+      ok = pwrite(fd, memory + offset, page_size, (off_t)offset) == (ssize_t)page_size;
+      }
+    if (!ok)
+      {
+      close(fd);
+      return false;
+      }
+    if (ctxt.snapshot_fd >= 0)
+      close(ctxt.snapshot_fd); // clones of the previous snapshot keep their mapping
+    ctxt.snapshot_fd = fd;
+    return true;
+    }
+#endif
+  }
+
+context create_context(uint64_t heap_size, uint64_t globals_stack, uint32_t local_stack, uint64_t scheme_stack, uint64_t nursery_size, bool huge_pages)
+  {
+  return make_context(heap_size, globals_stack, local_stack, scheme_stack, nursery_size, huge_pages, true);
   }
 
 
 void destroy_context(context& ctxt)
   {
-  delete[] ctxt.memory_allocated;
+  if (ctxt.heap_block_pending != ctxt.stack_end)
+    free_memory(ctxt.heap_block_pending, (ctxt.to_space_end - ctxt.to_space) * 2);
+  ctxt.heap_block_pending = nullptr;
+  free_memory(ctxt.heap_block, ctxt.total_heap_size);
+  ctxt.heap_block = nullptr;
+  free_memory(ctxt.memory_allocated, ctxt.memory_size);
   ctxt.memory_allocated = nullptr;
+  delete[] ctxt.procedure_counters;
+  ctxt.procedure_counters = nullptr;
+  ctxt.procedure_counters_size = 0;
+#ifndef _WIN32
+  if (ctxt.snapshot_fd >= 0)
+    close(ctxt.snapshot_fd);
+#endif
+  ctxt.snapshot_fd = -1;
   }
 
 context clone_context(const context& ctxt)
   {
-  uint64_t heap_size = ctxt.total_heap_size;
+  uint64_t heap_size = ctxt.heap_min_size;
   uint64_t globals_stack = ctxt.globals_end - ctxt.globals;
-  uint64_t local_stack = ctxt.globals - ctxt.locals;
   uint64_t scheme_stack = ctxt.stack_end - ctxt.stack_top;
-  context c = create_context(heap_size, globals_stack, (uint32_t)local_stack, scheme_stack);
-
-  uint64_t total_size = (uint64_t)5 + (uint64_t)256 + (uint64_t)3 + (uint64_t)8 + (uint64_t)local_stack + globals_stack + heap_size + scheme_stack;
+  uint64_t nursery_size = ctxt.nursery_end - ctxt.nursery;
+  context c = make_context(heap_size, globals_stack, (uint32_t)ctxt.number_of_locals, scheme_stack, nursery_size, ctxt.huge_pages, false);
 
-  for (uint64_t i = 0; i < total_size; ++i)
-    c.memory_allocated[i] = ctxt.memory_allocated[i];
+  uint64_t* first_to_copy = c.memory_allocated;
+#ifdef __linux__
+  if (snapshot_is_current(ctxt) || make_snapshot(ctxt))
+    {
+    uint64_t size = get_snapshot_size(ctxt);
+    if (mmap(c.memory_allocated, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, ctxt.snapshot_fd, 0) != MAP_FAILED)
+      first_to_copy += size / sizeof(uint64_t);
+    }
+#endif
+  if (first_to_copy == c.memory_allocated)
+    {
+    // no snapshot: copy the cells that are in use, the remainder of the locals buffer is scratch memory
+    std::copy(ctxt.memory_allocated, ctxt.locals + ctxt.number_of_locals, c.memory_allocated);
+    first_to_copy = c.globals;
+    }
+  std::copy(ctxt.memory_allocated + (first_to_copy - c.memory_allocated), ctxt.stack_end, first_to_copy);
 
+  set_heap_resize_policy(c, ctxt.heap_max_size, ctxt.heap_grow_threshold, ctxt.heap_shrink_threshold);
+  reserve_procedure_counters(c, ctxt.procedure_counters_size); // the counters of a clone start at zero and are its own
   return c;
   }
 
+void refresh_clone_context(context& clone, const context& ctxt)
+  {
+  std::copy(ctxt.globals, ctxt.globals_end, clone.globals);
+  if (clone.nursery)
+    {
+    // the nursery may have been reduced, or replaced by a window in the old space (see L_make_room)
+    clone.from_space = clone.nursery;
+    clone.from_space_end = clone.nursery_end;
+    clone.limit = clone.from_space_end - clone.from_space_reserve;
+    clone.old_alloc = clone.old_space;
+    clone.remembered_set_top = clone.remembered_set;
+    clone.remembered_set_overflow = 0;
+    }
+  clone.alloc = clone.from_space;
+  }
+
+void set_heap_resize_policy(context& ctxt, uint64_t max_heap_size, uint64_t grow_threshold, uint64_t shrink_threshold)
+  {
+  ctxt.heap_max_size = (std::max)(max_heap_size, ctxt.heap_min_size);
+  ctxt.heap_grow_threshold = grow_threshold;
+  ctxt.heap_shrink_threshold = shrink_threshold;
+  }
+
+uint64_t resize_heap(context* ctxt)
+  {
+  if (ctxt->nursery)
+    return 0;
+
+  if (ctxt->heap_block_pending)
+    {
+    // the live data has been moved to the first semispace of the pending block
+    uint64_t* alloc = ctxt->alloc;
+    uint64_t heap_size = (ctxt->from_space_end - ctxt->from_space) * 2;
+    free_memory(ctxt->heap_block, ctxt->total_heap_size);
+    ctxt->heap_block = ctxt->heap_block_pending == ctxt->stack_end ? nullptr : ctxt->heap_block_pending;
+    ctxt->heap_block_pending = nullptr;
+    set_semispaces(*ctxt, ctxt->from_space, heap_size);
+    ctxt->alloc = alloc;
+    return 0;
+    }
+
+  const uint64_t semispace_size = ctxt->from_space_end - ctxt->from_space;
+  const uint64_t min_semispace_size = ctxt->heap_min_size / 2;
+  const uint64_t max_semispace_size = ctxt->heap_max_size / 2;
+  const uint64_t used = (ctxt->alloc - ctxt->from_space) + ctxt->heap_request / sizeof(uint64_t); // the requested allocation should fit too
+  uint64_t new_semispace_size = semispace_size;
+  while (used * 100 > ctxt->heap_grow_threshold * new_semispace_size && new_semispace_size < max_semispace_size)
+    new_semispace_size = (std::min)(new_semispace_size * 2, max_semispace_size);
+  if (new_semispace_size == semispace_size)
+    {
+    while (used * 100 < ctxt->heap_shrink_threshold * new_semispace_size && new_semispace_size > min_semispace_size)
+      new_semispace_size = (std::max)(new_semispace_size / 2, min_semispace_size);
+    }
+  if (new_semispace_size == semispace_size)
+    return 0;
+
+  uint64_t* block = nullptr;
+  if (new_semispace_size == min_semispace_size)
+    block = ctxt->stack_end; // back to the heap inside memory_allocated, see create_context
+  else
+    {
+    block = allocate_memory(new_semispace_size * 2, ctxt->huge_pages);
+    if (!block)
+      return 0;
+    }
+  ctxt->heap_block_pending = block;
+  ctxt->to_space = block;
+  ctxt->to_space_end = block + new_semispace_size;
+  return 1;
+  }
+
+namespace
+  {
+  uint64_t nanoseconds_since_epoch()
+    {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+  uint64_t old_generation_bytes_in_use(const context& ctxt)
+    {
+    return (uint64_t)(ctxt.old_alloc - ctxt.old_space) * sizeof(uint64_t);
+    }
+  }
+
+uint64_t heap_bytes_in_use(const context& ctxt)
+  {
+  return (uint64_t)(ctxt.alloc - ctxt.from_space) * sizeof(uint64_t) + old_generation_bytes_in_use(ctxt);
+  }
+
+void gc_collection_started(context* ctxt)
+  {
+  ctxt->gc_bytes_before = heap_bytes_in_use(*ctxt);
+  ctxt->gc_peak_allocated_bytes = (std::max)(ctxt->gc_peak_allocated_bytes, ctxt->gc_bytes_before);
+  ctxt->gc_old_bytes_before = old_generation_bytes_in_use(*ctxt);
+  ctxt->gc_old_space_before = ctxt->old_space;
+  ctxt->gc_pause_start = nanoseconds_since_epoch();
+  }
+
+void gc_collection_finished(context* ctxt)
+  {
+  const uint64_t pause = nanoseconds_since_epoch() - ctxt->gc_pause_start;
+  const uint64_t bytes_after = heap_bytes_in_use(*ctxt);
+  // a minor collection leaves the old space where it is, and only copies the survivors of the nursery to it
+  const bool full = !ctxt->nursery || ctxt->old_space != ctxt->gc_old_space_before;
+  ++ctxt->gc_collections;
+  if (full)
+    ++ctxt->gc_full_collections;
+  ctxt->gc_bytes_copied += full ? bytes_after : bytes_after - ctxt->gc_old_bytes_before;
+  if (ctxt->gc_bytes_before > bytes_after)
+    ctxt->gc_bytes_reclaimed += ctxt->gc_bytes_before - bytes_after;
+  ctxt->gc_peak_live_bytes = (std::max)(ctxt->gc_peak_live_bytes, bytes_after);
+  ctxt->gc_total_pause += pause;
+  ctxt->gc_max_pause = (std::max)(ctxt->gc_max_pause, pause);
+  ctxt->gc_last_pause = pause;
+  }
+
+void reset_gc_statistics(context& ctxt)
+  {
+  ctxt.gc_collections = 0;
+  ctxt.gc_full_collections = 0;
+  ctxt.gc_bytes_copied = 0;
+  ctxt.gc_bytes_reclaimed = 0;
+  ctxt.gc_total_pause = 0;
+  ctxt.gc_max_pause = 0;
+  ctxt.gc_last_pause = 0;
+  ctxt.gc_pause_start = 0;
+  ctxt.gc_bytes_before = 0;
+  ctxt.gc_old_bytes_before = 0;
+  ctxt.gc_old_space_before = nullptr;
+  ctxt.gc_peak_allocated_bytes = 0;
+  ctxt.gc_peak_live_bytes = 0;
+  }
+
+void reserve_procedure_counters(context& ctxt, uint64_t nr_of_procedures)
+  {
+  if (nr_of_procedures <= ctxt.procedure_counters_size)
+    return;
+  uint64_t new_size = (std::max)(nr_of_procedures, ctxt.procedure_counters_size * 2);
+  uint64_t* counters = new uint64_t[new_size * 2];
+  std::fill(counters, counters + new_size * 2, (uint64_t)0);
+  if (ctxt.procedure_counters)
+    std::copy(ctxt.procedure_counters, ctxt.procedure_counters + ctxt.procedure_counters_size * 2, counters);
+  delete[] ctxt.procedure_counters;
+  ctxt.procedure_counters = counters;
+  ctxt.procedure_counters_size = new_size;
+  }
+
+void reset_procedure_counters(context& ctxt)
+  {
+  std::fill(ctxt.procedure_counters, ctxt.procedure_counters + ctxt.procedure_counters_size * 2, (uint64_t)0);
+  }
+
 SKIWI_END
@@ -10,6 +10,8 @@
 
 SKIWI_BEGIN
 
+struct heap_profile;
+
 struct context {
   void* rbx; // offset 0
   void* rdi; // offset 8
@@ -46,12 +48,137 @@ struct context {
   uint64_t* error_label; // offset 256
   uint64_t* stack_end; // offset 264
   uint64_t last_global_variable_used[SKIWI_VARIABLE_DEBUG_STACK_SIZE]; // offset 272
+  /*
+  The following fields are only used by the generational garbage collector (see compiler_options::generational_gc).
+  In that case alloc, limit, from_space and from_space_end describe the nursery, and the old generation
+  is a semispace pair of its own. Otherwise they are nullptr.
+  */
+  uint64_t* nursery; // offset 312
+  uint64_t* nursery_end; // offset 320
+  uint64_t* old_space; // offset 328
+  uint64_t* old_space_end; // offset 336
+  uint64_t* old_to_space; // offset 344
+  uint64_t* old_to_space_end; // offset 352
+  uint64_t* old_alloc; // offset 360
+  uint64_t* remembered_set; // offset 368
+  uint64_t* remembered_set_top; // offset 376
+  uint64_t* remembered_set_end; // offset 384
+  uint64_t remembered_set_overflow; // offset 392
+  /*
+  Heap resizing policy of the semispace garbage collector (see resize_heap). The semispaces start inside
+  memory_allocated. Once the heap is resized, they live in heap_block instead.
+  */
+  uint64_t* heap_block; // offset 400
+  uint64_t* heap_block_pending; // offset 408
+  uint64_t heap_min_size; // offset 416
+  uint64_t heap_max_size; // offset 424
+  uint64_t heap_grow_threshold; // offset 432, percentage of the semispace in use after a collection above which the heap grows
+  uint64_t heap_shrink_threshold; // offset 440, percentage of the semispace in use after a collection below which the heap shrinks
+  /*
+  Per procedure counters of code compiled with compiler_options::procedure_counters. The table has two cells per procedure:
+  the number of calls and the number of bytes allocated on the heap. current_procedure is the byte offset in the table of
+  the procedure that is running, and procedure_alloc_mark the value of alloc when that procedure was entered.
+  */
+  uint64_t* procedure_counters; // offset 448
+  uint64_t procedure_counters_size; // offset 456, number of procedures in the table
+  uint64_t current_procedure; // offset 464
+  uint64_t* procedure_alloc_mark; // offset 472
+  /*
+  Garbage collection statistics, kept up to date by gc_collection_started and gc_collection_finished. Full collections are
+  all collections of the semispace collector, and the major collections of the generational collector. Pauses are in
+  nanoseconds.
+  */
+  uint64_t gc_collections; // offset 480
+  uint64_t gc_full_collections; // offset 488
+  uint64_t gc_bytes_copied; // offset 496
+  uint64_t gc_bytes_reclaimed; // offset 504
+  uint64_t gc_total_pause; // offset 512
+  uint64_t gc_max_pause; // offset 520
+  uint64_t gc_last_pause; // offset 528
+  uint64_t gc_pause_start; // offset 536
+  uint64_t gc_bytes_before; // offset 544, bytes in use on the heap when the running collection started
+  uint64_t gc_old_bytes_before; // offset 552, bytes in use in the old generation when the running collection started
+  uint64_t* gc_old_space_before; // offset 560
+  /*
+  Allocation-site heap profile of code compiled with compiler_options::heap_profiling (see heap_profiler.h). The compiled
+  code subtracts the bytes it allocated from heap_sample_countdown, and calls sample_heap_allocations when it runs out.
+  */
+  heap_profile* heap_prof; // offset 568
+  int64_t heap_sample_countdown; // offset 576
+  uint64_t gc_peak_allocated_bytes; // offset 584, most bytes in use on the heap when a collection started, garbage included
+  uint64_t heap_request; // offset 592, bytes of an allocation that did not fit, while L_make_room collects for it (see resize_heap)
+  uint64_t gc_peak_live_bytes; // offset 600, most bytes in use on the heap right after a collection, see heap_bytes_in_use
 
   uint64_t* memory_allocated;
+  uint64_t memory_size; // number of cells in memory_allocated
+  bool huge_pages;
+  mutable int snapshot_fd; // memfd with the copy-on-write snapshot that clones are made of, -1 if there is none. A cache of clone_context, hence mutable.
   };
 
 
-SKIWI_SCHEME_API context create_context(uint64_t heap_size, uint64_t globals_stack, uint32_t local_stack, uint64_t scheme_stack);
+/*
+If nursery_size is not zero, the heap is laid out for the generational garbage collector: nursery_size cells of
+the heap are used as nursery, the remaining cells are split in two semispaces for the old generation.
+The memory of the context is reserved, but only committed when it is touched, so creating a context is cheap
+whatever the heap size. If huge_pages is true, the heap is backed by transparent huge pages where the os supports it.
+*/
+SKIWI_SCHEME_API context create_context(uint64_t heap_size, uint64_t globals_stack, uint32_t local_stack, uint64_t scheme_stack, uint64_t nursery_size = 0, bool huge_pages = false);
 SKIWI_SCHEME_API void destroy_context(context& ctxt);
+
+/*
+The clone gets a copy of the locals, globals and stack of ctxt, and an empty heap of its own, so that objects in the heap of ctxt
+are shared. On linux the copy is made copy-on-write: the memory in front of the heap of ctxt is written to a memfd, and the
+clones map it privately. ctxt itself is only read. Later clones reuse that snapshot for as long as the locals and globals
+of ctxt that are in use still equal it. ctxt should not run scheme code on another thread while it is cloned, or the clone may see a half written state.
+*/
 SKIWI_SCHEME_API context clone_context(const context& ctxt);
+
+/*
+Brings a clone of ctxt up to date without making a new clone: the globals of ctxt are copied into the clone, and the heap
+of the clone is emptied. Objects that the clone allocated before are no longer valid afterwards.
+*/
+SKIWI_SCHEME_API void refresh_clone_context(context& clone, const context& ctxt);
+
+/*
+Sets the resizing policy of the heap. The heap never grows beyond max_heap_size cells, and never shrinks below the
+heap_size that was passed to create_context. If max_heap_size equals that heap_size, the heap has a fixed size.
+The thresholds are percentages of the semispace that is in use after a garbage collection.
+*/
+SKIWI_SCHEME_API void set_heap_resize_policy(context& ctxt, uint64_t max_heap_size, uint64_t grow_threshold, uint64_t shrink_threshold);
+
+/*
+Called by the semispace garbage collector after each collection, with ctxt.alloc up to date.
+If the heap should grow or shrink, a new heap block is allocated, to_space is pointed to its first semispace and 1 is returned.
+The garbage collector then collects once more, which moves all live data to the new block, and calls resize_heap again.
+That second call releases the old heap and returns 0. If the heap keeps its size, 0 is returned.
+The ctxt.heap_request bytes count as in use, so that the heap grows for an allocation that did not fit (see L_make_room).
+*/
+SKIWI_SCHEME_API uint64_t resize_heap(context* ctxt);
+
+/*
+Called by the garbage collectors at the start and at the end of each collection, with ctxt.alloc up to date.
+They update the garbage collection statistics in ctxt.
+*/
+SKIWI_SCHEME_API void gc_collection_started(context* ctxt);
+SKIWI_SCHEME_API void gc_collection_finished(context* ctxt);
+
+/*
+Sets the garbage collection statistics to zero.
+*/
+SKIWI_SCHEME_API void reset_gc_statistics(context& ctxt);
+
+/*
+Returns the number of bytes in use on the heap: the nursery or the semispace, and the old generation.
+*/
+SKIWI_SCHEME_API uint64_t heap_bytes_in_use(const context& ctxt);
+
+/*
+Makes room for the counters of nr_of_procedures procedures (see compiler_options::procedure_counters). Existing counters are kept.
+*/
+SKIWI_SCHEME_API void reserve_procedure_counters(context& ctxt, uint64_t nr_of_procedures);
+
+/*
+Sets all procedure counters to zero.
+*/
+SKIWI_SCHEME_API void reset_procedure_counters(context& ctxt);
 SKIWI_END
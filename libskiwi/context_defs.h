@@ -49,6 +49,33 @@ SKIWI_BEGIN
 
 #define LAST_GLOBAL_VARIABLE_USED ASM::asmcode::MEM_R10, 272
 
+#define NURSERY ASM::asmcode::MEM_R10, 312
+#define NURSERY_END ASM::asmcode::MEM_R10, 320
+#define OLD_SPACE ASM::asmcode::MEM_R10, 328
+#define OLD_SPACE_END ASM::asmcode::MEM_R10, 336
+#define OLD_TO_SPACE ASM::asmcode::MEM_R10, 344
+#define OLD_TO_SPACE_END ASM::asmcode::MEM_R10, 352
+#define OLD_ALLOC ASM::asmcode::MEM_R10, 360
+#define REMEMBERED_SET ASM::asmcode::MEM_R10, 368
+#define REMEMBERED_SET_TOP ASM::asmcode::MEM_R10, 376
+#define REMEMBERED_SET_END ASM::asmcode::MEM_R10, 384
+#define REMEMBERED_SET_OVERFLOW ASM::asmcode::MEM_R10, 392
+
+#define PROCEDURE_COUNTERS ASM::asmcode::MEM_R10, 448
+#define CURRENT_PROCEDURE ASM::asmcode::MEM_R10, 464
+#define PROCEDURE_ALLOC_MARK ASM::asmcode::MEM_R10, 472
+
+#define GC_COLLECTIONS ASM::asmcode::MEM_R10, 480
+#define GC_FULL_COLLECTIONS ASM::asmcode::MEM_R10, 488
+#define GC_BYTES_COPIED ASM::asmcode::MEM_R10, 496
+#define GC_BYTES_RECLAIMED ASM::asmcode::MEM_R10, 504
+#define GC_TOTAL_PAUSE ASM::asmcode::MEM_R10, 512
+#define GC_MAX_PAUSE ASM::asmcode::MEM_R10, 520
+#define GC_LAST_PAUSE ASM::asmcode::MEM_R10, 528
+
+#define HEAP_SAMPLE_COUNTDOWN ASM::asmcode::MEM_R10, 576
+#define HEAP_REQUEST ASM::asmcode::MEM_R10, 592
+
 
 #define STACK_REGISTER ASM::asmcode::R13
 #define STACK_REGISTER_MEM ASM::asmcode::MEM_R13
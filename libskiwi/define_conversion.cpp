@@ -3,6 +3,7 @@
 #include "debug_find.h"
 #include "single_begin_conversion.h"
 #include "visitor.h"
+#include "concurrency.h"
 #include <algorithm>
 #include <cassert>
 #include <sstream>
@@ -161,37 +162,39 @@ namespace
       _convert_internal_define(l);
       }    
 
-    void modify_exprs(std::vector<Expression>& exprs)
-      {      
-      for (auto& expr : exprs)
+    void modify_expr(Expression& expr)
+      {
+      if (std::holds_alternative<PrimitiveCall>(expr))
         {
-        if (std::holds_alternative<PrimitiveCall>(expr))
-          {
-          PrimitiveCall& p = std::get<PrimitiveCall>(expr);
-          if (p.primitive_name == "define")
-            {            
-            rewrite(p);
-            if (p.arguments.size() != 2)
-              throw_error(p.line_nr, p.column_nr, p.filename, invalid_number_of_arguments);
-            Set s;
-            if (std::holds_alternative<Variable>(p.arguments.front()))
-              {
-              s.name = std::get<Variable>(p.arguments.front()).name;
-              }
-            else if (std::holds_alternative<PrimitiveCall>(p.arguments.front()))
-              {
-              s.name = std::get<PrimitiveCall>(p.arguments.front()).primitive_name;
-              }
-            else            
-              throw_error(p.line_nr, p.column_nr, p.filename, invalid_argument);
-                       
-            s.value.push_back(p.arguments[1]);
-            s.originates_from_define = true;
-            expr = s;
+        PrimitiveCall& p = std::get<PrimitiveCall>(expr);
+        if (p.primitive_name == "define")
+          {            
+          rewrite(p);
+          if (p.arguments.size() != 2)
+            throw_error(p.line_nr, p.column_nr, p.filename, invalid_number_of_arguments);
+          Set s;
+          if (std::holds_alternative<Variable>(p.arguments.front()))
+            {
+            s.name = std::get<Variable>(p.arguments.front()).name;
+            }
+          else if (std::holds_alternative<PrimitiveCall>(p.arguments.front()))
+            {
+            s.name = std::get<PrimitiveCall>(p.arguments.front()).primitive_name;
             }
+          else            
+            throw_error(p.line_nr, p.column_nr, p.filename, invalid_argument);
+                     
+          s.value.push_back(p.arguments[1]);
+          s.originates_from_define = true;
+          expr = s;
           }
         }
+      }
 
+    void modify_exprs(std::vector<Expression>& exprs)
+      {      
+      for (auto& expr : exprs)
+        modify_expr(expr);
       }
 
     virtual void _postvisit(Program& prog)
@@ -232,4 +235,39 @@ void define_conversion(Program& prog)
 
   }
 
+void define_conversion(Program& prog, const compiler_options& ops)
+  {
+  assert(!prog.simplified_to_core_forms);
+  assert(!prog.closure_converted);
+  remove_nested_begin_expressions(prog);
+  if (prog.expressions.size() != 1 || !std::holds_alternative<Begin>(prog.expressions.front()))
+    {
+    define_conversion(prog);
+    return;
+    }
+  Begin& beg = std::get<Begin>(prog.expressions.front());
+  // a define in an invalid place is reported for the first top-level form that has one, as in the serial conversion
+  std::vector<const PrimitiveCall*> invalid_define(beg.arguments.size(), nullptr);
+  parallel_for(size_t(0), beg.arguments.size(), [&](size_t i)
+    {
+    Expression& expr = beg.arguments[i];
+    define_conversion_visitor dcv;
+    visitor<Expression, define_conversion_visitor>::visit(expr, &dcv);
+    dcv.modify_expr(expr);
+    find(expr, [&](const Expression& e) {if (std::holds_alternative<PrimitiveCall>(e) && std::get<PrimitiveCall>(e).primitive_name == "define")
+      {
+      invalid_define[i] = &std::get<PrimitiveCall>(e);
+      return true;
+      }
+    else return false; });
+    }, ops);
+  prog.define_converted = true;
+
+  for (const PrimitiveCall* p : invalid_define)
+    {
+    if (p)
+      throw_error(p->line_nr, p->column_nr, p->filename, define_invalid_place);
+    }
+  }
+
 SKIWI_END
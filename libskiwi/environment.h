@@ -2,11 +2,13 @@
 
 #include "namespace.h"
 
+#include <cassert>
 #include <map>
 #include <memory>
 #include <stdint.h>
 #include <algorithm>
 #include <string>
+#include <vector>
 
 SKIWI_BEGIN
   
@@ -86,6 +88,7 @@ class environment
       auto it = env.find(name);
       if (it != env.end())
         {
+        record(it);
         it->second = e;
         return true;
         }
@@ -95,6 +98,7 @@ class environment
         it = p_outer_copy->env.find(name);
         if (it != p_outer_copy->env.end())
           {
+          p_outer_copy->record(it);
           it->second = e;
           return true;
           }
@@ -110,6 +114,7 @@ class environment
       auto it = env.find(name);
       if (it != env.end())
         {
+        record(it);
         env.erase(it);
         }
       //if (p_outer)
@@ -120,6 +125,7 @@ class environment
         it = p_outer_copy->env.find(name);
         if (it != p_outer_copy->env.end())
           {
+          p_outer_copy->record(it);
           p_outer_copy->env.erase(it);
           }
         p_outer_copy = p_outer_copy->p_outer;
@@ -128,6 +134,8 @@ class environment
 
     void push(const std::string& name, TEntry e)
       {
+      if (transaction_depth)
+        record(name);
       env[name] = e;
       }
 
@@ -144,10 +152,10 @@ class environment
         auto p_outer_copy = p_outer;
         while (p_outer_copy->p_outer)
           p_outer_copy = p_outer_copy->p_outer;
-        p_outer_copy->env[name] = e;
+        p_outer_copy->push(name, e);
         }
       else
-        env[name] = e;
+        push(name, e);
       }
 
     typename std::map<std::string, TEntry>::iterator begin()
@@ -173,6 +181,7 @@ class environment
         p_outer.reset();
         }
       */
+      assert(transaction_depth == 0); // changing p_outer is not recorded
       while (p_outer)
         {
         auto it = p_outer->begin();
@@ -183,11 +192,74 @@ class environment
         }
       }
 
+    /*
+    While a transaction is open, every change to the entries of this environment (not of its outer environments, they
+    have their own transactions) is recorded in an undo log. rollback restores the entries as they were when the
+    transaction began, so a failed compilation can be undone without a deep copy of the environment. Transactions can
+    be nested: begin_transaction returns a savepoint, that must be passed to the matching commit or rollback.
+    */
+    uint64_t begin_transaction()
+      {
+      ++transaction_depth;
+      return undo_log.size();
+      }
+
+    void commit(uint64_t savepoint)
+      {
+      assert(transaction_depth > 0);
+      assert(savepoint <= undo_log.size());
+      (void)savepoint;
+      if (--transaction_depth == 0)
+        undo_log.clear();
+      }
+
+    void rollback(uint64_t savepoint)
+      {
+      assert(transaction_depth > 0);
+      while (undo_log.size() > savepoint)
+        {
+        undo_entry& u = undo_log.back();
+        if (u.existed)
+          env[u.name] = u.old_entry;
+        else
+          env.erase(u.name);
+        undo_log.pop_back();
+        }
+      if (--transaction_depth == 0)
+        undo_log.clear();
+      }
+
   private:
+    struct undo_entry
+      {
+      std::string name;
+      bool existed;
+      TEntry old_entry;
+      };
+
+    void record(typename std::map<std::string, TEntry>::iterator it)
+      {
+      if (transaction_depth)
+        undo_log.push_back(undo_entry{ it->first, true, it->second });
+      }
+
+    void record(const std::string& name)
+      {
+      auto it = env.find(name);
+      if (it != env.end())
+        record(it);
+      else
+        undo_log.push_back(undo_entry{ name, false, TEntry() });
+      }
+
     template <class T>
     friend std::shared_ptr<environment<T>> make_deep_copy(const std::shared_ptr<environment<T>>& env);
+    template <class T>
+    friend std::shared_ptr<environment<T>> rollup_into_outer(const std::shared_ptr<environment<T>>& env);
     std::map<std::string, TEntry> env;
     std::shared_ptr<environment<TEntry>> p_outer;
+    std::vector<undo_entry> undo_log;
+    uint64_t transaction_depth = 0;
   };
 
 template <class TEntry>
@@ -196,6 +268,8 @@ std::shared_ptr<environment<TEntry>> make_deep_copy(const std::shared_ptr<enviro
   if (!env.get())
     return env;
   std::shared_ptr<environment<TEntry>> out = std::make_shared<environment<TEntry>>(*env);
+  out->undo_log.clear();
+  out->transaction_depth = 0;
   //if (out->p_outer)
   //  out->p_outer = make_deep_copy(out->p_outer);
   auto* p_outer_copy = &(out->p_outer);
@@ -207,4 +281,23 @@ std::shared_ptr<environment<TEntry>> make_deep_copy(const std::shared_ptr<enviro
   return out;
   }
 
+/*
+Has the same result as env->rollup(), but when env has a single outer environment, the entries of env are pushed into the
+outer environment, which is returned, instead of copying all the entries of the outer environment into env. This keeps
+the top level of a compilation cheap when the outer environment is the large global environment. The changes to the
+outer environment are recorded in its transaction, if one is open.
+*/
+template <class TEntry>
+std::shared_ptr<environment<TEntry>> rollup_into_outer(const std::shared_ptr<environment<TEntry>>& env)
+  {
+  if (!env->p_outer || env->p_outer->p_outer)
+    {
+    env->rollup();
+    return env;
+    }
+  for (const auto& entry : env->env)
+    env->p_outer->push(entry.first, entry.second);
+  return env->p_outer;
+  }
+
 SKIWI_END
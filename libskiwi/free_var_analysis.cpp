@@ -1,5 +1,6 @@
 #include "free_var_analysis.h"
 #include "visitor.h"
+#include "concurrency.h"
 #include <set>
 #include <string>
 #include <algorithm>
@@ -251,6 +252,25 @@ void free_variable_analysis(Program& prog, environment_map& env)
   prog.free_variables_analysed = true;
   }
 
+void free_variable_analysis(Program& prog, environment_map& env, const compiler_options& ops)
+  {
+  if (prog.expressions.size() != 1 || !std::holds_alternative<Begin>(prog.expressions.front()))
+    {
+    free_variable_analysis(prog, env);
+    return;
+    }
+  assert(prog.global_define_env_allocated);
+  assert(env.get());
+  Begin& beg = std::get<Begin>(prog.expressions.front());
+  parallel_for(size_t(0), beg.arguments.size(), [&](size_t i)
+    {
+    free_var_analysis_helper fvah(env);
+    fvah.expressions.push_back(&beg.arguments[i]);
+    fvah.treat_expressions();
+    }, ops);
+  prog.free_variables_analysed = true;
+  }
+
 void free_variable_analysis(Lambda& lam, environment_map& env)
   {
   //free_var_analysis_visitor fvav;
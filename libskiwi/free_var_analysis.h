@@ -10,7 +10,10 @@
 
 SKIWI_BEGIN
 
+struct compiler_options;
+
 SKIWI_SCHEME_API void free_variable_analysis(Program& prog, environment_map& env);
+SKIWI_SCHEME_API void free_variable_analysis(Program& prog, environment_map& env, const compiler_options& ops);
 void free_variable_analysis(Lambda& lam, environment_map& env);
 
 SKIWI_END
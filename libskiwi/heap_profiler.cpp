@@ -0,0 +1,203 @@
+#include "heap_profiler.h"
+#include "context.h"
+#include "types.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <utility>
+
+SKIWI_BEGIN
+
+namespace
+  {
+  struct entry_data
+    {
+    uint64_t procedure_index;
+    uint64_t tag;
+    uint64_t samples;
+    uint64_t total_bytes;
+    };
+
+  struct live_sample
+    {
+    uint64_t address;
+    uint64_t entry;
+    uint64_t bytes;
+    };
+
+  const int64_t no_sample = INT64_MAX;
+
+  std::string type_name(uint64_t tag)
+    {
+    switch (tag)
+      {
+      case flonum_tag: return "flonum";
+      case string_tag: return "string";
+      case symbol_tag: return "symbol";
+      case closure_tag: return "closure";
+      case pair_tag: return "pair";
+      case vector_tag: return "vector";
+      case port_tag: return "port";
+      case promise_tag: return "promise";
+      default: return "other";
+      }
+    }
+  }
+
+struct heap_profile
+  {
+  uint64_t sample_interval;
+  std::mt19937_64 random;
+  std::map<std::pair<uint64_t, uint64_t>, uint64_t> entry_index; // (procedure index, tag) to index in entries
+  std::vector<entry_data> entries;
+  std::vector<live_sample> live; // sorted by the order of allocation
+
+  /*
+  The gaps between samples are uniformly distributed with sample_interval as mean, so that allocation patterns that
+  repeat themselves are not always sampled at the same object.
+  */
+  int64_t next_gap()
+    {
+    if (sample_interval <= 1)
+      return 1;
+    std::uniform_int_distribution<uint64_t> gap(1, sample_interval * 2 - 1);
+    return (int64_t)gap(random);
+    }
+
+  void record(uint64_t procedure_index, uint64_t tag, uint64_t address)
+    {
+    auto key = std::make_pair(procedure_index, tag);
+    auto it = entry_index.find(key);
+    if (it == entry_index.end())
+      {
+      it = entry_index.insert(std::make_pair(key, (uint64_t)entries.size())).first;
+      entries.push_back(entry_data{ procedure_index, tag, 0, 0 });
+      }
+    entry_data& e = entries[it->second];
+    ++e.samples;
+    e.total_bytes += sample_interval;
+    if (!address)
+      return;
+    if (!live.empty() && live.back().address == address)
+      live.back().bytes += sample_interval; // a large object can contain more than one sampled byte
+    else
+      live.push_back(live_sample{ address, it->second, sample_interval });
+    }
+  };
+
+heap_profile* create_heap_profile(uint64_t sample_interval)
+  {
+  heap_profile* hp = new heap_profile();
+  hp->sample_interval = sample_interval ? sample_interval : 1;
+  return hp;
+  }
+
+void destroy_heap_profile(heap_profile* hp)
+  {
+  delete hp;
+  }
+
+void attach_heap_profile(context& ctxt, heap_profile* hp)
+  {
+  ctxt.heap_prof = hp;
+  ctxt.heap_sample_countdown = hp ? hp->next_gap() : no_sample;
+  }
+
+void reset_heap_profile(context& ctxt)
+  {
+  heap_profile* hp = ctxt.heap_prof;
+  if (!hp)
+    return;
+  hp->entry_index.clear();
+  hp->entries.clear();
+  hp->live.clear();
+  ctxt.heap_sample_countdown = hp->next_gap();
+  }
+
+std::vector<heap_profile_entry> get_heap_profile(const context& ctxt)
+  {
+  std::vector<heap_profile_entry> result;
+  const heap_profile* hp = ctxt.heap_prof;
+  if (!hp)
+    return result;
+  for (const auto& e : hp->entries)
+    result.push_back(heap_profile_entry{ e.procedure_index, type_name(e.tag), e.samples, e.total_bytes, 0 });
+  for (const auto& s : hp->live)
+    result[s.entry].live_bytes += s.bytes;
+  std::stable_sort(result.begin(), result.end(), [](const heap_profile_entry& left, const heap_profile_entry& right)
+    {
+    return left.total_bytes > right.total_bytes;
+    });
+  return result;
+  }
+
+void sample_heap_allocations(context* ctxt)
+  {
+  heap_profile* hp = ctxt->heap_prof;
+  if (!hp)
+    {
+    ctxt->heap_sample_countdown = no_sample;
+    return;
+    }
+  const uint64_t begin = (uint64_t)ctxt->procedure_alloc_mark;
+  const uint64_t end = (std::min)((uint64_t)ctxt->alloc, (uint64_t)ctxt->from_space_end); // alloc passes the end when the heap is full
+  const uint64_t procedure_index = ctxt->current_procedure / (2 * sizeof(uint64_t));
+  int64_t countdown = ctxt->heap_sample_countdown;
+  /*
+  The objects between begin and end follow each other, so they are walked once, from header to header.
+  If a header does not make sense, the remaining samples of the range are counted without an object.
+  */
+  uint64_t object = begin;
+  uint64_t object_end = begin;
+  uint64_t tag = 0;
+  bool walkable = begin <= end;
+  while (countdown <= 0)
+    {
+    uint64_t sampled_byte = (std::max)(begin, end + countdown - 1);
+    while (walkable && sampled_byte >= object_end)
+      {
+      object = object_end;
+      if (object >= end)
+        {
+        walkable = false;
+        break;
+        }
+      const uint64_t header = *(const uint64_t*)object;
+      const uint64_t size = (get_block_size(header) + 1) * sizeof(uint64_t);
+      tag = (header >> block_shift) & block_header_mask;
+      if (tag < flonum_tag || tag > promise_tag || size > end - object)
+        walkable = false;
+      else
+        object_end = object + size;
+      }
+    if (walkable)
+      hp->record(procedure_index, tag, object);
+    else
+      hp->record(procedure_index, 0, 0);
+    countdown += hp->next_gap();
+    }
+  ctxt->heap_sample_countdown = countdown;
+  }
+
+void update_heap_profile(context* ctxt)
+  {
+  heap_profile* hp = ctxt->heap_prof;
+  if (!hp)
+    return;
+  const uint64_t from_space = (uint64_t)ctxt->from_space;
+  const uint64_t from_space_end = (uint64_t)ctxt->from_space_end;
+  auto collected = [&](live_sample& s)
+    {
+    if (s.address < from_space || s.address >= from_space_end)
+      return false;
+    const uint64_t header = *(const uint64_t*)s.address;
+    if (!(header & block_mask_bit))
+      return true;
+    s.address = header & ~block_mask_bit & ~(uint64_t)block_mask; // the collector left the new address of the block
+    return false;
+    };
+  hp->live.erase(std::remove_if(hp->live.begin(), hp->live.end(), collected), hp->live.end());
+  }
+
+SKIWI_END
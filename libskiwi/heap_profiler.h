@@ -0,0 +1,67 @@
+#pragma once
+
+#include "namespace.h"
+#include "libskiwi_api.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+SKIWI_BEGIN
+
+struct context;
+
+/*
+An allocation-site heap profiler for code compiled with compiler_options::heap_profiling.
+
+The procedure counters (see compiler_options::procedure_counters) already know which procedure allocated the heap
+between procedure_alloc_mark and alloc. Every time that range is counted, the bytes in it are also subtracted from
+context::heap_sample_countdown. When the countdown runs out, sample_heap_allocations walks the objects in the range and
+samples the object that contains the byte at which the countdown ran out, so that on average one sample is taken every
+sample_interval bytes. Each sample stands for sample_interval bytes of its procedure and object type.
+The garbage collectors call update_heap_profile after they copied the live objects, so that the samples follow their
+objects, and the samples of objects that were collected no longer count as live.
+
+With a sample interval of 1 every byte is sampled, and the numbers are exact.
+*/
+
+struct heap_profile;
+
+struct heap_profile_entry
+  {
+  uint64_t procedure_index; // index in repl_data::procedure_names
+  std::string type; // pair, closure, flonum, string, symbol, vector, promise, port, or other
+  uint64_t samples;
+  uint64_t total_bytes; // estimate of the bytes allocated
+  uint64_t live_bytes; // estimate of the bytes that were not collected yet
+  };
+
+SKIWI_SCHEME_API heap_profile* create_heap_profile(uint64_t sample_interval);
+SKIWI_SCHEME_API void destroy_heap_profile(heap_profile* hp);
+
+/*
+Samples the allocations in ctxt for hp from now on. If hp is nullptr, nothing is sampled.
+*/
+SKIWI_SCHEME_API void attach_heap_profile(context& ctxt, heap_profile* hp);
+
+/*
+Forgets all samples.
+*/
+SKIWI_SCHEME_API void reset_heap_profile(context& ctxt);
+
+/*
+Returns the samples of ctxt, sorted by decreasing total bytes.
+*/
+SKIWI_SCHEME_API std::vector<heap_profile_entry> get_heap_profile(const context& ctxt);
+
+/*
+Called by the compiled code when context::heap_sample_countdown runs out, with ctxt.alloc up to date.
+*/
+SKIWI_SCHEME_API void sample_heap_allocations(context* ctxt);
+
+/*
+Called by the garbage collectors after the live blocks between from_space and from_space_end were copied.
+*/
+SKIWI_SCHEME_API void update_heap_profile(context* ctxt);
+
+SKIWI_END
@@ -1,5 +1,6 @@
 #include "inline_primitives_conversion.h"
 
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 #include <inttypes.h>
@@ -10,15 +11,18 @@
 #include "parse.h"
 #include "tokenize.h"
 #include "visitor.h"
+#include "concurrency.h"
+#include "debug_find.h"
 #include "simplify_to_core.h"
 
 SKIWI_BEGIN
 
 namespace
   {
-  bool g_safe_primitives = true;
-  bool g_standard_bindings = false;
-  uint64_t g_alpha_conversion_index = 0;
+  // thread_local, so that the top-level forms can be converted in parallel
+  thread_local bool g_safe_primitives = true;
+  thread_local bool g_standard_bindings = false;
+  thread_local uint64_t g_alpha_conversion_index = 0;
 
   typedef void(*fun_ptr)(PrimitiveCall&, Expression&);
 
@@ -1337,4 +1341,49 @@ void inline_primitives(Program& prog, uint64_t& alpha_conversion_index, bool saf
   alpha_conversion_index = g_alpha_conversion_index;
   }
 
+/*
+Inlining a primitive call with n arguments uses n new variable names, so a top-level form never needs more indices than the
+number of arguments of its primitive calls. Every form gets a block of that many indices, in program order, so that the
+names do not depend on the order in which the forms are converted.
+*/
+void inline_primitives(Program& prog, uint64_t& alpha_conversion_index, bool safe_primitives, bool standard_bindings, const compiler_options& ops)
+  {
+  if (prog.expressions.size() != 1 || !std::holds_alternative<Begin>(prog.expressions.front()))
+    {
+    inline_primitives(prog, alpha_conversion_index, safe_primitives, standard_bindings);
+    return;
+    }
+  Begin& beg = std::get<Begin>(prog.expressions.front());
+  const size_t sz = beg.arguments.size();
+  std::vector<uint64_t> first_index(sz + 1, 0);
+  parallel_for(size_t(0), sz, [&](size_t i)
+    {
+    uint64_t nr_of_names = 0;
+    find(beg.arguments[i], [&](const Expression& e)
+      {
+      if (std::holds_alternative<PrimitiveCall>(e))
+        nr_of_names += std::min<uint64_t>(std::get<PrimitiveCall>(e).arguments.size(), 4);
+      return false;
+      });
+    first_index[i + 1] = nr_of_names;
+    }, ops);
+  first_index[0] = alpha_conversion_index;
+  for (size_t i = 0; i < sz; ++i)
+    first_index[i + 1] += first_index[i];
+
+  parallel_for(size_t(0), sz, [&](size_t i)
+    {
+    g_safe_primitives = safe_primitives;
+    g_standard_bindings = standard_bindings;
+    g_alpha_conversion_index = first_index[i];
+    inline_primitives_conversion_helper ipch;
+    ipch.expressions.push_back(&beg.arguments[i]);
+    ipch.treat_expressions();
+    assert(g_alpha_conversion_index <= first_index[i + 1]);
+    }, ops);
+
+  prog.inline_primitives_converted = true;
+  alpha_conversion_index = first_index[sz];
+  }
+
 SKIWI_END
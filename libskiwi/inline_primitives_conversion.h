@@ -9,6 +9,9 @@
 
 SKIWI_BEGIN
 
+struct compiler_options;
+
 SKIWI_SCHEME_API void inline_primitives(Program& prog, uint64_t& alpha_conversion_index, bool safe_primitives, bool standard_bindings);
+SKIWI_SCHEME_API void inline_primitives(Program& prog, uint64_t& alpha_conversion_index, bool safe_primitives, bool standard_bindings, const compiler_options& ops);
 
 SKIWI_END
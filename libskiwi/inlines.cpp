@@ -639,16 +639,28 @@ void inline_cdr(ASM::asmcode& code, const compiler_options&)
   code.add(ASM::asmcode::MOV, ASM::asmcode::RAX, ASM::asmcode::MEM_RAX, CELLS(2));
   }
 
-void inline_set_car(ASM::asmcode& code, const compiler_options&)
+void inline_set_car(ASM::asmcode& code, const compiler_options& ops)
   {
   code.add(ASM::asmcode::AND, ASM::asmcode::RAX, ASM::asmcode::NUMBER, 0xFFFFFFFFFFFFFFF8);
   code.add(ASM::asmcode::MOV, ASM::asmcode::MEM_RAX, CELLS(1), ASM::asmcode::RBX);
+  if (ops.generational_gc)
+    {
+    code.add(ASM::asmcode::ADD, ASM::asmcode::RAX, ASM::asmcode::NUMBER, CELLS(1));
+    write_barrier(code, ASM::asmcode::RAX, ASM::asmcode::RBX);
+    code.add(ASM::asmcode::SUB, ASM::asmcode::RAX, ASM::asmcode::NUMBER, CELLS(1));
+    }
   }
 
-void inline_set_cdr(ASM::asmcode& code, const compiler_options&)
+void inline_set_cdr(ASM::asmcode& code, const compiler_options& ops)
   {
   code.add(ASM::asmcode::AND, ASM::asmcode::RAX, ASM::asmcode::NUMBER, 0xFFFFFFFFFFFFFFF8);
   code.add(ASM::asmcode::MOV, ASM::asmcode::MEM_RAX, CELLS(2), ASM::asmcode::RBX);
+  if (ops.generational_gc)
+    {
+    code.add(ASM::asmcode::ADD, ASM::asmcode::RAX, ASM::asmcode::NUMBER, CELLS(2));
+    write_barrier(code, ASM::asmcode::RAX, ASM::asmcode::RBX);
+    code.add(ASM::asmcode::SUB, ASM::asmcode::RAX, ASM::asmcode::NUMBER, CELLS(2));
+    }
   }
 
 void inline_not(ASM::asmcode& code, const compiler_options&)
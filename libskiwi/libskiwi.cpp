@@ -8,22 +8,33 @@
 #else
 #include <unistd.h>
 #endif
+#include <algorithm>
 #include <fstream>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 
 #include "asm/assembler.h"
+#include "asm/jit_symbols.h"
 #include "asm/vm.h"
 #include "asm_aux.h"
 #include "c_prim_decl.h"
 #include "context.h"
+#include "context_defs.h"
+#include "heap_profiler.h"
 #include "load_lib.h"
 #include "macro_data.h"
 #include "cinput_data.h"
 #include "parse.h"
 #include "preprocess.h"
 #include "primitives_lib.h"
+#include "profiler.h"
 #include "runtime.h"
+#include "startup_cache.h"
 #include "tokenize.h"
 #include "compiler.h"
+#include "compile_stats.h"
+#include "compile_transaction.h"
 #include "types.h"
 #include "dump.h"
 #include "format.h"
@@ -41,7 +52,7 @@ namespace
 #ifdef _SKIWI_FOR_ARM
   struct compiler_data
     {
-    compiler_data() : initialized(false), trace(nullptr) {}
+    compiler_data() : initialized(false), worker_setup(nullptr), worker_teardown(nullptr), trace(nullptr) {}
 
     bool initialized;
     compiler_options ops;
@@ -54,16 +65,37 @@ namespace
     primitive_map pm;
     std::map<std::string, external_function> externals;
     std::vector<ASM::external_function> externals_for_vm;
+    std::map<uint64_t, skiwi_compiled_function_ptr> call_stubs; // per arity, see skiwi_apply
+    std::vector<uint64_t> call_globals; // positions of the globals that pass the closure and its arguments to the call stubs
+    skiwi_compiled_function_ptr worker_setup; // see skiwi_parallel_for
+    skiwi_compiled_function_ptr worker_teardown;
     std::ostream* trace;
     std::ostream* stderror;
     std::ostream* stdoutput;
     };
 #else
+  /*
+  A compiled expression in the compile cache. The entry stays valid for as long as each global or primitive that the
+  expression refers to still refers to the same global variable and no macros were defined since it was compiled.
+  */
+  struct compile_cache_entry
+    {
+    skiwi_compiled_function_ptr f;
+    uint64_t size;
+    bool handed_out; // returned by skiwi_compile, so the caller may still call f after the entry is gone
+    uint64_t macro_generation;
+    std::vector<std::pair<std::string, uint64_t>> dependencies; // identifier and the position of its global, unbound_global for a primitive
+    std::list<std::string>::iterator lru_position;
+    };
+
   struct compiler_data
     {
-    compiler_data() : initialized(false), trace(nullptr) {}
+    compiler_data() : initialized(false), compiling_startup_libraries(false), use_compile_cache(false), compile_cache_size(0), reclaim_code_threshold(64), worker_setup(nullptr), worker_teardown(nullptr), heap_prof(nullptr), trace(nullptr) {}
 
     bool initialized;
+    bool compiling_startup_libraries;
+    bool use_compile_cache;
+    uint64_t compile_cache_size; // see skiwi_parameters::compile_cache_size
     typedef uint64_t(*fptr)(void*, ...);
     compiler_options ops;
     context ctxt;
@@ -72,8 +104,19 @@ namespace
     macro_data md;
     std::shared_ptr<environment<environment_entry>> env;
     std::vector<std::pair<fptr, uint64_t>> compiled_functions;
+    std::vector<std::pair<fptr, uint64_t>> one_shot_functions; // code of expressions that ran once, released when no closure refers to it anymore (see skiwi_reclaim_code)
+    uint64_t reclaim_code_threshold; // number of one_shot_functions above which reclaim_code runs automatically
+    std::vector<startup_code_unit> startup_units; // the code compiled during startup, in the order in which it was compiled
+    std::vector<std::string> startup_files; // the files that were loaded while compiling the startup libraries, e.g. packages.scm
+    std::map<std::string, compile_cache_entry> compile_cache; // source text to compiled code, see skiwi_parameters::use_compile_cache
+    std::list<std::string> compile_cache_lru; // the keys of compile_cache, the most recently used one first
     primitive_map pm;
     std::map<std::string, external_function> externals;
+    std::map<uint64_t, skiwi_compiled_function_ptr> call_stubs; // per arity, see skiwi_apply
+    std::vector<uint64_t> call_globals; // positions of the globals that pass the closure and its arguments to the call stubs
+    skiwi_compiled_function_ptr worker_setup; // see skiwi_parallel_for
+    skiwi_compiled_function_ptr worker_teardown;
+    heap_profile* heap_prof; // the heap profile of ctxt, see skiwi_parameters::heap_profiling
     std::ostream* trace;
     std::ostream* stderror;
     std::ostream* stdoutput;
@@ -119,6 +162,10 @@ Enter scheme commands or one of the following:
 ,expand
 ,external
 ,mem
+,profile <expr>
+,compile-stats [reset]
+,counters [reset]
+,heap <expr>
 ,unresolved
 
 )";
@@ -148,6 +195,14 @@ Enter scheme commands or one of the following:
       ((*cd.stderror) << ... << args);
     }
 
+#ifndef _SKIWI_FOR_ARM
+  void* timed_assemble(uint64_t& size, ASM::first_pass_data& d, ASM::asmcode& code)
+    {
+    SKIWI::compile_pass_timer timer("assemble");
+    return ASM::assemble(size, d, code);
+    }
+#endif
+
   void compile_primitives_library()
     {
     using namespace SKIWI;
@@ -169,11 +224,12 @@ Enter scheme commands or one of the following:
       run_bytecode(f, size, reg);
       cd.compiled_bytecode.emplace_back(f, size);
 #else
-      compiler_data::fptr f = (compiler_data::fptr)assemble(size, d, code);
+      compiler_data::fptr f = (compiler_data::fptr)timed_assemble(size, d, code);
       f(&cd.ctxt);
       cd.compiled_functions.emplace_back(f, size);
+      cd.startup_units.push_back(startup_code_unit{ (void*)f, size, d.imm64_offsets, false });
 #endif
-      assign_primitive_addresses(cd.pm, d, (uint64_t)f);
+      assign_primitive_addresses(cd.pm, d, code, (uint64_t)f);
       }
     catch (std::logic_error e)
       {
@@ -213,9 +269,10 @@ Enter scheme commands or one of the following:
         run_bytecode(f, size, reg);
         cd.compiled_bytecode.emplace_back(f, size);
 #else
-        compiler_data::fptr f = (compiler_data::fptr)assemble(size, d, code);
+        compiler_data::fptr f = (compiler_data::fptr)timed_assemble(size, d, code);
         f(&cd.ctxt);
         cd.compiled_functions.emplace_back(f, size);
+        cd.startup_units.push_back(startup_code_unit{ (void*)f, size, d.imm64_offsets, false });
 #endif
         }
       else
@@ -259,9 +316,10 @@ Enter scheme commands or one of the following:
         run_bytecode(f, size, reg);
         cd.compiled_bytecode.emplace_back(f, size);
 #else
-        compiler_data::fptr f = (compiler_data::fptr)assemble(size, d, code);
+        compiler_data::fptr f = (compiler_data::fptr)timed_assemble(size, d, code);
         f(&cd.ctxt);
         cd.compiled_functions.emplace_back(f, size);
+        cd.startup_units.push_back(startup_code_unit{ (void*)f, size, d.imm64_offsets, false });
 #endif
         }
       else
@@ -305,9 +363,10 @@ Enter scheme commands or one of the following:
         run_bytecode(f, size, reg);
         cd.compiled_bytecode.emplace_back(f, size);
 #else
-        compiler_data::fptr f = (compiler_data::fptr)assemble(size, d, code);
+        compiler_data::fptr f = (compiler_data::fptr)timed_assemble(size, d, code);
         f(&cd.ctxt);
         cd.compiled_functions.emplace_back(f, size);
+        cd.startup_units.push_back(startup_code_unit{ (void*)f, size, d.imm64_offsets, false });
 #endif
         }
       else
@@ -351,9 +410,10 @@ Enter scheme commands or one of the following:
         run_bytecode(f, size, reg);
         cd.compiled_bytecode.emplace_back(f, size);
 #else
-        compiler_data::fptr f = (compiler_data::fptr)assemble(size, d, code);
+        compiler_data::fptr f = (compiler_data::fptr)timed_assemble(size, d, code);
         f(&cd.ctxt);
         cd.compiled_functions.emplace_back(f, size);
+        cd.startup_units.push_back(startup_code_unit{ (void*)f, size, d.imm64_offsets, false });
 #endif
         }
       else
@@ -397,9 +457,10 @@ Enter scheme commands or one of the following:
         run_bytecode(f, size, reg, cd.externals_for_vm);
         cd.compiled_bytecode.emplace_back(f, size);
 #else
-        compiler_data::fptr f = (compiler_data::fptr)assemble(size, d, code);
+        compiler_data::fptr f = (compiler_data::fptr)timed_assemble(size, d, code);
         f(&cd.ctxt);
         cd.compiled_functions.emplace_back(f, size);
+        cd.startup_units.push_back(startup_code_unit{ (void*)f, size, d.imm64_offsets, false });
 #endif
         }
       else
@@ -445,7 +506,7 @@ Enter scheme commands or one of the following:
         run_bytecode(f, size, reg);
         cd.compiled_bytecode.emplace_back(f, size);
 #else
-        compiler_data::fptr f = (compiler_data::fptr)assemble(size, d, code);
+        compiler_data::fptr f = (compiler_data::fptr)timed_assemble(size, d, code);
         f(&cd.ctxt);
         cd.compiled_functions.emplace_back(f, size);
 #endif
@@ -475,8 +536,7 @@ Enter scheme commands or one of the following:
 
     asmcode code;
     Program prog;
-    auto env_copy = make_deep_copy(env);
-    auto rd_copy = make_deep_copy(rd);
+    compile_transaction transaction(env, rd);
     try
       {
       auto tokens = tokenize(input);
@@ -485,8 +545,7 @@ Enter scheme commands or one of the following:
       }
     catch (std::logic_error e)
       {
-      env = env_copy;
-      rd = rd_copy;
+      transaction.rollback();
       code.clear();
       err(e.what(), "\n");
       return nullptr;
@@ -500,39 +559,60 @@ Enter scheme commands or one of the following:
       }
     catch (std::logic_error e)
       {
-      env = env_copy;
-      rd = rd_copy;
+      transaction.rollback();
       code.clear();
       err(e.what(), "\n");
       }
     catch (std::runtime_error e)
       {
-      env = env_copy;
-      rd = rd_copy;
+      transaction.rollback();
       code.clear();
       err(e.what(), "\n");
       }
     return nullptr;
     }
 #else
-  compiler_data::fptr compile(uint64_t& size, const std::string& input, environment_map& env, repl_data& rd)
+  /*
+  Returns true if the code can store the address of one of its labels somewhere, i.e. if it creates closures.
+  The error label is stored in the context, but it is reset by every scheme call. The labels that are put in CONTINUE
+  are return addresses for primitives, which primitives never store.
+  */
+  bool code_addresses_escape(const asmcode& code)
+    {
+    for (const auto& instructions : code.get_instructions_list())
+      {
+      for (const auto& ins : instructions)
+        {
+        if (ins.operand2 == asmcode::LABELADDRESS && (ins.operand1 == CONTINUE || code.get_text(ins.text) == "L_error"))
+          continue;
+        if (ins.operand1 == asmcode::LABELADDRESS || ins.operand2 == asmcode::LABELADDRESS)
+          return true;
+        }
+      }
+    return false;
+    }
+
+  compiler_data::fptr compile(uint64_t& size, first_pass_data& d, const std::string& input, environment_map& env, repl_data& rd, bool* code_escapes = nullptr)
     {
     using namespace SKIWI;
 
     asmcode code;
     Program prog;
-    auto env_copy = make_deep_copy(env);
-    auto rd_copy = make_deep_copy(rd);
+    compile_transaction transaction(env, rd);
     try
       {
-      auto tokens = tokenize(input);
-      std::reverse(tokens.begin(), tokens.end());
+      std::vector<token> tokens;
+        {
+        compile_pass_timer timer("tokenize");
+        tokens = tokenize(input);
+        std::reverse(tokens.begin(), tokens.end());
+        }
+      compile_pass_timer timer("parse");
       prog = make_program(tokens);
       }
     catch (std::logic_error e)
       {
-      env = env_copy;
-      rd = rd_copy;
+      transaction.rollback();
       code.clear();
       err(e.what(), "\n");
       return nullptr;
@@ -540,26 +620,234 @@ Enter scheme commands or one of the following:
     try
       {
       compile(env, rd, cd.md, cd.ctxt, code, prog, cd.pm, cd.externals, cd.ops);
-      first_pass_data d;
-      compiler_data::fptr f = (compiler_data::fptr)assemble(size, d, code);
+      if (code_escapes)
+        *code_escapes = code_addresses_escape(code);
+      compiler_data::fptr f = (compiler_data::fptr)timed_assemble(size, d, code);
       return f;
       }
     catch (std::logic_error e)
       {
-      env = env_copy;
-      rd = rd_copy;
+      transaction.rollback();
       code.clear();
       err(e.what(), "\n");
       }
     catch (std::runtime_error e)
       {
-      env = env_copy;
-      rd = rd_copy;
+      transaction.rollback();
       code.clear();
       err(e.what(), "\n");
       }
     return nullptr;
     }
+
+  compiler_data::fptr compile(uint64_t& size, const std::string& input, environment_map& env, repl_data& rd)
+    {
+    first_pass_data d;
+    return compile(size, d, input, env, rd);
+    }
+#endif
+
+#ifndef _SKIWI_FOR_ARM
+  typedef std::vector<std::pair<compiler_data::fptr, uint64_t>> code_list;
+
+  /*
+  Marks the functions in code (sorted by address) that one of the words in [first, last) points into.
+  */
+  void mark_code_references(std::vector<bool>& referenced, const code_list& code, const uint64_t* first, const uint64_t* last)
+    {
+    if (code.empty() || first >= last)
+      return;
+    const uint64_t lowest = (uint64_t)code.front().first;
+    const uint64_t highest = (uint64_t)code.back().first + code.back().second;
+    for (; first < last; ++first)
+      {
+      const uint64_t address = *first & ~(uint64_t)7; // closures and procedures are tagged in the lowest bits
+      if (address < lowest || address >= highest)
+        continue;
+      auto it = std::upper_bound(code.begin(), code.end(), address, [](uint64_t a, const std::pair<compiler_data::fptr, uint64_t>& f)
+        {
+        return a < (uint64_t)f.first;
+        });
+      if (it == code.begin())
+        continue;
+      --it;
+      if (address < (uint64_t)it->first + it->second)
+        referenced[it - code.begin()] = true;
+      }
+    }
+
+  void mark_code_references(std::vector<bool>& referenced, const code_list& code, const context& ctxt)
+    {
+    if (!ctxt.memory_allocated)
+      return;
+    mark_code_references(referenced, code, (const uint64_t*)&ctxt.rbx, (const uint64_t*)&ctxt.r15 + 1);
+    mark_code_references(referenced, code, ctxt.gc_save, ctxt.globals_end); // locals and globals
+    mark_code_references(referenced, code, ctxt.stack_top, ctxt.stack); // the scheme stack as it was saved by the last (foreign) call
+    if (ctxt.nursery)
+      mark_code_references(referenced, code, ctxt.old_space, ctxt.old_alloc);
+    mark_code_references(referenced, code, ctxt.from_space, ctxt.alloc);
+    }
+
+  /*
+  Releases the one shot functions that nothing refers to. The scan is conservative: every word in the heaps, globals, locals
+  and scheme stacks of the contexts that points into a function keeps it, even if it belongs to a dead object.
+  While a scheme call is running (e.g. eval), the native stack up to that call is scanned too, as it holds the return
+  addresses into the running code. Returns the number of bytes released.
+  */
+  uint64_t reclaim_code()
+    {
+    code_list& code = cd.one_shot_functions;
+    std::sort(code.begin(), code.end());
+    std::vector<bool> referenced(code.size(), false);
+    mark_code_references(referenced, code, cd.ctxt);
+    for (const auto& clone : cd.ctxt_clones)
+      mark_code_references(referenced, code, clone);
+    const auto& mementos = compiler_data_memento_vector.local();
+    if (!mementos.empty())
+      {
+      uint64_t marker = 0;
+      mark_code_references(referenced, code, &marker, (const uint64_t*)mementos.front().rsp);
+      }
+    uint64_t released = 0;
+    code_list kept;
+    for (size_t i = 0; i < code.size(); ++i)
+      {
+      if (referenced[i])
+        kept.push_back(code[i]);
+      else
+        {
+        free_assembled_function((void*)code[i].first, code[i].second);
+        released += code[i].second;
+        }
+      }
+    code.swap(kept);
+    cd.reclaim_code_threshold = (std::max)((uint64_t)64, (uint64_t)code.size() * 2);
+    return released;
+    }
+
+  /*
+  Runs code that is not kept by the caller, and releases it afterwards. If the code creates no closures, it is released
+  immediately, otherwise when reclaim_code finds no more references to it.
+  */
+  uint64_t run_one_shot_function(compiler_data::fptr f, uint64_t size, bool code_escapes)
+    {
+    uint64_t result = f(&cd.ctxt);
+    if (!code_escapes)
+      {
+      free_assembled_function((void*)f, size);
+      return result;
+      }
+    cd.one_shot_functions.emplace_back(f, size);
+    if (cd.one_shot_functions.size() >= cd.reclaim_code_threshold) // a closure in result is still in the heap, so the scan keeps f
+      reclaim_code();
+    return result;
+    }
+
+  const uint64_t unbound_global = (uint64_t)-1;
+
+  uint64_t find_global_position(const std::string& identifier)
+    {
+    alpha_conversion_data acd;
+    environment_entry e;
+    if (!cd.rd.alpha_conversion_env->find(acd, identifier) || !cd.env->find(e, acd.name) || e.st != environment_entry::st_global)
+      return unbound_global;
+    return e.pos;
+    }
+
+  /*
+  Removes an entry from the compile cache. Unless skiwi_compile handed its code out, nobody calls the code anymore, but
+  closures that it made may still run it, so it becomes a one shot function that reclaim_code releases when no closure
+  refers to it anymore.
+  */
+  void remove_from_compile_cache(std::map<std::string, compile_cache_entry>::iterator it)
+    {
+    const compile_cache_entry& entry = it->second;
+    if (!entry.handed_out)
+      {
+      auto f_it = std::find_if(cd.compiled_functions.begin(), cd.compiled_functions.end(), [&](const std::pair<compiler_data::fptr, uint64_t>& f)
+        {
+        return f.first == (compiler_data::fptr)entry.f;
+        });
+      if (f_it != cd.compiled_functions.end())
+        {
+        cd.compiled_functions.erase(f_it);
+        cd.one_shot_functions.emplace_back((compiler_data::fptr)entry.f, entry.size);
+        }
+      }
+    cd.compile_cache_lru.erase(entry.lru_position);
+    cd.compile_cache.erase(it);
+    }
+
+  compiler_data::fptr find_in_compile_cache(const std::string& input, bool hand_out)
+    {
+    auto it = cd.compile_cache.find(input);
+    if (it == cd.compile_cache.end())
+      return nullptr;
+    bool valid = it->second.macro_generation == cd.md.compiled_macros.size();
+    for (auto dep_it = it->second.dependencies.begin(); valid && dep_it != it->second.dependencies.end(); ++dep_it)
+      valid = find_global_position(dep_it->first) == dep_it->second;
+    if (!valid) // an identifier is bound to another global now, the code refers to the old one
+      {
+      remove_from_compile_cache(it);
+      return nullptr;
+      }
+    it->second.handed_out |= hand_out;
+    cd.compile_cache_lru.splice(cd.compile_cache_lru.begin(), cd.compile_cache_lru, it->second.lru_position);
+    return (compiler_data::fptr)it->second.f;
+    }
+
+  /*
+  The dependencies of an entry are the identifiers of input that refer to a global once input is compiled (a free
+  variable that was not defined yet got a global as forward declaration), and the primitives, which a define can turn
+  into a global. The local variables of input are left out.
+  */
+  void add_to_compile_cache(const std::string& input, compiler_data::fptr f, uint64_t size, bool hand_out)
+    {
+    if (cd.compile_cache_size == 0)
+      return;
+    while (cd.compile_cache.size() >= cd.compile_cache_size)
+      remove_from_compile_cache(cd.compile_cache.find(cd.compile_cache_lru.back()));
+    compile_cache_entry entry;
+    entry.f = (skiwi_compiled_function_ptr)f;
+    entry.size = size;
+    entry.handed_out = hand_out;
+    entry.macro_generation = cd.md.compiled_macros.size();
+    std::vector<std::string> identifiers;
+    for (const auto& t : tokenize(input))
+      {
+      if (t.type == token::T_ID)
+        identifiers.push_back(t.value);
+      }
+    std::sort(identifiers.begin(), identifiers.end());
+    identifiers.erase(std::unique(identifiers.begin(), identifiers.end()), identifiers.end());
+    for (const auto& id : identifiers)
+      {
+      const uint64_t position = find_global_position(id);
+      if (position != unbound_global || cd.pm.find(id) != cd.pm.end())
+        entry.dependencies.emplace_back(id, position);
+      }
+    cd.compile_cache_lru.push_front(input);
+    entry.lru_position = cd.compile_cache_lru.begin();
+    cd.compile_cache[input] = entry;
+    }
+
+  /*
+  skiwi_compile, but with hand_out false the caller does not keep the code, so the compile cache may release it.
+  */
+  skiwi_compiled_function_ptr compile_with_cache(const std::string& scheme_expression, bool hand_out)
+    {
+    auto cached = find_in_compile_cache(scheme_expression, hand_out);
+    if (cached)
+      return (skiwi_compiled_function_ptr)cached;
+    uint64_t size;
+    auto f = compile(size, scheme_expression, cd.env, cd.rd);
+    if (f)
+      {
+      cd.compiled_functions.emplace_back(f, size);
+      add_to_compile_cache(scheme_expression, f, size, hand_out);
+      }
+    return (skiwi_compiled_function_ptr)f;
+    }
 #endif
 
   uint64_t compile_and_run(const std::string& input, environment_map& env, repl_data& rd)
@@ -567,7 +855,13 @@ Enter scheme commands or one of the following:
     using namespace SKIWI;
     uint64_t result = skiwi_undefined;
     uint64_t size;
+#ifdef _SKIWI_FOR_ARM
     auto f = compile(size, input, env, rd);
+#else
+    first_pass_data d;
+    bool code_escapes = true;
+    auto f = compile(size, d, input, env, rd, &code_escapes);
+#endif
     if (f)
       {
 #ifdef _SKIWI_FOR_ARM
@@ -582,14 +876,45 @@ Enter scheme commands or one of the following:
       result = reg.rax;
       cd.compiled_bytecode.emplace_back(f, size);
 #else
-      result = f(&cd.ctxt);
-      cd.compiled_functions.emplace_back(f, size);
+      if (cd.compiling_startup_libraries) // e.g. packages.scm, which is loaded by modules.scm
+        {
+        result = f(&cd.ctxt);
+        cd.compiled_functions.emplace_back(f, size);
+        cd.startup_units.push_back(startup_code_unit{ (void*)f, size, d.imm64_offsets, false });
+        }
+      else
+        result = run_one_shot_function(f, size, code_escapes);
 #endif
       }
     return result;
     }
 
 
+#ifndef _SKIWI_FOR_ARM
+  bool load_startup_libraries(const std::string& filename, uint64_t key)
+    {
+    std::vector<startup_code_unit> units;
+    if (!load_startup_cache(units, cd.pm, cd.env, cd.rd, cd.md, cd.ctxt, filename, key))
+      return false;
+    for (const auto& u : units)
+      cd.compiled_functions.emplace_back((compiler_data::fptr)u.address, u.size);
+    log(prompt.c_str(), "loaded startup libraries from ", filename, "\n");
+    return true;
+    }
+
+  void save_startup_libraries(const std::string& filename, uint64_t key)
+    {
+    // The heap can contain dead closures that refer to code that was already freed (e.g. the code for expanding macros).
+    // After garbage collection only live objects remain, and those only refer to the startup code.
+    compile_and_run("(reclaim-garbage)", cd.env, cd.rd);
+    std::vector<startup_code_unit> units = cd.startup_units;
+    for (size_t i = 0; i < cd.md.compiled_macros.size() && i < cd.md.compiled_macros_imm64_offsets.size(); ++i)
+      units.push_back(startup_code_unit{ cd.md.compiled_macros[i].first, cd.md.compiled_macros[i].second, cd.md.compiled_macros_imm64_offsets[i], true });
+    if (!save_startup_cache(filename, key, units, cd.startup_files, cd.pm, cd.env, cd.rd, cd.md, cd.ctxt))
+      err("Could not write startup cache ", filename, "\n");
+    }
+#endif
+
   bool is_cmd_command(std::string txt)
     {
     auto it = txt.find_first_not_of(' ');
@@ -656,10 +981,21 @@ Enter scheme commands or one of the following:
     out("number of global variables assigned: ", nr_of_globals_used, "\n");
     out("maximum number of local variables: ", nr_locals + 8, "\n");
     out("heap size: ", (double)heap_size / (0.125 * 1000.0 * 1000.0), "Mb\n");
-    out("heap semispace size: ", (double)heap_size / (2.0 * 0.125 * 1000.0 * 1000.0), "Mb\n");
+    if (ctxt.nursery)
+      {
+      out("nursery size: ", (double)(ctxt.nursery_end - ctxt.nursery) / (0.125 * 1000.0 * 1000.0), "Mb\n");
+      out("old generation semispace size: ", (double)(ctxt.old_space_end - ctxt.old_space) / (0.125 * 1000.0 * 1000.0), "Mb\n");
+      out("old generation size used: ", (double)(ctxt.old_alloc - ctxt.old_space) / (0.125 * 1000.0 * 1000.0), "Mb\n");
+      out("remembered set entries: ", (uint64_t)(ctxt.remembered_set_top - ctxt.remembered_set), "\n");
+      }
+    else
+      {
+      out("heap semispace size: ", (double)heap_size / (2.0 * 0.125 * 1000.0 * 1000.0), "Mb\n");
+      out("maximum heap size: ", (double)ctxt.heap_max_size / (0.125 * 1000.0 * 1000.0), "Mb\n");
+      }
 
     size_t heap_size_used = ctxt.alloc - ctxt.from_space;
-    out("heap size used: ", (double)heap_size_used / (0.125 * 1000.0 * 1000.0), "Mb\n");
+    out(ctxt.nursery ? "nursery size used: " : "heap size used: ", (double)heap_size_used / (0.125 * 1000.0 * 1000.0), "Mb\n");
 
     if (ctxt.alloc < ctxt.from_space_end)
       {
@@ -679,6 +1015,10 @@ Enter scheme commands or one of the following:
       {
       out("garbage collection will be triggered immediately\n");
       }
+    out("garbage collections: ", ctxt.gc_collections, " (", ctxt.gc_full_collections, " of the whole heap)\n");
+    out("memory copied by the garbage collector: ", (double)ctxt.gc_bytes_copied / (1000.0 * 1000.0), "Mb\n");
+    out("memory reclaimed by the garbage collector: ", (double)ctxt.gc_bytes_reclaimed / (1000.0 * 1000.0), "Mb\n");
+    out("garbage collection pauses: ", (double)ctxt.gc_total_pause / 1000000.0, "ms in total, ", (double)ctxt.gc_max_pause / 1000000.0, "ms at most, ", (double)ctxt.gc_last_pause / 1000000.0, "ms last\n");
     }
 
   void show_environment(const std::shared_ptr<environment<environment_entry>>& env, const repl_data& rd, const context& ctxt)
@@ -763,17 +1103,223 @@ Enter scheme commands or one of the following:
     return res;
     }
 
+
+  /*
+  The tasks of a batch must not write to heap objects of the main context: another worker may write to the same object at
+  the same time, and a pointer into the heap of a worker that ends up in the main heap dangles once that worker's heap is
+  emptied. The runtime itself writes to two kinds of objects that every task can reach: the ports (writing to a port
+  updates its buffer and its position) and the symbol table (string->symbol adds new symbols to it). So before every batch,
+  worker_setup gives each worker private copies of the current ports and of the symbol table. The copy of an output port
+  to a file starts with an empty buffer, and worker_teardown flushes it after the batch, so output is not lost. Output
+  written to a string port, and symbols added to the symbol table, stay with the worker. The symbols that existed
+  before the batch are shared, so they remain eq? to the symbols of the main context.
+  */
+  const char* worker_ports[] = { "standard-input-port", "standard-output-port", "standard-error-port" };
+
+  bool has_global(const std::string& name)
+    {
+    alpha_conversion_data acd;
+    return cd.rd.alpha_conversion_env->find(acd, name) && cd.env->has(acd.name);
+    }
+
+  bool has_worker_runtime()
+    {
+    if (!has_global("%symbol-table") || !has_global("list->vector") || !has_global("vector->list"))
+      return false;
+    for (const char* port : worker_ports)
+      if (!has_global(port))
+        return false;
+    return true;
+    }
+
+  void compile_worker_setup()
+    {
+    if (cd.worker_setup || !has_worker_runtime())
+      return;
+    std::stringstream setup;
+    setup << "(let ([copy-port (lambda (p) (let ([q (make-port (%slot-ref p 0) (%slot-ref p 1) (%slot-ref p 2) (string-copy (%slot-ref p 3))";
+    setup << " (if (or (%slot-ref p 0) (fx<? (%slot-ref p 2) 0)) (%slot-ref p 4) 0) (%slot-ref p 5))]) (%slot-set! q 6 (%slot-ref p 6)) q))])";
+    setup << " (set! %symbol-table (list->vector (vector->list %symbol-table)))";
+    for (const char* port : worker_ports)
+      setup << " (set! " << port << " (copy-port " << port << "))";
+    setup << ")";
+    std::stringstream teardown;
+    teardown << "(begin";
+    for (const char* port : worker_ports)
+      teardown << " (if (and (not (%slot-ref " << port << " 0)) (fx>=? (%slot-ref " << port << " 2) 0)) (%flush-output-port " << port << "))";
+    teardown << ")";
+    cd.worker_setup = skiwi_compile(setup.str());
+    cd.worker_teardown = skiwi_compile(teardown.str());
+    if (!cd.worker_setup || !cd.worker_teardown)
+      throw std::runtime_error("skiwi_parallel_init: could not compile the setup of the workers");
+    }
+
+  /*
+  The threads of skiwi_parallel_for: a thread_pool, whose participants are the calling thread and nr_of_threads - 1 workers.
+  Every participant owns a clone of the skiwi context, that lives as long as the pool. At the start of every batch the clones
+  are refreshed (see refresh_clone_context), so that they see the current globals of the main context, and so that they
+  never refer to heap objects that a garbage collection in the main context moved in the meantime. Then worker_setup runs
+  in every clone.
+  */
+  class parallel_pool
+    {
+    public:
+      parallel_pool(uint32_t nr_of_threads) : threads(nr_of_threads)
+        {
+        compile_worker_setup();
+        contexts.resize(threads.size());
+        for (auto& c : contexts)
+          c = clone_context(cd.ctxt);
+        }
+
+      ~parallel_pool()
+        {
+        for (auto& c : contexts)
+          destroy_context(c);
+        }
+
+      uint32_t size() const
+        {
+        return threads.size();
+        }
+
+      void run(uint64_t nr_of_tasks, const std::function<void(uint64_t, void*)>& task)
+        {
+        std::lock_guard<std::mutex> lock(batch_mutex); // the clones serve one batch at a time
+        for (auto& c : contexts)
+          {
+          refresh_clone_context(c, cd.ctxt);
+          reserve_procedure_counters(c, cd.ctxt.procedure_counters_size); // code may have been compiled since the previous batch
+          if (cd.worker_setup)
+            cd.worker_setup((void*)&c);
+          }
+        std::exception_ptr error;
+        try
+          {
+          threads.run_indexed(nr_of_tasks, [&](uint64_t begin, uint64_t end, uint32_t participant)
+            {
+            for (uint64_t t = begin; t < end; ++t)
+              task(t, &contexts[participant]);
+            });
+          }
+        catch (...)
+          {
+          error = std::current_exception();
+          }
+        if (cd.worker_teardown)
+          for (auto& c : contexts)
+            cd.worker_teardown((void*)&c);
+        if (error)
+          std::rethrow_exception(error);
+        }
+
+    private:
+      thread_pool threads;
+      std::vector<context> contexts;
+      std::mutex batch_mutex;
+    };
+
+  static std::unique_ptr<parallel_pool> pool;
+
+  /*
+  skiwi_apply passes the closure and its arguments to scheme via hidden globals. Global 0 holds the closure,
+  global i holds argument i-1.
+  */
+  const uint64_t max_call_arguments = 16;
+
+  std::string call_global_name(uint64_t index)
+    {
+    if (index == 0)
+      return std::string("%skiwi-call-closure");
+    std::stringstream ss;
+    ss << "%skiwi-call-argument-" << index - 1;
+    return ss.str();
+    }
+
+  uint64_t get_global_position(const std::string& name)
+    {
+    alpha_conversion_data acd;
+    environment_entry e;
+    if (!cd.rd.alpha_conversion_env->find(acd, name) || !cd.env->find(e, acd.name) || e.st != environment_entry::st_global)
+      throw std::runtime_error("compiler error in skiwi_apply: " + name + " is not a global variable");
+    return e.pos >> 3;
+    }
+
+  /*
+  Defines the globals of skiwi_apply during initialization. skiwi_apply itself never runs scheme code before it calls the
+  closure: it may be called from a primitive while scheme code runs, and a garbage collection would move the closure and
+  the arguments that the caller passed by value.
+  */
+  void define_call_globals()
+    {
+    std::stringstream ss;
+    ss << "(begin";
+    for (uint64_t i = 0; i <= max_call_arguments; ++i)
+      ss << " (define " << call_global_name(i) << " #f)";
+    ss << ")";
+    compile_and_run(ss.str(), cd.env, cd.rd);
+    cd.call_globals.clear();
+    for (uint64_t i = 0; i <= max_call_arguments; ++i)
+      cd.call_globals.push_back(get_global_position(call_global_name(i)));
+    }
+
+  std::mutex call_stubs_mutex; // guards cd.call_stubs, skiwi_apply may run on several threads
+
+  /*
+  The call stub for nr_of_arguments arguments is the compiled expression (%skiwi-call-closure %skiwi-call-argument-0 ...).
+  It is compiled once per arity, which does not run any scheme code. Afterwards a call only writes the globals and jumps
+  into the stub.
+  */
+  skiwi_compiled_function_ptr get_call_stub(uint64_t nr_of_arguments)
+    {
+    std::lock_guard<std::mutex> lock(call_stubs_mutex);
+    auto it = cd.call_stubs.find(nr_of_arguments);
+    if (it != cd.call_stubs.end())
+      return it->second;
+    std::stringstream ss;
+    ss << "(" << call_global_name(0);
+    for (uint64_t i = 1; i <= nr_of_arguments; ++i)
+      ss << " " << call_global_name(i);
+    ss << ")";
+    uint64_t size;
+    auto f = compile(size, ss.str(), cd.env, cd.rd);
+    if (!f)
+      throw std::runtime_error("skiwi_apply: could not compile the call stub");
+#ifdef _SKIWI_FOR_ARM
+    cd.compiled_bytecode.emplace_back(f, size);
+#else
+    cd.compiled_functions.emplace_back(f, size);
+#endif
+    cd.call_stubs[nr_of_arguments] = (skiwi_compiled_function_ptr)f;
+    return (skiwi_compiled_function_ptr)f;
+    }
+
   } // anonymous namespace
 
 skiwi_parameters::skiwi_parameters()
   {
   heap_size = 2 * 1024 * 1024;
+  heap_max_size = 256 * 1024 * 1024;
+  heap_grow_threshold = 50;
+  heap_shrink_threshold = 10;
+  huge_pages = false;
   globals_stack = 64 * 1024;
   local_stack = 256;
   scheme_stack = 4096;
   trace = &std::cout;
   stderror = &std::cout;
   stdoutput = &std::cout;
+  use_startup_cache = false;
+  use_compile_cache = false;
+  compile_cache_size = 1024;
+  generational_gc = false;
+  nursery_size = 256 * 1024;
+  perf_map = false;
+  gdb_jit = false;
+  profiling = true;
+  procedure_counters = false;
+  heap_profiling = false;
+  heap_profile_interval = 512 * 1024;
   }
 
 void* scheme_with_skiwi(void* (*func)(void*), void* data, skiwi_parameters params)
@@ -794,12 +1340,27 @@ void* scheme_with_skiwi(void* (*func)(void*), void* data, skiwi_parameters param
 #ifdef _SKIWI_FOR_ARM
   cd.externals_for_vm = convert_externals_to_vm(cd.externals);
 #endif
-  cd.ctxt = create_context(params.heap_size, params.globals_stack, params.local_stack, params.scheme_stack);
+  cd.ops.generational_gc = params.generational_gc;
+  cd.ops.procedure_counters = params.procedure_counters || params.heap_profiling;
+  cd.ops.heap_profiling = params.heap_profiling;
+  cd.ctxt = create_context(params.heap_size, params.globals_stack, params.local_stack, params.scheme_stack, params.generational_gc ? params.nursery_size : 0, params.huge_pages);
+  set_heap_resize_policy(cd.ctxt, params.heap_max_size, params.heap_grow_threshold, params.heap_shrink_threshold);
+#ifndef _SKIWI_FOR_ARM
+  if (params.heap_profiling)
+    {
+    cd.heap_prof = create_heap_profile(params.heap_profile_interval);
+    attach_heap_profile(cd.ctxt, cd.heap_prof);
+    }
+#endif
   cd.env = std::make_shared<environment<environment_entry>>(nullptr);
   cd.trace = params.trace;
   cd.stderror = params.stderror;
   cd.stdoutput = params.stdoutput;
+  set_perf_map_enabled(params.perf_map);
+  set_gdb_jit_enabled(params.gdb_jit);
+  set_jit_symbol_table_enabled(params.profiling);
 
+#ifdef _SKIWI_FOR_ARM
   compile_primitives_library();
   compile_string_to_symbol();
   compile_apply();
@@ -807,6 +1368,30 @@ void* scheme_with_skiwi(void* (*func)(void*), void* data, skiwi_parameters param
 
   compile_r5rs();
   compile_modules();
+#else
+  std::string startup_cache_file = params.startup_cache_file.empty() ? get_folder(get_executable_path()) + std::string("skiwi.cache") : params.startup_cache_file;
+  const bool use_startup_cache = params.use_startup_cache && !params.generational_gc; // the cache only holds semispace heaps
+  uint64_t startup_cache_key = use_startup_cache ? make_startup_cache_key(cd.ops, cd.ctxt) : 0;
+  if (!use_startup_cache || !load_startup_libraries(startup_cache_file, startup_cache_key))
+    {
+    cd.compiling_startup_libraries = true;
+    compile_primitives_library();
+    compile_string_to_symbol();
+    compile_apply();
+    compile_call_cc();
+
+    compile_r5rs();
+    compile_modules();
+    cd.compiling_startup_libraries = false;
+
+    if (use_startup_cache)
+      save_startup_libraries(startup_cache_file, startup_cache_key);
+    }
+  cd.startup_units.clear();
+  cd.use_compile_cache = params.use_compile_cache;
+  cd.compile_cache_size = params.compile_cache_size;
+#endif
+  define_call_globals();
 
   if (!func)
     return nullptr;
@@ -818,8 +1403,7 @@ std::string skiwi_expand(const std::string& scheme_expression)
   using namespace SKIWI;
   if (!cd.initialized)
     throw std::runtime_error("Skiwi is not initialized");
-  auto env_copy = make_deep_copy(cd.env);
-  auto rd_copy = make_deep_copy(cd.rd);
+  compile_transaction transaction(cd.env, cd.rd);
   Program prog;
   try
     {
@@ -829,20 +1413,17 @@ std::string skiwi_expand(const std::string& scheme_expression)
     }
   catch (std::logic_error e)
     {
-    cd.env = env_copy;
-    cd.rd = rd_copy;
+    transaction.rollback();
     return e.what();
     }
   catch (std::runtime_error e)
     {
-    cd.env = env_copy;
-    cd.rd = rd_copy;
+    transaction.rollback();
     return e.what();
     }
   cinput_data cinput;
   preprocess(cd.env, cd.rd, cd.md, cd.ctxt, cinput, prog, cd.pm, cd.ops);
-  cd.env = env_copy;
-  cd.rd = rd_copy;
+  transaction.rollback();
   std::stringstream ss;
   dump(ss, prog);
   format_options format_ops;
@@ -857,8 +1438,7 @@ std::string skiwi_assembly(const std::string& scheme_expression)
   using namespace SKIWI;
   if (!cd.initialized)
     throw std::runtime_error("Skiwi is not initialized");
-  auto env_copy = make_deep_copy(cd.env);
-  auto rd_copy = make_deep_copy(cd.rd);
+  compile_transaction transaction(cd.env, cd.rd);
   asmcode code;
   Program prog;
   try
@@ -869,14 +1449,12 @@ std::string skiwi_assembly(const std::string& scheme_expression)
     }
   catch (std::logic_error e)
     {
-    cd.env = env_copy;
-    cd.rd = rd_copy;
+    transaction.rollback();
     return e.what();
     }
   catch (std::runtime_error e)
     {
-    cd.env = env_copy;
-    cd.rd = rd_copy;
+    transaction.rollback();
     return e.what();
     }
   try
@@ -885,18 +1463,15 @@ std::string skiwi_assembly(const std::string& scheme_expression)
     }
   catch (std::logic_error e)
     {
-    cd.env = env_copy;
-    cd.rd = rd_copy;
+    transaction.rollback();
     return e.what();
     }
   catch (std::runtime_error e)
     {
-    cd.env = env_copy;
-    cd.rd = rd_copy;
+    transaction.rollback();
     return e.what();
     }
-  cd.env = env_copy;
-  cd.rd = rd_copy;
+  transaction.rollback();
   std::stringstream ss;
   code.stream(ss);
   return ss.str();
@@ -905,6 +1480,10 @@ std::string skiwi_assembly(const std::string& scheme_expression)
 skiwi_compiled_function_ptr skiwi_compile(const std::string& scheme_expression)
   {
   using namespace SKIWI;
+#ifndef _SKIWI_FOR_ARM
+  if (cd.use_compile_cache)
+    return compile_with_cache(scheme_expression, true);
+#endif
   uint64_t size;
   auto f = compile(size, scheme_expression, cd.env, cd.rd);
   if (f)
@@ -918,11 +1497,98 @@ skiwi_compiled_function_ptr skiwi_compile(const std::string& scheme_expression)
   return (skiwi_compiled_function_ptr)f;
   }
 
+scm_type skiwi_apply(scm_type closure, const std::vector<scm_type>& arguments, void* ctxt)
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  if (!closure.is_closure())
+    throw std::runtime_error("skiwi_apply: the first argument is not a closure");
+  if (arguments.size() > max_call_arguments)
+    throw std::runtime_error("skiwi_apply: too many arguments");
+  const std::vector<uint64_t>& call_globals = cd.call_globals;
+  skiwi_compiled_function_ptr stub = get_call_stub(arguments.size());
+  context* p_ctxt = ctxt ? (context*)ctxt : &cd.ctxt;
+  reserve_procedure_counters(*p_ctxt, cd.ctxt.procedure_counters_size); // a clone may run code that was compiled after it was made
+  // from here on the closure and its arguments are roots of the garbage collector, until the stub returns
+  p_ctxt->globals[call_globals[0]] = closure;
+  for (uint64_t i = 0; i < arguments.size(); ++i)
+    p_ctxt->globals[call_globals[i + 1]] = arguments[i];
+  bool reentrant = p_ctxt == &cd.ctxt;
+  if (reentrant) // skiwi_apply might be called from an external primitive, so keep the state of the running scheme call
+    save_compiler_data();
+  uint64_t result = skiwi_run_raw(stub, (void*)p_ctxt);
+  if (reentrant)
+    restore_compiler_data();
+  for (uint64_t i = 0; i <= arguments.size(); ++i) // don't keep the arguments alive
+    p_ctxt->globals[call_globals[i]] = bool_f;
+  return result;
+  }
+
+uint64_t skiwi_reclaim_code()
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+#ifdef _SKIWI_FOR_ARM
+  return 0;
+#else
+  return reclaim_code();
+#endif
+  }
+
+uint64_t skiwi_code_size()
+  {
+  using namespace SKIWI;
+  uint64_t size = 0;
+#ifdef _SKIWI_FOR_ARM
+  for (const auto& f : cd.compiled_bytecode)
+    size += f.second;
+#else
+  for (const auto& f : cd.compiled_functions)
+    size += f.second;
+  for (const auto& f : cd.one_shot_functions)
+    size += f.second;
+#endif
+  for (const auto& f : cd.md.compiled_macros)
+    size += f.second;
+  return size;
+  }
+
 void* skiwi_get_context()
   {
   return (void*)(&cd.ctxt);
   }
 
+void skiwi_parallel_init(uint32_t nr_of_threads)
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  if (nr_of_threads == 0)
+    nr_of_threads = (std::max)((uint32_t)1, (uint32_t)std::thread::hardware_concurrency());
+  pool.reset();
+  pool.reset(new parallel_pool(nr_of_threads));
+  }
+
+void skiwi_parallel_exit()
+  {
+  pool.reset();
+  }
+
+uint32_t skiwi_parallel_threads()
+  {
+  return pool ? pool->size() : 0;
+  }
+
+void skiwi_parallel_for(uint64_t nr_of_tasks, const std::function<void(uint64_t, void*)>& task)
+  {
+  using namespace SKIWI;
+  if (!pool)
+    skiwi_parallel_init();
+  pool->run(nr_of_tasks, task);
+  }
+
 void* skiwi_clone_context(void* ctxt)
   {
   context* p_ctxt = (context*)ctxt;
@@ -940,6 +1606,10 @@ uint64_t skiwi_run_raw(const std::string& scheme_expression)
   {
   if (!cd.initialized)
     throw std::runtime_error("Skiwi is not initialized");
+#ifndef _SKIWI_FOR_ARM
+  if (cd.use_compile_cache)
+    return skiwi_run_raw(compile_with_cache(scheme_expression, false), (void*)&cd.ctxt);
+#endif
   return compile_and_run(scheme_expression, cd.env, cd.rd);
   }
 
@@ -1048,11 +1718,212 @@ void skiwi_show_memory()
   show_memory(cd.ctxt);
   }
 
+skiwi_gc_stats skiwi_get_gc_stats()
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  skiwi_gc_stats stats;
+  stats.collections = cd.ctxt.gc_collections;
+  stats.full_collections = cd.ctxt.gc_full_collections;
+  stats.bytes_copied = cd.ctxt.gc_bytes_copied;
+  stats.bytes_reclaimed = cd.ctxt.gc_bytes_reclaimed;
+  stats.total_pause_nanoseconds = cd.ctxt.gc_total_pause;
+  stats.max_pause_nanoseconds = cd.ctxt.gc_max_pause;
+  stats.last_pause_nanoseconds = cd.ctxt.gc_last_pause;
+  stats.peak_live_bytes = cd.ctxt.gc_collections ? cd.ctxt.gc_peak_live_bytes : heap_bytes_in_use(cd.ctxt);
+  stats.peak_allocated_bytes = (std::max)(cd.ctxt.gc_peak_allocated_bytes, heap_bytes_in_use(cd.ctxt));
+  return stats;
+  }
+
+void skiwi_reset_gc_stats()
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  reset_gc_statistics(cd.ctxt);
+  }
+
 void skiwi_show_environment()
   {
   show_environment(cd.env, cd.rd, cd.ctxt);
   }
 
+void skiwi_profile_start(uint64_t interval_microseconds)
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  start_profiler(interval_microseconds);
+  }
+
+void skiwi_profile_stop()
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  if (!profiler_is_running())
+    return;
+  const void* primitives = cd.compiled_functions.empty() ? nullptr : (const void*)cd.compiled_functions.front().first; // the primitives library is compiled or loaded first
+  profile p = stop_profiler(primitives);
+  std::stringstream str;
+  print_profile(str, p);
+  if (!is_jit_symbol_table_enabled())
+    str << "Only the code compiled while the profiler ran is named, see skiwi_parameters::profiling\n";
+  out(str.str());
+  }
+
+std::vector<skiwi_procedure_counter> skiwi_procedure_counters()
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  std::vector<skiwi_procedure_counter> counters;
+  for (uint64_t i = 0; i < cd.rd.procedure_names.size() && i < cd.ctxt.procedure_counters_size; ++i)
+    {
+    skiwi_procedure_counter c;
+    c.name = cd.rd.procedure_names[i];
+    c.calls = cd.ctxt.procedure_counters[i * 2];
+    c.allocated_bytes = cd.ctxt.procedure_counters[i * 2 + 1];
+    if (c.calls || c.allocated_bytes)
+      counters.push_back(c);
+    }
+  std::stable_sort(counters.begin(), counters.end(), [](const skiwi_procedure_counter& left, const skiwi_procedure_counter& right)
+    {
+    if (left.calls != right.calls)
+      return left.calls > right.calls;
+    return left.allocated_bytes > right.allocated_bytes;
+    });
+  return counters;
+  }
+
+void skiwi_show_procedure_counters(uint64_t max_entries)
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  if (!cd.ops.procedure_counters)
+    {
+    err("The procedure counters are off, see skiwi_parameters::procedure_counters\n");
+    return;
+    }
+  std::vector<skiwi_procedure_counter> counters = skiwi_procedure_counters();
+  std::stringstream str;
+  str << "               calls     allocated bytes  procedure\n";
+  for (uint64_t i = 0; i < counters.size() && i < max_entries; ++i)
+    str << std::setw(20) << counters[i].calls << std::setw(20) << counters[i].allocated_bytes << "  " << counters[i].name << "\n";
+  out(str.str());
+  }
+
+void skiwi_reset_procedure_counters()
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  reset_procedure_counters(cd.ctxt);
+  }
+
+std::vector<skiwi_heap_profile_entry> skiwi_heap_profile()
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  std::vector<skiwi_heap_profile_entry> entries;
+  for (const auto& e : get_heap_profile(cd.ctxt))
+    {
+    skiwi_heap_profile_entry entry;
+    entry.procedure = e.procedure_index < cd.rd.procedure_names.size() ? cd.rd.procedure_names[e.procedure_index] : std::string("[unknown]");
+    entry.type = e.type;
+    entry.total_bytes = e.total_bytes;
+    entry.live_bytes = e.live_bytes;
+    entry.samples = e.samples;
+    entries.push_back(entry);
+    }
+  return entries;
+  }
+
+void skiwi_show_heap_profile(uint64_t max_entries)
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  if (!cd.ops.heap_profiling)
+    {
+    err("The heap profiler is off, see skiwi_parameters::heap_profiling\n");
+    return;
+    }
+  std::vector<skiwi_heap_profile_entry> entries = skiwi_heap_profile();
+  std::stringstream str;
+  str << "         total bytes          live bytes     samples  type      procedure\n";
+  for (uint64_t i = 0; i < entries.size() && i < max_entries; ++i)
+    {
+    const skiwi_heap_profile_entry& e = entries[i];
+    str << std::setw(20) << e.total_bytes << std::setw(20) << e.live_bytes << std::setw(12) << e.samples << "  " << std::left << std::setw(8) << e.type << std::right << "  " << e.procedure << "\n";
+    }
+  out(str.str());
+  }
+
+void skiwi_reset_heap_profile()
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  reset_heap_profile(cd.ctxt);
+  }
+
+std::vector<skiwi_compile_pass_stats> skiwi_compile_stats()
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  std::vector<skiwi_compile_pass_stats> passes;
+  for (const auto& p : get_compile_stats())
+    passes.push_back(skiwi_compile_pass_stats{ p.name, p.runs, p.nanoseconds, p.allocations, p.allocated_bytes });
+  return passes;
+  }
+
+void skiwi_show_compile_stats()
+  {
+  using namespace SKIWI;
+  std::vector<skiwi_compile_pass_stats> passes = skiwi_compile_stats();
+  skiwi_compile_pass_stats total{ "total", 0, 0, 0, 0 };
+  for (const auto& p : passes)
+    {
+    total.nanoseconds += p.nanoseconds;
+    total.allocations += p.allocations;
+    total.allocated_bytes += p.allocated_bytes;
+    }
+  passes.push_back(total);
+  std::stringstream str;
+  str << "        runs     seconds       %   allocations     allocated bytes  pass\n";
+  str << std::fixed;
+  for (const auto& p : passes)
+    {
+    str << std::setw(12);
+    if (&p == &passes.back())
+      str << "";
+    else
+      str << p.runs;
+    str << std::setw(12) << std::setprecision(4) << (double)p.nanoseconds / 1e9;
+    str << std::setw(8) << std::setprecision(1) << (total.nanoseconds ? 100.0 * (double)p.nanoseconds / (double)total.nanoseconds : 0.0);
+    str << std::setw(14) << p.allocations << std::setw(20) << p.allocated_bytes << "  " << p.pass << "\n";
+    }
+  out(str.str());
+  }
+
+void skiwi_count_allocation(uint64_t size)
+  {
+  SKIWI::count_compile_allocation(size);
+  }
+
+void skiwi_reset_compile_stats()
+  {
+  using namespace SKIWI;
+  if (!cd.initialized)
+    throw std::runtime_error("Skiwi is not initialized");
+  reset_compile_stats();
+  }
+
 void skiwi_repl(int argc, char** argv)
   {
   using namespace SKIWI;
@@ -1098,6 +1969,24 @@ void skiwi_repl(int argc, char** argv)
           }
         break;
         }
+        case 'c':
+        {
+        if (command == ",counters")
+          {
+          if (get_cleaned_first_argument(input) == "reset")
+            skiwi_reset_procedure_counters();
+          else
+            skiwi_show_procedure_counters();
+          }
+        else if (command == ",compile-stats")
+          {
+          if (get_cleaned_first_argument(input) == "reset")
+            skiwi_reset_compile_stats();
+          else
+            skiwi_show_compile_stats();
+          }
+        break;
+        }
         case 'e':
         {
         if (command == ",env")
@@ -1119,6 +2008,18 @@ void skiwi_repl(int argc, char** argv)
           }
         break;
         }
+        case 'h':
+        {
+        if (command == ",heap")
+          {
+          // collect the garbage afterwards, so that only the objects that are still reachable count as live
+          skiwi_reset_heap_profile();
+          skiwi_run(remove_command(input));
+          skiwi_run_raw("(reclaim-garbage)");
+          skiwi_show_heap_profile();
+          }
+        break;
+        }
         case 'm':
         {
         if (command == ",mem")
@@ -1127,6 +2028,21 @@ void skiwi_repl(int argc, char** argv)
           }
         break;
         }
+        case 'p':
+        {
+        if (command == ",profile")
+          {
+          if (!profiler_is_supported())
+            {
+            err("The profiler is not supported on this platform\n");
+            break;
+            }
+          skiwi_profile_start();
+          skiwi_run(remove_command(input));
+          skiwi_profile_stop();
+          }
+        break;
+        }
         case 'u':
         {
         if (command == ",unresolved")
@@ -1159,6 +2075,7 @@ void skiwi_quit()
   using namespace SKIWI;
   if (!cd.initialized)
     throw std::runtime_error("Skiwi is not initialized");
+  pool.reset();
   destroy_macro_data(cd.md);
 #ifdef _SKIWI_FOR_ARM
   for (auto& f : cd.compiled_bytecode)
@@ -1166,8 +2083,14 @@ void skiwi_quit()
 #else
   for (auto& f : cd.compiled_functions)
     free_assembled_function((void*)f.first, f.second);
+  for (auto& f : cd.one_shot_functions)
+    free_assembled_function((void*)f.first, f.second);
 #endif
   destroy_contexts(cd);
+#ifndef _SKIWI_FOR_ARM
+  destroy_heap_profile(cd.heap_prof);
+  cd.heap_prof = nullptr;
+#endif
   cd.initialized = false;
   }
 
@@ -1672,6 +2595,8 @@ SKIWI_END
 uint64_t c_prim_load(const char* filename)
   {
   using namespace SKIWI;
+  if (cd.compiling_startup_libraries)
+    cd.startup_files.emplace_back(filename);
   /*
    // saving the registers, should we save the locals too??
    void* rbx = cd.ctxt.rbx;
@@ -1831,7 +2756,13 @@ uint64_t c_prim_eval(const char* script)
   if (!cd.initialized)
     throw std::runtime_error("Skiwi is not initialized");
   uint64_t size;
+#ifdef _SKIWI_FOR_ARM
   auto f = compile(size, script, cd.env, cd.rd);
+#else
+  first_pass_data d;
+  bool code_escapes = true;
+  auto f = compile(size, d, script, cd.env, cd.rd, &code_escapes);
+#endif
   if (f)
     {
 #ifdef _SKIWI_FOR_ARM
@@ -1845,8 +2776,7 @@ uint64_t c_prim_eval(const char* script)
     cd.compiled_bytecode.emplace_back(f, size);
     return_value = reg.rax;
 #else
-    return_value = f(&cd.ctxt);
-    cd.compiled_functions.emplace_back(f, size);
+    return_value = run_one_shot_function(f, size, code_escapes);
 #endif
     }
   /*
@@ -3,7 +3,10 @@
 #include "libskiwi_api.h"
 
 #include <stdint.h>
+#include <functional>
 #include <ostream>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace skiwi
@@ -20,12 +23,28 @@ typedef uint8_t* skiwi_compiled_function_ptr;
     {
     SKIWI_SCHEME_API skiwi_parameters();
     uint64_t heap_size;
+    uint64_t heap_max_size; // the heap grows up to heap_max_size cells when it gets too full. The semispace garbage collector only.
+    uint64_t heap_grow_threshold; // percentage of the heap in use after a garbage collection above which the heap grows
+    uint64_t heap_shrink_threshold; // percentage of the heap in use after a garbage collection below which the heap shrinks, but never below heap_size
+    bool huge_pages; // if true, the heap is backed by transparent huge pages where the os supports it
     uint64_t globals_stack;
     uint32_t local_stack;
     uint64_t scheme_stack;
     std::ostream* trace;
     std::ostream* stderror;
     std::ostream* stdoutput;
+    bool use_startup_cache; // if true, the compiled startup libraries are stored on disk and reused by the next initialization
+    std::string startup_cache_file; // if empty, the startup cache is stored as skiwi.cache next to the executable
+    bool use_compile_cache; // if true, skiwi_run, skiwi_run_raw and skiwi_compile reuse the compiled code of source text they have seen before, until a global it refers to is redefined
+    uint64_t compile_cache_size; // most expressions in the compile cache, the least recently used one is evicted first. Its code is released unless skiwi_compile returned it.
+    bool generational_gc; // if true, skiwi uses the generational garbage collector. The startup cache is not used in that case.
+    uint64_t nursery_size; // number of heap cells used as nursery by the generational garbage collector. Objects that do not fit the nursery are allocated in the old generation.
+    bool perf_map; // if true, the names of compiled procedures are written to /tmp/perf-<pid>.map for perf
+    bool gdb_jit; // if true, compiled code is registered with gdb's jit interface, so that gdb shows procedure names in backtraces
+    bool profiling; // default true: the names of all compiled procedures are kept for skiwi_profile_stop. If false, it only names the code compiled while the profiler ran
+    bool procedure_counters; // if true, compiled code counts the calls of each procedure and the bytes it allocates, see skiwi_procedure_counters
+    bool heap_profiling; // if true, compiled code samples its allocations by procedure and type, see skiwi_heap_profile. Turns on procedure_counters.
+    uint64_t heap_profile_interval; // mean number of bytes allocated between two samples of the heap profiler, 1 samples every allocation
     };
 
   /*
@@ -42,6 +61,18 @@ typedef uint8_t* skiwi_compiled_function_ptr;
 
   SKIWI_SCHEME_API void* skiwi_get_context();
 
+  /*
+  The code of expressions that are run once (skiwi_run, the repl, eval, load) is released after running if it creates no
+  closures. Otherwise it is released once no closure refers to it anymore, which is checked every so many expressions.
+  skiwi_reclaim_code runs that check now and returns the number of bytes of code released. Code returned by skiwi_compile is kept.
+  */
+  SKIWI_SCHEME_API uint64_t skiwi_reclaim_code();
+
+  /*
+  Returns the number of bytes of compiled code that is currently kept.
+  */
+  SKIWI_SCHEME_API uint64_t skiwi_code_size();
+
   SKIWI_SCHEME_API void* skiwi_clone_context(void* ctxt);
 
   SKIWI_SCHEME_API void skiwi_destroy_clone_context(void* ctxt);
@@ -57,6 +88,29 @@ typedef uint8_t* skiwi_compiled_function_ptr;
     return result;
     }
 
+  /*
+  Parallel evaluation. skiwi_parallel_init prepares nr_of_threads threads (0 means one per hardware thread): the thread
+  that calls skiwi_parallel_for and nr_of_threads - 1 worker threads. Each of them owns a clone of the skiwi context (see
+  skiwi_clone_context) that is refreshed at the start of every skiwi_parallel_for, so that the tasks see the globals of the
+  main context as they are at that moment. The clones share the heap objects of the main context, so tasks should not
+  modify them. The exceptions are the current ports and the symbol table: each clone gets private copies of these at the
+  start of every batch, so tasks can write to the standard ports and call string->symbol. Output to a file port is flushed
+  at the end of the batch, output to a string port and symbols created by a task are not seen by the main context. Tasks
+  cannot compile scheme code (no eval or load), and the main context should not run scheme code while a batch runs.
+  Each context has its own error and stack save state, and the compiler data memento stack is kept per thread.
+  */
+  SKIWI_SCHEME_API void skiwi_parallel_init(uint32_t nr_of_threads = 0);
+  SKIWI_SCHEME_API void skiwi_parallel_exit();
+  SKIWI_SCHEME_API uint32_t skiwi_parallel_threads();
+
+  /*
+  Calls task(index, ctxt) for every index in [0, nr_of_tasks) on the calling thread and the worker threads, where ctxt is
+  the context of the thread, and returns when all tasks are done. The first exception thrown by a task is rethrown.
+  Scheme values created in ctxt are only valid until the thread starts its next task. Calls from several threads run one
+  after the other, and a task cannot call skiwi_parallel_for itself.
+  */
+  SKIWI_SCHEME_API void skiwi_parallel_for(uint64_t nr_of_tasks, const std::function<void(uint64_t, void*)>& task);
+
   SKIWI_SCHEME_API uint64_t skiwi_run_raw(const std::string& scheme_expression);
   SKIWI_SCHEME_API uint64_t skiwi_runf_raw(const std::string& scheme_file);
   SKIWI_SCHEME_API std::string skiwi_raw_to_string(uint64_t scm_value, std::streamsize precision=6);
@@ -72,6 +126,99 @@ typedef uint8_t* skiwi_compiled_function_ptr;
   SKIWI_SCHEME_API void skiwi_show_memory();
   SKIWI_SCHEME_API void skiwi_show_environment();
 
+  /*
+  Sampling profiler. skiwi_profile_start samples the running code every interval_microseconds of cpu time, and
+  skiwi_profile_stop prints how the samples are spread over the compiled procedures, the primitives and native code,
+  and which procedures the time in the primitives was spent for. Only available on linux for x64.
+  */
+  SKIWI_SCHEME_API void skiwi_profile_start(uint64_t interval_microseconds = 1000);
+  SKIWI_SCHEME_API void skiwi_profile_stop();
+
+  struct skiwi_procedure_counter
+    {
+    std::string name;
+    uint64_t calls;
+    uint64_t allocated_bytes;
+    };
+
+  /*
+  Procedure counters, if skiwi_parameters::procedure_counters was set. Every call of a compiled procedure is counted, and
+  every byte allocated on the heap is counted for the procedure that was entered last, where returning to a procedure
+  counts as entering it. skiwi_procedure_counters returns the procedures that were called or allocated, sorted by
+  decreasing number of calls and then by decreasing number of bytes. Code that runs in a clone of the context is counted
+  in the clone.
+  */
+  SKIWI_SCHEME_API std::vector<skiwi_procedure_counter> skiwi_procedure_counters();
+  SKIWI_SCHEME_API void skiwi_show_procedure_counters(uint64_t max_entries = 30);
+  SKIWI_SCHEME_API void skiwi_reset_procedure_counters();
+
+  /*
+  Garbage collection statistics of the main context since skiwi was initialized or since skiwi_reset_gc_stats.
+  Full collections are all collections of the semispace collector, and the major collections of the generational collector.
+  The scheme primitive (gc-stats) returns the same numbers in a vector, in the order of this struct, except the peaks.
+  */
+  struct skiwi_gc_stats
+    {
+    uint64_t collections;
+    uint64_t full_collections;
+    uint64_t bytes_copied;
+    uint64_t bytes_reclaimed;
+    uint64_t total_pause_nanoseconds;
+    uint64_t max_pause_nanoseconds;
+    uint64_t last_pause_nanoseconds;
+    uint64_t peak_live_bytes; // most bytes in use right after a collection (after a minor one the old generation counts in full), or now if there was no collection
+    uint64_t peak_allocated_bytes; // most bytes in use on the heap so far, garbage included: when a collection started or now. Bounded by the heap size.
+    };
+
+  SKIWI_SCHEME_API skiwi_gc_stats skiwi_get_gc_stats();
+  SKIWI_SCHEME_API void skiwi_reset_gc_stats();
+
+  struct skiwi_heap_profile_entry
+    {
+    std::string procedure;
+    std::string type; // pair, closure, flonum, string, symbol, vector, promise, port, or other
+    uint64_t total_bytes;
+    uint64_t live_bytes;
+    uint64_t samples;
+    };
+
+  /*
+  Allocation-site heap profile, if skiwi_parameters::heap_profiling was set. On average one of every heap_profile_interval
+  bytes allocated on the heap is sampled, and the object that contains it counts for heap_profile_interval bytes of the
+  procedure that allocated it. Objects that were not collected by the last garbage collection count as live, so run
+  (reclaim-garbage) first for an accurate number of live bytes. The entries are sorted by decreasing total bytes.
+  Code that runs in a clone of the context is not sampled.
+  */
+  SKIWI_SCHEME_API std::vector<skiwi_heap_profile_entry> skiwi_heap_profile();
+  SKIWI_SCHEME_API void skiwi_show_heap_profile(uint64_t max_entries = 30);
+  SKIWI_SCHEME_API void skiwi_reset_heap_profile();
+
+  struct skiwi_compile_pass_stats
+    {
+    std::string pass;
+    uint64_t runs;
+    uint64_t nanoseconds;
+    uint64_t allocations; // number of allocations reported with skiwi_count_allocation
+    uint64_t allocated_bytes;
+    };
+
+  /*
+  Compile-time statistics per pass of the compiler (tokenize, parse, macro expansion, alpha conversion, cps conversion,
+  closure conversion, linear scan, code generation, assemble, ...) since skiwi was initialized or since
+  skiwi_reset_compile_stats, in the order of the compiler pipeline. Passes that run inside other passes, like the
+  compilation of macros during macro expansion, only count for themselves, so that the passes add up to the total.
+  */
+  SKIWI_SCHEME_API std::vector<skiwi_compile_pass_stats> skiwi_compile_stats();
+
+  /*
+  Skiwi does not replace the global operator new, so the allocations of the compile passes are only counted if the
+  application replaces operator new itself, and calls skiwi_count_allocation from it. Only allocations of a thread that
+  is running a compile pass are counted, so the call is cheap otherwise.
+  */
+  SKIWI_SCHEME_API void skiwi_count_allocation(uint64_t size);
+  SKIWI_SCHEME_API void skiwi_show_compile_stats();
+  SKIWI_SCHEME_API void skiwi_reset_compile_stats();
+
   SKIWI_SCHEME_API std::string skiwi_expand(const std::string& scheme_expression);
 
   SKIWI_SCHEME_API std::string skiwi_last_global_variable_used();
@@ -149,6 +296,44 @@ typedef uint8_t* skiwi_compiled_function_ptr;
   SKIWI_SCHEME_API scm_type make_vector(const std::vector<scm_type>& vec);
   SKIWI_SCHEME_API scm_type make_string(const std::string& s);
 
+  /*
+  Calls closure with at most 16 arguments and returns its result, without compiling the call. The first call with a
+  given number of arguments compiles a small stub that is reused afterwards. This only compiles and never runs scheme
+  code, so skiwi_apply may also be called from an external primitive while scheme code runs.
+  If ctxt is nullptr, the closure runs in the main context, otherwise in ctxt, e.g. the context of a parallel task.
+  The stubs are shared by all threads and guarded by a lock.
+  While the closure runs, the closure and the arguments are roots of the garbage collector. When called from a primitive,
+  the closure should not collect garbage: the scheme code that called the primitive keeps values in registers that a
+  collection does not update.
+  */
+  SKIWI_SCHEME_API scm_type skiwi_apply(scm_type closure, const std::vector<scm_type>& arguments, void* ctxt = nullptr);
+
+  template <typename... Args>
+  scm_type skiwi_call(scm_type closure, Args... args)
+    {
+    return skiwi_apply(closure, std::vector<scm_type>{ scm_type(args)... });
+    }
+
+  /*
+  Runs fun for every index in [0, nr_of_tasks) with skiwi_parallel_for. The index is passed to fun as its first c-input
+  parameter, e.g. (c-input "(int i)"). convert turns each result into a value that does not depend on the context of the thread.
+  */
+  template <typename TResult>
+  std::vector<TResult> skiwi_parallel_map(skiwi_compiled_function_ptr fun, uint64_t nr_of_tasks, const std::function<TResult(scm_type)>& convert)
+    {
+    struct result_slot { TResult value; }; // not a std::vector<bool>, whose elements share bytes
+    std::vector<result_slot> slots(nr_of_tasks);
+    skiwi_parallel_for(nr_of_tasks, [&](uint64_t index, void* ctxt)
+      {
+      slots[index].value = convert(scm_type(skiwi_run_raw(fun, ctxt, (int64_t)index)));
+      });
+    std::vector<TResult> results;
+    results.reserve(nr_of_tasks);
+    for (auto& slot : slots)
+      results.push_back(std::move(slot.value));
+    return results;
+    }
+
   SKIWI_SCHEME_API void set_prompt(const std::string& prompt_text);
   SKIWI_SCHEME_API void set_welcome_message(const std::string& welcome_message_text);
   SKIWI_SCHEME_API void set_help_text(const std::string& help_text);
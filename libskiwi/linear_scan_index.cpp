@@ -1,6 +1,9 @@
 #include "linear_scan_index.h"
 #include "visitor.h"
+#include "concurrency.h"
+#include "debug_find.h"
 #include <algorithm>
+#include <cassert>
 
 SKIWI_BEGIN
 
@@ -246,4 +249,43 @@ void compute_linear_scan_index(Program& prog)
   prog.linear_scan_indices_computed = true;
   }
 
+/*
+Every expression gets one index, so the indices of a top-level form start after those of the forms before it. The forms
+are counted first, so that each form can be numbered independently and the result equals the serial numbering.
+*/
+void compute_linear_scan_index(Program& prog, const compiler_options& ops)
+  {
+  if (prog.expressions.size() != 1 || !std::holds_alternative<Begin>(prog.expressions.front()))
+    {
+    compute_linear_scan_index(prog);
+    return;
+    }
+  Begin& beg = std::get<Begin>(prog.expressions.front());
+  const size_t sz = beg.arguments.size();
+  std::vector<uint64_t> first_index(sz + 1, 0);
+  parallel_for(size_t(0), sz, [&](size_t i)
+    {
+    uint64_t nr_of_expressions = 0;
+    find(beg.arguments[i], [&](const Expression&) { ++nr_of_expressions; return false; });
+    first_index[i + 1] = nr_of_expressions;
+    }, ops);
+  first_index[0] = 1; // index 0 is the begin of the program
+  for (size_t i = 0; i < sz; ++i)
+    first_index[i + 1] += first_index[i];
+
+  beg.pre_scan_index = 0;
+  parallel_for(size_t(0), sz, [&](size_t i)
+    {
+    linear_scan_index_helper lsih;
+    lsih.index = 0;
+    lsih.pre_index = first_index[i];
+    lsih.expressions.push_back(&beg.arguments[i]);
+    lsih.treat_expressions();
+    assert(lsih.pre_index == first_index[i + 1]);
+    }, ops);
+  beg.scan_index = first_index[sz];
+
+  prog.linear_scan_indices_computed = true;
+  }
+
 SKIWI_END
@@ -9,6 +9,9 @@
 
 SKIWI_BEGIN
 
+struct compiler_options;
+
 SKIWI_SCHEME_API void compute_linear_scan_index(Program& prog);
+SKIWI_SCHEME_API void compute_linear_scan_index(Program& prog, const compiler_options& ops);
 
 SKIWI_END
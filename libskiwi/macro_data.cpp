@@ -18,6 +18,7 @@ void destroy_macro_data(macro_data& md)
   for (auto& f : md.compiled_macros)
     ASM::free_assembled_function(f.first, f.second);
   md.compiled_macros.clear();
+  md.compiled_macros_imm64_offsets.clear();
 #endif
   }
 
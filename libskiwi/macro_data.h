@@ -23,6 +23,7 @@ struct macro_data
   {
   macro_map m;
   std::vector<std::pair<void*, uint64_t>> compiled_macros;
+  std::vector<std::vector<uint64_t>> compiled_macros_imm64_offsets; // for each compiled macro the offsets of its 64-bit immediates, used by the startup cache
   };
 
 SKIWI_SCHEME_API macro_data create_macro_data();
@@ -1,6 +1,7 @@
 #include "macro_expander.h"
 #include "visitor.h"
 #include "compile_error.h"
+#include "compile_stats.h"
 #include "debug_find.h"
 #include <cassert>
 #include <map>
@@ -433,11 +434,16 @@ namespace
       typedef uint64_t(*_fun_ptr)(void*);
 
       uint64_t fie_size;
-      auto fie = (_fun_ptr)assemble(fie_size, d, code);
+      _fun_ptr fie;
+        {
+        compile_pass_timer timer("assemble");
+        fie = (_fun_ptr)assemble(fie_size, d, code);
+        }
       if (fie)
         {
         fie(&ctxt);
         md.compiled_macros.emplace_back((void*)fie, fie_size);
+        md.compiled_macros_imm64_offsets.push_back(d.imm64_offsets);
         }
 #endif
       }
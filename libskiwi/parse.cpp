@@ -176,6 +176,7 @@ std::map<std::string, expression_type> generate_expression_map()
   m.insert(std::pair<std::string, expression_type>("flonum?", et_primitive_call));
   m.insert(std::pair<std::string, expression_type>("flonum->fixnum", et_primitive_call));
   m.insert(std::pair<std::string, expression_type>("flonum-expt", et_primitive_call));
+  m.insert(std::pair<std::string, expression_type>("gc-stats", et_primitive_call));
   m.insert(std::pair<std::string, expression_type>("%flush-output-port", et_primitive_call));
   m.insert(std::pair<std::string, expression_type>("fx=?", et_primitive_call));
   m.insert(std::pair<std::string, expression_type>("fx>?", et_primitive_call));
@@ -362,7 +363,8 @@ namespace
     throw_parse_error(-1, -1, t);
     }
 
-  token popped_token = token(token::T_BAD, "", -1, -1);
+  // thread_local, as inline_primitives parses its scripts from several threads at once
+  thread_local token popped_token = token(token::T_BAD, "", -1, -1);
 
   void invalidate_popped()
     {
@@ -24,220 +24,135 @@
 #include "tail_call_analysis.h"
 #include "tail_calls_check.h"
 #include "cinput_data.h"
-
-#include <ctime>
-
-namespace
-  {
-
-  class timer
-    {
-    public:
-      timer() : m_start(std::clock())
-        {
-        }
-
-      ~timer()
-        {
-        }
-
-      double get_time_elapsed_in_sec() const
-        {
-        std::clock_t time_elapsed = std::clock() - m_start;
-        return static_cast<double>(time_elapsed) / static_cast<double>(CLOCKS_PER_SEC);
-        }
-
-      void start_timer()
-        {
-        m_start = std::clock();
-        }
-
-    private:
-      std::clock_t m_start;
-    };
-
-  }
+#include "compile_stats.h"
 
 SKIWI_BEGIN
 
-namespace
-  {
-  timer g_timer;
-
-  void tic()
-    {
-    g_timer.start_timer();
-    }
-
-  void debug_string(const char* txt)
-    { 
-    (void)txt;
-    //printf(txt); printf("\n");
-    }
-
-  void toc()
-    {
-    auto t = g_timer.get_time_elapsed_in_sec();
-    (void)t;
-    //printf("Time spent: %fs\n", t);
-    }
-  }
-
 void preprocess(environment_map& env, repl_data& data, macro_data& md, context& ctxt, cinput_data& cinput, Program& prog, const primitive_map& pm, const compiler_options& options)
   {
-  tic();
-  debug_string("start handle_include_command");
   if (options.do_handle_include)
+    {
+    compile_pass_timer timer("include");
     handle_include_command(prog);
-  debug_string("done handle_include_command");
-  toc();
-  tic();
-  debug_string("start macro_expander");
+    }
   if (options.do_expand_macros)
+    {
+    compile_pass_timer timer("macro expansion");
     expand_macros(prog, env, data, md, ctxt, pm, options);
-  debug_string("done macro_expander");
-  toc();
-  tic();
-  debug_string("start quasiquote_conversion");
+    }
   if (options.do_quasiquote_conversion)
+    {
+    compile_pass_timer timer("quasiquote conversion");
     quasiquote_conversion(prog);
-  debug_string("done quasiquote_conversion");
-  toc();
-
-  tic();
-  debug_string("start c-input conversion");
+    }
   if (options.do_cinput_conversion)
+    {
+    compile_pass_timer timer("c-input conversion");
     cinput_conversion(cinput, prog, env, data);
-  debug_string("done c-input conversion");
-  toc();
-
-  tic();
-  debug_string("start define_conversion");
+    }
   if (options.do_define_conversion)
-    define_conversion(prog);
-  debug_string("done define_conversion");
-  toc();
-  tic();
-  debug_string("start single_begin_conversion");
+    {
+    compile_pass_timer timer("define conversion");
+    define_conversion(prog, options);
+    }
   if (options.do_single_begin_conversion)
+    {
+    compile_pass_timer timer("single begin conversion");
     single_begin_conversion(prog);
-  debug_string("done single_begin_conversion");
-  toc();
-  tic();
-  debug_string("start simplify_to_core_forms");
+    }
   if (options.do_simplify_to_core_forms)
-    simplify_to_core_forms(prog);
-  debug_string("done simplify_to_core_forms");
-  toc();
-  tic();
-  debug_string("start alpha_conversion");
-  alpha_conversion(prog, data.alpha_conversion_index, data.alpha_conversion_env, options.do_alpha_conversion);
-  debug_string("done alpha_conversion");
-  toc();
-  tic();
-  debug_string("start collect_quotes");
+    {
+    compile_pass_timer timer("simplify to core forms");
+    simplify_to_core_forms(prog, options);
+    }
+    {
+    compile_pass_timer timer("alpha conversion");
+    alpha_conversion(prog, data.alpha_conversion_index, data.alpha_conversion_env, options.do_alpha_conversion, options);
+    }
   if (options.do_collect_quotes)
+    {
+    compile_pass_timer timer("collect quotes");
     collect_quotes(prog, data);
-  debug_string("done collect_quotes");
-  toc();
-  tic();
-  debug_string("start quote_conversion");
+    }
   if (options.do_quote_conversion)
+    {
+    compile_pass_timer timer("quote conversion");
     quote_conversion(prog, data, env, ctxt);
-  debug_string("done quote_conversion");
-  toc();
-  tic();
-  debug_string("start global_define_environment_allocation");
+    }
   if (options.do_global_define_env_allocation)
+    {
+    compile_pass_timer timer("global define allocation");
     global_define_environment_allocation(prog, env, data, ctxt);
-  debug_string("done global_define_environment_allocation");
-  toc();
-  tic();
-  debug_string("start cps_conversion");
+    }
   if (options.do_cps_conversion)
+    {
+    compile_pass_timer timer("cps conversion");
     cps_conversion(prog, options);
-  debug_string("done cps_conversion");
-  toc();
-  tic();
-  debug_string("start lambda_to_let_conversion");
+    }
   if (options.do_lambda_to_let_conversion)
+    {
+    compile_pass_timer timer("lambda to let conversion");
     lambda_to_let_conversion(prog);
-  debug_string("done lambda_to_let_conversion");
-  toc();
-  tic();
-  debug_string("start assignable_variable_conversion");
+    }
   if (options.do_assignable_variables_conversion)
+    {
+    compile_pass_timer timer("assignable variable conversion");
     assignable_variable_conversion(prog, options);
-  debug_string("done assignable_variable_conversion");
-  toc();
-  tic();
+    }
   // this run of constant propagation can remove the need for closures
-  debug_string("start constant_propagation");
   if (options.do_constant_propagation)
-    constant_propagation(prog);
-  debug_string("done constant_propagation");
-  toc();
-  tic();
-  debug_string("start free_variable_analysis");
+    {
+    compile_pass_timer timer("constant propagation");
+    constant_propagation(prog, options);
+    }
   if (options.do_free_variables_analysis)
-    free_variable_analysis(prog, env);  
-  debug_string("done free_variable_analysis");
-  toc();
-  tic();
-  debug_string("start closure_conversion");
+    {
+    compile_pass_timer timer("free variable analysis");
+    free_variable_analysis(prog, env, options);
+    }
   if (options.do_closure_conversion)
+    {
+    compile_pass_timer timer("closure conversion");
     closure_conversion(prog, options);
-  debug_string("done closure_conversion");
-  toc();
-  tic();
-  debug_string("start inline_primitives_conversion");
+    }
   if (options.primitives_inlined)
-    inline_primitives(prog, data.alpha_conversion_index, options.safe_primitives, options.standard_bindings);
-  debug_string("done inline_primitives_conversion");
-  toc();
-  tic();
+    {
+    compile_pass_timer timer("inline primitives");
+    inline_primitives(prog, data.alpha_conversion_index, options.safe_primitives, options.standard_bindings, options);
+    }
   // this 2nd run of constant propagation is necessary, because the inlinging step might have introduced new opportunities for simplification
-  debug_string("start 2nd run constant_propagation");
   if (options.do_constant_propagation)
-    constant_propagation(prog);
-  debug_string("done 2nd run constant_propagation");
-  toc();
-  tic();
-  debug_string("start constant_folding");
+    {
+    compile_pass_timer timer("constant propagation");
+    constant_propagation(prog, options);
+    }
   if (options.do_constant_folding)
-    constant_folding(prog);
-  debug_string("done  constant_folding");
-  toc();
-  tic(); 
-  debug_string("start tail_call_analysis");
+    {
+    compile_pass_timer timer("constant folding");
+    constant_folding(prog, options);
+    }
   if (options.do_tail_call_analysis)
     {
-    tail_call_analysis(prog);
+    compile_pass_timer timer("tail call analysis");
+    tail_call_analysis(prog, options);
     if (!only_tail_calls(prog))
       throw std::runtime_error("preprocess: something went wrong: continuation passing style conversion failed");
     }
-  debug_string("done tail_call_analysis");
-  toc();
-  
-  tic();
-  debug_string("start remove_single_begins");
   if (options.do_remove_single_begins)
+    {
+    compile_pass_timer timer("remove single begins");
     remove_single_begins(prog);
-  debug_string("start remove_single_begins");
-  toc();
-  
-  tic();
-  debug_string("start do_linear_scan_indices_computation");
+    }
   if (options.do_linear_scan_indices_computation)
-    compute_linear_scan_index(prog);
-  debug_string("done do_linear_scan_indices_computation");
-  toc();
-  tic();
-  debug_string("start do_linear_scan");
+    {
+    compile_pass_timer timer("linear scan indices");
+    compute_linear_scan_index(prog, options);
+    }
   if (options.do_linear_scan)
-    linear_scan(prog, options.lsa_algo, options);  
-  debug_string("done linear_scan");
-  toc();
+    {
+    compile_pass_timer timer("linear scan");
+    linear_scan(prog, options.lsa_algo, options);
+    }
   }
 
 SKIWI_END
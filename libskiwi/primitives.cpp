@@ -7,6 +7,7 @@
 #include "context.h"
 #include "context_defs.h"
 #include "globals.h"
+#include "heap_profiler.h"
 #include "inlines.h"
 #include "types.h"
 #include "syscalls.h"
@@ -184,7 +185,7 @@ void compile_closure(asmcode& code, const compiler_options& ops)
     {
     code.add(asmcode::MOV, asmcode::RAX, asmcode::R11);
     code.add(asmcode::INC, asmcode::RAX);
-    check_heap(code, re_closure_heap_overflow);
+    check_heap_or_make_room(code, re_closure_heap_overflow);
     }
   auto done = label_to_string(label++);
   auto done2 = label_to_string(label++);
@@ -500,22 +501,24 @@ void compile_string_append1(asmcode& code, const compiler_options& ops)
   string_length(code, asmcode::RDX);
   code.add(asmcode::POP, asmcode::RDX);
 
-  if (ops.safe_primitives) // TO CHECK: string length should be divided by 8 here I thing before heap check
+  if (ops.safe_primitives)
     {
     code.add(asmcode::MOV, asmcode::RAX, asmcode::RBX);
     code.add(asmcode::POP, asmcode::RBX);
-    code.add(asmcode::PUSH, asmcode::RCX);
-    code.add(asmcode::MOV, asmcode::RCX, asmcode::RAX);
+    code.add(asmcode::PUSH, asmcode::RAX); // the lengths are kept on the stack, the collection does not look at them
+    code.add(asmcode::PUSH, asmcode::R15);
     code.add(asmcode::ADD, asmcode::RAX, asmcode::R15);
-    code.add(asmcode::MOV, asmcode::R11, asmcode::R15);
-    //code.add(asmcode::SHR, asmcode::RAX, asmcode::NUMBER, 3); // added as action on comment // TO CHECK: string length should be divided by 8 here I thing before heap check
-    //code.add(asmcode::INC, asmcode::RAX);                     // not tested yet  ==> removed again: made compiler.scm fail!!
-    check_heap(code, re_string_append_heap_overflow);
-    code.add(asmcode::MOV, asmcode::RAX, asmcode::RBX);
-    code.add(asmcode::MOV, asmcode::RBX, asmcode::RCX);
-    code.add(asmcode::POP, asmcode::RCX);
-    code.add(asmcode::PUSH, asmcode::RAX);
-    code.add(asmcode::MOV, asmcode::R15, asmcode::R11);
+    code.add(asmcode::SHR, asmcode::RAX, asmcode::NUMBER, 3);
+    code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, 2); // header, characters and ending 0, as allocated below
+    code.add(asmcode::OR, asmcode::RCX, asmcode::NUMBER, block_tag); // tagged, so that a collection updates the strings
+    code.add(asmcode::OR, asmcode::RDX, asmcode::NUMBER, block_tag);
+    check_heap_or_make_room(code, re_string_append_heap_overflow);
+    code.add(asmcode::AND, asmcode::RCX, asmcode::NUMBER, 0xfffffffffffffff8);
+    code.add(asmcode::AND, asmcode::RDX, asmcode::NUMBER, 0xfffffffffffffff8);
+    code.add(asmcode::POP, asmcode::R15);
+    code.add(asmcode::POP, asmcode::RAX);
+    code.add(asmcode::PUSH, asmcode::RBX);
+    code.add(asmcode::MOV, asmcode::RBX, asmcode::RAX);
     }
 
   /*
@@ -610,8 +613,9 @@ void compile_substring(asmcode& code, const compiler_options& ops)
     code.add(asmcode::JG, not_in_bounds);
     code.add(asmcode::MOV, asmcode::RAX, asmcode::RSI);
     code.add(asmcode::SUB, asmcode::RAX, asmcode::RDX);
-    code.add(asmcode::SHR, asmcode::RAX, asmcode::NUMBER, 1);
-    check_heap(code, re_substring_heap_overflow);
+    code.add(asmcode::SHR, asmcode::RAX, asmcode::NUMBER, 4);
+    code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, 2); // header and characters with ending 0, as allocated below
+    check_heap_or_make_room(code, re_substring_heap_overflow);
     }
   code.add(asmcode::AND, asmcode::RCX, asmcode::NUMBER, 0xfffffffffffffff8);
   if (ops.safe_primitives)
@@ -754,7 +758,7 @@ void compile_make_string(asmcode& code, const compiler_options& ops)
     code.add(asmcode::MOV, asmcode::RAX, asmcode::RCX);
     code.add(asmcode::SHR, asmcode::RAX, asmcode::NUMBER, 4);
     code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, 2);
-    check_heap(code, re_make_string_heap_overflow);
+    check_heap_or_make_room(code, re_make_string_heap_overflow);
     }
   code.add(asmcode::CMP, asmcode::R11, asmcode::NUMBER, 2);
   code.add(asmcode::JE, fill_with_value);
@@ -1413,7 +1417,7 @@ void compile_string(asmcode& code, const compiler_options& ops)
     code.add(asmcode::MOV, asmcode::RAX, asmcode::R11);
     code.add(asmcode::SHR, asmcode::RAX, asmcode::NUMBER, 3);
     code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, 2);
-    check_heap(code, re_string_heap_overflow);
+    check_heap_or_make_room(code, re_string_heap_overflow);
     }
   auto done = label_to_string(label++);
   auto repeat = label_to_string(label++);
@@ -1840,6 +1844,8 @@ void compile_vector_fill(asmcode& code, const compiler_options& ops)
   code.add(asmcode::TEST, asmcode::RAX, asmcode::RAX);
   code.add(asmcode::JES, done);
   code.add(asmcode::MOV, asmcode::MEM_RCX, asmcode::RDX);
+  if (ops.generational_gc)
+    code.add(asmcode::CALL, "L_write_barrier");
   code.add(asmcode::ADD, asmcode::RCX, asmcode::NUMBER, CELLS(1));
   code.add(asmcode::DEC, asmcode::RAX);
   code.add(asmcode::JMPS, repeat);
@@ -1866,7 +1872,7 @@ void compile_make_vector(asmcode& code, const compiler_options& ops)
     code.add(asmcode::MOV, asmcode::RAX, asmcode::RCX);
     code.add(asmcode::SAR, asmcode::RAX, asmcode::NUMBER, 1);
     code.add(asmcode::INC, asmcode::RAX);
-    check_heap(code, re_make_vector_heap_overflow);
+    check_heap_or_make_room(code, re_make_vector_heap_overflow);
     }
   auto done = label_to_string(label++);
   auto fill = label_to_string(label++);
@@ -1913,7 +1919,7 @@ void compile_vector(asmcode& code, const compiler_options& ops)
     {
     code.add(asmcode::MOV, asmcode::RAX, asmcode::R11);
     code.add(asmcode::INC, asmcode::RAX);
-    check_heap(code, re_vector_heap_overflow);
+    check_heap_or_make_room(code, re_vector_heap_overflow);
     }
   code.add(asmcode::MOV, asmcode::RAX, asmcode::R11);
   code.add(asmcode::MOV, asmcode::R15, asmcode::NUMBER, (uint64_t)vector_tag << (uint64_t)block_shift);
@@ -2057,6 +2063,11 @@ void compile_slot_set(asmcode& code, const compiler_options& ops)
   code.add(asmcode::ADD, asmcode::RCX, asmcode::RDX);
   code.add(asmcode::MOV, asmcode::RAX, asmcode::RSI);
   code.add(asmcode::MOV, asmcode::MEM_RCX, asmcode::RAX);
+  if (ops.generational_gc)
+    {
+    code.add(asmcode::MOV, asmcode::RDX, asmcode::RAX);
+    code.add(asmcode::CALL, "L_write_barrier");
+    }
 
   code.add(asmcode::JMP, CONTINUE);
   if (ops.safe_primitives)
@@ -2152,6 +2163,11 @@ void compile_vector_set(asmcode& code, const compiler_options& ops)
   code.add(asmcode::ADD, asmcode::RCX, asmcode::RDX);
   code.add(asmcode::MOV, asmcode::RAX, asmcode::RSI);
   code.add(asmcode::MOV, asmcode::MEM_RCX, asmcode::RAX);
+  if (ops.generational_gc)
+    {
+    code.add(asmcode::MOV, asmcode::RDX, asmcode::RAX);
+    code.add(asmcode::CALL, "L_write_barrier");
+    }
 
   code.add(asmcode::JMP, CONTINUE);
   if (ops.safe_primitives)
@@ -4404,7 +4420,7 @@ void compile_list(asmcode& code, const compiler_options& ops)
     code.add(asmcode::MOV, asmcode::RAX, asmcode::R11);
     code.add(asmcode::SHL, asmcode::RAX, asmcode::NUMBER, 1);
     code.add(asmcode::ADD, asmcode::RAX, asmcode::R11); // shl 1 and add for * 3
-    check_heap(code, re_list_heap_overflow);
+    check_heap_or_make_room(code, re_list_heap_overflow);
     }
 
   code.add(asmcode::MOV, asmcode::R15, ALLOC);
@@ -4563,6 +4579,11 @@ void compile_set_car(asmcode& code, const compiler_options& ops)
     jump_if_arg_does_not_point_to_pair(code, asmcode::RCX, asmcode::R11, error);
     }
   code.add(asmcode::MOV, asmcode::MEM_RCX, CELLS(1), asmcode::RDX);
+  if (ops.generational_gc)
+    {
+    code.add(asmcode::ADD, asmcode::RCX, asmcode::NUMBER, CELLS(1));
+    code.add(asmcode::CALL, "L_write_barrier");
+    }
   code.add(asmcode::JMP, CONTINUE);
   if (ops.safe_primitives)
     {
@@ -4588,6 +4609,11 @@ void compile_set_cdr(asmcode& code, const compiler_options& ops)
     jump_if_arg_does_not_point_to_pair(code, asmcode::RCX, asmcode::R11, error);
     }
   code.add(asmcode::MOV, asmcode::MEM_RCX, CELLS(2), asmcode::RDX);
+  if (ops.generational_gc)
+    {
+    code.add(asmcode::ADD, asmcode::RCX, asmcode::NUMBER, CELLS(2));
+    code.add(asmcode::CALL, "L_write_barrier");
+    }
   code.add(asmcode::JMP, CONTINUE);
   if (ops.safe_primitives)
     {
@@ -4704,6 +4730,16 @@ void compile_mark(asmcode& code, const compiler_options&)
   code.add(asmcode::RET);
   }
 
+void compile_write_barrier(asmcode& code, const compiler_options& ops)
+  {
+  /*write barrier for the generational garbage collector: rcx contains the address that was written, rdx the value. clobbers r11 and r15*/
+  if (!ops.generational_gc)
+    return;
+  code.add(asmcode::LABEL, "L_write_barrier");
+  write_barrier(code, asmcode::RCX, asmcode::RDX);
+  code.add(asmcode::RET);
+  }
+
 void compile_reclaim(asmcode& code, const compiler_options& ops)
   {
   auto reclaim = label_to_string(label++);
@@ -4714,204 +4750,591 @@ void compile_reclaim(asmcode& code, const compiler_options& ops)
   compile_reclaim_garbage(code, ops);
   }
 
-void compile_reclaim_garbage(asmcode& code, const compiler_options&)
+namespace
   {
-  auto no_heap = label_to_string(label++);
+  void save_registers_for_gc(asmcode& code)
+    {
+    code.add(asmcode::MOV, asmcode::RAX, GC_SAVE);
+    code.add(asmcode::MOV, asmcode::MEM_RAX, asmcode::RCX);
+    code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(1), asmcode::RDX);
+    code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(2), asmcode::RSI);
+    code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(3), asmcode::RDI);
+    code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(4), asmcode::R8);
+    code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(5), asmcode::R9);
+    code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(6), asmcode::R12);
+    code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(7), asmcode::R14);
+    }
 
-  code.add(asmcode::CMP, ALLOC, FROM_SPACE_END);
-  code.add(asmcode::JG, no_heap);
+  /*
+  Calls the c++ function at address with the context as argument, and leaves its result in rax.
+  All scheme registers should be saved in GC_SAVE, and rbx should be on the stack, so that rbx can keep rsp.
+  */
+  void call_from_gc(asmcode& code, uint64_t address)
+    {
+    code.add(asmcode::MOV, ALLOC_SAVED, ALLOC);
+    code.add(asmcode::MOV, asmcode::R15, CONTEXT); // r15 should be saved by the callee but r10 not, so we save the context in r15
+    code.add(asmcode::MOV, asmcode::RBX, asmcode::RSP);
+    code.add(asmcode::AND, asmcode::RSP, asmcode::NUMBER, 0xFFFFFFFFFFFFFFF0);
+#ifdef _WIN32
+    code.add(asmcode::MOV, asmcode::RCX, CONTEXT);
+    code.add(asmcode::SUB, asmcode::RSP, asmcode::NUMBER, 32);
+#else
+    code.add(asmcode::MOV, asmcode::RDI, CONTEXT);
+#endif
+    code.add(asmcode::MOV, asmcode::R11, asmcode::NUMBER, address);
+    code.add(asmcode::CALLEXTERNAL, asmcode::R11);
+    code.add(asmcode::MOV, asmcode::RSP, asmcode::RBX);
+    code.add(asmcode::MOV, CONTEXT, asmcode::R15); // now we restore the context
+    }
 
-  code.add(asmcode::PUSH, asmcode::RBX);
+  /*
+  With compiler_options::heap_profiling the samples of the allocations before the collection are taken first, and the
+  samples follow their objects once these are copied (see heap_profiler.h).
+  */
+  void sample_heap_before_gc(asmcode& code, const compiler_options& ops)
+    {
+    if (ops.heap_profiling)
+      call_from_gc(code, (uint64_t)&sample_heap_allocations);
+    }
+
+  /*
+  Call right after scan_copied_blocks, while FROM_SPACE and FROM_SPACE_END still hold the range that was collected.
+  Keeps rsi, the allocation pointer of the space that was copied to.
+  */
+  void update_heap_profile_after_copy(asmcode& code, const compiler_options& ops)
+    {
+    if (!ops.heap_profiling)
+      return;
+    code.add(asmcode::MOV, ALLOC, asmcode::RSI); // alloc is set again after the collection
+    call_from_gc(code, (uint64_t)&update_heap_profile);
+    code.add(asmcode::MOV, asmcode::RSI, ALLOC);
+    }
 
-  // run over all registers (in GC_SAVE) and locals. R11 contains the number of items.  
-  code.add(asmcode::MOV, asmcode::R11, NUMBER_OF_LOCALS);
-  code.add(asmcode::ADD, asmcode::R11, asmcode::NUMBER, 8); // add the 8 free registers
+  void restore_registers_after_gc(asmcode& code)
+    {
+    code.add(asmcode::MOV, asmcode::RAX, GC_SAVE);
+    code.add(asmcode::MOV, asmcode::RCX, asmcode::MEM_RAX);
+    code.add(asmcode::MOV, asmcode::RDX, asmcode::MEM_RAX, CELLS(1));
+    code.add(asmcode::MOV, asmcode::RSI, asmcode::MEM_RAX, CELLS(2));
+    code.add(asmcode::MOV, asmcode::RDI, asmcode::MEM_RAX, CELLS(3));
+    code.add(asmcode::MOV, asmcode::R8, asmcode::MEM_RAX, CELLS(4));
+    code.add(asmcode::MOV, asmcode::R9, asmcode::MEM_RAX, CELLS(5));
+    code.add(asmcode::MOV, asmcode::R12, asmcode::MEM_RAX, CELLS(6));
+    code.add(asmcode::MOV, asmcode::R14, asmcode::MEM_RAX, CELLS(7));
+    }
 
-  code.add(asmcode::MOV, asmcode::RAX, GC_SAVE);
-  code.add(asmcode::MOV, asmcode::MEM_RAX, asmcode::RCX);
-  code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(1), asmcode::RDX);
-  code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(2), asmcode::RSI);
-  code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(3), asmcode::RDI);
-  code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(4), asmcode::R8);
-  code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(5), asmcode::R9);
-  code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(6), asmcode::R12);
-  code.add(asmcode::MOV, asmcode::MEM_RAX, CELLS(7), asmcode::R14);
+  /*
+  Marks the registers saved in GC_SAVE, the locals, the globals and the items saved on the stack.
+  Blocks are copied to rdi, see L_mark.
+  */
+  void mark_roots(asmcode& code)
+    {
+    // run over all registers (in GC_SAVE) and locals. R11 contains the number of items.
+    code.add(asmcode::MOV, asmcode::R11, NUMBER_OF_LOCALS);
+    code.add(asmcode::ADD, asmcode::R11, asmcode::NUMBER, 8); // add the 8 free registers
+    code.add(asmcode::MOV, asmcode::RAX, GC_SAVE);
 
+    /*
+    All local variables are now in memory in sequential order, as gc_save and locals follow each other (see context creation).
+    We will now mark them with the block_mask_bit.
+    */
+    auto mark_local_rep = label_to_string(label++);
+    auto mark_local_done = label_to_string(label++);
+    code.add(asmcode::LABEL, mark_local_rep);
+    code.add(asmcode::TEST, asmcode::R11, asmcode::R11);
+    code.add(asmcode::JES, mark_local_done);
+    code.add(asmcode::CALL, "L_mark");
+    code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, CELLS(1));
+    code.add(asmcode::DEC, asmcode::R11);
+    code.add(asmcode::JMPS, mark_local_rep);
+    code.add(asmcode::LABEL, mark_local_done);
+
+    /*
+    Next we mark the globals with the block_mask_bit.
+    */
+    code.add(asmcode::MOV, asmcode::RAX, GLOBALS);
+    code.add(asmcode::MOV, asmcode::R11, GLOBALS_END);
+    code.add(asmcode::SUB, asmcode::R11, GLOBALS);
+    code.add(asmcode::SHR, asmcode::R11, asmcode::NUMBER, 3);
+    auto mark_global_rep = label_to_string(label++);
+    auto mark_global_done = label_to_string(label++);
+    //auto skip_mark = label_to_string(label++);
+    code.add(asmcode::LABEL, mark_global_rep);
+    code.add(asmcode::TEST, asmcode::R11, asmcode::R11);
+    code.add(asmcode::JES, mark_global_done);
+    code.add(asmcode::CMP, asmcode::MEM_RAX, asmcode::NUMBER, unalloc_tag);
+    code.add(asmcode::JES, mark_global_done);
+    //code.add(asmcode::JES, skip_mark);
+    code.add(asmcode::CALL, "L_mark");
+    //code.add(asmcode::LABEL, skip_mark);
+    code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, CELLS(1));
+    code.add(asmcode::DEC, asmcode::R11);
+    code.add(asmcode::JMPS, mark_global_rep);
+    code.add(asmcode::LABEL, mark_global_done);
+
+
+
+    /*
+    Next we update the items saved on the stack. The stack register holds the current stack position: STACK in the
+    context is only updated around foreign calls, so it misses the items pushed since, e.g. the continuation of a
+    primitive object call like apply.
+    */
 
-  code.add(asmcode::MOV, asmcode::RSI, TO_SPACE); // rsi = alloc-ptr
-  code.add(asmcode::MOV, asmcode::RDI, asmcode::RSI);
+    code.add(asmcode::MOV, asmcode::R11, STACK_REGISTER);
+    code.add(asmcode::MOV, asmcode::RAX, STACK_TOP);
+    code.add(asmcode::SUB, asmcode::R11, asmcode::RAX);
+    code.add(asmcode::SHR, asmcode::R11, asmcode::NUMBER, 3);
+    //code.add(asmcode::SUB, asmcode::R11, asmcode::NUMBER, 2); // r11 and rbx are pushed on the stack at the top of this method
+    auto mark_rsp_rep = label_to_string(label++);
+    auto mark_rsp_done = label_to_string(label++);
+    code.add(asmcode::LABEL, mark_rsp_rep);
+    code.add(asmcode::TEST, asmcode::R11, asmcode::R11);
+    code.add(asmcode::JES, mark_rsp_done);
+    code.add(asmcode::CALL, "L_mark");
+    code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, CELLS(1));
+    code.add(asmcode::DEC, asmcode::R11);
+    code.add(asmcode::JMPS, mark_rsp_rep);
+    code.add(asmcode::LABEL, mark_rsp_done);
+    }
 
   /*
-  All local variables are now in memory in sequential order, as gc_save and locals follow each other (see context creation).
-  We will now mark them with the block_mask_bit.
+  Runs over the copied blocks from rsi to rdi and marks their content, until rsi equals rdi.
   */
-  auto mark_local_rep = label_to_string(label++);
-  auto mark_local_done = label_to_string(label++);
-  code.add(asmcode::LABEL, mark_local_rep);
-  code.add(asmcode::TEST, asmcode::R11, asmcode::R11);
-  code.add(asmcode::JES, mark_local_done);
-  code.add(asmcode::CALL, "L_mark");
-  code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, CELLS(1));
-  code.add(asmcode::DEC, asmcode::R11);
-  code.add(asmcode::JMPS, mark_local_rep);
-  code.add(asmcode::LABEL, mark_local_done);
+  void scan_copied_blocks(asmcode& code)
+    {
+    auto cmp_rsi_rdi_loop = label_to_string(label++);
+    code.add(asmcode::LABEL, cmp_rsi_rdi_loop);
+    auto rsi_equals_rdi = label_to_string(label++);
+    auto simple_block = label_to_string(label++);
+    auto complicated_block = label_to_string(label++);
+    auto closure_block = label_to_string(label++);
+    code.add(asmcode::CMP, asmcode::RSI, asmcode::RDI);
+    code.add(asmcode::JE, rsi_equals_rdi);
+
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::MEM_RSI); // get header
+    code.add(asmcode::MOV, asmcode::RCX, asmcode::RAX);
+    code.add(asmcode::MOV, asmcode::RDX, asmcode::NUMBER, block_size_mask);
+    code.add(asmcode::AND, asmcode::RCX, asmcode::RDX); // get size of block in rcx
+    code.add(asmcode::MOV, asmcode::RDX, asmcode::RAX);
+    code.add(asmcode::SHR, asmcode::RDX, asmcode::NUMBER, block_shift);
+    code.add(asmcode::AND, asmcode::RDX, asmcode::NUMBER, block_header_mask); // rdx contains the type
+    code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, closure_tag);
+    code.add(asmcode::JES, closure_block);
+    code.add(asmcode::JGS, complicated_block);
+    /*
+    code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, string_tag);
+    code.add(asmcode::JES, simple_block);
+    code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, symbol_tag);
+    code.add(asmcode::JES, simple_block);
+    code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, flonum_tag);
+    code.add(asmcode::JES, simple_block);
+    code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, closure_tag);
+    code.add(asmcode::JES, closure_block);
+    code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, pair_tag);
+    code.add(asmcode::JES, complicated_block);
+    code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, vector_tag);
+    code.add(asmcode::JES, complicated_block);
+    */
+    code.add(asmcode::LABEL, simple_block);
+    code.add(asmcode::INC, asmcode::RCX);
+    code.add(asmcode::SHL, asmcode::RCX, asmcode::NUMBER, 3);
+    code.add(asmcode::ADD, asmcode::RSI, asmcode::RCX);
+    code.add(asmcode::JMP, cmp_rsi_rdi_loop);
+    code.add(asmcode::LABEL, closure_block);
+    code.add(asmcode::ADD, asmcode::RSI, asmcode::NUMBER, CELLS(1)); // skip label address of closure
+    code.add(asmcode::DEC, asmcode::RCX);
+    // now treat closure as complicated block
+    code.add(asmcode::LABEL, complicated_block);
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::RSI);
+    code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, CELLS(1));
+    auto complicated_block_loop = label_to_string(label++);
+    auto complicated_block_done = label_to_string(label++);
+    code.add(asmcode::LABEL, complicated_block_loop);
+    code.add(asmcode::TEST, asmcode::RCX, asmcode::RCX);
+    code.add(asmcode::JES, complicated_block_done);
+    code.add(asmcode::CALL, "L_mark");
+    code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, CELLS(1));
+    code.add(asmcode::DEC, asmcode::RCX);
+    code.add(asmcode::JMPS, complicated_block_loop);
+    code.add(asmcode::LABEL, complicated_block_done);
+    code.add(asmcode::MOV, asmcode::RSI, asmcode::RAX);
+    code.add(asmcode::JMP, cmp_rsi_rdi_loop);
+    code.add(asmcode::LABEL, rsi_equals_rdi);
+    }
 
   /*
-  Next we mark the globals with the block_mask_bit.
+  Copies the live blocks to TO_SPACE, swaps the semispaces, and lets resize_heap decide whether the heap should grow or
+  shrink. If so, resize_heap returns 1 with TO_SPACE pointing to the new heap, and we collect once more to move everything
+  over. The registers should be saved in GC_SAVE, and rbx should be on the stack (see call_from_gc).
   */
-  code.add(asmcode::MOV, asmcode::RAX, GLOBALS);
-  code.add(asmcode::MOV, asmcode::R11, GLOBALS_END);
-  code.add(asmcode::SUB, asmcode::R11, GLOBALS);
-  code.add(asmcode::SHR, asmcode::R11, asmcode::NUMBER, 3);
-  auto mark_global_rep = label_to_string(label++);
-  auto mark_global_done = label_to_string(label++);
-  //auto skip_mark = label_to_string(label++);
-  code.add(asmcode::LABEL, mark_global_rep);
-  code.add(asmcode::TEST, asmcode::R11, asmcode::R11);
-  code.add(asmcode::JES, mark_global_done);
-  code.add(asmcode::CMP, asmcode::MEM_RAX, asmcode::NUMBER, unalloc_tag);
-  code.add(asmcode::JES, mark_global_done);
-  //code.add(asmcode::JES, skip_mark);
-  code.add(asmcode::CALL, "L_mark");
-  //code.add(asmcode::LABEL, skip_mark);
-  code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, CELLS(1));
-  code.add(asmcode::DEC, asmcode::R11);
-  code.add(asmcode::JMPS, mark_global_rep);
-  code.add(asmcode::LABEL, mark_global_done);
+  void collect_semispace(asmcode& code, const compiler_options& ops)
+    {
+    auto collect = label_to_string(label++);
+    code.add(asmcode::LABEL, collect);
+
+    code.add(asmcode::MOV, asmcode::RSI, TO_SPACE); // rsi = alloc-ptr
+    code.add(asmcode::MOV, asmcode::RDI, asmcode::RSI);
+
+    mark_roots(code);
+    scan_copied_blocks(code);
+    update_heap_profile_after_copy(code, ops);
+
+    // swap spaces
+    code.add(asmcode::MOV, asmcode::RDX, FROM_SPACE);
+    code.add(asmcode::MOV, asmcode::RAX, TO_SPACE);
+    code.add(asmcode::MOV, FROM_SPACE, asmcode::RAX);
+    code.add(asmcode::MOV, TO_SPACE, asmcode::RDX);
+    code.add(asmcode::MOV, asmcode::RDX, FROM_SPACE_END);
+    code.add(asmcode::MOV, asmcode::RAX, TO_SPACE_END);
+    code.add(asmcode::MOV, FROM_SPACE_END, asmcode::RAX);
+    code.add(asmcode::MOV, TO_SPACE_END, asmcode::RDX);
+
+    code.add(asmcode::MOV, ALLOC, asmcode::RSI);
+    code.add(asmcode::MOV, asmcode::RAX, FROM_SPACE_END);
+    code.add(asmcode::MOV, asmcode::R11, FROMSPACE_RESERVE);
+    code.add(asmcode::SHL, asmcode::R11, asmcode::NUMBER, 3);
+    code.add(asmcode::SUB, asmcode::RAX, asmcode::R11);
+    code.add(asmcode::MOV, LIMIT, asmcode::RAX);
+
+    call_from_gc(code, (uint64_t)&resize_heap);
+    code.add(asmcode::TEST, asmcode::RAX, asmcode::RAX);
+    code.add(asmcode::JNE, collect);
+    }
+
+  void compile_reclaim_garbage_semispace(asmcode& code, const compiler_options& ops)
+    {
+    auto no_heap = label_to_string(label++);
+
+    code.add(asmcode::CMP, ALLOC, FROM_SPACE_END);
+    code.add(asmcode::JG, no_heap);
+
+    code.add(asmcode::PUSH, asmcode::RBX);
+
+    save_registers_for_gc(code);
+    call_from_gc(code, (uint64_t)&gc_collection_started);
+    sample_heap_before_gc(code, ops);
+
+    collect_semispace(code, ops);
+
+    call_from_gc(code, (uint64_t)&gc_collection_finished);
+    restore_registers_after_gc(code);
+    /*
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, unalloc_tag);
+    code.add(asmcode::MOV, asmcode::R15, TO_SPACE);
+    code.add(asmcode::MOV, asmcode::R11, TO_SPACE_END);
+    code.add(asmcode::SUB, asmcode::R11, TO_SPACE);
+    code.add(asmcode::SHR, asmcode::R11, asmcode::NUMBER, 3);
+    auto make_zero_loop = label_to_string(label++);
+    auto make_zero_done = label_to_string(label++);
+    code.add(asmcode::LABEL, make_zero_loop);
+    code.add(asmcode::TEST, asmcode::R11, asmcode::R11);
+    code.add(asmcode::JES, make_zero_done);
+    code.add(asmcode::DEC, asmcode::R11);
+    code.add(asmcode::MOV, asmcode::MEM_R15, asmcode::RAX);
+    code.add(asmcode::ADD, asmcode::R15, asmcode::NUMBER, CELLS(1));
+    code.add(asmcode::JMPS, make_zero_loop);
+    code.add(asmcode::LABEL, make_zero_done);
+    */
+    code.add(asmcode::POP, asmcode::RBX); // continue value
+
+    code.add(asmcode::MOV, PROCEDURE_ALLOC_MARK, ALLOC);
+    code.add(asmcode::CMP, ALLOC, FROM_SPACE_END);
+    code.add(asmcode::JGS, no_heap);
+
+    code.add(asmcode::JMP, CONTINUE);
+
+    error_label(code, no_heap, re_heap_full);
+    }
+
+  /*
+  Gives the nursery its capacity for the free room in the old space after OLD_ALLOC: the nursery size, but at most half
+  of that room, so that the old space can always take a full nursery. Empties the nursery. Clobbers rax and r11.
+  */
+  void reset_nursery(asmcode& code)
+    {
+    auto capacity_ok = label_to_string(label++);
+    auto limit_ok = label_to_string(label++);
+    code.add(asmcode::MOV, asmcode::RAX, OLD_SPACE_END);
+    code.add(asmcode::SUB, asmcode::RAX, OLD_ALLOC);
+    code.add(asmcode::SHR, asmcode::RAX, asmcode::NUMBER, 1);
+    code.add(asmcode::AND, asmcode::RAX, asmcode::NUMBER, 0xFFFFFFFFFFFFFFF8);
+    code.add(asmcode::MOV, asmcode::R11, NURSERY_END);
+    code.add(asmcode::SUB, asmcode::R11, NURSERY);
+    code.add(asmcode::CMP, asmcode::RAX, asmcode::R11);
+    code.add(asmcode::JLE, capacity_ok);
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::R11);
+    code.add(asmcode::LABEL, capacity_ok);
+    code.add(asmcode::MOV, asmcode::R11, NURSERY);
+    code.add(asmcode::MOV, FROM_SPACE, asmcode::R11);
+    code.add(asmcode::ADD, asmcode::R11, asmcode::RAX);
+    code.add(asmcode::MOV, FROM_SPACE_END, asmcode::R11);
+    code.add(asmcode::MOV, asmcode::RAX, FROMSPACE_RESERVE);
+    code.add(asmcode::SHL, asmcode::RAX, asmcode::NUMBER, 3);
+    code.add(asmcode::SUB, asmcode::R11, asmcode::RAX);
+    code.add(asmcode::CMP, asmcode::R11, FROM_SPACE);
+    code.add(asmcode::JGE, limit_ok);
+    code.add(asmcode::MOV, asmcode::R11, FROM_SPACE);
+    code.add(asmcode::LABEL, limit_ok);
+    code.add(asmcode::MOV, LIMIT, asmcode::R11);
+    code.add(asmcode::MOV, ALLOC, FROM_SPACE);
+    }
 
+  /*
+  An allocation that does not fit the nursery is done at the end of the old space, see open_old_space_window. While this
+  window is open, FROM_SPACE is not the nursery. Closing it adds the allocations in the window to the old space, and
+  gives the allocation back to the nursery. Clobbers rax and r11.
+  */
+  void close_old_space_window(asmcode& code)
+    {
+    auto no_window = label_to_string(label++);
+    code.add(asmcode::MOV, asmcode::RAX, FROM_SPACE);
+    code.add(asmcode::CMP, asmcode::RAX, NURSERY);
+    code.add(asmcode::JE, no_window);
+    code.add(asmcode::MOV, OLD_ALLOC, ALLOC);
+    reset_nursery(code);
+    code.add(asmcode::LABEL, no_window);
+    }
 
+  /*
+  A major collection copies the live blocks of the old space and the nursery to OLD_TO_SPACE, and swaps the old spaces.
+  If the old space does not have enough free room afterwards, the nursery capacity is reduced.
+  */
+  void collect_generational_major(asmcode& code, const compiler_options& ops)
+    {
+    /*
+    L_mark copies the blocks between FROM_SPACE and FROM_SPACE_END. The nursery lies in between the two old spaces
+    (see create_context), so the old space and the nursery together form one range.
+    */
+    auto old_space_after_nursery = label_to_string(label++);
+    auto range_set = label_to_string(label++);
+    code.add(asmcode::MOV, asmcode::RAX, OLD_SPACE);
+    code.add(asmcode::CMP, asmcode::RAX, NURSERY);
+    code.add(asmcode::JG, old_space_after_nursery);
+    code.add(asmcode::MOV, FROM_SPACE, asmcode::RAX);
+    code.add(asmcode::MOV, asmcode::RAX, NURSERY_END);
+    code.add(asmcode::MOV, FROM_SPACE_END, asmcode::RAX);
+    code.add(asmcode::JMP, range_set);
+    code.add(asmcode::LABEL, old_space_after_nursery);
+    code.add(asmcode::MOV, asmcode::RAX, NURSERY);
+    code.add(asmcode::MOV, FROM_SPACE, asmcode::RAX);
+    code.add(asmcode::MOV, asmcode::RAX, OLD_SPACE_END);
+    code.add(asmcode::MOV, FROM_SPACE_END, asmcode::RAX);
+    code.add(asmcode::LABEL, range_set);
+
+    code.add(asmcode::MOV, asmcode::RSI, OLD_TO_SPACE);
+    code.add(asmcode::MOV, asmcode::RDI, asmcode::RSI);
+    mark_roots(code);
+    scan_copied_blocks(code);
+    update_heap_profile_after_copy(code, ops);
+
+    // swap old spaces
+    code.add(asmcode::MOV, asmcode::RDX, OLD_SPACE);
+    code.add(asmcode::MOV, asmcode::RAX, OLD_TO_SPACE);
+    code.add(asmcode::MOV, OLD_SPACE, asmcode::RAX);
+    code.add(asmcode::MOV, OLD_TO_SPACE, asmcode::RDX);
+    code.add(asmcode::MOV, asmcode::RDX, OLD_SPACE_END);
+    code.add(asmcode::MOV, asmcode::RAX, OLD_TO_SPACE_END);
+    code.add(asmcode::MOV, OLD_SPACE_END, asmcode::RAX);
+    code.add(asmcode::MOV, OLD_TO_SPACE_END, asmcode::RDX);
+    code.add(asmcode::MOV, OLD_ALLOC, asmcode::RSI);
+
+    code.add(asmcode::MOV, asmcode::RAX, REMEMBERED_SET);
+    code.add(asmcode::MOV, REMEMBERED_SET_TOP, asmcode::RAX);
+    code.add(asmcode::MOV, REMEMBERED_SET_OVERFLOW, asmcode::NUMBER, 0);
+
+    reset_nursery(code);
+    }
 
-  auto cmp_rsi_rdi_loop = label_to_string(label++);
   /*
-  Next we update the items saved on the stack.
+  Generational collector. Allocation happens in the nursery (FROM_SPACE to FROM_SPACE_END), the old generation is a
+  semispace pair (OLD_SPACE and OLD_TO_SPACE).
+  A minor collection copies the live blocks of the nursery to the end of the old space. Its roots are the registers, locals,
+  globals, stack and the slots in the remembered set (old blocks that were written with a pointer into the nursery).
+  A major collection is done when the remembered set overflowed, or when the old space has less than twice the nursery
+  capacity free, so that the old space can always take a full nursery.
   */
+  void collect_generational(asmcode& code, const compiler_options& ops)
+    {
+    auto major = label_to_string(label++);
+    auto done = label_to_string(label++);
 
-  code.add(asmcode::MOV, asmcode::RAX, STACK);
-  code.add(asmcode::MOV, asmcode::R11, asmcode::RAX);
-  code.add(asmcode::MOV, asmcode::RAX, STACK_TOP);
-  code.add(asmcode::SUB, asmcode::R11, asmcode::RAX);
-  code.add(asmcode::SHR, asmcode::R11, asmcode::NUMBER, 3);
-  //code.add(asmcode::SUB, asmcode::R11, asmcode::NUMBER, 2); // r11 and rbx are pushed on the stack at the top of this method
-  auto mark_rsp_rep = label_to_string(label++);
-  code.add(asmcode::LABEL, mark_rsp_rep);
-  code.add(asmcode::TEST, asmcode::R11, asmcode::R11);
-  code.add(asmcode::JES, cmp_rsi_rdi_loop);
-  code.add(asmcode::CALL, "L_mark");
-  code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, CELLS(1));
-  code.add(asmcode::DEC, asmcode::R11);
-  code.add(asmcode::JMPS, mark_rsp_rep);
+    close_old_space_window(code);
 
+    code.add(asmcode::CMP, REMEMBERED_SET_OVERFLOW, asmcode::NUMBER, 0);
+    code.add(asmcode::JNE, major);
+    code.add(asmcode::MOV, asmcode::RAX, OLD_SPACE_END);
+    code.add(asmcode::SUB, asmcode::RAX, OLD_ALLOC);
+    code.add(asmcode::MOV, asmcode::R11, FROM_SPACE_END);
+    code.add(asmcode::SUB, asmcode::R11, FROM_SPACE);
+    code.add(asmcode::SHL, asmcode::R11, asmcode::NUMBER, 1);
+    code.add(asmcode::CMP, asmcode::RAX, asmcode::R11);
+    code.add(asmcode::JL, major);
+
+    // minor collection
+    code.add(asmcode::MOV, asmcode::RSI, OLD_ALLOC);
+    code.add(asmcode::MOV, asmcode::RDI, asmcode::RSI);
+    mark_roots(code);
+
+    auto remembered_rep = label_to_string(label++);
+    auto remembered_done = label_to_string(label++);
+    code.add(asmcode::MOV, asmcode::RCX, REMEMBERED_SET);
+    code.add(asmcode::LABEL, remembered_rep);
+    code.add(asmcode::CMP, asmcode::RCX, REMEMBERED_SET_TOP);
+    code.add(asmcode::JGE, remembered_done);
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::MEM_RCX);
+    code.add(asmcode::CALL, "L_mark");
+    code.add(asmcode::ADD, asmcode::RCX, asmcode::NUMBER, CELLS(1));
+    code.add(asmcode::JMP, remembered_rep);
+    code.add(asmcode::LABEL, remembered_done);
+
+    scan_copied_blocks(code);
+    update_heap_profile_after_copy(code, ops);
+
+    code.add(asmcode::MOV, OLD_ALLOC, asmcode::RSI);
+    code.add(asmcode::MOV, asmcode::RAX, REMEMBERED_SET);
+    code.add(asmcode::MOV, REMEMBERED_SET_TOP, asmcode::RAX);
+    code.add(asmcode::MOV, ALLOC, FROM_SPACE);
+    code.add(asmcode::JMP, done);
 
+    code.add(asmcode::LABEL, major);
+    collect_generational_major(code, ops);
 
-  code.add(asmcode::LABEL, cmp_rsi_rdi_loop);
-  auto rsi_equals_rdi = label_to_string(label++);
-  auto simple_block = label_to_string(label++);
-  auto complicated_block = label_to_string(label++);
-  auto closure_block = label_to_string(label++);
-  code.add(asmcode::CMP, asmcode::RSI, asmcode::RDI);
-  code.add(asmcode::JE, rsi_equals_rdi);
+    code.add(asmcode::LABEL, done);
+    }
 
-  code.add(asmcode::MOV, asmcode::RAX, asmcode::MEM_RSI); // get header
-  code.add(asmcode::MOV, asmcode::RCX, asmcode::RAX);
-  code.add(asmcode::MOV, asmcode::RDX, asmcode::NUMBER, block_size_mask);
-  code.add(asmcode::AND, asmcode::RCX, asmcode::RDX); // get size of block in rcx
-  code.add(asmcode::MOV, asmcode::RDX, asmcode::RAX);
-  code.add(asmcode::SHR, asmcode::RDX, asmcode::NUMBER, block_shift);
-  code.add(asmcode::AND, asmcode::RDX, asmcode::NUMBER, block_header_mask); // rdx contains the type
-  code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, closure_tag);
-  code.add(asmcode::JES, closure_block);
-  code.add(asmcode::JGS, complicated_block);
   /*
-  code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, string_tag);
-  code.add(asmcode::JES, simple_block);
-  code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, symbol_tag);
-  code.add(asmcode::JES, simple_block);
-  code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, flonum_tag);
-  code.add(asmcode::JES, simple_block);
-  code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, closure_tag);
-  code.add(asmcode::JES, closure_block);
-  code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, pair_tag);
-  code.add(asmcode::JES, complicated_block);
-  code.add(asmcode::CMP, asmcode::RDX, asmcode::NUMBER, vector_tag);
-  code.add(asmcode::JES, complicated_block);
+  Call after collect_generational, with the bytes that did not fit in HEAP_REQUEST. If they still do not fit the nursery,
+  the allocation is moved to the end of the old space, after a major collection if the old space has no room: FROM_SPACE
+  and ALLOC become OLD_ALLOC and FROM_SPACE_END becomes OLD_SPACE_END. The nursery is empty after the collection, so the
+  objects allocated in this window cannot refer to it, and later stores in them pass the write barrier, as for any old
+  block. LIMIT is set to FROM_SPACE, so the next safepoint closes the window (see close_old_space_window).
   */
-  code.add(asmcode::LABEL, simple_block);
-  code.add(asmcode::INC, asmcode::RCX);
-  code.add(asmcode::SHL, asmcode::RCX, asmcode::NUMBER, 3);
-  code.add(asmcode::ADD, asmcode::RSI, asmcode::RCX);
-  code.add(asmcode::JMP, cmp_rsi_rdi_loop);
-  code.add(asmcode::LABEL, closure_block);
-  code.add(asmcode::ADD, asmcode::RSI, asmcode::NUMBER, CELLS(1)); // skip label address of closure
-  code.add(asmcode::DEC, asmcode::RCX);
-  // now treat closure as complicated block
-  code.add(asmcode::LABEL, complicated_block);
-  code.add(asmcode::MOV, asmcode::RAX, asmcode::RSI);
-  code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, CELLS(1));
-  auto complicated_block_loop = label_to_string(label++);
-  auto complicated_block_done = label_to_string(label++);
-  code.add(asmcode::LABEL, complicated_block_loop);
-  code.add(asmcode::TEST, asmcode::RCX, asmcode::RCX);
-  code.add(asmcode::JES, complicated_block_done);
-  code.add(asmcode::CALL, "L_mark");
-  code.add(asmcode::ADD, asmcode::RAX, asmcode::NUMBER, CELLS(1));
-  code.add(asmcode::DEC, asmcode::RCX);
-  code.add(asmcode::JMPS, complicated_block_loop);
-  code.add(asmcode::LABEL, complicated_block_done);
-  code.add(asmcode::MOV, asmcode::RSI, asmcode::RAX);
-  code.add(asmcode::JMP, cmp_rsi_rdi_loop);
-  code.add(asmcode::LABEL, rsi_equals_rdi);
-
-  // swap spaces
-  code.add(asmcode::MOV, asmcode::RDX, FROM_SPACE);
-  code.add(asmcode::MOV, asmcode::RAX, TO_SPACE);
-  code.add(asmcode::MOV, FROM_SPACE, asmcode::RAX);
-  code.add(asmcode::MOV, TO_SPACE, asmcode::RDX);
-  code.add(asmcode::MOV, asmcode::RDX, FROM_SPACE_END);
-  code.add(asmcode::MOV, asmcode::RAX, TO_SPACE_END);
-  code.add(asmcode::MOV, FROM_SPACE_END, asmcode::RAX);
-  code.add(asmcode::MOV, TO_SPACE_END, asmcode::RDX);
-
-  code.add(asmcode::MOV, ALLOC, asmcode::RSI);
-  code.add(asmcode::MOV, asmcode::RAX, FROM_SPACE_END);
-  code.add(asmcode::MOV, asmcode::R11, FROMSPACE_RESERVE);
-  code.add(asmcode::SHL, asmcode::R11, asmcode::NUMBER, 3);
-  code.add(asmcode::SUB, asmcode::RAX, asmcode::R11);
-  code.add(asmcode::MOV, LIMIT, asmcode::RAX);
+  void open_old_space_window(asmcode& code, const compiler_options& ops)
+    {
+    auto fits = label_to_string(label++);
+    auto open = label_to_string(label++);
+    code.add(asmcode::MOV, asmcode::RAX, HEAP_REQUEST);
+    code.add(asmcode::ADD, asmcode::RAX, ALLOC);
+    code.add(asmcode::CMP, asmcode::RAX, FROM_SPACE_END);
+    code.add(asmcode::JL, fits);
+
+    // the request and the reserve for the allocations up to the next safepoint should fit the old space
+    code.add(asmcode::MOV, asmcode::R11, FROMSPACE_RESERVE);
+    code.add(asmcode::SHL, asmcode::R11, asmcode::NUMBER, 3);
+    code.add(asmcode::ADD, asmcode::R11, HEAP_REQUEST);
+    code.add(asmcode::ADD, asmcode::R11, OLD_ALLOC);
+    code.add(asmcode::CMP, asmcode::R11, OLD_SPACE_END);
+    code.add(asmcode::JL, open);
+    collect_generational_major(code, ops);
+    code.add(asmcode::MOV, asmcode::R11, FROMSPACE_RESERVE);
+    code.add(asmcode::SHL, asmcode::R11, asmcode::NUMBER, 3);
+    code.add(asmcode::ADD, asmcode::R11, HEAP_REQUEST);
+    code.add(asmcode::ADD, asmcode::R11, OLD_ALLOC);
+    code.add(asmcode::CMP, asmcode::R11, OLD_SPACE_END);
+    code.add(asmcode::JGE, fits); // no room, the allocation fails
+
+    code.add(asmcode::LABEL, open);
+    code.add(asmcode::MOV, asmcode::RAX, OLD_ALLOC);
+    code.add(asmcode::MOV, FROM_SPACE, asmcode::RAX);
+    code.add(asmcode::MOV, LIMIT, asmcode::RAX);
+    code.add(asmcode::MOV, ALLOC, asmcode::RAX);
+    code.add(asmcode::MOV, asmcode::RAX, OLD_SPACE_END);
+    code.add(asmcode::MOV, FROM_SPACE_END, asmcode::RAX);
+    code.add(asmcode::LABEL, fits);
+    }
+
+  void compile_reclaim_garbage_generational(asmcode& code, const compiler_options& ops)
+    {
+    auto no_heap = label_to_string(label++);
+
+    code.add(asmcode::CMP, ALLOC, FROM_SPACE_END);
+    code.add(asmcode::JG, no_heap);
+
+    code.add(asmcode::PUSH, asmcode::RBX);
+
+    save_registers_for_gc(code);
+    call_from_gc(code, (uint64_t)&gc_collection_started);
+    sample_heap_before_gc(code, ops);
+
+    collect_generational(code, ops);
+
+    call_from_gc(code, (uint64_t)&gc_collection_finished);
+    restore_registers_after_gc(code);
+    code.add(asmcode::POP, asmcode::RBX); // continue value
+
+    code.add(asmcode::MOV, PROCEDURE_ALLOC_MARK, ALLOC);
+    code.add(asmcode::CMP, ALLOC, FROM_SPACE_END);
+    code.add(asmcode::JGS, no_heap);
+
+    code.add(asmcode::JMP, CONTINUE);
+
+    error_label(code, no_heap, re_heap_full);
+    }
 
-  code.add(asmcode::MOV, asmcode::RAX, GC_SAVE);
-  code.add(asmcode::MOV, asmcode::RCX, asmcode::MEM_RAX);
-  code.add(asmcode::MOV, asmcode::RDX, asmcode::MEM_RAX, CELLS(1));
-  code.add(asmcode::MOV, asmcode::RSI, asmcode::MEM_RAX, CELLS(2));
-  code.add(asmcode::MOV, asmcode::RDI, asmcode::MEM_RAX, CELLS(3));
-  code.add(asmcode::MOV, asmcode::R8, asmcode::MEM_RAX, CELLS(4));
-  code.add(asmcode::MOV, asmcode::R9, asmcode::MEM_RAX, CELLS(5));
-  code.add(asmcode::MOV, asmcode::R12, asmcode::MEM_RAX, CELLS(6));
-  code.add(asmcode::MOV, asmcode::R14, asmcode::MEM_RAX, CELLS(7));
   /*
-  code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, unalloc_tag);
-  code.add(asmcode::MOV, asmcode::R15, TO_SPACE);
-  code.add(asmcode::MOV, asmcode::R11, TO_SPACE_END);
-  code.add(asmcode::SUB, asmcode::R11, TO_SPACE);
-  code.add(asmcode::SHR, asmcode::R11, asmcode::NUMBER, 3);
-  auto make_zero_loop = label_to_string(label++);
-  auto make_zero_done = label_to_string(label++);
-  code.add(asmcode::LABEL, make_zero_loop);
-  code.add(asmcode::TEST, asmcode::R11, asmcode::R11);
-  code.add(asmcode::JES, make_zero_done);
-  code.add(asmcode::DEC, asmcode::R11);
-  code.add(asmcode::MOV, asmcode::MEM_R15, asmcode::RAX);
-  code.add(asmcode::ADD, asmcode::R15, asmcode::NUMBER, CELLS(1));
-  code.add(asmcode::JMPS, make_zero_loop);
-  code.add(asmcode::LABEL, make_zero_done);
+  The collection moves ALLOC, so the allocations of the running procedure are counted now, and both collectors reset
+  PROCEDURE_ALLOC_MARK when they are done (see compiler_options::procedure_counters). These allocations are also subtracted
+  from HEAP_SAMPLE_COUNTDOWN, the collectors sample them (see sample_heap_before_gc). Clobbers rax and r11.
   */
-  code.add(asmcode::POP, asmcode::RBX); // continue value
+  void count_allocations_before_gc(asmcode& code, const compiler_options& ops)
+    {
+    auto no_counters = label_to_string(label++);
+    code.add(asmcode::MOV, asmcode::RAX, PROCEDURE_COUNTERS);
+    code.add(asmcode::TEST, asmcode::RAX, asmcode::RAX);
+    code.add(asmcode::JES, no_counters);
+    count_procedure_allocations(code, asmcode::RAX, asmcode::R11);
+    if (ops.heap_profiling)
+      code.add(asmcode::SUB, HEAP_SAMPLE_COUNTDOWN, asmcode::R11);
+    code.add(asmcode::LABEL, no_counters);
+    }
 
-  code.add(asmcode::CMP, ALLOC, FROM_SPACE_END);
-  code.add(asmcode::JGS, no_heap);
+  } // namespace
 
-  code.add(asmcode::JMP, CONTINUE);
+void compile_reclaim_garbage(asmcode& code, const compiler_options& ops)
+  {
+  count_allocations_before_gc(code, ops);
+  if (ops.generational_gc)
+    compile_reclaim_garbage_generational(code, ops);
+  else
+    compile_reclaim_garbage_semispace(code, ops);
+  }
 
-  error_label(code, no_heap, re_heap_full);
+void compile_make_room(asmcode& code, const compiler_options& ops)
+  {
+  /*
+  Called by check_heap_or_make_room with the number of bytes that did not fit in rax. The semispace collector collects,
+  and grows the heap so that these bytes fit, within the heap_max_size of the context (see resize_heap). The generational
+  collector collects, and allocates the bytes in the old space if they do not fit the nursery (see open_old_space_window).
+  Keeps rax, r11 and rbx. Without compiler_options::garbage_collection nothing is done, and the allocation fails.
+  */
+  code.add(asmcode::LABEL, "L_make_room");
+  if (!ops.garbage_collection)
+    {
+    code.add(asmcode::RET);
+    return;
+    }
+  code.add(asmcode::MOV, HEAP_REQUEST, asmcode::RAX);
+  code.add(asmcode::PUSH, asmcode::R11);
+  count_allocations_before_gc(code, ops);
+  code.add(asmcode::PUSH, asmcode::RBX);
+  save_registers_for_gc(code);
+  call_from_gc(code, (uint64_t)&gc_collection_started);
+  sample_heap_before_gc(code, ops);
+  if (ops.generational_gc)
+    {
+    collect_generational(code, ops);
+    open_old_space_window(code, ops);
+    }
+  else
+    collect_semispace(code, ops);
+  call_from_gc(code, (uint64_t)&gc_collection_finished);
+  restore_registers_after_gc(code);
+  code.add(asmcode::POP, asmcode::RBX);
+  code.add(asmcode::POP, asmcode::R11);
+  code.add(asmcode::MOV, PROCEDURE_ALLOC_MARK, ALLOC);
+  code.add(asmcode::MOV, asmcode::RAX, HEAP_REQUEST);
+  code.add(asmcode::MOV, HEAP_REQUEST, asmcode::NUMBER, 0);
+  code.add(asmcode::RET);
   }
 
 void compile_structurally_equal(asmcode& code, const compiler_options&, const std::string& label_name)
@@ -8007,6 +8430,38 @@ void compile_current_milliseconds(ASM::asmcode& code, const compiler_options& /*
   code.add(asmcode::JMP, CONTINUE);
   }
 
+/*
+Returns the garbage collection statistics of the context as a vector of fixnums:
+#(collections full-collections bytes-copied bytes-reclaimed total-pause max-pause last-pause), pauses in nanoseconds.
+*/
+void compile_gc_stats(asmcode& code, const compiler_options& ops)
+  {
+  if (ops.safe_primitives)
+    {
+    code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, 8);
+    check_heap(code, re_vector_heap_overflow);
+    }
+  code.add(asmcode::MOV, asmcode::RAX, asmcode::NUMBER, make_block_header(7, T_VECTOR));
+  code.add(asmcode::MOV, MEM_ALLOC, asmcode::RAX);
+  auto store_as_fixnum = [&](uint64_t index, asmcode::operand field, uint64_t field_offset)
+    {
+    code.add(asmcode::MOV, asmcode::RAX, field, field_offset);
+    code.add(asmcode::SHL, asmcode::RAX, asmcode::NUMBER, 1);
+    code.add(asmcode::MOV, MEM_ALLOC, CELLS(index + 1), asmcode::RAX);
+    };
+  store_as_fixnum(0, GC_COLLECTIONS);
+  store_as_fixnum(1, GC_FULL_COLLECTIONS);
+  store_as_fixnum(2, GC_BYTES_COPIED);
+  store_as_fixnum(3, GC_BYTES_RECLAIMED);
+  store_as_fixnum(4, GC_TOTAL_PAUSE);
+  store_as_fixnum(5, GC_MAX_PAUSE);
+  store_as_fixnum(6, GC_LAST_PAUSE);
+  code.add(asmcode::MOV, asmcode::RAX, ALLOC);
+  code.add(asmcode::OR, asmcode::RAX, asmcode::NUMBER, block_tag);
+  code.add(asmcode::ADD, ALLOC, asmcode::NUMBER, CELLS(8));
+  code.add(asmcode::JMP, CONTINUE);
+  }
+
 void compile_getenv(asmcode& code, const compiler_options& ops)
   {
   std::string error;
@@ -19,6 +19,7 @@ void compile_file_exists(ASM::asmcode& code, const compiler_options& options);
 void compile_getenv(ASM::asmcode& code, const compiler_options& options);
 void compile_current_seconds(ASM::asmcode& code, const compiler_options& options);
 void compile_current_milliseconds(ASM::asmcode& code, const compiler_options& options);
+void compile_gc_stats(ASM::asmcode& code, const compiler_options& options);
 void compile_putenv(ASM::asmcode& code, const compiler_options& options);
 void compile_eval(ASM::asmcode& code, const compiler_options& options);
 void compile_load(ASM::asmcode& code, const compiler_options& options);
@@ -148,6 +149,7 @@ void compile_car(ASM::asmcode& code, const compiler_options& options);
 void compile_cdr(ASM::asmcode& code, const compiler_options& options);
 void compile_reclaim_garbage(ASM::asmcode& code, const compiler_options& options);
 void compile_reclaim(ASM::asmcode& code, const compiler_options& options);
+void compile_make_room(ASM::asmcode& code, const compiler_options& options);
 void compile_arithmetic_shift(ASM::asmcode& code, const compiler_options& options);
 void compile_quotient(ASM::asmcode& code, const compiler_options& options);
 void compile_remainder(ASM::asmcode& code, const compiler_options& options);
@@ -167,6 +169,7 @@ void compile_assoc_cmp_equal(ASM::asmcode& code, const compiler_options&);
 void compile_structurally_equal(ASM::asmcode& code, const compiler_options&, const std::string& label_name);
 void compile_recursively_equal(ASM::asmcode& code, const compiler_options&, const std::string& label_name);
 void compile_mark(ASM::asmcode& code, const compiler_options&);
+void compile_write_barrier(ASM::asmcode& code, const compiler_options& ops);
 void compile_not_equal_2(ASM::asmcode& code, const compiler_options& ops);
 void compile_equal_2(ASM::asmcode& code, const compiler_options& options);
 void compile_less_2(ASM::asmcode& code, const compiler_options& options);
@@ -7,10 +7,36 @@
 #include "types.h"
 #include "compile_error.h"
 
+#include <asm/peephole.h>
+
+#include <algorithm>
 #include <sstream>
 
 SKIWI_BEGIN
 
+namespace
+  {
+  /*
+  Names the code of each primitive and helper routine after its label. Labels made by label_to_string are local jump
+  targets inside a routine, so they are skipped.
+  */
+  void add_primitive_symbols(ASM::asmcode& code)
+    {
+    for (const auto& block : code.get_instructions_list())
+      {
+      for (const auto& ins : block)
+        {
+        if (ins.oper != ASM::asmcode::LABEL && ins.oper != ASM::asmcode::LABEL_ALIGNED && ins.oper != ASM::asmcode::GLOBAL)
+          continue;
+        const std::string name = code.get_text(ins.text);
+        if (name.size() > 2 && name[0] == 'L' && name[1] == '_' && std::all_of(name.begin() + 2, name.end(), [](char ch) { return ch >= '0' && ch <= '9'; }))
+          continue;
+        code.add_symbol(name, name);
+        }
+      }
+    }
+  }
+
 void compile_primitives_library(primitive_map& pm, repl_data& rd, environment_map& env, context& ctxt, ASM::asmcode& code, const compiler_options& options)
   {
   //std::shared_ptr<environment<alpha_conversion_data>> new_alpha = std::make_shared<environment<alpha_conversion_data>>(rd.alpha_conversion_env);
@@ -103,6 +129,8 @@ void compile_primitives_library(primitive_map& pm, repl_data& rd, environment_ma
   compile_fold_binary(code, options);
   compile_pairwise_compare(code, options);
   compile_mark(code, options);
+  compile_make_room(code, options);
+  compile_write_barrier(code, options);
   compile_recursively_equal(code, options, "L_recursively_equal");
   compile_structurally_equal(code, options, "L_structurally_equal");
   compile_member_cmp_eqv(code, options);
@@ -114,17 +142,22 @@ void compile_primitives_library(primitive_map& pm, repl_data& rd, environment_ma
   compile_apply_fake_cps_identity(code, options);
   code.pop();
 
+  add_primitive_symbols(code);
+
+  if (options.do_peephole_optimization)
+    ASM::peephole_optimize(code);
+
   //rd.alpha_conversion_env = new_alpha;
   }
 
-void assign_primitive_addresses(primitive_map& pm, const ASM::first_pass_data& d, uint64_t address_start)
+void assign_primitive_addresses(primitive_map& pm, const ASM::first_pass_data& d, const ASM::asmcode& code, uint64_t address_start)
   {
   for (auto& pe : pm)
     {
-    auto it = d.label_to_address.find(pe.second.label_name);
-    if (it == d.label_to_address.end())
+    uint64_t address;
+    if (!ASM::find_label_address(address, d, code, pe.second.label_name))
       throw std::runtime_error("Error during primitives library generation");
-    pe.second.address = address_start + it->second;
+    pe.second.address = address_start + address;
     }
   }
 
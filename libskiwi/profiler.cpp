@@ -0,0 +1,245 @@
+#include "profiler.h"
+
+#include <asm/jit_symbols.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+
+#if defined(__linux__) && defined(__x86_64__)
+#define SKIWI_PROFILER_SUPPORTED
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#endif
+
+SKIWI_BEGIN
+
+namespace
+  {
+  struct profile_sample
+    {
+    uint64_t ip;
+    uint64_t cont; // the CONTINUE register
+    };
+
+  const uint64_t sample_capacity = 256 * 1024;
+
+  profile_sample* sample_buffer = nullptr;
+  std::atomic<uint64_t> sample_count(0);
+  bool running = false;
+  uint64_t running_interval = 0;
+  bool symbol_table_was_enabled = false;
+
+  template <class T>
+  std::vector<T> sorted_by_samples(const std::map<std::string, T>& m)
+    {
+    std::vector<T> v;
+    for (const auto& item : m)
+      v.push_back(item.second);
+    std::stable_sort(v.begin(), v.end(), [](const T& left, const T& right)
+      {
+      return left.samples > right.samples;
+      });
+    return v;
+    }
+
+#ifdef SKIWI_PROFILER_SUPPORTED
+  struct sigaction previous_action;
+
+  /*
+  Only touches the preallocated sample buffer, so that it is async-signal-safe.
+  */
+  void profiler_signal_handler(int, siginfo_t*, void* uc)
+    {
+    const ucontext_t* context = (const ucontext_t*)uc;
+    const uint64_t index = sample_count.fetch_add(1, std::memory_order_relaxed);
+    if (index < sample_capacity)
+      {
+      sample_buffer[index].ip = (uint64_t)context->uc_mcontext.gregs[REG_RIP];
+      sample_buffer[index].cont = (uint64_t)context->uc_mcontext.gregs[REG_RBX];
+      }
+    }
+
+  std::string native_name(uint64_t ip)
+    {
+    Dl_info info;
+    if (!dladdr((void*)ip, &info))
+      return "[native code]";
+    if (!info.dli_sname)
+      {
+      std::string module = info.dli_fname ? info.dli_fname : "";
+      return "[native code in " + module.substr(module.find_last_of('/') + 1) + "]";
+      }
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    std::string name = (status == 0 && demangled) ? demangled : info.dli_sname;
+    free(demangled);
+    return "[native] " + name;
+    }
+#endif
+  }
+
+bool profiler_is_supported()
+  {
+#ifdef SKIWI_PROFILER_SUPPORTED
+  return true;
+#else
+  return false;
+#endif
+  }
+
+bool profiler_is_running()
+  {
+  return running;
+  }
+
+void start_profiler(uint64_t interval_microseconds)
+  {
+#ifdef SKIWI_PROFILER_SUPPORTED
+  if (running)
+    throw std::runtime_error("The profiler is already running");
+  if (!sample_buffer)
+    sample_buffer = new profile_sample[sample_capacity];
+  if (interval_microseconds == 0)
+    interval_microseconds = 1;
+  sample_count = 0;
+  symbol_table_was_enabled = ASM::is_jit_symbol_table_enabled();
+  ASM::set_jit_symbol_table_enabled(true); // names the code that is compiled while the profiler runs
+  struct sigaction action;
+  action.sa_sigaction = &profiler_signal_handler;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  if (sigaction(SIGPROF, &action, &previous_action) != 0)
+    {
+    ASM::set_jit_symbol_table_enabled(symbol_table_was_enabled);
+    throw std::runtime_error("The profiler could not install its signal handler");
+    }
+  struct itimerval timer;
+  timer.it_interval.tv_sec = (time_t)(interval_microseconds / 1000000);
+  timer.it_interval.tv_usec = (suseconds_t)(interval_microseconds % 1000000);
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0)
+    {
+    sigaction(SIGPROF, &previous_action, nullptr);
+    ASM::set_jit_symbol_table_enabled(symbol_table_was_enabled);
+    throw std::runtime_error("The profiler could not start its timer");
+    }
+  running = true;
+  running_interval = interval_microseconds;
+#else
+  (void)interval_microseconds;
+  throw std::runtime_error("The profiler is not supported on this platform");
+#endif
+  }
+
+profile stop_profiler(const void* primitives_address)
+  {
+  profile p;
+  p.interval_microseconds = running_interval;
+  p.samples = 0;
+  p.dropped_samples = 0;
+#ifdef SKIWI_PROFILER_SUPPORTED
+  if (!running)
+    return p;
+  struct itimerval timer = {};
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  /*
+  A signal of the timer that is still pending would reach the previous disposition, which terminates the process if that
+  is SIG_DFL. So SIGPROF is blocked, a pending one is taken while our handler is still installed, and only then is the
+  previous disposition restored.
+  */
+  sigset_t prof_set, old_set;
+  sigemptyset(&prof_set);
+  sigaddset(&prof_set, SIGPROF);
+  pthread_sigmask(SIG_BLOCK, &prof_set, &old_set);
+  struct timespec no_wait = {};
+  while (sigtimedwait(&prof_set, nullptr, &no_wait) == SIGPROF)
+    ;
+  sigaction(SIGPROF, &previous_action, nullptr);
+  pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+  running = false;
+
+  const uint64_t count = sample_count.load();
+  p.samples = std::min(count, sample_capacity);
+  p.dropped_samples = count - p.samples;
+
+  std::map<std::string, profile_entry> entries;
+  std::map<std::string, profile_call_site> call_sites;
+  for (uint64_t i = 0; i < p.samples; ++i)
+    {
+    const profile_sample& s = sample_buffer[i];
+    std::string name;
+    uint64_t code_address;
+    bool in_primitives = false;
+    if (ASM::find_jit_symbol(name, code_address, s.ip))
+      in_primitives = code_address == (uint64_t)primitives_address;
+    else
+      name = native_name(s.ip);
+    profile_entry& e = entries[name];
+    e.name = name;
+    ++e.samples;
+    if (in_primitives)
+      {
+      std::string caller;
+      uint64_t caller_address;
+      if (!ASM::find_jit_symbol(caller, caller_address, s.cont))
+        caller = "[unknown]";
+      if (caller == name)
+        continue;
+      profile_call_site& cs = call_sites[name + '\n' + caller];
+      cs.callee = name;
+      cs.caller = caller;
+      ++cs.samples;
+      }
+    }
+  p.entries = sorted_by_samples(entries);
+  p.call_sites = sorted_by_samples(call_sites);
+  ASM::set_jit_symbol_table_enabled(symbol_table_was_enabled);
+#else
+  (void)primitives_address;
+#endif
+  return p;
+  }
+
+void print_profile(std::ostream& out, const profile& p, uint64_t max_entries)
+  {
+  std::stringstream str; // keeps the formatting flags of out as they are
+  str << p.samples << " samples, one every " << p.interval_microseconds << " microseconds of cpu time";
+  if (p.dropped_samples)
+    str << " (" << p.dropped_samples << " samples dropped)";
+  str << "\n";
+  auto percentage = [&](uint64_t samples)
+    {
+    return 100.0 * (double)samples / (double)p.samples;
+    };
+  str << std::fixed << std::setprecision(1);
+  if (!p.entries.empty())
+    {
+    str << "\n   samples       %  procedure\n";
+    for (uint64_t i = 0; i < p.entries.size() && i < max_entries; ++i)
+      {
+      const profile_entry& e = p.entries[i];
+      str << std::setw(10) << e.samples << std::setw(7) << percentage(e.samples) << "%  " << e.name << "\n";
+      }
+    }
+  if (!p.call_sites.empty())
+    {
+    str << "\n   samples       %  primitive <- call site\n";
+    for (uint64_t i = 0; i < p.call_sites.size() && i < max_entries; ++i)
+      {
+      const profile_call_site& cs = p.call_sites[i];
+      str << std::setw(10) << cs.samples << std::setw(7) << percentage(cs.samples) << "%  " << cs.callee << " <- " << cs.caller << "\n";
+      }
+    }
+  out << str.str();
+  }
+
+SKIWI_END
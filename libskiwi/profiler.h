@@ -0,0 +1,66 @@
+#pragma once
+
+#include "namespace.h"
+#include "libskiwi_api.h"
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+#include <vector>
+
+SKIWI_BEGIN
+
+/*
+A sampling profiler for compiled scheme code. While it runs, a SIGPROF timer interrupts the process every interval of cpu
+time, and the signal handler stores the instruction pointer and the CONTINUE register of the interrupted code. When the
+profiler stops, each sample is named after the symbol of the assembled code that contains it (see asm/jit_symbols.h), or
+after the native function that contains it. Code is only named if its symbols were registered (see asm/jit_symbols.h):
+the profiler registers the code that is compiled while it runs, code compiled before that only has a name if the symbol
+table, the perf map or gdb was enabled at the time.
+
+The code of a primitive is shared by all its callers. Primitives return to their caller by jumping to CONTINUE, so the
+samples in a primitive are also split up by the code that CONTINUE points to: the call sites.
+
+The profiler is only available on linux for x64.
+*/
+
+struct profile_entry
+  {
+  std::string name;
+  uint64_t samples;
+  };
+
+struct profile_call_site
+  {
+  std::string callee; // the primitive
+  std::string caller; // the code that the primitive returns to
+  uint64_t samples;
+  };
+
+struct profile
+  {
+  uint64_t interval_microseconds;
+  uint64_t samples;
+  uint64_t dropped_samples; // samples that did not fit in the sample buffer
+  std::vector<profile_entry> entries; // sorted by decreasing number of samples
+  std::vector<profile_call_site> call_sites; // sorted by decreasing number of samples
+  };
+
+SKIWI_SCHEME_API bool profiler_is_supported();
+
+SKIWI_SCHEME_API bool profiler_is_running();
+
+/*
+Throws a std::runtime_error if the profiler is already running or not supported on this platform.
+*/
+SKIWI_SCHEME_API void start_profiler(uint64_t interval_microseconds);
+
+/*
+Stops the profiler and names its samples. The primitives library is the assembled function that starts at
+primitives_address, the samples in there are also split up per call site.
+*/
+SKIWI_SCHEME_API profile stop_profiler(const void* primitives_address);
+
+SKIWI_SCHEME_API void print_profile(std::ostream& out, const profile& p, uint64_t max_entries = 30);
+
+SKIWI_END
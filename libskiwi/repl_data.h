@@ -7,6 +7,7 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <vector>
 #include "alpha_conversion.h"
 #include "reader.h"
 
@@ -20,6 +21,7 @@ struct repl_data
   uint64_t alpha_conversion_index;
   std::map<std::string, uint64_t> quote_to_index;
   uint64_t global_index;
+  std::vector<std::string> procedure_names; // names of the procedures in context::procedure_counters, the first one is the top level code
   };
 
 SKIWI_SCHEME_API repl_data make_deep_copy(const repl_data& rd);
@@ -1,6 +1,7 @@
 #include "simplify_to_core.h"
 #include "compile_error.h"
 #include "visitor.h"
+#include "concurrency.h"
 #include <cassert>
 #include <sstream>
 
@@ -523,4 +524,21 @@ void simplify_to_core_forms(Program& prog)
   prog.simplified_to_core_forms = true;
   }
 
+void simplify_to_core_forms(Program& prog, const compiler_options& ops)
+  {
+  if (prog.expressions.size() != 1 || !std::holds_alternative<Begin>(prog.expressions.front()))
+    {
+    simplify_to_core_forms(prog);
+    return;
+    }
+  Begin& beg = std::get<Begin>(prog.expressions.front());
+  parallel_for(size_t(0), beg.arguments.size(), [&](size_t i)
+    {
+    simplify_to_core_visitor stcv;
+    stcv.letrec_index = 0; // the #%t names are let bindings, so they only need to be unique within a top-level form
+    visitor<Expression, simplify_to_core_visitor>::visit(beg.arguments[i], &stcv);
+    }, ops);
+  prog.simplified_to_core_forms = true;
+  }
+
 SKIWI_END
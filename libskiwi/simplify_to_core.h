@@ -7,6 +7,9 @@
 
 SKIWI_BEGIN
 
+struct compiler_options;
+
 SKIWI_SCHEME_API void simplify_to_core_forms(Program& prog);
+SKIWI_SCHEME_API void simplify_to_core_forms(Program& prog, const compiler_options& ops);
 
 SKIWI_END
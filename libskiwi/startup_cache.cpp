@@ -0,0 +1,805 @@
+#include "startup_cache.h"
+
+#include <asm/assembler.h>
+#include <asm/code_heap.h>
+#include <asm/jit_symbols.h>
+
+#include "file_utils.h"
+#include "types.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <link.h>
+#endif
+
+SKIWI_BEGIN
+
+namespace
+  {
+  const uint64_t startup_cache_magic = 0x45474d4957494b53; // "SKIWIMGE"
+  const uint64_t startup_cache_version = 6;
+
+  const char* startup_libraries[] = { "core/symbol-table.scm", "core/apply.scm", "core/callcc.scm", "core/r5rs.scm", "core/modules.scm" };
+
+  void hash_bytes(uint64_t& h, const void* data, size_t size)
+    {
+    // FNV-1a
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i)
+      {
+      h ^= (uint64_t)p[i];
+      h *= 0x100000001b3;
+      }
+    }
+
+  void hash_value(uint64_t& h, uint64_t value)
+    {
+    hash_bytes(h, &value, sizeof(uint64_t));
+    }
+
+  void hash_file(uint64_t& h, const std::string& filepath)
+    {
+#ifdef _WIN32
+    std::ifstream f{ convert_string_to_wstring(filepath) };
+#else
+    std::ifstream f{ filepath };
+#endif
+    std::stringstream ss;
+    if (f.is_open())
+      ss << f.rdbuf();
+    std::string content = ss.str();
+    hash_value(h, content.size());
+    hash_bytes(h, content.data(), content.size());
+    }
+
+  uint64_t hash_file(const std::string& filepath)
+    {
+    uint64_t h = 0xcbf29ce484222325;
+    hash_file(h, filepath);
+    return h;
+    }
+
+  void hash_options(uint64_t& h, const compiler_options& ops)
+    {
+    hash_value(h, ops.do_handle_include);
+    hash_value(h, ops.do_alpha_conversion);
+    hash_value(h, ops.do_assignable_variables_conversion);
+    hash_value(h, ops.do_lambda_to_let_conversion);
+    hash_value(h, ops.do_define_conversion);
+    hash_value(h, ops.do_closure_conversion);
+    hash_value(h, ops.do_cinput_conversion);
+    hash_value(h, ops.do_cps_conversion);
+    hash_value(h, ops.do_free_variables_analysis);
+    hash_value(h, ops.do_linear_scan);
+    hash_value(h, ops.do_linear_scan_indices_computation);
+    hash_value(h, ops.do_simplify_to_core_forms);
+    hash_value(h, ops.do_single_begin_conversion);
+    hash_value(h, ops.do_tail_call_analysis);
+    hash_value(h, ops.do_global_define_env_allocation);
+    hash_value(h, ops.do_collect_quotes);
+    hash_value(h, ops.do_quote_conversion);
+    hash_value(h, ops.do_quasiquote_conversion);
+    hash_value(h, ops.do_remove_single_begins);
+    hash_value(h, (uint64_t)ops.lsa_algo);
+    hash_value(h, ops.primitives_inlined);
+    hash_value(h, ops.do_constant_folding);
+    hash_value(h, ops.do_constant_propagation);
+    hash_value(h, ops.do_expand_macros);
+    hash_value(h, ops.do_peephole_optimization);
+    hash_value(h, ops.standard_bindings);
+    hash_value(h, ops.safe_primitives);
+    hash_value(h, ops.safe_cons);
+    hash_value(h, ops.safe_flonums);
+    hash_value(h, ops.safe_promises);
+    hash_value(h, ops.garbage_collection);
+    hash_value(h, ops.generational_gc);
+    hash_value(h, ops.fast_expression_targetting);
+    hash_value(h, ops.keep_variable_stack);
+    hash_value(h, ops.procedure_counters);
+    hash_value(h, ops.heap_profiling);
+    }
+
+  /*
+  A shared object (or the executable) that is loaded in this process. Assembled code contains absolute addresses of
+  C functions, so we need to know in which module they live to be able to relocate them.
+  */
+  struct loaded_module
+    {
+    std::string name;
+    uint64_t base;
+    uint64_t begin, end;
+    uint64_t file_size;
+    uint64_t file_time;
+    };
+
+  bool get_file_identity(uint64_t& file_size, uint64_t& file_time, const std::string& module_name)
+    {
+    std::string path = module_name.empty() ? get_executable_path() : module_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+      return false;
+    file_size = (uint64_t)st.st_size;
+    file_time = (uint64_t)st.st_mtime;
+    return true;
+    }
+
+#ifndef _WIN32
+  int add_loaded_module(struct dl_phdr_info* info, size_t, void* data)
+    {
+    std::vector<loaded_module>* modules = (std::vector<loaded_module>*)data;
+    loaded_module m;
+    m.name = info->dlpi_name ? std::string(info->dlpi_name) : std::string();
+    m.base = (uint64_t)info->dlpi_addr;
+    m.begin = (uint64_t)-1;
+    m.end = 0;
+    for (int i = 0; i < info->dlpi_phnum; ++i)
+      {
+      if (info->dlpi_phdr[i].p_type != PT_LOAD)
+        continue;
+      uint64_t seg_begin = m.base + (uint64_t)info->dlpi_phdr[i].p_vaddr;
+      uint64_t seg_end = seg_begin + (uint64_t)info->dlpi_phdr[i].p_memsz;
+      if (seg_begin < m.begin)
+        m.begin = seg_begin;
+      if (seg_end > m.end)
+        m.end = seg_end;
+      }
+    if (m.begin < m.end && get_file_identity(m.file_size, m.file_time, m.name))
+      modules->push_back(m);
+    return 0;
+    }
+#endif
+
+  std::vector<loaded_module> get_loaded_modules()
+    {
+    std::vector<loaded_module> modules;
+#ifndef _WIN32
+    dl_iterate_phdr(&add_loaded_module, &modules);
+#endif
+    return modules;
+    }
+
+  int64_t find_module(const std::vector<loaded_module>& modules, uint64_t address)
+    {
+    for (size_t i = 0; i < modules.size(); ++i)
+      {
+      if (address >= modules[i].begin && address < modules[i].end)
+        return (int64_t)i;
+      }
+    return -1;
+    }
+
+  int64_t find_unit(const std::vector<startup_code_unit>& units, uint64_t address)
+    {
+    for (size_t i = 0; i < units.size(); ++i)
+      {
+      uint64_t base = (uint64_t)units[i].address;
+      if (address >= base && address < base + units[i].size)
+        return (int64_t)i;
+      }
+    return -1;
+    }
+
+  /*
+  Runs over all objects in the heap between begin and end. tagged_value is called for each slot that contains a scheme value,
+  code_address is called for the first slot of each closure. Returns false if the heap contains an unknown block.
+  */
+  template <class TTaggedValue, class TCodeAddress>
+  bool walk_heap(uint64_t* begin, uint64_t* end, TTaggedValue tagged_value, TCodeAddress code_address)
+    {
+    uint64_t* ptr = begin;
+    while (ptr < end)
+      {
+      uint64_t header = *ptr;
+      uint64_t size = get_block_size(header);
+      if (ptr + size + 1 > end)
+        return false;
+      uint64_t type = (header >> block_shift) & block_header_mask;
+      switch (type)
+        {
+        case flonum_tag:
+        case string_tag:
+        case symbol_tag:
+          break;
+        case closure_tag:
+          if (size == 0 || !code_address(ptr[1]))
+            return false;
+          for (uint64_t i = 2; i <= size; ++i)
+            {
+            if (!tagged_value(ptr[i]))
+              return false;
+            }
+          break;
+        case pair_tag:
+        case vector_tag:
+        case port_tag:
+        case promise_tag:
+          for (uint64_t i = 1; i <= size; ++i)
+            {
+            if (!tagged_value(ptr[i]))
+              return false;
+            }
+          break;
+        default:
+          return false;
+        }
+      ptr += size + 1;
+      }
+    return true;
+    }
+
+  void write_uint64(std::ostream& str, uint64_t value)
+    {
+    str.write((const char*)&value, sizeof(uint64_t));
+    }
+
+  void write_string(std::ostream& str, const std::string& s)
+    {
+    write_uint64(str, s.size());
+    str.write(s.data(), s.size());
+    }
+
+  void write_words(std::ostream& str, const uint64_t* words, uint64_t size)
+    {
+    write_uint64(str, size);
+    str.write((const char*)words, size * sizeof(uint64_t));
+    }
+
+  uint64_t read_uint64(std::istream& str)
+    {
+    uint64_t value = 0;
+    str.read((char*)&value, sizeof(uint64_t));
+    return value;
+    }
+
+  std::string read_string(std::istream& str)
+    {
+    uint64_t size = read_uint64(str);
+    if (!str || size > (1 << 20))
+      {
+      str.setstate(std::ios::failbit);
+      return std::string();
+      }
+    std::string s(size, ' ');
+    str.read(&s[0], size);
+    return s;
+    }
+
+  std::vector<uint64_t> read_words(std::istream& str)
+    {
+    uint64_t size = read_uint64(str);
+    if (!str || size > ((uint64_t)1 << 32))
+      {
+      str.setstate(std::ios::failbit);
+      return std::vector<uint64_t>();
+      }
+    std::vector<uint64_t> words(size);
+    str.read((char*)words.data(), size * sizeof(uint64_t));
+    return words;
+    }
+
+  enum relocation_target
+    {
+    rt_unit,
+    rt_module
+    };
+
+  struct relocation
+    {
+    uint64_t offset; // offset of the 64-bit immediate in the code unit
+    uint64_t target; // relocation_target
+    uint64_t index; // index of the unit or module
+    uint64_t target_offset; // offset of the address with respect to the base of the unit or module
+    };
+
+  /*
+  Maps scheme values and code addresses from the process that wrote the cache to the current process.
+  */
+  struct address_map
+    {
+    uint64_t old_heap_begin, old_heap_end, new_heap_begin;
+    std::vector<uint64_t> old_unit_base, unit_size, new_unit_base;
+
+    bool map_code_address(uint64_t& address) const
+      {
+      for (size_t i = 0; i < old_unit_base.size(); ++i)
+        {
+        if (address >= old_unit_base[i] && address < old_unit_base[i] + unit_size[i])
+          {
+          address = address - old_unit_base[i] + new_unit_base[i];
+          return true;
+          }
+        }
+      return false;
+      }
+
+    bool map_tagged_value(uint64_t& value) const
+      {
+      if ((value & block_mask) == block_tag)
+        {
+        uint64_t address = value & 0xFFFFFFFFFFFFFFF8;
+        if (address < old_heap_begin || address >= old_heap_end)
+          return false;
+        value = value - old_heap_begin + new_heap_begin;
+        return true;
+        }
+      if ((value & procedure_mask) == procedure_tag)
+        {
+        uint64_t address = value & 0xFFFFFFFFFFFFFFF8;
+        if (!map_code_address(address))
+          return false;
+        value = address | procedure_tag;
+        return true;
+        }
+      return true;
+      }
+    };
+
+  template <class TEntry, class TWrite>
+  void write_environment(std::ostream& str, const std::shared_ptr<environment<TEntry>>& env, TWrite write_entry)
+    {
+    auto env_copy = make_deep_copy(env);
+    env_copy->rollup();
+    write_uint64(str, (uint64_t)std::distance(env_copy->begin(), env_copy->end()));
+    for (auto it = env_copy->begin(); it != env_copy->end(); ++it)
+      {
+      write_string(str, it->first);
+      write_entry(it->second);
+      }
+    }
+
+  template <class TEntry, class TRead>
+  std::shared_ptr<environment<TEntry>> read_environment(std::istream& str, TRead read_entry)
+    {
+    auto env = std::make_shared<environment<TEntry>>(nullptr);
+    uint64_t size = read_uint64(str);
+    for (uint64_t i = 0; i < size && str; ++i)
+      {
+      std::string name = read_string(str);
+      env->push(name, read_entry());
+      }
+    return env;
+    }
+  }
+
+uint64_t make_startup_cache_key(const compiler_options& ops, const context& ctxt)
+  {
+  uint64_t h = 0xcbf29ce484222325;
+  hash_value(h, startup_cache_version);
+  hash_value(h, sizeof(context));
+  hash_value(h, (uint64_t)(ctxt.globals_end - ctxt.globals));
+  hash_value(h, ctxt.number_of_locals);
+  hash_options(h, ops);
+  hash_value(h, ASM::jit_symbols_wanted()); // the cached code only has symbols if they were made
+  std::string modulepath = get_folder(get_executable_path()) + std::string("scm/");
+  for (const char* lib : startup_libraries)
+    hash_file(h, modulepath + std::string(lib));
+  return h;
+  }
+
+bool save_startup_cache(const std::string& filename, uint64_t key, const std::vector<startup_code_unit>& units, const std::vector<std::string>& loaded_files, const primitive_map& pm, const environment_map& env, const repl_data& rd, const macro_data& md, const context& ctxt)
+  {
+#ifdef _WIN32
+  (void*)&filename; (void*)&key; (void*)&units; (void*)&loaded_files; (void*)&pm; (void*)&env; (void*)&rd; (void*)&md; (void*)&ctxt;
+  return false;
+#else
+  if (ctxt.nursery) // the heap of the generational collector is not a single range, which is what the cache stores
+    return false;
+  std::vector<loaded_module> modules = get_loaded_modules();
+  /*
+  The assembled code depends on the exact build of libskiwi, so we always record the module that contains this method.
+  */
+  std::vector<bool> module_used(modules.size(), false);
+  int64_t own_module = find_module(modules, (uint64_t)&save_startup_cache);
+  if (own_module < 0)
+    return false;
+  module_used[own_module] = true;
+
+  std::vector<std::vector<relocation>> relocations(units.size());
+  for (size_t u = 0; u < units.size(); ++u)
+    {
+    const uint8_t* code = (const uint8_t*)units[u].address;
+    for (uint64_t offset : units[u].imm64_offsets)
+      {
+      if (offset + 8 > units[u].size)
+        return false;
+      uint64_t value;
+      memcpy(&value, code + offset, sizeof(uint64_t));
+      relocation r;
+      r.offset = offset;
+      int64_t unit_index = find_unit(units, value);
+      int64_t module_index = unit_index < 0 ? find_module(modules, value) : -1;
+      if (unit_index >= 0)
+        {
+        r.target = rt_unit;
+        r.index = (uint64_t)unit_index;
+        r.target_offset = value - (uint64_t)units[unit_index].address;
+        }
+      else if (module_index >= 0)
+        {
+        r.target = rt_module;
+        r.index = (uint64_t)module_index;
+        r.target_offset = value - modules[module_index].base;
+        module_used[module_index] = true;
+        }
+      else
+        continue; // a constant
+      relocations[u].push_back(r);
+      }
+    }
+
+  /*
+  Check that the heap and the globals only refer to the heap or to the startup code.
+  */
+  address_map check;
+  check.old_heap_begin = (uint64_t)ctxt.from_space;
+  check.old_heap_end = (uint64_t)ctxt.alloc;
+  check.new_heap_begin = check.old_heap_begin;
+  for (const auto& unit : units)
+    {
+    check.old_unit_base.push_back((uint64_t)unit.address);
+    check.unit_size.push_back(unit.size);
+    check.new_unit_base.push_back((uint64_t)unit.address);
+    }
+  uint64_t heap_size = (uint64_t)(ctxt.alloc - ctxt.from_space);
+  std::vector<uint64_t> heap(ctxt.from_space, ctxt.alloc);
+  std::vector<uint64_t> globals(ctxt.globals, ctxt.globals + rd.global_index);
+  auto check_value = [&](uint64_t& v) { return check.map_tagged_value(v); };
+  auto check_code = [&](uint64_t& a) { return check.map_code_address(a); };
+  if (!walk_heap(heap.data(), heap.data() + heap_size, check_value, check_code))
+    return false;
+  for (auto& g : globals)
+    {
+    if (!check_value(g))
+      return false;
+    }
+
+  std::string temp_filename = filename + ".tmp";
+  std::ofstream f(temp_filename, std::ios::binary);
+  if (!f.is_open())
+    return false;
+
+  write_uint64(f, startup_cache_magic);
+  write_uint64(f, key);
+  write_uint64(f, loaded_files.size());
+  for (const auto& file : loaded_files)
+    {
+    write_string(f, file);
+    write_uint64(f, hash_file(file));
+    }
+
+  std::vector<uint64_t> module_index_in_file(modules.size(), (uint64_t)-1);
+  uint64_t nr_of_modules_used = 0;
+  for (size_t i = 0; i < modules.size(); ++i)
+    {
+    if (module_used[i])
+      module_index_in_file[i] = nr_of_modules_used++;
+    }
+  write_uint64(f, nr_of_modules_used);
+  for (size_t i = 0; i < modules.size(); ++i)
+    {
+    if (!module_used[i])
+      continue;
+    write_string(f, modules[i].name);
+    write_uint64(f, modules[i].file_size);
+    write_uint64(f, modules[i].file_time);
+    }
+
+  write_uint64(f, units.size());
+  for (size_t u = 0; u < units.size(); ++u)
+    {
+    write_uint64(f, (uint64_t)units[u].address);
+    write_uint64(f, units[u].size);
+    write_uint64(f, units[u].is_macro ? 1 : 0);
+    write_uint64(f, units[u].imm64_offsets.size());
+    for (uint64_t offset : units[u].imm64_offsets)
+      write_uint64(f, offset);
+    write_uint64(f, relocations[u].size());
+    for (const auto& r : relocations[u])
+      {
+      write_uint64(f, r.offset);
+      write_uint64(f, r.target);
+      write_uint64(f, r.target == rt_module ? module_index_in_file[r.index] : r.index);
+      write_uint64(f, r.target_offset);
+      }
+    std::vector<ASM::jit_symbol> symbols = ASM::get_jit_symbols(units[u].address);
+    write_uint64(f, symbols.size());
+    for (const auto& sym : symbols)
+      {
+      write_string(f, sym.name);
+      write_uint64(f, sym.offset);
+      write_uint64(f, sym.size);
+      }
+    f.write((const char*)units[u].address, units[u].size);
+    }
+
+  write_uint64(f, pm.size());
+  for (const auto& p : pm)
+    {
+    write_string(f, p.first);
+    write_string(f, p.second.label_name);
+    int64_t unit_index = find_unit(units, p.second.address);
+    write_uint64(f, (uint64_t)unit_index);
+    write_uint64(f, unit_index < 0 ? p.second.address : p.second.address - (uint64_t)units[unit_index].address);
+    }
+
+  write_environment(f, env, [&](const environment_entry& e)
+    {
+    write_uint64(f, (uint64_t)e.st);
+    write_uint64(f, e.pos);
+    write_uint64(f, e.live_range.first);
+    write_uint64(f, e.live_range.last);
+    });
+
+  write_environment(f, rd.alpha_conversion_env, [&](const alpha_conversion_data& acd)
+    {
+    write_string(f, acd.name);
+    write_uint64(f, acd.forward_declaration ? 1 : 0);
+    });
+  write_uint64(f, rd.alpha_conversion_index);
+  write_uint64(f, rd.global_index);
+  write_uint64(f, rd.procedure_names.size());
+  for (const auto& name : rd.procedure_names)
+    write_string(f, name);
+  write_uint64(f, rd.quote_to_index.size());
+  for (const auto& q : rd.quote_to_index)
+    {
+    write_string(f, q.first);
+    write_uint64(f, q.second);
+    }
+
+  write_uint64(f, md.m.size());
+  for (const auto& m : md.m)
+    {
+    write_string(f, m.first);
+    write_string(f, m.second.name);
+    write_uint64(f, m.second.variable_arity ? 1 : 0);
+    write_uint64(f, m.second.variables.size());
+    for (const auto& v : m.second.variables)
+      write_string(f, v);
+    }
+
+  write_uint64(f, check.old_heap_begin);
+  write_words(f, globals.data(), globals.size());
+  write_words(f, heap.data(), heap.size());
+
+  f.close();
+  if (!f)
+    {
+    std::remove(temp_filename.c_str());
+    return false;
+    }
+  std::remove(filename.c_str());
+  return std::rename(temp_filename.c_str(), filename.c_str()) == 0;
+#endif
+  }
+
+bool load_startup_cache(std::vector<startup_code_unit>& units, primitive_map& pm, environment_map& env, repl_data& rd, macro_data& md, context& ctxt, const std::string& filename, uint64_t key)
+  {
+#ifdef _WIN32
+  (void*)&units; (void*)&pm; (void*)&env; (void*)&rd; (void*)&md; (void*)&ctxt; (void*)&filename; (void*)&key;
+  return false;
+#else
+  if (ctxt.nursery)
+    return false;
+  std::ifstream f(filename, std::ios::binary);
+  if (!f.is_open())
+    return false;
+  if (read_uint64(f) != startup_cache_magic)
+    return false;
+  if (read_uint64(f) != key)
+    return false;
+  uint64_t nr_of_loaded_files = read_uint64(f);
+  for (uint64_t i = 0; i < nr_of_loaded_files && f; ++i)
+    {
+    std::string file = read_string(f);
+    if (read_uint64(f) != hash_file(file))
+      return false;
+    }
+
+  std::vector<loaded_module> modules = get_loaded_modules();
+  std::vector<uint64_t> module_base;
+  uint64_t nr_of_modules = read_uint64(f);
+  for (uint64_t i = 0; i < nr_of_modules && f; ++i)
+    {
+    std::string name = read_string(f);
+    uint64_t file_size = read_uint64(f);
+    uint64_t file_time = read_uint64(f);
+    auto it = std::find_if(modules.begin(), modules.end(), [&](const loaded_module& m) { return m.name == name; });
+    if (it == modules.end() || it->file_size != file_size || it->file_time != file_time)
+      return false; // the code refers to a module that is not loaded, or that was rebuilt
+    module_base.push_back(it->base);
+    }
+
+  struct unit_data
+    {
+    uint64_t old_address;
+    std::vector<relocation> relocations;
+    std::vector<ASM::jit_symbol> symbols;
+    };
+
+  std::vector<startup_code_unit> new_units;
+  std::vector<unit_data> new_units_data;
+  auto free_new_units = [&]()
+    {
+    for (auto& u : new_units)
+      ASM::free_assembled_function(u.address, u.size);
+    return false;
+    };
+
+  uint64_t nr_of_units = read_uint64(f);
+  for (uint64_t u = 0; u < nr_of_units && f; ++u)
+    {
+    startup_code_unit unit;
+    unit_data ud;
+    ud.old_address = read_uint64(f);
+    unit.size = read_uint64(f);
+    unit.is_macro = read_uint64(f) != 0;
+    unit.imm64_offsets = read_words(f);
+    uint64_t nr_of_relocations = read_uint64(f);
+    for (uint64_t r = 0; r < nr_of_relocations && f; ++r)
+      {
+      relocation rel;
+      rel.offset = read_uint64(f);
+      rel.target = read_uint64(f);
+      rel.index = read_uint64(f);
+      rel.target_offset = read_uint64(f);
+      if (rel.offset + 8 > unit.size || (rel.target == rt_module && rel.index >= module_base.size()) || (rel.target == rt_unit && rel.index >= nr_of_units))
+        return free_new_units();
+      ud.relocations.push_back(rel);
+      }
+    uint64_t nr_of_symbols = read_uint64(f);
+    for (uint64_t i = 0; i < nr_of_symbols && f; ++i)
+      {
+      ASM::jit_symbol sym;
+      sym.name = read_string(f);
+      sym.offset = read_uint64(f);
+      sym.size = read_uint64(f);
+      if (sym.offset + sym.size > unit.size)
+        return free_new_units();
+      ud.symbols.push_back(sym);
+      }
+    if (!f || unit.size > ((uint64_t)1 << 32))
+      return free_new_units();
+    unit.address = ASM::allocate_executable_memory(unit.size);
+    new_units.push_back(unit);
+    f.read((char*)ASM::code_heap_writable_address(unit.address), unit.size);
+    new_units_data.push_back(ud);
+    }
+  if (!f)
+    return free_new_units();
+
+  for (size_t u = 0; u < new_units.size(); ++u)
+    {
+    uint8_t* code = (uint8_t*)ASM::code_heap_writable_address(new_units[u].address);
+    for (const auto& r : new_units_data[u].relocations)
+      {
+      uint64_t value = r.target_offset + (r.target == rt_module ? module_base[r.index] : (uint64_t)new_units[r.index].address);
+      memcpy(code + r.offset, &value, sizeof(uint64_t));
+      }
+    }
+
+  address_map amap;
+  for (size_t u = 0; u < new_units.size(); ++u)
+    {
+    amap.old_unit_base.push_back(new_units_data[u].old_address);
+    amap.unit_size.push_back(new_units[u].size);
+    amap.new_unit_base.push_back((uint64_t)new_units[u].address);
+    }
+
+  primitive_map new_pm;
+  uint64_t pm_size = read_uint64(f);
+  for (uint64_t i = 0; i < pm_size && f; ++i)
+    {
+    std::string name = read_string(f);
+    primitive_entry pe;
+    pe.label_name = read_string(f);
+    uint64_t unit_index = read_uint64(f);
+    uint64_t offset = read_uint64(f);
+    if (unit_index == (uint64_t)-1)
+      pe.address = offset;
+    else if (unit_index < new_units.size())
+      pe.address = (uint64_t)new_units[unit_index].address + offset;
+    else
+      return free_new_units();
+    new_pm[name] = pe;
+    }
+
+  environment_map new_env = read_environment<environment_entry>(f, [&]()
+    {
+    environment_entry e;
+    e.st = (environment_entry::storage_type)read_uint64(f);
+    e.pos = read_uint64(f);
+    e.live_range.first = read_uint64(f);
+    e.live_range.last = read_uint64(f);
+    return e;
+    });
+
+  repl_data new_rd;
+  new_rd.alpha_conversion_env = read_environment<alpha_conversion_data>(f, [&]()
+    {
+    alpha_conversion_data acd(read_string(f));
+    acd.forward_declaration = read_uint64(f) != 0;
+    return acd;
+    });
+  new_rd.alpha_conversion_index = read_uint64(f);
+  new_rd.global_index = read_uint64(f);
+  uint64_t nr_of_procedures = read_uint64(f);
+  for (uint64_t i = 0; i < nr_of_procedures && f; ++i)
+    new_rd.procedure_names.push_back(read_string(f));
+  uint64_t nr_of_quotes = read_uint64(f);
+  for (uint64_t i = 0; i < nr_of_quotes && f; ++i)
+    {
+    std::string q = read_string(f);
+    new_rd.quote_to_index[q] = read_uint64(f);
+    }
+
+  macro_map new_macros;
+  uint64_t nr_of_macros = read_uint64(f);
+  for (uint64_t i = 0; i < nr_of_macros && f; ++i)
+    {
+    std::string name = read_string(f);
+    macro_entry me;
+    me.name = read_string(f);
+    me.variable_arity = read_uint64(f) != 0;
+    uint64_t nr_of_variables = read_uint64(f);
+    for (uint64_t j = 0; j < nr_of_variables && f; ++j)
+      me.variables.push_back(read_string(f));
+    new_macros[name] = me;
+    }
+
+  amap.old_heap_begin = read_uint64(f);
+  std::vector<uint64_t> globals = read_words(f);
+  std::vector<uint64_t> heap = read_words(f);
+  if (!f)
+    return free_new_units();
+  if (globals.size() != new_rd.global_index || globals.size() > (uint64_t)(ctxt.globals_end - ctxt.globals) || ctxt.from_space + heap.size() >= ctxt.limit)
+    return free_new_units();
+  amap.old_heap_end = amap.old_heap_begin + heap.size() * sizeof(uint64_t);
+  amap.new_heap_begin = (uint64_t)ctxt.from_space;
+
+  auto map_value = [&](uint64_t& v) { return amap.map_tagged_value(v); };
+  auto map_code = [&](uint64_t& a) { return amap.map_code_address(a); };
+  if (!walk_heap(heap.data(), heap.data() + heap.size(), map_value, map_code))
+    return free_new_units();
+  for (auto& g : globals)
+    {
+    if (!map_value(g))
+      return free_new_units();
+    }
+
+  /*
+  Everything is read and relocated. Now we can fill in the output.
+  */
+  std::copy(globals.begin(), globals.end(), ctxt.globals);
+  std::copy(heap.begin(), heap.end(), ctxt.from_space);
+  ctxt.alloc = ctxt.from_space + heap.size();
+
+  pm.swap(new_pm);
+  env = new_env;
+  rd = new_rd;
+  reserve_procedure_counters(ctxt, rd.procedure_names.size());
+  md.m.swap(new_macros);
+  for (size_t u = 0; u < new_units.size(); ++u)
+    ASM::register_jit_symbols(new_units[u].address, new_units[u].size, new_units_data[u].symbols);
+  units.clear();
+  for (auto& u : new_units)
+    {
+    if (u.is_macro)
+      {
+      md.compiled_macros.emplace_back(u.address, u.size);
+      md.compiled_macros_imm64_offsets.push_back(u.imm64_offsets);
+      }
+    else
+      units.push_back(u);
+    }
+  return true;
+#endif
+  }
+
+SKIWI_END
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "namespace.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "compiler.h"
+#include "compiler_options.h"
+#include "context.h"
+#include "macro_data.h"
+#include "repl_data.h"
+#include "libskiwi_api.h"
+
+SKIWI_BEGIN
+
+/*
+A piece of assembled code that was generated while skiwi was starting up.
+imm64_offsets are the offsets of all 64-bit immediates in the code (see ASM::first_pass_data::imm64_offsets).
+*/
+struct startup_code_unit
+  {
+  void* address;
+  uint64_t size;
+  std::vector<uint64_t> imm64_offsets;
+  bool is_macro; // if true, this code belongs in macro_data::compiled_macros
+  };
+
+/*
+Computes the key of the startup cache. The key depends on the content of the scheme libraries in scm/core,
+on the compiler options, and on the context layout. The files that these libraries load (e.g. packages.scm) are only
+known after compiling them, so the cache stores their content hashes, and load_startup_cache checks them.
+*/
+SKIWI_SCHEME_API uint64_t make_startup_cache_key(const compiler_options& ops, const context& ctxt);
+
+/*
+Writes all the state of skiwi after startup to filename: the assembled code, the primitive map, the environment, the repl data,
+the macro data, the globals and the heap. loaded_files are the files that were loaded during startup. All absolute addresses are stored as relocations, so that the image can be loaded at
+a different address in a different process.
+Returns false if the state could not be stored.
+*/
+SKIWI_SCHEME_API bool save_startup_cache(const std::string& filename, uint64_t key, const std::vector<startup_code_unit>& units, const std::vector<std::string>& loaded_files, const primitive_map& pm, const environment_map& env, const repl_data& rd, const macro_data& md, const context& ctxt);
+
+/*
+Restores the state written by save_startup_cache. units receives the newly allocated code, which is owned by the caller,
+except for the macros which are added to md.compiled_macros.
+Returns false if the cache does not exist, if its key differs from key, if one of the files that were loaded during startup
+changed, or if it cannot be relocated in this process.
+In that case none of the output arguments is changed.
+*/
+SKIWI_SCHEME_API bool load_startup_cache(std::vector<startup_code_unit>& units, primitive_map& pm, environment_map& env, repl_data& rd, macro_data& md, context& ctxt, const std::string& filename, uint64_t key);
+
+SKIWI_END
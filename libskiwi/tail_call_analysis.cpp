@@ -1,5 +1,6 @@
 #include "tail_call_analysis.h"
 #include "visitor.h"
+#include "concurrency.h"
 #include <variant>
 #include <algorithm>
 
@@ -404,6 +405,37 @@ void tail_call_analysis(Program& prog)
   prog.tail_call_analysis = true;
   }
 
+/*
+Every top-level form is in tail position, so the forms can be analysed independently.
+*/
+void tail_call_analysis(Program& prog, const compiler_options& ops)
+  {
+  if (prog.expressions.size() != 1 || !std::holds_alternative<Begin>(prog.expressions.front()))
+    {
+    tail_call_analysis(prog);
+    return;
+    }
+  Begin& beg = std::get<Begin>(prog.expressions.front());
+  if (prog.tail_call_analysis)
+    beg.tail_position = false;
+  parallel_for(size_t(0), beg.arguments.size(), [&](size_t i)
+    {
+    Expression& expr = beg.arguments[i];
+    if (prog.tail_call_analysis)
+      {
+      tail_calls_set_helper tcsh(false);
+      tcsh.expressions.push_back(&expr);
+      tcsh.treat_expressions();
+      }
+    tail_call_analysis_helper tcah;
+    tcah.set_tail_position(expr);
+    tcah.expressions.push_back(&expr);
+    tcah.treat_expressions();
+    }, ops);
+
+  prog.tail_call_analysis = true;
+  }
+
 void tail_call_analysis(Expression& e)
   {
   tail_calls_set_helper tcsh(false);
@@ -7,7 +7,10 @@
 
 SKIWI_BEGIN
 
+struct compiler_options;
+
 SKIWI_SCHEME_API void tail_call_analysis(Expression& e);
 SKIWI_SCHEME_API void tail_call_analysis(Program& prog);
+SKIWI_SCHEME_API void tail_call_analysis(Program& prog, const compiler_options& ops);
 
 SKIWI_END
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <stdlib.h>
 #include <libskiwi/libskiwi.h>
 
 int main(int argc, char** argv)
@@ -6,10 +7,24 @@ int main(int argc, char** argv)
   skiwi::skiwi_parameters pars;
   pars.heap_size = 64 * 1024 * 1024;
   pars.local_stack = 1024;
+  pars.use_startup_cache = true;
+  pars.perf_map = getenv("SKIWI_PERF_MAP") != nullptr;
+  pars.gdb_jit = getenv("SKIWI_GDB_JIT") != nullptr;
+  const char* profiling = getenv("SKIWI_PROFILING"); // SKIWI_PROFILING=0 does not keep the names of the code for ,profile
+  if (profiling)
+    pars.profiling = atoll(profiling) != 0;
+  pars.procedure_counters = getenv("SKIWI_PROCEDURE_COUNTERS") != nullptr;
+  const char* heap_profile = getenv("SKIWI_HEAP_PROFILE"); // optionally the sample interval in bytes
+  pars.heap_profiling = heap_profile != nullptr;
+  if (heap_profile && atoll(heap_profile) > 0)
+    pars.heap_profile_interval = (uint64_t)atoll(heap_profile);
   skiwi::scheme_with_skiwi(nullptr, nullptr, pars);
 
   skiwi::skiwi_repl(argc, argv);
 
+  if (pars.heap_profiling)
+    skiwi::skiwi_show_heap_profile();
+
   skiwi::skiwi_quit();
 
   return 0;
@@ -0,0 +1,516 @@
+#include <libskiwi/libskiwi.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#define chdir _chdir
+#define dup _dup
+#define dup2 _dup2
+#define close _close
+#define open _open
+#define O_WRONLY _O_WRONLY
+#define null_device "NUL"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define null_device "/dev/null"
+#endif
+
+/*
+Runs the benchmarks in the bench folder, each in a fresh skiwi context, and writes the results as json or csv.
+With --compare, the results are compared with a baseline that skiwi_bench wrote before, and the benchmarks that became
+slower than the threshold are flagged as regressions.
+
+For each benchmark the time to compile its source, the time to run its top level (which loads run-benchmark.scm), and
+the time to run (main) are measured separately.
+*/
+
+namespace
+  {
+  struct options
+    {
+    std::string bench_folder;
+    std::string output_file;
+    std::string baseline_file;
+    bool csv;
+    bool fast; // run each benchmark once instead of its number of iterations
+    bool generational_gc;
+    double threshold; // percentage by which a benchmark should become slower to count as a regression
+    double min_difference; // seconds by which a benchmark should become slower to count as a regression
+    std::vector<std::string> benchmarks;
+    };
+
+  struct bench_result
+    {
+    std::string name;
+    bool ok;
+    double compile_seconds;
+    double load_seconds;
+    double run_seconds;
+    uint64_t gc_collections;
+    uint64_t gc_full_collections;
+    double gc_pause_seconds;
+    uint64_t peak_live_bytes;
+    uint64_t peak_allocated_bytes;
+    };
+
+  const char* columns[] = { "name", "status", "compile_seconds", "load_seconds", "run_seconds", "gc_collections", "gc_full_collections", "gc_pause_seconds", "peak_live_bytes", "peak_allocated_bytes" };
+
+  void print_usage()
+    {
+    std::cout << "Usage: skiwi_bench [options] [benchmark ...]\n\n";
+    std::cout << "Runs the given benchmarks, or all benchmarks of benchall.scm, each in a fresh skiwi context.\n\n";
+    std::cout << "  --json               write the results as json (default)\n";
+    std::cout << "  --csv                write the results as csv\n";
+    std::cout << "  --output <file>      write the results to file instead of to the standard output\n";
+    std::cout << "  --compare <file>     compare the results with a baseline written by skiwi_bench before\n";
+    std::cout << "  --threshold <pct>    slowdown in percent that counts as a regression (default 10)\n";
+    std::cout << "  --fast               run each benchmark once instead of its number of iterations\n";
+    std::cout << "  --generational       use the generational garbage collector\n";
+    std::cout << "  --dir <folder>       the folder with the benchmarks (default " << SKIWI_BENCH_FOLDER << ")\n";
+    }
+
+  options read_options(int argc, char** argv)
+    {
+    options ops;
+    ops.bench_folder = SKIWI_BENCH_FOLDER;
+    ops.csv = false;
+    ops.fast = false;
+    ops.generational_gc = false;
+    ops.threshold = 10.0;
+    ops.min_difference = 0.01;
+    for (int i = 1; i < argc; ++i)
+      {
+      std::string arg(argv[i]);
+      auto next = [&]() -> std::string
+        {
+        if (i + 1 >= argc)
+          throw std::runtime_error(arg + " expects an argument");
+        return std::string(argv[++i]);
+        };
+      if (arg == "--json")
+        ops.csv = false;
+      else if (arg == "--csv")
+        ops.csv = true;
+      else if (arg == "--output")
+        ops.output_file = next();
+      else if (arg == "--compare")
+        ops.baseline_file = next();
+      else if (arg == "--threshold")
+        ops.threshold = atof(next().c_str());
+      else if (arg == "--fast")
+        ops.fast = true;
+      else if (arg == "--generational")
+        ops.generational_gc = true;
+      else if (arg == "--dir")
+        ops.bench_folder = next();
+      else if (!arg.empty() && arg[0] == '-')
+        throw std::runtime_error("Unknown option " + arg);
+      else
+        ops.benchmarks.push_back(arg);
+      }
+    if (!ops.bench_folder.empty() && ops.bench_folder.back() != '/' && ops.bench_folder.back() != '\\')
+      ops.bench_folder.push_back('/');
+    return ops;
+    }
+
+  std::string read_file(const std::string& filename)
+    {
+    std::ifstream f(filename);
+    if (!f.is_open())
+      throw std::runtime_error("Cannot open " + filename);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    return ss.str();
+    }
+
+  /*
+  The benchmarks that benchall.scm runs: the symbols in the quoted list of (define all-benchmarks '(...)).
+  */
+  std::vector<std::string> read_all_benchmarks(const std::string& bench_folder)
+    {
+    std::string text = read_file(bench_folder + "benchall.scm");
+    auto pos = text.find("all-benchmarks");
+    if (pos != std::string::npos)
+      pos = text.find('(', pos);
+    auto end = pos == std::string::npos ? pos : text.find(')', pos);
+    if (end == std::string::npos)
+      throw std::runtime_error("Cannot find the list of benchmarks in benchall.scm");
+    std::stringstream list(text.substr(pos + 1, end - pos - 1));
+    std::vector<std::string> names;
+    std::string name;
+    while (list >> name)
+      names.push_back(name);
+    return names;
+    }
+
+  /*
+  The benchmarks display their own progress and timings on the standard output, which is also where the results go.
+  While a benchmark runs, the standard output is sent to the null device.
+  */
+  class standard_output_silencer
+    {
+    public:
+      standard_output_silencer() : saved(-1)
+        {
+        fflush(stdout);
+        std::cout.flush();
+        int null_fd = open(null_device, O_WRONLY);
+        if (null_fd < 0)
+          return;
+        saved = dup(1);
+        dup2(null_fd, 1);
+        close(null_fd);
+        }
+
+      ~standard_output_silencer()
+        {
+        if (saved < 0)
+          return;
+        fflush(stdout);
+        std::cout.flush();
+        dup2(saved, 1);
+        close(saved);
+        }
+
+    private:
+      int saved;
+    };
+
+  double seconds_since(std::chrono::steady_clock::time_point start)
+    {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+  bench_result run_benchmark(const std::string& name, const options& ops)
+    {
+    using namespace skiwi;
+    bench_result r = {};
+    r.name = name;
+    r.ok = false;
+    std::string source;
+    try
+      {
+      source = read_file(name + ".scm");
+      }
+    catch (std::runtime_error& e)
+      {
+      std::cerr << e.what() << "\n";
+      return r;
+      }
+    std::stringstream benchmark_output; // the benchmarks print their own timings, which are not needed here
+    skiwi_parameters params; // the settings of s, with which the timings in bench/README.md were made
+    params.heap_size = 64 * 1024 * 1024;
+    params.local_stack = 1024;
+    params.use_startup_cache = true;
+    params.generational_gc = ops.generational_gc;
+    params.trace = nullptr;
+    params.stdoutput = &benchmark_output;
+    params.stderror = &std::cerr;
+    standard_output_silencer silencer;
+    scheme_with_skiwi(nullptr, nullptr, params);
+    try
+      {
+      skiwi_reset_gc_stats(); // leave out the collections while the startup libraries were compiled
+      auto start = std::chrono::steady_clock::now();
+      skiwi_compiled_function_ptr f = skiwi_compile(source);
+      r.compile_seconds = seconds_since(start);
+      start = std::chrono::steady_clock::now();
+      scm_type loaded = skiwi_run_raw(f, skiwi_get_context());
+      r.load_seconds = seconds_since(start);
+      if (ops.fast)
+        skiwi_run_raw("(set! fast-run #t)");
+      start = std::chrono::steady_clock::now();
+      scm_type result = skiwi_run_raw("(main)");
+      r.run_seconds = seconds_since(start);
+      r.ok = f && !loaded.is_error() && !result.is_error();
+      if (!r.ok)
+        std::cerr << name << " failed\n";
+      skiwi_gc_stats stats = skiwi_get_gc_stats();
+      r.gc_collections = stats.collections;
+      r.gc_full_collections = stats.full_collections;
+      r.gc_pause_seconds = (double)stats.total_pause_nanoseconds / 1e9;
+      r.peak_live_bytes = stats.peak_live_bytes;
+      r.peak_allocated_bytes = stats.peak_allocated_bytes;
+      }
+    catch (std::exception& e)
+      {
+      std::cerr << name << ": " << e.what() << "\n";
+      r.ok = false;
+      }
+    skiwi_quit();
+    return r;
+    }
+
+  std::vector<std::string> values_of(const bench_result& r)
+    {
+    std::vector<std::string> values;
+    auto seconds = [](double s)
+      {
+      std::stringstream str;
+      str << std::fixed << std::setprecision(6) << s;
+      return str.str();
+      };
+    values.push_back(r.name);
+    values.push_back(r.ok ? "ok" : "failed");
+    values.push_back(seconds(r.compile_seconds));
+    values.push_back(seconds(r.load_seconds));
+    values.push_back(seconds(r.run_seconds));
+    values.push_back(std::to_string(r.gc_collections));
+    values.push_back(std::to_string(r.gc_full_collections));
+    values.push_back(seconds(r.gc_pause_seconds));
+    values.push_back(std::to_string(r.peak_live_bytes));
+    values.push_back(std::to_string(r.peak_allocated_bytes));
+    return values;
+    }
+
+  /*
+  One benchmark per line, so that the baseline can be read back line by line (see read_results).
+  */
+  void write_json(std::ostream& out, const std::vector<bench_result>& results)
+    {
+    out << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+      {
+      std::vector<std::string> values = values_of(results[i]);
+      out << "    {";
+      for (size_t c = 0; c < values.size(); ++c)
+        {
+        if (c)
+          out << ", ";
+        out << "\"" << columns[c] << "\": ";
+        if (c < 2)
+          out << "\"" << values[c] << "\"";
+        else
+          out << values[c];
+        }
+      out << (i + 1 < results.size() ? "},\n" : "}\n");
+      }
+    out << "  ]\n}\n";
+    }
+
+  void write_csv(std::ostream& out, const std::vector<bench_result>& results)
+    {
+    for (size_t c = 0; c < sizeof(columns) / sizeof(columns[0]); ++c)
+      out << (c ? "," : "") << columns[c];
+    out << "\n";
+    for (const auto& r : results)
+      {
+      std::vector<std::string> values = values_of(r);
+      for (size_t c = 0; c < values.size(); ++c)
+        out << (c ? "," : "") << values[c];
+      out << "\n";
+      }
+    }
+
+  bench_result make_result(const std::map<std::string, std::string>& fields)
+    {
+    auto get = [&](const char* column)
+      {
+      auto it = fields.find(column);
+      return it == fields.end() ? std::string() : it->second;
+      };
+    bench_result r = {};
+    r.name = get("name");
+    r.ok = get("status") == "ok";
+    r.compile_seconds = atof(get("compile_seconds").c_str());
+    r.load_seconds = atof(get("load_seconds").c_str());
+    r.run_seconds = atof(get("run_seconds").c_str());
+    r.gc_collections = strtoull(get("gc_collections").c_str(), nullptr, 10);
+    r.gc_full_collections = strtoull(get("gc_full_collections").c_str(), nullptr, 10);
+    r.gc_pause_seconds = atof(get("gc_pause_seconds").c_str());
+    r.peak_live_bytes = strtoull(get("peak_live_bytes").c_str(), nullptr, 10);
+    r.peak_allocated_bytes = strtoull(get("peak_allocated_bytes").c_str(), nullptr, 10);
+    return r;
+    }
+
+  std::string trim(const std::string& s)
+    {
+    auto first = s.find_first_not_of(" \t\r\n\"");
+    if (first == std::string::npos)
+      return std::string();
+    auto last = s.find_last_not_of(" \t\r\n\"");
+    return s.substr(first, last - first + 1);
+    }
+
+  /*
+  Reads json or csv as written by write_json or write_csv.
+  */
+  std::map<std::string, bench_result> read_results(const std::string& filename)
+    {
+    std::stringstream text(read_file(filename));
+    std::map<std::string, bench_result> results;
+    std::string line;
+    std::vector<std::string> header;
+    bool json = trim(text.str()).substr(0, 1) == "{";
+    while (std::getline(text, line))
+      {
+      std::map<std::string, std::string> fields;
+      if (json)
+        {
+        auto open = line.find('{');
+        auto close = line.rfind('}');
+        if (open == std::string::npos || close == std::string::npos || close < open || line.find("\"name\"") == std::string::npos)
+          continue;
+        std::stringstream items(line.substr(open + 1, close - open - 1));
+        std::string item;
+        while (std::getline(items, item, ','))
+          {
+          auto colon = item.find(':');
+          if (colon != std::string::npos)
+            fields[trim(item.substr(0, colon))] = trim(item.substr(colon + 1));
+          }
+        }
+      else
+        {
+        std::stringstream items(line);
+        std::vector<std::string> values;
+        std::string item;
+        while (std::getline(items, item, ','))
+          values.push_back(trim(item));
+        if (header.empty())
+          {
+          header = values;
+          continue;
+          }
+        for (size_t c = 0; c < values.size() && c < header.size(); ++c)
+          fields[header[c]] = values[c];
+        }
+      bench_result r = make_result(fields);
+      if (!r.name.empty())
+        results[r.name] = r;
+      }
+    return results;
+    }
+
+  /*
+  Prints a comparison with the baseline and returns the number of regressions: benchmarks that failed, or of which the
+  compile time or the run time grew by more than the threshold.
+  */
+  uint64_t compare(std::ostream& out, const std::vector<bench_result>& results, const std::map<std::string, bench_result>& baseline, const options& ops)
+    {
+    uint64_t regressions = 0;
+    auto change = [](double before, double after)
+      {
+      std::stringstream str;
+      str << std::showpos << std::fixed << std::setprecision(1) << (before > 0 ? 100.0 * (after - before) / before : 0.0) << "%";
+      return str.str();
+      };
+    auto slower = [&](double before, double after)
+      {
+      return after - before > ops.min_difference && after > before * (1.0 + ops.threshold / 100.0);
+      };
+    out << std::left << std::setw(14) << "benchmark" << std::right << std::setw(14) << "compile" << std::setw(10) << "change"
+      << std::setw(14) << "run" << std::setw(10) << "change" << "\n";
+    for (const auto& r : results)
+      {
+      auto it = baseline.find(r.name);
+      out << std::left << std::setw(14) << r.name << std::right << std::fixed << std::setprecision(3);
+      if (it == baseline.end())
+        {
+        out << std::setw(14) << r.compile_seconds << std::setw(10) << "" << std::setw(14) << r.run_seconds << std::setw(10) << "" << "  not in baseline\n";
+        continue;
+        }
+      const bench_result& b = it->second;
+      out << std::setw(14) << r.compile_seconds << std::setw(10) << change(b.compile_seconds, r.compile_seconds);
+      out << std::setw(14) << r.run_seconds << std::setw(10) << change(b.run_seconds, r.run_seconds);
+      if (!r.ok)
+        {
+        out << (b.ok ? "  REGRESSION: failed" : "  failed");
+        if (b.ok)
+          ++regressions;
+        }
+      else if (slower(b.compile_seconds, r.compile_seconds) || slower(b.run_seconds, r.run_seconds))
+        {
+        out << "  REGRESSION";
+        ++regressions;
+        }
+      out << "\n";
+      }
+    out << std::defaultfloat << regressions << (regressions == 1 ? " regression" : " regressions") << " against " << ops.baseline_file << " (threshold " << ops.threshold << "%)\n";
+    return regressions;
+    }
+  }
+
+int main(int argc, char** argv)
+  {
+  options ops;
+  try
+    {
+    ops = read_options(argc, argv);
+    }
+  catch (std::runtime_error& e)
+    {
+    std::cerr << e.what() << "\n\n";
+    print_usage();
+    return 2;
+    }
+
+  std::map<std::string, bench_result> baseline;
+  std::ofstream file;
+  try
+    {
+    if (ops.benchmarks.empty())
+      ops.benchmarks = read_all_benchmarks(ops.bench_folder);
+    if (!ops.baseline_file.empty())
+      baseline = read_results(ops.baseline_file);
+    if (!ops.output_file.empty())
+      {
+      file.open(ops.output_file);
+      if (!file.is_open())
+        throw std::runtime_error("Cannot write " + ops.output_file);
+      }
+    }
+  catch (std::runtime_error& e)
+    {
+    std::cerr << e.what() << "\n";
+    return 2;
+    }
+
+  // the benchmarks load run-benchmark.scm and their data files from the current folder
+  if (chdir(ops.bench_folder.c_str()) != 0)
+    {
+    std::cerr << "Cannot open the benchmark folder " << ops.bench_folder << "\n";
+    return 2;
+    }
+
+  std::vector<bench_result> results;
+  bool all_ok = true;
+  for (const auto& name : ops.benchmarks)
+    {
+    std::cerr << "running " << name << "\n";
+    results.push_back(run_benchmark(name, ops));
+    all_ok = all_ok && results.back().ok;
+    }
+
+  // with --compare the comparison goes to the standard output, and the results only to the output file
+  if (!ops.output_file.empty() || ops.baseline_file.empty())
+    {
+    std::ostream& out = ops.output_file.empty() ? std::cout : file;
+    if (ops.csv)
+      write_csv(out, results);
+    else
+      write_json(out, results);
+    }
+
+  uint64_t regressions = 0;
+  if (!ops.baseline_file.empty())
+    regressions = compare(std::cout, results, baseline, ops);
+
+  return (all_ok && regressions == 0) ? 0 : 1;
+  }